@@ -166,13 +166,13 @@ process_objects_mk() {
   file="${BUILD_DIR}/$1"
   echo "... Procesing file \"${file}\" ..."
 
-  #  LIBS := -lrt -lcurl -lmicrohttpd -lmosquitto -lmosquittopp
+  #  LIBS := -lrt -lcurl -lmicrohttpd -lz -lmosquitto -lmosquittopp
   libs='LIBS := -lrt -lcurl'
   if [ $use_gpio_ts -ne 1 ]; then
     libs=${libs}' -lpigpio'
   fi
   if [ $include_HTTPD -eq 1 ]; then
-    libs=${libs}' -lmicrohttpd'
+    libs=${libs}' -lmicrohttpd -lz'
   fi
   if [ $include_MQTT -eq 1 ]; then
     libs=${libs}' -lmosquitto -lmosquittopp'
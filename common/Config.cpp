@@ -19,8 +19,10 @@
 #include "Config.hpp"
 #include "ConfigParser.hpp"
 #include "SensorsData.hpp"
+#include "W1Devices.hpp"
 #include "../utils/Logger.hpp"
 #include "../utils/Utils.hpp"
+#include "../utils/Realtime.hpp"
 
 
 #define is_cmd(cmd,opt,opt_len) (opt_len == (sizeof(cmd)-1) && strncmp(cmd, opt, opt_len) == 0)
@@ -54,6 +56,7 @@ static const struct option long_options[] = {
 #endif
     { "max-gap", required_argument, NULL, 'G' },
     { "auth-header", required_argument, NULL, 'a'},
+    { "check-config", no_argument, NULL, 'k'},
     { NULL, 0, NULL, 0 }
 };
 
@@ -111,12 +114,34 @@ command_def(sensor, 4) = {
   { "name", arg_required }, // it is required but is checked explicitly
 #define CMD_SENSOR_ID 4
   { "id", 0 }, // it may be required - depending on protocol
+#define CMD_SENSOR_INTERVAL 5
+  { "interval", 0 }, // only for polled sensors
+};
+
+command_def(sensors, 0) = {
+#define CMD_SENSORS_MAX_COUNT 0
+  { "max_count", 0 },
+#define CMD_SENSORS_UNDEFINED_TTL 1
+  { "undefined_ttl", 0 },
+};
+
+command_def(realtime, 0) = {
+#define CMD_REALTIME_PRIORITY 0
+  { "priority", 0 },
+#define CMD_REALTIME_CPUS 1
+  { "cpus", 0 },
+#define CMD_REALTIME_LOCK_MEMORY 2
+  { "lock_memory", 0 },
 };
 
 #ifdef INCLUDE_POLLSTER
 command_def(w1, 1) = {
 #define CMD_W1_ENABLE_DS18B20 0
   { "enable_DS18B20", 0 },
+#define CMD_W1_INTERVAL 1
+  { "interval", 0 },
+#define CMD_W1_READERS 2
+  { "readers", 0 },
 };
 #endif
 
@@ -126,6 +151,20 @@ command_def(httpd, 1) = {
   { "port", arg_required },
 #define CMD_HTTPD_WWW_ROOT 1
   { "www_root", 0 },
+#define CMD_HTTPD_THREADS 2
+  { "threads", 0 },
+#define CMD_HTTPD_MAX_CONNECTIONS 3
+  { "max_connections", 0 },
+#define CMD_HTTPD_MAX_CONNECTIONS_PER_IP 4
+  { "max_connections_per_ip", 0 },
+#define CMD_HTTPD_TIMEOUT 5
+  { "timeout", 0 },
+#define CMD_HTTPD_MAX_AGE 6
+  { "max_age", 0 },
+#define CMD_HTTPD_COMPRESSION_LEVEL 7
+  { "compression_level", 0 },
+#define CMD_HTTPD_COMPRESSION_THRESHOLD 8
+  { "compression_threshold", 0 },
 };
 #endif
 
@@ -281,6 +320,8 @@ const char* const VALID_OPTIONS =
 #ifdef INCLUDE_HTTPD
     "--httpd, -H\n"
     "    Run HTTPD server on the specified port.\n"
+    "    Readings of sensors and internal counters are exported for Prometheus at /metrics.\n"
+    "    Use it with --no-server to run as Prometheus exporter without sending data to servers.\n"
 #endif
     "--max_gap, -G\n"
     "    Max gap between reported reading. Next reading will be sent to server or printed even it is the same as previous readings.\n"
@@ -289,7 +330,11 @@ const char* const VALID_OPTIONS =
     "--quiet, -q\n"
     "    Do not print data on console.\n"
     "--more_verbose, -V\n"
-    "    More verbose output.\n";
+    "    More verbose output.\n"
+    "--check-config\n"
+    "    Check the command line and configuration files then exit with code 0 if they are valid.\n"
+    "    Send signal SIGHUP to the running utility to reload configuration files. Changes of GPIO pin, 1-Wire, real-time\n"
+    "    settings, log and dump files are applied only after restart.\n";
 
 //-------------------------------------------------------------
 Config::Config() {
@@ -308,8 +353,10 @@ void Config::init_command_defs() {
   add_command_def(log);
   add_command_alias_def(log,"log-file");
   add_command_def(sensor);
+  add_command_def(sensors);
   add_command_def(action_rule);
   add_command_def(dump);
+  add_command_def(realtime);
 #ifdef INCLUDE_POLLSTER
   add_command_def(w1);
 #endif
@@ -360,11 +407,21 @@ void Config::printHelpAndExit(const char* version) {
 
 //-------------------------------------------------------------
 void Config::help() {
+  if (config_reloading) config_error_exit();
   printHelpAndExit(getVersion());
 }
 
 //-------------------------------------------------------------
-void Config::process_args(int argc, char *argv[]) {
+bool Config::process_args(int argc, char *argv[]) {
+  try {
+    parse_args(argc, argv);
+  } catch (ConfigParsingAborted&) {
+    return false;
+  }
+  return true;
+}
+
+void Config::parse_args(int argc, char *argv[]) {
   while (1) {
     int c = getopt_long(argc, argv, short_options, long_options, NULL);
     if (c == -1) break;
@@ -385,7 +442,7 @@ void Config::process_args(int argc, char *argv[]) {
 
   if (protocols == 0) {
     fputs("ERROR: No protocols are enabled.\n", stderr);
-    exit(1);
+    config_error_exit();
   } else if ((options&(VERBOSITY_DEBUG|VERBOSITY_INFO)) != 0 ) {
     bool first = true;
     fputs("Enabled protocols:", stderr);
@@ -436,7 +493,7 @@ void Config::process_args(int argc, char *argv[]) {
 #ifdef TEST_DECODING
   if (input_log_file_path == NULL) {
     fputs("ERROR: Input log file must be specified (option --input-log or -I).\n", stderr);
-    exit(1);
+    config_error_exit();
   }
 #endif
 
@@ -605,6 +662,10 @@ bool Config::process_cmdline_option( int c, const char* option, const char* opta
     auth_header = clone(optarg);
     break;
 
+  case 'k':
+    check_config = true;
+    break;
+
   case '?':
     help();
     break;
@@ -650,7 +711,7 @@ void Config::enableProtocols(const char* list, ConfigParser* parser) {
         const char* protocol_name = make_str(name_start, len);
         if (parser != NULL) parser->error("Unknown protocol \"%s\"", protocol_name);
         fprintf(stderr, "ERROR: Unknown protocol \"%s\".\n", protocol_name);
-        exit(1);
+        config_error_exit();
       }
       protocols |= (uint32_t)def->protocol_bit;
       protocols_set_explicitly = true;
@@ -667,7 +728,7 @@ void Config::readConfig(const char* configFileRelativePath) {
 }
 
 void Config::readConfig(ConfigParser& configParser, const char* baseFilePath, const char* configFileRelativePath) {
-  if (!configParser.open_file(baseFilePath, configFileRelativePath)) exit(1);
+  if (!configParser.open_file(baseFilePath, configFileRelativePath)) config_error_exit();
 
   char* optarg_buffer = NULL;
   size_t optarg_bufsize = 0;
@@ -803,10 +864,12 @@ void Config::readConfig(ConfigParser& configParser, const char* baseFilePath, co
     for (cmd_def = command_defs; cmd_def != NULL; cmd_def = cmd_def->next) {
       fprintf(stderr, "  %s\n", cmd_def->name );
     }
-    configParser.print_valid_options();
-    fflush(stderr);
-    fclose(stderr);
-    exit(1);
+    if (!config_reloading) {
+      configParser.print_valid_options();
+      fflush(stderr);
+      fclose(stderr);
+    }
+    config_error_exit();
   }
 
   if (optarg_buffer != NULL) free(optarg_buffer);
@@ -939,6 +1002,16 @@ void Config::command_sensor(const char** argv, int number_of_unnamed_args, Confi
   if (name_len == 0) errorLogger->error("The name of the sensor must be specified");
   if (name_len > MAX_SENSOR_NAME_LEN) errorLogger->error("The name of the sensor is too long (max length is %d", MAX_SENSOR_NAME_LEN);
 
+  unsigned poll_interval = 0;
+  const char* interval_str = argv[CMD_SENSOR_INTERVAL];
+  if (interval_str != NULL) {
+    if ((features&FEATURE_RF) != 0) errorLogger->error("Argument \"interval\" is allowed only for polled sensors");
+    const char* p = interval_str;
+    poll_interval = getUnsigned(p, errorLogger);
+    if (p != NULL && skipBlanks(p) != NULL) errorLogger->error("The value of argument \"interval\" must be a number of seconds");
+    if (poll_interval == 0) errorLogger->error("The value of argument \"interval\" must be greater than 0");
+  }
+
   SensorDef* def = NULL;
   switch (SensorDef::add(sensor_id, name, name_len, def)) {
   case SENSOR_DEF_WAS_ADDED:
@@ -961,6 +1034,7 @@ void Config::command_sensor(const char** argv, int number_of_unnamed_args, Confi
   default:
     errorLogger->error("Programming error - unrecognized error code from SensorDef::add()");
   }
+  def->poll_interval = poll_interval;
 #ifndef NDEBUG
   if ((features&(FEATURE_CHANNEL|FEATURE_ROLLING_CODE)) != 0) {
     if ((features&(FEATURE_CHANNEL|FEATURE_ROLLING_CODE)) == FEATURE_ROLLING_CODE)
@@ -1027,10 +1101,77 @@ void Config::command_dump(const char** argv, int number_of_unnamed_args, ConfigP
 #endif
 }
 
+/*-------------------------------------------------------------
+ * Command "sensors":
+ *   sensors [max_count=<n>] [undefined_ttl=<seconds>]
+ *
+ * Limits the table of received sensors. Sensors that are not defined by command "sensor"
+ * are removed if they were not heard during undefined_ttl seconds. If the table has max_count
+ * sensors then the least recently heard undefined sensor is replaced by a new one.
+ * Defined sensors are never removed.
+ */
+void Config::command_sensors(const char** argv, int number_of_unnamed_args, ConfigParser* parser) {
+
+  const char* str = argv[CMD_SENSORS_MAX_COUNT];
+  if (str != NULL && *str != '\0') max_sensors = getUnsigned(str, parser);
+  str = argv[CMD_SENSORS_UNDEFINED_TTL];
+  if (str != NULL && *str != '\0') undefined_sensor_ttl = getUnsigned(str, parser);
+
+#ifndef NDEBUG
+  fprintf(stderr, "command \"sensors\" in line #%d of file \"%s\": max_count=%u undefined_ttl=%u\n",
+      parser->linenum, parser->configFilePath, max_sensors, undefined_sensor_ttl);
+#endif
+}
+
+/*-------------------------------------------------------------
+ * Command "realtime":
+ *   realtime [priority=<1..99>] [cpus=<list>] [lock_memory=<true|false>]
+ *
+ * Runs the threads that capture and decode pulses with SCHED_FIFO priority and binds them to the listed CPUs
+ * (comma-separated numbers, e.g. cpus=3 for a core that is isolated with kernel parameter isolcpus=3).
+ * lock_memory=true locks pages of the process in memory and pre-faults stacks and buffers of these threads.
+ * The utility must be run as root or have capabilities CAP_SYS_NICE and CAP_IPC_LOCK.
+ */
+void Config::command_realtime(const char** argv, int number_of_unnamed_args, ConfigParser* parser) {
+
+  const char* str = argv[CMD_REALTIME_PRIORITY];
+  if (str != NULL && *str != '\0') {
+    realtime_priority = getUnsigned(str, parser);
+    if (str != NULL && skipBlanks(str) != NULL) parser->error("The value of argument \"priority\" must be a number");
+    if (realtime_priority < 1 || realtime_priority > 99) parser->error("The value of argument \"priority\" must be between 1 and 99");
+  }
+
+  str = argv[CMD_REALTIME_CPUS];
+  if (str != NULL && *str != '\0') {
+    const char* p = str;
+    realtime_cpus = 0;
+    while (*p != '\0') {
+      char* end = (char*)p;
+      unsigned long cpu = *p >= '0' && *p <= '9' ? strtoul(p, &end, 10) : 0;
+      if (end == p || (*end != ',' && *end != '\0') || cpu >= REALTIME_MAX_CPUS)
+        parser->error("The value of argument \"cpus\" must be comma-separated list of CPU numbers less than %d", REALTIME_MAX_CPUS);
+      realtime_cpus |= 1ULL<<cpu;
+      p = *end == ',' ? end+1 : end;
+    }
+  }
+
+  str = argv[CMD_REALTIME_LOCK_MEMORY];
+  if (str != NULL) lock_memory = str2bool(str, parser);
+
+#ifndef NDEBUG
+  fprintf(stderr, "command \"realtime\" in line #%d of file \"%s\": priority=%d cpus=0x%llx lock_memory=%d\n",
+      parser->linenum, parser->configFilePath, realtime_priority, (unsigned long long)realtime_cpus, lock_memory);
+#endif
+}
+
 #ifdef INCLUDE_POLLSTER
 /*-------------------------------------------------------------
  * Command "w1":
- *   w1 <gpio>
+ *   w1 [enable_DS18B20=<true|false>] [interval=<seconds>] [readers=<n>]
+ *
+ * interval is the default poll interval of DS18B20 sensors (15 seconds), it can be changed for a sensor
+ * by argument "interval" of command "sensor". If the bus master does not support bulk conversion
+ * then up to "readers" sensors are read in parallel.
  */
 void Config::command_w1(const char** argv, int number_of_unnamed_args, ConfigParser* parser) {
 
@@ -1048,6 +1189,19 @@ void Config::command_w1(const char** argv, int number_of_unnamed_args, ConfigPar
 
   }
 
+  const char* str = argv[CMD_W1_INTERVAL];
+  if (str != NULL && *str != '\0') {
+    w1_poll_interval = getUnsigned(str, parser);
+    if (str != NULL && skipBlanks(str) != NULL) parser->error("The value of argument \"interval\" must be a number of seconds");
+    if (w1_poll_interval == 0) parser->error("The value of argument \"interval\" must be greater than 0");
+  }
+  str = argv[CMD_W1_READERS];
+  if (str != NULL && *str != '\0') {
+    w1_readers = getUnsigned(str, parser);
+    if (str != NULL && skipBlanks(str) != NULL) parser->error("The value of argument \"readers\" must be a number");
+    if (w1_readers < 1 || w1_readers > W1_MAX_READERS) parser->error("The value of argument \"readers\" must be between 1 and %d", W1_MAX_READERS);
+  }
+
 #ifndef NDEBUG
   fprintf(stderr, "command \"w1\" in line #%d of file \"%s\": enable_DS18B20=%s\n",
       parser->linenum, parser->configFilePath, enable_DS18B20_str);
@@ -1059,7 +1213,15 @@ void Config::command_w1(const char** argv, int number_of_unnamed_args, ConfigPar
 #ifdef INCLUDE_HTTPD
 /*-------------------------------------------------------------
  * Command "httpd":
- *   httpd <port> [<www_root>]
+ *   httpd <port> [www_root=<www_root>] [threads=<n>] [max_connections=<n>] [max_connections_per_ip=<n>] [timeout=<seconds>]
+ *         [max_age=<seconds>] [compression_level=<0..9>] [compression_threshold=<bytes>]
+ *
+ * By default requests are processed by a pool of threads (one per CPU core) that share an epoll loop.
+ * threads=0 selects the old mode with a separate thread for each connection.
+ * max_connections, max_connections_per_ip and timeout equal to 0 mean libmicrohttpd defaults.
+ * max_age is the value of Cache-Control max-age for files from www_root. By default browsers must revalidate files.
+ * API responses longer than compression_threshold bytes are compressed with gzip for clients that accept it.
+ * compression_level=0 disables compression.
  */
 void Config::command_httpd(const char** argv, int number_of_unnamed_args, ConfigParser* parser) {
 
@@ -1080,9 +1242,34 @@ void Config::command_httpd(const char** argv, int number_of_unnamed_args, Config
     this->www_root = www_root_path;
   }
 
+  const char* str = argv[CMD_HTTPD_THREADS];
+  if (str != NULL && *str != '\0') {
+    long_value = getUnsigned(str, parser);
+    if (long_value > MAX_HTTPD_THREADS) parser->error("Invalid number of HTTPD threads \"%s\" (max is %d)", str, MAX_HTTPD_THREADS);
+    httpd_threads = (int)long_value;
+  }
+  str = argv[CMD_HTTPD_MAX_CONNECTIONS];
+  if (str != NULL && *str != '\0') httpd_max_connections = getUnsigned(str, parser);
+  str = argv[CMD_HTTPD_MAX_CONNECTIONS_PER_IP];
+  if (str != NULL && *str != '\0') httpd_max_connections_per_ip = getUnsigned(str, parser);
+  str = argv[CMD_HTTPD_TIMEOUT];
+  if (str != NULL && *str != '\0') httpd_timeout = getUnsigned(str, parser);
+  str = argv[CMD_HTTPD_MAX_AGE];
+  if (str != NULL && *str != '\0') httpd_max_age = getUnsigned(str, parser);
+  str = argv[CMD_HTTPD_COMPRESSION_LEVEL];
+  if (str != NULL && *str != '\0') {
+    long_value = getUnsigned(str, parser);
+    if (long_value > 9) parser->error("Invalid compression level \"%s\" (must be from 0 to 9)", str);
+    httpd_compression_level = (int)long_value;
+  }
+  str = argv[CMD_HTTPD_COMPRESSION_THRESHOLD];
+  if (str != NULL && *str != '\0') httpd_compression_threshold = getUnsigned(str, parser);
+
 #ifndef NDEBUG
-  fprintf(stderr, "command \"httpd\" in line #%d of file \"%s\": port=%d www_root=\"%s\"\n",
-      parser->linenum, parser->configFilePath, httpd_port, www_root);
+  fprintf(stderr, "command \"httpd\" in line #%d of file \"%s\": port=%d www_root=\"%s\" threads=%d max_connections=%u max_connections_per_ip=%u timeout=%u max_age=%u"
+      " compression_level=%d compression_threshold=%u\n",
+      parser->linenum, parser->configFilePath, httpd_port, www_root, httpd_threads, httpd_max_connections, httpd_max_connections_per_ip, httpd_timeout, httpd_max_age,
+      httpd_compression_level, httpd_compression_threshold);
 #endif
 }
 #endif
@@ -1173,7 +1360,7 @@ void Config::command_mqtt_rule(const char** argv, int number_of_unnamed_args, Co
   bool is_hi_specified = convertDecimalArg(argv[CMD_MQTT_RULE_HI], hi, scale, allow_negative, "hi", errorLogger);
   if (is_lo_specified && is_hi_specified) {
     errorLogger->error("MQTT rule arguments \"hi\" and \"lo\" are mutually exclusive");
-    exit(1);
+    config_error_exit();
   }
 
   const char* topic = argv[CMD_MQTT_RULE_TOPIC];
@@ -1513,7 +1700,7 @@ void Config::resolveReferencesToRules() {
     free(reference);
     reference = next;
   }
-  if (!success) exit(1);
+  if (!success) config_error_exit();
   unresolved_references_to_rules = NULL;
 }
 
@@ -85,6 +85,8 @@
 #define MIN_HTTPD_PORT 1
 #endif
 
+#define MAX_HTTPD_THREADS 64
+
 #endif // INCLUDE_HTTPD
 //-------------------------------------------------------------
 #ifdef INCLUDE_MQTT
@@ -158,10 +160,24 @@ public:
   bool type_is_set = false;
 
   bool verbosity_set_explicitly = false;
+  bool check_config = false;
   uint32_t options = 0;
+
+  unsigned max_sensors = 0;           // 0 means unlimited
+  unsigned undefined_sensor_ttl = 0;  // seconds, 0 means unlimited
+  int realtime_priority = 0;          // SCHED_FIFO priority of capturing and decoding threads, 0 means normal scheduling
+  uint64_t realtime_cpus = 0;         // CPUs for capturing and decoding threads, 0 means any CPU
+  bool lock_memory = false;
 #ifdef INCLUDE_HTTPD
   int httpd_port = 0;
   const char* www_root = NULL;
+  int httpd_threads = -1;                     // -1 means number of CPU cores, 0 means thread per connection
+  unsigned httpd_max_connections = 0;         // 0 means libmicrohttpd default
+  unsigned httpd_max_connections_per_ip = 0;  // 0 means unlimited
+  unsigned httpd_timeout = 0;                 // seconds, 0 means no timeout
+  unsigned httpd_max_age = 0;                 // seconds, 0 means that browsers must revalidate static files
+  int httpd_compression_level = 6;            // gzip level of API responses, 0 means no compression
+  unsigned httpd_compression_threshold = 1024; // API responses shorter than this are not compressed
 #endif
 #ifdef TEST_DECODING
   bool wait_after_reading = false;
@@ -178,9 +194,12 @@ public:
 #endif
 #ifdef INCLUDE_POLLSTER
   bool w1_enable = false;
+  unsigned w1_poll_interval = 15;     // seconds, the default for DS18B20 sensors
+  unsigned w1_readers = 4;            // number of sensors that are read in parallel without bulk conversion
 #endif
 
   std::vector<AbstractRuleWithSchedule*> rules;
+  SensorDefs* sensor_defs = NULL; // definitions of sensors of reloaded configuration, NULL for the initial one
   UnresolvedReferenceToRule* unresolved_references_to_rules = NULL;
 
 public:
@@ -191,13 +210,15 @@ public:
   static void printHelpAndExit(const char* version);
   static void help();
 
-  void process_args (int argc, char *argv[]);
+  // Returns false if configuration is not valid and it is being reloaded, otherwise the process is terminated.
+  bool process_args (int argc, char *argv[]);
   bool process_cmdline_option( int c, const char* option, const char* optarg, ConfigParser* parser);
 
   void enableProtocols(const char* list, ConfigParser* parser);
 
 private:
 
+  void parse_args(int argc, char *argv[]);
   void readConfig(ConfigParser& configParser, const char* baseFilePath, const char* configFileRelativePath);
   void readConfig(const char* configFileRelativePath);
   void adjust_unnamed_args(const char** argv, int& number_of_unnamed_args, int max_num_of_unnamed_args, const struct CmdArgDef* arg_defs);
@@ -207,6 +228,8 @@ private:
   void command_dump(const char** argv, int number_of_unnamed_args, ConfigParser* errorLogger);
 
   void command_sensor(const char** argv, int number_of_unnamed_args, ConfigParser* errorLogger);
+  void command_sensors(const char** argv, int number_of_unnamed_args, ConfigParser* errorLogger);
+  void command_realtime(const char** argv, int number_of_unnamed_args, ConfigParser* errorLogger);
 #ifdef INCLUDE_POLLSTER
   void command_w1(const char** argv, int number_of_unnamed_args, ConfigParser* errorLogger);
 #endif
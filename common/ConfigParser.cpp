@@ -15,6 +15,13 @@
 #include <fcntl.h>
 
 
+thread_local bool config_reloading = false;
+
+void config_error_exit() {
+  if (config_reloading) throw ConfigParsingAborted();
+  exit(1);
+}
+
 //-------------------------------------------------------------
 ConfigParser::ConfigParser(const char* const valid_options_text) : ErrorLogger(LOGGER_FLAG_STDERR) {
   this->valid_options_text = valid_options_text;
@@ -44,7 +51,7 @@ void ConfigParser::print_error_vargs(const char* fmt, va_list vargs) {
 
 void ConfigParser::error_vargs(const char* fmt, va_list vargs) {
   print_error_vargs(fmt, vargs);
-  exit(1);
+  config_error_exit();
 }
 
 void ConfigParser::error(const char* fmt, ...) {
@@ -52,7 +59,7 @@ void ConfigParser::error(const char* fmt, ...) {
   va_start(vargs, fmt);
   print_error_vargs(fmt, vargs);
   va_end(vargs);
-  exit(1);
+  config_error_exit();
 }
 
 void ConfigParser::print_error(const char* fmt, ...) {
@@ -70,10 +77,12 @@ void ConfigParser::errorWithHelp(const char* fmt, ...) {
   va_start(vargs, fmt);
   print_error_vargs(fmt, vargs);
   va_end(vargs);
-  print_valid_options();
-  fflush(stderr);
-  fclose(stderr);
-  exit(1);
+  if (!config_reloading) {
+    print_valid_options();
+    fflush(stderr);
+    fclose(stderr);
+  }
+  config_error_exit();
 }
 
 //-------------------------------------------------------------
@@ -349,7 +358,7 @@ const char* ConfigParser::getString(const char*& p, char*& buffer, size_t& bufsi
     }
     if (buffer == NULL) {
       fprintf(stderr, "ERROR: Out of memory\n");
-      exit(1);
+      config_error_exit();
     }
 
     char* out = buffer;
@@ -449,7 +458,7 @@ const char* ConfigParser::getString(const char*& p, char*& buffer, size_t& bufsi
   }
   if (buffer == NULL) {
     fprintf(stderr, "ERROR: Out of memory\n");
-    exit(1);
+    config_error_exit();
   }
   if (!include_quotes) {
     strncpy(buffer, start, value_len);
@@ -737,5 +746,5 @@ void errorInavidArg(const char* str, const char* p, const char* argname, ConfigP
 void errorInavidValueOfArg(const char* arg_name, const char* value, ConfigParser* parser) {
   if (parser != NULL) errorInavidArg(value, "arg_name", parser);
   fprintf(stderr, "ERROR: Invalid value of argument --%s=\"%s\".\n", arg_name, value);
-  exit(1);
+  config_error_exit();
 }
@@ -66,6 +66,13 @@ public:
   const char* getFirstWord(const char*& p, size_t& length);
 };
 
+//-------------------------------------------------------------
+// An error in configuration terminates the process with exit code 1. If configuration is being reloaded
+// by this thread then parsing is aborted instead and Config::process_args() returns false.
+typedef struct ConfigParsingAborted {} ConfigParsingAborted;
+extern thread_local bool config_reloading;
+void config_error_exit() __attribute__ ((noreturn));
+
 //-------------------------------------------------------------
 void errorMissingArg(const char* command, const char* argname, ConfigParser* errorLogger);
 void errorInavidArg(const char* str, const char* argname, ConfigParser* errorLogger);
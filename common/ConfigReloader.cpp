@@ -0,0 +1,121 @@
+/*
+ * ConfigReloader.cpp
+ *
+ *  Created on: October 18, 2026
+ *      Author: Alex Konshin
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <spawn.h>
+#include <getopt.h>
+#include <sys/wait.h>
+
+#include "../utils/Logger.hpp"
+#include "ConfigReloader.hpp"
+#include "ConfigParser.hpp"
+
+extern char** environ;
+
+//-------------------------------------------------------------
+ConfigReloader::ConfigReloader(int argc, char** argv) {
+  this->argc = argc;
+  this->argv = argv;
+  receiver = NULL;
+  started = false;
+  pending.store(NULL);
+
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGHUP);
+  pthread_sigmask(SIG_BLOCK, &signals, NULL);
+}
+
+bool ConfigReloader::start(Receiver* receiver) {
+  if (started) return true;
+  this->receiver = receiver;
+  int rc = pthread_create(&thread, NULL, threadFunction, (void*)this);
+  if (rc != 0) {
+    Log->error("Failed to start configuration reloader thread: %s", strerror(rc));
+    return false;
+  }
+  pthread_detach(thread);
+  started = true;
+  return true;
+}
+
+void* ConfigReloader::threadFunction(void* context) {
+  ((ConfigReloader*)context)->run();
+  return NULL;
+}
+
+void ConfigReloader::run() {
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGHUP);
+  while (true) {
+    int signum;
+    if (sigwait(&signals, &signum) != 0 || signum != SIGHUP) continue;
+
+    Log->log("Got SIGHUP. Reloading configuration...");
+    Config* cfg = check() ? load() : NULL;
+    if (cfg == NULL) {
+      Log->error("Configuration is not valid. The current configuration is kept.");
+      continue;
+    }
+    // A configuration that has not been taken yet is just dropped.
+    pending.exchange(cfg);
+    if (receiver != NULL) receiver->raiseReloadEvent();
+  }
+}
+
+// Runs this executable with the same arguments and option --check-config.
+bool ConfigReloader::check() {
+  char** args = (char**)malloc((argc+2)*sizeof(char*));
+  if (args == NULL) {
+    Log->error("Out of memory");
+    return false;
+  }
+  args[0] = argv[0];
+  args[1] = (char*)"--check-config";
+  for (int index = 1; index < argc; index++) args[index+1] = argv[index];
+  args[argc+1] = NULL;
+
+  pid_t pid;
+  int rc = posix_spawn(&pid, "/proc/self/exe", NULL, NULL, args, environ);
+  free(args);
+  if (rc != 0) {
+    Log->error("Failed to check configuration: %s", strerror(rc));
+    return false;
+  }
+
+  int status;
+  while (waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR) {
+      Log->error("Failed to check configuration: %s", strerror(errno));
+      return false;
+    }
+  }
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// Parses the configuration that has been checked. Returns NULL if configuration files have been changed
+// after checking and are not valid anymore.
+Config* ConfigReloader::load() {
+  Config* cfg = new Config();
+  SensorDef::beginLoading();
+  optind = 0; // restart scanning of arguments by getopt_long()
+  config_reloading = true;
+  bool loaded = cfg->process_args(argc, argv);
+  config_reloading = false;
+  SensorDefs* sensor_defs = SensorDef::endLoading();
+  if (!loaded) {
+    SensorDef::discard(sensor_defs);
+    delete cfg;
+    return NULL;
+  }
+  cfg->sensor_defs = sensor_defs;
+  return cfg;
+}
@@ -0,0 +1,56 @@
+/*
+ * ConfigReloader.hpp
+ *
+ *  Created on: October 18, 2026
+ *      Author: Alex Konshin
+ */
+
+#ifndef CONFIGRELOADER_HPP_
+#define CONFIGRELOADER_HPP_
+
+#include <pthread.h>
+#include <atomic>
+
+#include "Receiver.hpp"
+#include "Config.hpp"
+
+//-------------------------------------------------------------
+// Reloading of configuration on signal SIGHUP without stopping of receiving.
+//
+// SIGHUP is blocked in all threads and is accepted by the reloader thread with sigwait() so nothing is done
+// in a signal handler. The command line and configuration files are checked first by running this executable
+// with option --check-config. Then they are parsed by the reloader thread into a new Config object with its own
+// set of sensor definitions. If files are changed between checking and parsing and the parser finds an error then
+// the current configuration is kept. The main thread takes the new configuration between messages, publishes
+// the sensor definitions and restarts only the components whose settings have been changed.
+// Replaced Config objects and their sensor definitions are never freed because other threads may still use them,
+// so each reload leaks one copy of configuration.
+
+class ConfigReloader {
+private:
+  int argc;
+  char** argv;
+  Receiver* receiver;
+  pthread_t thread;
+  bool started;
+  std::atomic<Config*> pending;
+
+  static void* threadFunction(void* context);
+  void run();
+  bool check();
+  Config* load();
+
+public:
+  // Blocks SIGHUP in the calling thread. It must be created before any other thread so all threads inherit the mask.
+  ConfigReloader(int argc, char** argv);
+
+  // Starts waiting for SIGHUP. The receiver is woken up when new configuration is ready.
+  bool start(Receiver* receiver);
+
+  // Returns new configuration (if any). The caller becomes the owner. Called by the main thread.
+  Config* take() {
+    return pending.exchange(NULL);
+  }
+};
+
+#endif /* CONFIGRELOADER_HPP_ */
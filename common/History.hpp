@@ -0,0 +1,929 @@
+/*
+ * History.hpp
+ *
+ *  Created on: October 18, 2026
+ *      Author: Alex Konshin
+ */
+
+#ifndef COMMON_HISTORY_HPP_
+#define COMMON_HISTORY_HPP_
+
+#include <time.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <mutex>
+#include "../utils/Logger.hpp"
+#include "../utils/Utils.hpp"
+
+#ifndef HISTORY_DEPTH_HOURS
+#define HISTORY_DEPTH_HOURS         24
+#endif
+
+//-------------------------------------------------------------
+enum class ValueConversion : int { None=0, F2C=1, C2F=2 };
+
+// Format of history responses:
+//   json      [{"t":"2020-12-31 00:00:00+05:00","y":-12.3},...]
+//   columnar  {"t0":1609362000,"dt":[0,60,61],"y":[-12.3,-12.2,-12.2]}  (t0 is epoch seconds, dt are deltas from previous point)
+//   binary    little-endian header of 4 uint32 (version, count, t0, divisor) followed by
+//             uint32 t[count] (seconds since t0) and int32 y[count] (value*divisor)
+enum class HistoryFormat : int { json=0, columnar=1, binary=2 };
+
+#define HISTORY_BINARY_VERSION     1
+#define HISTORY_BINARY_HEADER_SIZE 16
+
+static inline int32_t convert_history_value(int32_t value, ValueConversion convertion) {
+  switch (convertion) {
+  case ValueConversion::F2C:
+    return ((value-320)*5)/9;
+  case ValueConversion::C2F:
+    return (value*9)/5+320;
+  default:
+    return value;
+  }
+}
+
+static inline void put_le32(uint8_t* p, uint32_t value) {
+  p[0] = (uint8_t)value;
+  p[1] = (uint8_t)(value >> 8);
+  p[2] = (uint8_t)(value >> 16);
+  p[3] = (uint8_t)(value >> 24);
+}
+
+
+typedef struct HistoryData {
+  time_t time;
+  int32_t value;
+
+  size_t generateJson(int start, void*& buffer, size_t& buffer_size, ValueConversion convertion, bool x10, bool time_UTC) {
+
+    char dt[TIME2STR_BUFFER_SIZE];
+    convert_time(&time, dt, TIME2STR_BUFFER_SIZE, time_UTC);
+
+    // {"t":"2020-12-31 00:00:00+05:00","y":-12345678900}
+    size_t required_buffer_size = (size_t)start+(strlen(dt)+12+14)*sizeof(unsigned char);
+    char* ptr = (char*)resize_buffer(required_buffer_size, buffer, buffer_size);
+    if (ptr == NULL) return 0;
+    ptr += start;
+    size_t remain = buffer_size-start;
+
+    int32_t converted_value = convert_history_value(value, convertion);
+    int len;
+    if (x10) {
+      len = snprintf(ptr, remain, "{\"t\":\"%s\",\"y\":%d}", dt, converted_value );
+    } else {
+      char t2d_buffer[T2D_BUFFER_SIZE];
+      uint32_t dummy = 0;
+      len = snprintf(ptr, remain, "{\"t\":\"%s\",\"y\":%s}", dt, t2d(converted_value, t2d_buffer, dummy));
+    }
+
+    return (size_t)len;
+  }
+
+} HistoryData;
+
+//-------------------------------------------------------------
+// Compressed history storage.
+//
+// The newest points are kept uncompressed in a small head block so appends are cheap.
+// When the head block is full its points are encoded into a chain of fixed size blocks:
+//  - timestamps as delta-of-delta, zig-zag encoded, with variable length prefix:
+//      '0'                  delta is the same as previous one
+//      '10'   +  7 bits
+//      '110'  +  9 bits
+//      '1110' + 12 bits
+//      '1111' + 32 bits
+//  - values (temperature x10 or humidity) as zig-zag encoded delta from the previous value:
+//      '0'                  value is not changed
+//      '10'   +  6 bits
+//      '110'  + 12 bits
+//      '111'  + 32 bits
+// The first point of each block is stored as is in the block header.
+// With readings every minute or so a point takes 2-3 bytes instead of 24-32 bytes of a list node.
+
+#define HISTORY_HEAD_SIZE     16
+#define HISTORY_BLOCK_SIZE   128  // size of the encoded bit stream in a block (bytes)
+#define HISTORY_SCAN_CHUNK   256  // points decoded by History::scan() at once under the lock
+
+typedef struct HistoryBlock {
+  HistoryBlock* next;
+  time_t first_time;
+  time_t last_time;
+  int32_t first_value;
+  int32_t last_value;
+  int32_t last_delta;
+  uint16_t count;
+  uint16_t bits;
+  uint8_t data[HISTORY_BLOCK_SIZE];
+
+  static inline uint32_t zigzag(int32_t n) {
+    return ((uint32_t)n << 1) ^ (uint32_t)(n >> 31);
+  }
+  static inline int32_t unzigzag(uint32_t n) {
+    return (int32_t)(n >> 1) ^ -(int32_t)(n & 1);
+  }
+
+  static unsigned timeBits(uint32_t zz) {
+    if (zz == 0) return 1;
+    if (zz < (1U<<7)) return 2+7;
+    if (zz < (1U<<9)) return 3+9;
+    if (zz < (1U<<12)) return 4+12;
+    return 4+32;
+  }
+  static unsigned valueBits(uint32_t zz) {
+    if (zz == 0) return 1;
+    if (zz < (1U<<6)) return 2+6;
+    if (zz < (1U<<12)) return 3+12;
+    return 3+32;
+  }
+
+  void writeBits(uint32_t value, unsigned n) {
+    while (n > 0) {
+      unsigned bit_in_byte = bits & 7;
+      unsigned chunk = 8-bit_in_byte;
+      if (chunk > n) chunk = n;
+      n -= chunk;
+      uint8_t part = (uint8_t)((value >> n) & ((1U<<chunk)-1));
+      data[bits>>3] |= (uint8_t)(part << (8-bit_in_byte-chunk));
+      bits += chunk;
+    }
+  }
+
+  // Try to append the point to the block. Returns false if the block has no room for it.
+  bool append(time_t time, int32_t value) {
+    if (count == 0) {
+      first_time = last_time = time;
+      first_value = last_value = value;
+      last_delta = 0;
+      count = 1;
+      return true;
+    }
+    int64_t delta = (int64_t)(time-last_time);
+    int64_t dod = delta-last_delta;
+    int64_t value_delta = (int64_t)value-last_value;
+    if (delta < INT32_MIN || delta > INT32_MAX || dod < INT32_MIN || dod > INT32_MAX ||
+        value_delta < INT32_MIN || value_delta > INT32_MAX || count == UINT16_MAX) return false;
+
+    uint32_t tz = zigzag((int32_t)dod);
+    uint32_t vz = zigzag((int32_t)value_delta);
+    unsigned tbits = timeBits(tz);
+    unsigned vbits = valueBits(vz);
+    if (bits+tbits+vbits > HISTORY_BLOCK_SIZE*8) return false;
+
+    switch (tbits) {
+    case 1:      writeBits(0, 1); break;
+    case 2+7:    writeBits(2, 2);  writeBits(tz, 7); break;
+    case 3+9:    writeBits(6, 3);  writeBits(tz, 9); break;
+    case 4+12:   writeBits(14, 4); writeBits(tz, 12); break;
+    default:     writeBits(15, 4); writeBits(tz, 32); break;
+    }
+    switch (vbits) {
+    case 1:      writeBits(0, 1); break;
+    case 2+6:    writeBits(2, 2); writeBits(vz, 6); break;
+    case 3+12:   writeBits(6, 3); writeBits(vz, 12); break;
+    default:     writeBits(7, 3); writeBits(vz, 32); break;
+    }
+
+    last_time = time;
+    last_delta = (int32_t)delta;
+    last_value = value;
+    count++;
+    return true;
+  }
+
+} HistoryBlock;
+
+//-------------------------------------------------------------
+// Sequential decoder of a chain of compressed blocks.
+typedef struct HistoryBlockReader {
+  const HistoryBlock* block;
+  unsigned index;
+  unsigned bit;
+  time_t time;
+  int32_t delta;
+  int32_t value;
+
+  void start(const HistoryBlock* first) {
+    block = first;
+    index = 0;
+    bit = 0;
+  }
+
+  uint32_t readBits(unsigned n) {
+    uint32_t result = 0;
+    while (n > 0) {
+      unsigned bit_in_byte = bit & 7;
+      unsigned chunk = 8-bit_in_byte;
+      if (chunk > n) chunk = n;
+      uint8_t byte = block->data[bit>>3];
+      result = (result << chunk) | ((byte >> (8-bit_in_byte-chunk)) & ((1U<<chunk)-1));
+      bit += chunk;
+      n -= chunk;
+    }
+    return result;
+  }
+
+  unsigned readPrefix(unsigned max_ones) {
+    unsigned ones = 0;
+    while (ones < max_ones && readBits(1) == 1) ones++;
+    return ones;
+  }
+
+  bool next(HistoryData& point) {
+    while (block != NULL && index >= block->count) {
+      block = block->next;
+      index = 0;
+      bit = 0;
+    }
+    if (block == NULL) return false;
+    if (index == 0) {
+      time = block->first_time;
+      value = block->first_value;
+      delta = 0;
+    } else {
+      uint32_t tz;
+      switch (readPrefix(4)) {
+      case 0:  tz = 0; break;
+      case 1:  tz = readBits(7); break;
+      case 2:  tz = readBits(9); break;
+      case 3:  tz = readBits(12); break;
+      default: tz = readBits(32); break;
+      }
+      uint32_t vz;
+      switch (readPrefix(3)) {
+      case 0:  vz = 0; break;
+      case 1:  vz = readBits(6); break;
+      case 2:  vz = readBits(12); break;
+      default: vz = readBits(32); break;
+      }
+      delta += HistoryBlock::unzigzag(tz);
+      time += delta;
+      value += HistoryBlock::unzigzag(vz);
+    }
+    index++;
+    point.time = time;
+    point.value = value;
+    return true;
+  }
+
+} HistoryBlockReader;
+
+//-------------------------------------------------------------
+// Downsampling of history for charts (parameter points=N of history requests).
+//   lttb    Largest-Triangle-Three-Buckets: one point per bucket that keeps the shape of the line
+//   minmax  the lowest and the highest point of each bucket so spikes are never lost
+// The time range is divided into buckets of equal duration, so gaps in data stay gaps.
+// The first and the last points are always returned, so the time of the last point can be used as cursor.
+// Points are processed in one pass while the history is being decoded. LTTB needs the average of the next
+// bucket to choose a point so it keeps points of two buckets, min/max keeps only two points.
+
+enum class DownsampleMethod : int { none=0, lttb=1, minmax=2 };
+
+#define MIN_DOWNSAMPLE_POINTS 4
+
+typedef struct HistoryBucket {
+  HistoryData* points;
+  unsigned count;
+  unsigned capacity;
+  unsigned index;
+  double sum_time;
+  double sum_value;
+
+  bool add(HistoryData& point, double time) {
+    if (count >= capacity) {
+      unsigned new_capacity = capacity == 0 ? 16 : capacity*2;
+      HistoryData* new_points = (HistoryData*)realloc(points, new_capacity*sizeof(HistoryData));
+      if (new_points == NULL) return false;
+      points = new_points;
+      capacity = new_capacity;
+    }
+    points[count++] = point;
+    sum_time += time;
+    sum_value += point.value;
+    return true;
+  }
+
+  void reset(unsigned index) {
+    this->index = index;
+    count = 0;
+    sum_time = 0;
+    sum_value = 0;
+  }
+
+} HistoryBucket;
+
+template<typename F> struct HistoryDownsampler {
+  F& emit;
+  DownsampleMethod method;
+  time_t start_time;
+  double bucket_duration;
+  unsigned buckets;
+
+  bool has_first;
+  bool has_pending;
+  bool failed;
+  HistoryData pending;     // the latest point, it is added to buckets when the next point arrives
+  HistoryData selected;    // the last returned point (LTTB)
+
+  // LTTB: the bucket to choose a point from and the next bucket
+  HistoryBucket current;
+  HistoryBucket next;
+
+  // min/max: the current bucket
+  bool has_bucket;
+  unsigned bucket_index;
+  HistoryData min_point;
+  HistoryData max_point;
+
+  HistoryDownsampler(F& emit, DownsampleMethod method, unsigned points, time_t start_time, time_t end_time) : emit(emit) {
+    this->method = method;
+    this->start_time = start_time;
+    if (points < MIN_DOWNSAMPLE_POINTS) points = MIN_DOWNSAMPLE_POINTS;
+    // The first and the last points are not in buckets. Min/max returns up to 2 points from each bucket.
+    buckets = method == DownsampleMethod::minmax ? (points-2)/2 : points-2;
+    if (buckets == 0) buckets = 1;
+    bucket_duration = (double)(end_time-start_time+1)/buckets;
+    has_first = false;
+    has_pending = false;
+    failed = false;
+    has_bucket = false;
+    bucket_index = 0;
+    memset(&current, 0, sizeof(current));
+    memset(&next, 0, sizeof(next));
+  }
+
+  ~HistoryDownsampler() {
+    if (current.points != NULL) free(current.points);
+    if (next.points != NULL) free(next.points);
+  }
+
+  unsigned getBucket(time_t time) {
+    if (time <= start_time) return 0;
+    unsigned index = (unsigned)((double)(time-start_time)/bucket_duration);
+    return index < buckets ? index : buckets-1;
+  }
+
+  void add(HistoryData& point) {
+    if (!has_first) {
+      has_first = true;
+      selected = point;
+      emit(point);
+      return;
+    }
+    if (has_pending) {
+      if (method == DownsampleMethod::minmax) addMinMax(pending); else addLTTB(pending);
+    }
+    pending = point;
+    has_pending = true;
+  }
+
+  void finish() {
+    if (method == DownsampleMethod::minmax) {
+      if (has_bucket) emitMinMax();
+    } else {
+      if (current.count > 0) {
+        if (next.count > 0) {
+          selectLTTB(current, next.sum_time/next.count, next.sum_value/next.count);
+          current.reset(0);
+          // The last point plays the role of the next bucket for the last bucket.
+          if (has_pending) selectLTTB(next, (double)(pending.time-start_time), pending.value);
+        } else if (has_pending) {
+          selectLTTB(current, (double)(pending.time-start_time), pending.value);
+        }
+      }
+    }
+    if (has_pending) emit(pending);
+    has_pending = false;
+  }
+
+private:
+  void addLTTB(HistoryData& point) {
+    if (failed) return;
+    unsigned index = getBucket(point.time);
+    double time = (double)(point.time-start_time);
+    HistoryBucket* bucket;
+    if (current.count == 0 || index == current.index) {
+      if (current.count == 0) current.reset(index);
+      bucket = &current;
+    } else if (next.count == 0 || index == next.index) {
+      if (next.count == 0) next.reset(index);
+      bucket = &next;
+    } else {
+      // The next bucket is complete so the point of the current bucket can be chosen.
+      selectLTTB(current, next.sum_time/next.count, next.sum_value/next.count);
+      HistoryBucket tmp = current;
+      current = next;
+      next = tmp;
+      next.reset(index);
+      bucket = &next;
+    }
+    if (!bucket->add(point, time)) {
+      Log->error("Out of memory");
+      failed = true;
+    }
+  }
+
+  // Choose the point of the bucket that makes the largest triangle with the last selected point and the next point.
+  void selectLTTB(HistoryBucket& bucket, double next_time, double next_value) {
+    double a_time = (double)(selected.time-start_time);
+    double a_value = selected.value;
+    double max_area = -1;
+    unsigned max_index = 0;
+    for (unsigned index = 0; index < bucket.count; index++) {
+      HistoryData& point = bucket.points[index];
+      double area = (a_time-next_time)*((double)point.value-a_value)-(a_time-(double)(point.time-start_time))*(next_value-a_value);
+      if (area < 0) area = -area;
+      if (area > max_area) {
+        max_area = area;
+        max_index = index;
+      }
+    }
+    if (bucket.count > 0) {
+      selected = bucket.points[max_index];
+      emit(selected);
+    }
+  }
+
+  void addMinMax(HistoryData& point) {
+    unsigned index = getBucket(point.time);
+    if (has_bucket && index != bucket_index) emitMinMax();
+    if (!has_bucket) {
+      has_bucket = true;
+      bucket_index = index;
+      min_point = max_point = point;
+      return;
+    }
+    if (point.value < min_point.value) min_point = point;
+    if (point.value > max_point.value) max_point = point;
+  }
+
+  void emitMinMax() {
+    has_bucket = false;
+    if (min_point.time == max_point.time) {
+      emit(min_point);
+    } else if (min_point.time < max_point.time) {
+      emit(min_point);
+      emit(max_point);
+    } else {
+      emit(max_point);
+      emit(min_point);
+    }
+  }
+};
+
+//-------------------------------------------------------------
+// History of one metric of one sensor.
+// All fields must be valid when zero-initialized because the owner is allocated with calloc().
+typedef struct History {
+private:
+  HistoryBlock* first;
+  HistoryBlock* last;
+  unsigned skip;                   // number of outdated points at the beginning of the first block
+  HistoryData head[HISTORY_HEAD_SIZE];
+  unsigned head_count;
+  std::mutex chain_mutex;
+  unsigned count;
+  size_t blocks_count;
+
+  // Move points from the head block to compressed blocks. Must be called with locked chain_mutex.
+  void flushHead() {
+    for (unsigned index = 0; index < head_count; index++) {
+      HistoryData& point = head[index];
+      if (last == NULL || !last->append(point.time, point.value)) {
+        HistoryBlock* block = (HistoryBlock*)calloc(1, sizeof(HistoryBlock));
+        if (block == NULL) {
+          Log->error("Out of memory");
+          count -= head_count-index;
+          break;
+        }
+        block->append(point.time, point.value);
+        if (last != NULL) last->next = block; else first = block;
+        last = block;
+        blocks_count++;
+      }
+    }
+    head_count = 0;
+  }
+
+  // Must be called with locked chain_mutex.
+  void startReader(HistoryBlockReader& reader) {
+    reader.start(first);
+    HistoryData dummy;
+    for (unsigned index = 0; index < skip; index++) reader.next(dummy);
+  }
+
+public:
+  void add(time_t time, int32_t value) {
+    chain_mutex.lock();
+    if (head_count >= HISTORY_HEAD_SIZE) flushHead();
+    HistoryData& point = head[head_count++];
+    point.time = time;
+    point.value = value;
+    count++;
+    chain_mutex.unlock();
+  }
+
+  bool isEmpty() {
+    return count == 0;
+  }
+
+  // Release all stored data.
+  void clear() {
+    chain_mutex.lock();
+    while (first != NULL) {
+      HistoryBlock* next = first->next;
+      free(first);
+      first = next;
+    }
+    last = NULL;
+    skip = 0;
+    head_count = 0;
+    count = 0;
+    blocks_count = 0;
+    chain_mutex.unlock();
+  }
+
+  unsigned getCount() { return count; }
+
+  // Approximate amount of memory used by stored data.
+  size_t getMemorySize() { return blocks_count*sizeof(HistoryBlock); }
+
+  void truncate() {
+    struct tm tm;
+    time_t now = time(NULL);
+    localtime_r(&now, &tm);
+    tm.tm_hour -= HISTORY_DEPTH_HOURS;
+    time_t from_time = mktime(&tm);
+    truncate(from_time);
+  }
+
+  void truncate(time_t from) {
+    if (from == 0) return;
+    chain_mutex.lock();
+    truncateLocked(from);
+    chain_mutex.unlock();
+  }
+
+private:
+  void truncateLocked(time_t from) {
+    // Whole blocks are released as soon as their last point is outdated.
+    while (first != NULL && first->last_time < from) {
+      HistoryBlock* next = first->next;
+      count -= first->count-skip;
+      skip = 0;
+      free(first);
+      blocks_count--;
+      first = next;
+    }
+    if (first == NULL) {
+      last = NULL;
+    } else if (first->first_time < from) {
+      // Outdated points of the first block are just skipped.
+      HistoryBlockReader reader;
+      startReader(reader);
+      HistoryData point;
+      while (reader.block == first && reader.index < first->count && reader.next(point) && point.time < from) {
+        skip++;
+        count--;
+      }
+    }
+    if (first == NULL && head_count > 0 && head[0].time < from) {
+      unsigned n = 0;
+      while (n < head_count && head[n].time < from) n++;
+      head_count -= n;
+      count -= n;
+      if (head_count > 0) memmove(head, head+n, head_count*sizeof(HistoryData));
+    }
+  }
+
+  // Find the first point in the head block with time >= from.
+  // Must be called with locked chain_mutex.
+  unsigned findInHead(time_t from) {
+    unsigned low = 0;
+    unsigned high = head_count;
+    while (low < high) {
+      unsigned middle = (low+high)/2;
+      if (head[middle].time < from) low = middle+1; else high = middle;
+    }
+    return low;
+  }
+
+  // Position of scan() between chunks: the time of the last returned point and the number of returned points
+  // with this time. Blocks can be released or appended while the lock is not held, so the position is not a pointer.
+  typedef struct HistoryCursor {
+    bool started;
+    time_t time;
+    unsigned same;
+  } HistoryCursor;
+
+  // Decode at most max points of the range [from, to] after the cursor into the array.
+  // Sets done if there are no more points in the range. Must be called with locked chain_mutex.
+  unsigned readChunk(time_t from, time_t to, HistoryCursor& cursor, HistoryData* points, unsigned max, bool& done) {
+    time_t start = cursor.started ? cursor.time : from;
+    unsigned skip_same = cursor.started ? cursor.same : 0;
+    HistoryBlockReader reader;
+    startReader(reader);
+    if (start != 0) {
+      // Blocks before the range are skipped without decoding.
+      while (reader.block != NULL && reader.block->last_time < start) reader.start(reader.block->next);
+    }
+    unsigned head_index = start == 0 ? 0 : findInHead(start);
+    unsigned n = 0;
+    done = false;
+    HistoryData point;
+    while (n < max) {
+      if (!reader.next(point)) {
+        if (head_index >= head_count) break;
+        point = head[head_index++];
+      }
+      if (start != 0 && point.time < start) continue;
+      if (skip_same > 0 && point.time == cursor.time) {
+        skip_same--;
+        continue;
+      }
+      if (to != 0 && point.time > to) {
+        done = true;
+        return n;
+      }
+      points[n++] = point;
+      if (cursor.started && point.time == cursor.time) {
+        cursor.same++;
+      } else {
+        cursor.started = true;
+        cursor.time = point.time;
+        cursor.same = 1;
+      }
+    }
+    if (n < max) done = true;
+    return n;
+  }
+
+  // Iterate over stored points in the time range [from, to]. 0 means no limit.
+  // At most limit points are returned if limit is not 0.
+  // Points are decoded under chain_mutex in chunks of HISTORY_SCAN_CHUNK points and function f is called
+  // without the lock, so formatting of a response does not delay add() of new points.
+  // Outdated points are removed if from is 0.
+  template<typename F> unsigned scan(time_t from, time_t to, unsigned limit, F f) {
+    time_t truncate_time = 0;
+    if (from == 0) {
+      struct tm tm;
+      time_t now = time(NULL);
+      localtime_r(&now, &tm);
+      tm.tm_hour -= HISTORY_DEPTH_HOURS;
+      truncate_time = mktime(&tm);
+    }
+    if (limit == 0) limit = UINT_MAX;
+
+    HistoryData points[HISTORY_SCAN_CHUNK];
+    HistoryCursor cursor;
+    cursor.started = false;
+    cursor.time = 0;
+    cursor.same = 0;
+    unsigned n = 0;
+    bool done = false;
+    while (!done && n < limit) {
+      unsigned max = limit-n < HISTORY_SCAN_CHUNK ? limit-n : HISTORY_SCAN_CHUNK;
+      chain_mutex.lock();
+      if (!cursor.started && n == 0) {
+        if (truncate_time != 0) truncateLocked(truncate_time);
+        truncate_time = 0;
+        // Points added while the lock is released are not returned, so the scan always ends.
+        time_t last_time = head_count > 0 ? head[head_count-1].time : last != NULL ? last->last_time : 0;
+        if (to == 0 || to > last_time) to = last_time;
+      }
+      unsigned chunk_size = readChunk(from, to, cursor, points, max, done);
+      chain_mutex.unlock();
+      for (unsigned index = 0; index < chunk_size; index++) f(points[index]);
+      n += chunk_size;
+    }
+    return n;
+  }
+
+  // Time of the first and the last stored points. Returns false if there are no points.
+  bool getTimeRange(time_t& first_time, time_t& last_time) {
+    chain_mutex.lock();
+    HistoryBlockReader reader;
+    startReader(reader);
+    HistoryData point;
+    bool result = true;
+    if (reader.next(point)) {
+      first_time = point.time;
+      last_time = head_count > 0 ? head[head_count-1].time : last->last_time;
+    } else if (head_count > 0) {
+      first_time = head[0].time;
+      last_time = head[head_count-1].time;
+    } else {
+      result = false;
+    }
+    chain_mutex.unlock();
+    return result;
+  }
+
+  // The same as scan() but returns at most points points selected by the method for a chart (see HistoryDownsampler).
+  // Limit is applied to returned points.
+  template<typename F> unsigned scan(time_t from, time_t to, unsigned limit, unsigned points, DownsampleMethod method, F f) {
+    if (points == 0 || method == DownsampleMethod::none) return scan(from, to, limit, f);
+    if (from == 0) truncate();
+    time_t first_time, last_time;
+    if (!getTimeRange(first_time, last_time)) return 0;
+    time_t start_time = from != 0 && from > first_time ? from : first_time;
+    time_t end_time = to != 0 && to < last_time ? to : last_time;
+    if (end_time < start_time) return 0;
+    if (limit == 0) limit = UINT_MAX;
+
+    unsigned n = 0;
+    auto output = [&](HistoryData& point) {
+      if (n < limit) {
+        f(point);
+        n++;
+      }
+    };
+    HistoryDownsampler<decltype(output)> downsampler(output, method, points, start_time, end_time);
+    scan(from, to, 0, [&](HistoryData& point) {
+      downsampler.add(point);
+    });
+    downsampler.finish();
+    return n;
+  }
+
+public:
+  // Copy data for the requested time range.
+  // Return the size of result array in argument count.
+  HistoryData* get(time_t from, time_t to, unsigned& count) {
+    count = 0;
+    unsigned capacity = this->count;
+    if (capacity == 0) return NULL;
+    HistoryData* result = (HistoryData*)calloc(capacity, sizeof(HistoryData));
+    if (result == NULL) {
+      Log->error("Out of memory");
+      return NULL;
+    }
+    scan(from, to, capacity, [&](HistoryData& point) {
+      result[count++] = point;
+    });
+    if (count == 0) {
+      free((void*)result);
+      return NULL;
+    }
+    return result;
+  }
+
+  // The decoder writes JSON directly into the buffer without intermediate copy of data.
+  // Time of the last returned point is returned in argument last_time (0 if there is no data).
+  size_t generateJson(time_t from, time_t to, unsigned limit, unsigned points, DownsampleMethod method,
+      void*& buffer, size_t& buffer_size, ValueConversion convertion, bool x10, bool time_UTC, time_t& last_time) {
+    last_time = 0;
+    unsigned count = this->count;
+    if (count == 0) return 0;
+    if (limit != 0 && limit < count) count = limit;
+    if (points != 0 && method != DownsampleMethod::none && points < count) count = points < MIN_DOWNSAMPLE_POINTS ? MIN_DOWNSAMPLE_POINTS : points;
+
+// {"t":"2020-12-31 00:00:00+05:00","y":-12345678900}
+#define JSON_HISTORY_RECORD_SIZE  54
+    // [<record>,<record>]
+    size_t required_buffer_size = (count*(JSON_HISTORY_RECORD_SIZE+1)-1+3)*sizeof(unsigned char);
+    if (resize_buffer(required_buffer_size, buffer, buffer_size) == NULL) return 0;
+    size_t total_len = 1;
+    ((char*)buffer)[0] = '[';
+    ((char*)buffer)[1] = '\0';
+
+    unsigned n = scan(from, to, limit, points, method, [&](HistoryData& point) {
+      if (buffer == NULL) return;
+      if (total_len > 1) {
+        ((char*)buffer)[total_len] = ',';
+        ((char*)buffer)[++total_len] = '\0';
+      }
+      size_t len = point.generateJson(total_len, buffer, buffer_size, convertion, x10, time_UTC);
+      if (len > 0) {
+        total_len += len;
+      } else if (total_len > 1) { // remove last comma
+        ((char*)buffer)[--total_len] = '\0';
+      }
+      last_time = point.time;
+    });
+    if (n == 0) return 0;
+
+    char* pchars = (char*)resize_buffer(total_len+2, buffer, buffer_size);
+    if (pchars == NULL) return 0;
+    pchars[total_len++] = ']';
+    pchars[total_len] = '\0';
+
+    return total_len;
+  }
+
+  // Columnar JSON: {"t0":1609362000,"dt":[0,60,61],"y":[-12.3,-12.2,-12.2]}
+  // Numbers are formatted without printf and without time conversion.
+  size_t generateColumnarJson(time_t from, time_t to, unsigned limit, unsigned points, DownsampleMethod method,
+      void*& buffer, size_t& buffer_size, ValueConversion convertion, bool x10, time_t& last_time) {
+    last_time = 0;
+    unsigned count = this->count;
+    if (limit != 0 && limit < count) count = limit;
+    if (points != 0 && method != DownsampleMethod::none && points < count) count = points < MIN_DOWNSAMPLE_POINTS ? MIN_DOWNSAMPLE_POINTS : points;
+
+    int32_t* values = NULL;
+    if (count > 0) {
+      values = (int32_t*)malloc(count*sizeof(int32_t));
+      if (values == NULL) {
+        Log->error("Out of memory");
+        return 0;
+      }
+    }
+
+#define COLUMNAR_HISTORY_HEADER_SIZE 64
+    // A delta with comma takes at most 11 characters and a value with comma at most T2D_BUFFER_SIZE.
+    size_t required_buffer_size = COLUMNAR_HISTORY_HEADER_SIZE+(size_t)count*(11+T2D_BUFFER_SIZE);
+    char* ptr = (char*)resize_buffer(required_buffer_size, buffer, buffer_size);
+    if (ptr == NULL) {
+      if (values != NULL) free(values);
+      return 0;
+    }
+
+    // The space for t0 is reserved and filled after scanning.
+    const size_t dt_start = 40;
+    char* p = ptr+dt_start;
+    unsigned n = 0;
+    time_t first_time = 0;
+    time_t prev_time = 0;
+    char number[T2D_BUFFER_SIZE];
+    uint32_t len;
+    if (count > 0) {
+      n = scan(from, to, count, points, method, [&](HistoryData& point) {
+        if (n == 0) {
+          first_time = prev_time = point.time;
+        } else {
+          *p++ = ',';
+        }
+        char* s = i2a((int)(point.time-prev_time), number, len);
+        memcpy(p, s, len);
+        p += len;
+        prev_time = point.time;
+        values[n++] = convert_history_value(point.value, convertion);
+      });
+      last_time = prev_time;
+    }
+
+    memcpy(p, "],\"y\":[", 7);
+    p += 7;
+    for (unsigned index = 0; index < n; index++) {
+      if (index != 0) *p++ = ',';
+      char* s = x10 ? i2a(values[index], number, len) : t2d(values[index], number, len);
+      memcpy(p, s, len);
+      p += len;
+    }
+    *p++ = ']';
+    *p++ = '}';
+    *p = '\0';
+    if (values != NULL) free(values);
+
+    // {"t0":1609362000,"dt":[
+    char header[COLUMNAR_HISTORY_HEADER_SIZE];
+    int header_len = snprintf(header, sizeof(header), "{\"t0\":%lld,\"dt\":[", (long long)first_time);
+    char* start = ptr+dt_start-header_len;
+    memcpy(start, header, header_len);
+    size_t total_len = p-start;
+    memmove(ptr, start, total_len+1);
+    return total_len;
+  }
+
+  // Binary form for JavaScript DataView/typed arrays. See HistoryFormat.
+  // Values are always integers: temperature multiplied by 10 (divisor 10) or humidity (divisor 1).
+  size_t generateBinary(time_t from, time_t to, unsigned limit, unsigned points, DownsampleMethod method,
+      void*& buffer, size_t& buffer_size, ValueConversion convertion, uint32_t divisor, time_t& last_time) {
+    last_time = 0;
+    unsigned count = this->count;
+    if (limit != 0 && limit < count) count = limit;
+    if (points != 0 && method != DownsampleMethod::none && points < count) count = points < MIN_DOWNSAMPLE_POINTS ? MIN_DOWNSAMPLE_POINTS : points;
+
+    // Values are collected after times and moved to their place when the number of points is known.
+    size_t required_buffer_size = HISTORY_BINARY_HEADER_SIZE+(size_t)count*2*sizeof(uint32_t);
+    uint8_t* ptr = (uint8_t*)resize_buffer(required_buffer_size, buffer, buffer_size);
+    if (ptr == NULL) return 0;
+
+    uint8_t* times = ptr+HISTORY_BINARY_HEADER_SIZE;
+    uint8_t* values = times+(size_t)count*sizeof(uint32_t);
+    unsigned n = 0;
+    time_t first_time = 0;
+    if (count > 0) {
+      n = scan(from, to, count, points, method, [&](HistoryData& point) {
+        if (n == 0) first_time = point.time;
+        put_le32(times+n*sizeof(uint32_t), (uint32_t)(point.time-first_time));
+        put_le32(values+n*sizeof(uint32_t), (uint32_t)convert_history_value(point.value, convertion));
+        last_time = point.time;
+        n++;
+      });
+    }
+    if (n < count) memmove(times+n*sizeof(uint32_t), values, n*sizeof(uint32_t));
+
+    put_le32(ptr, HISTORY_BINARY_VERSION);
+    put_le32(ptr+4, n);
+    put_le32(ptr+8, (uint32_t)first_time);
+    put_le32(ptr+12, divisor);
+    return HISTORY_BINARY_HEADER_SIZE+(size_t)n*2*sizeof(uint32_t);
+  }
+
+} History;
+
+#endif /* COMMON_HISTORY_HPP_ */
@@ -18,6 +18,7 @@ typedef struct ReceivedData {
   struct ReceivedData *next;
   int16_t* pSequence;
   uint32_t uSequenceStartTime;
+  uint64_t trace[NUMBER_OF_TRACE_STAMPS]; // see TRACE_*
   SensorData sensorData;
 
   uint32_t protocol_tried_manchester;
@@ -163,6 +164,9 @@ public:
 
     if (output == NULL) output = stdout;
 
+    // The writer thread of Log writes into the same log file, the lock of the stream keeps lines of both together.
+    if (log != NULL) flockfile(log);
+
     FILE* file = output;
     FILE* file2 = log;
     do { // repeat for log_file if it is not NULL
@@ -213,7 +217,10 @@ public:
     }
 
     fflush(output);
-    if (log != NULL) fflush(log);
+    if (log != NULL) {
+      fflush(log);
+      funlockfile(log);
+    }
 
     return true;
   }
@@ -291,7 +298,42 @@ public:
 
   int update(SensorsData& sensorsData, time_t max_unchanged_gap) {
     getSensorDef(); // sets is_sensor_def_set = true;
-    return sensorsData.update(&data->sensorData, data_time, max_unchanged_gap);
+    int changed = sensorsData.update(&data->sensorData, data_time, max_unchanged_gap);
+    stamp(TRACE_STATE_UPDATED);
+    return changed;
+  }
+
+  void stamp(int stage) {
+    if (data != NULL) data->trace[stage] = metrics_clock();
+  }
+
+  uint64_t getStamp(int stage) {
+    return data == NULL ? 0 : data->trace[stage];
+  }
+
+  // Adds latencies of passed stages to the statistics when the main loop is done with the message.
+  // In debug mode they are also logged.
+  void finishTrace(bool debug) {
+    if (data == NULL) return;
+    uint64_t* trace = data->trace;
+    char buffer[256];
+    int len = 0;
+    uint64_t previous = 0;
+    for (int stage = 0; stage < NUMBER_OF_TRACE_STAMPS; stage++) {
+      if (trace[stage] == 0) continue;
+      if (previous != 0) {
+        statistics->latency[stage].observeInterval(previous, trace[stage]);
+        if (debug) len += snprintf(buffer+len, sizeof(buffer)-len, " %s=%lluus", latency_names[stage],
+            (unsigned long long)(trace[stage] <= previous ? 0 : (trace[stage]-previous)/1000));
+      }
+      previous = trace[stage];
+    }
+    if (trace[TRACE_SEQUENCE_CLOSED] != 0 && trace[TRACE_SINK_ACKED] != 0) {
+      statistics->latency[LATENCY_END_TO_END].observeInterval(trace[TRACE_SEQUENCE_CLOSED], trace[TRACE_SINK_ACKED]);
+      if (debug) snprintf(buffer+len, sizeof(buffer)-len, " %s=%lluus", latency_names[LATENCY_END_TO_END],
+          (unsigned long long)((trace[TRACE_SINK_ACKED]-trace[TRACE_SEQUENCE_CLOSED])/1000));
+    }
+    if (debug && len > 0) Log->info("Latency:%s", buffer);
   }
 };
 
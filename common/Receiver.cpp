@@ -7,6 +7,7 @@
 #include "Receiver.hpp"
 #include "../protocols/Protocol.hpp"
 #include "Config.hpp"
+#include "../utils/Realtime.hpp"
 #include <mutex>
 
 #ifdef INCLUDE_POLLSTER
@@ -29,7 +30,6 @@ Receiver::Receiver(Config* cfg) {
   max_duration = cfg->max_duration;
   min_duration = cfg->min_duration;
   isEnabled = false;
-  isMessageQueueInitialized = false;
   isDecoderStarted = false;
   stopDecoder = false;
   stopMessageReader = false;
@@ -39,6 +39,7 @@ Receiver::Receiver(Config* cfg) {
   isPollsterStarted = false;
   isPollsterInitialized = false;
   stopPollster = false;
+  w1Devices = NULL;
 #endif
 #ifdef TEST_DECODING
   inputLogFilePath = NULL;
@@ -46,11 +47,13 @@ Receiver::Receiver(Config* cfg) {
   waitAfterReading = false;
 #elif defined(USE_GPIO_TS)
   fd = -1;
+#else
+  isCallbackThreadConfigured = false;
 #endif
   timerEvent = 0;
+  reloadEvent = 0;
 
-  firstMessage = NULL;
-  lastMessagePtr = &firstMessage;
+  batch = NULL;
 
   resetReceiverBuffer();
 
@@ -66,12 +69,17 @@ Receiver::Receiver(Config* cfg) {
 }
 Receiver::~Receiver() {
   stop();
-  if (isMessageQueueInitialized) {
-    isMessageQueueInitialized = false;
-    pthread_mutex_destroy(&messageQueueLock);
-  }
 
 #ifdef INCLUDE_POLLSTER
+  if (isPollsterStarted) {
+    // the pollster may be reading devices, it stops after the current poll
+    pthread_join(pollsterThreadId, NULL);
+    isPollsterStarted = false;
+  }
+  if (w1Devices != NULL) {
+    delete w1Devices; // stops reader threads and closes the inotify descriptor
+    w1Devices = NULL;
+  }
   if (isPollsterInitialized) {
     isPollsterInitialized = false;
     pthread_mutex_destroy(&pollsterLock);
@@ -236,19 +244,10 @@ void Receiver::close() {
 bool Receiver::enableReceive() {
   if (!isEnabled) {
     resetReceiverBuffer();
+    // Buffers of sequences are members of this object so they are pre-faulted with it.
+    if (cfg->lock_memory && lock_process_memory()) prefault(this, sizeof(Receiver));
     initLib();
-
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wunused-but-set-variable"
-    Protocol::setLimits(protocols, min_sequence_length, max_duration, min_duration);
-    if (min_sequence_length <= 16) min_sequence_length = MIN_SEQUENCE_LENGTH;
-    if (max_duration > 10000) max_duration = 10000;
-    if (min_duration < 30) min_duration = 30;
-    else if (min_duration > 8000) min_duration = 8000;
-    if (min_duration >= max_duration) {
-      max_duration = min_duration+2000;
-    }
-#pragma GCC diagnostic pop
+    initLimits();
 
 #ifdef TEST_DECODING
     startDecoder();
@@ -312,6 +311,21 @@ bool Receiver::enableReceive() {
   return true;
 }
 
+// Limits of durations and length of sequences that are required by enabled protocols.
+void Receiver::initLimits() {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-but-set-variable"
+  Protocol::setLimits(protocols, min_sequence_length, max_duration, min_duration);
+  if (min_sequence_length <= 16) min_sequence_length = MIN_SEQUENCE_LENGTH;
+  if (max_duration > 10000) max_duration = 10000;
+  if (min_duration < 30) min_duration = 30;
+  else if (min_duration > 8000) min_duration = 8000;
+  if (min_duration >= max_duration) {
+    max_duration = min_duration+2000;
+  }
+#pragma GCC diagnostic pop
+}
+
 void Receiver::disableReceive() {
   if (isEnabled) {
 #ifdef TEST_DECODING
@@ -358,12 +372,8 @@ void Receiver::stop() {
       // TODO ???
     }
   }
-  if (isMessageQueueInitialized) {
-    // notify all message processors
-    pthread_mutex_lock(&messageQueueLock);
-    pthread_cond_broadcast(&messageReady);
-    pthread_mutex_unlock(&messageQueueLock);
-  }
+  // notify the message processor
+  messageQueue.notify();
 }
 
 bool Receiver::isStopped() {
@@ -434,6 +444,8 @@ int Receiver::readSequences() {
           iPoolWrite = nextIndex;
           if (++iCurrentSequenceSize < MAX_SEQUENCE_LENGTH) continue; // done with updating the current sequence
           // the current sequence is already too long
+        } else {
+          statistics->pool_overflow++;
         }
       }
       //DBG("readSequences() => iCurrentSequenceSize=%d iPoolRead=%d iPoolWrite=%d", iCurrentSequenceSize, iPoolRead, iPoolWrite );
@@ -477,6 +489,7 @@ int Receiver::readSequences() {
         iSequenceSize[iSequenceWrite] = (int16_t)iCurrentSequenceSize;
         iSequenceStart[iSequenceWrite] = (int16_t)iCurrentSequenceStart;
         uSequenceStartTime[iSequenceWrite] = uCurrentSequenceStartTime;
+        uSequenceCloseTime[iSequenceWrite] = metrics_clock();
 
         iSequenceWrite = nextSequenceIndex;
 
@@ -549,88 +562,111 @@ int Receiver::readSequences() {
     // process data
     int n_items = bytes_read>>2;
     //DBG("readSequences() n_items=%d", n_items);
+    putItems(buffer, n_items);
+  }
+  return 1;
+}
 
-    for (int index=0; index<n_items; index++) {
-      uint32_t item = buffer[index];
-      int status = (int)item_to_status(item);
-      if ((status & ~1) == 0) {
-        int16_t duration = (int16_t)item_to_duration(item);
-        int nextIndex = (iPoolWrite+1)&(POOL_SIZE-1);
-
-        if (iPoolRead != nextIndex) { // checking free space in pool
-          pool[iPoolWrite] = duration;
-          iPoolWrite = nextIndex;
-
-          if (++iCurrentSequenceSize < MAX_SEQUENCE_LENGTH) continue; // done with updating the current sequence
+#endif
 
-          // the current sequence is already too long
-        }
+#if defined(USE_GPIO_TS)||defined(TEST_DECODING)
+// Puts items received from gpio-ts into the pool. Remaining items are lost if the queue of sequences is full.
+// In the test build it is called by the load test (tools/capture_load_test.cpp).
+void Receiver::putItems(uint32_t* buffer, int n_items) {
+  for (int index=0; index<n_items; index++) {
+    uint32_t item = buffer[index];
+    int status = (int)item_to_status(item);
+    if ((status & ~1) == 0) {
+      int16_t duration = (int16_t)item_to_duration(item);
+      int nextIndex = (iPoolWrite+1)&(POOL_SIZE-1);
+
+      if (iPoolRead != nextIndex) { // checking free space in pool
+        pool[iPoolWrite] = duration;
+        iPoolWrite = nextIndex;
+
+        if (++iCurrentSequenceSize < MAX_SEQUENCE_LENGTH) continue; // done with updating the current sequence
+
+        // the current sequence is already too long
+      } else {
+        statistics->pool_overflow++;
       }
+    }
 
-      // End of sequence
+    // End of sequence
 
-      if (iCurrentSequenceSize<(int)min_sequence_length) {
+    if (iCurrentSequenceSize<(int)min_sequence_length) {
 /* debug
-        if (iCurrentSequenceSize > 0) {
-          DBG("readSequences() => dropped %d iPoolRead=%d iPoolWrite=%d item=%d:%lu",
-              iCurrentSequenceSize, iPoolRead, iPoolWrite, status, item_to_duration(item));
-          for (int i = 0; i < n_items; i++) {
-            uint32_t item = buffer[i];
-            uint32_t duration = item_to_duration(item);
-            status = item_to_status(item);
-            if (i > 0) fputs(", ", stdout);
-            if (duration == GPIO_TS_MAX_DURATION) {
-                printf("%d:MAX", status);
-            } else {
-                printf("%d:%u", status, duration);
-            }
+      if (iCurrentSequenceSize > 0) {
+        DBG("readSequences() => dropped %d iPoolRead=%d iPoolWrite=%d item=%d:%lu",
+            iCurrentSequenceSize, iPoolRead, iPoolWrite, status, item_to_duration(item));
+        for (int i = 0; i < n_items; i++) {
+          uint32_t item = buffer[i];
+          uint32_t duration = item_to_duration(item);
+          status = item_to_status(item);
+          if (i > 0) fputs(", ", stdout);
+          if (duration == GPIO_TS_MAX_DURATION) {
+              printf("%d:MAX", status);
+          } else {
+              printf("%d:%u", status, duration);
           }
-          putchar('\n');
         }
+        putchar('\n');
+      }
 */
 
-        // drop the current sequence because it is too short
-        statistics->dropped++;
+      // drop the current sequence because it is too short
+      statistics->dropped++;
 
-        iPoolWrite = iCurrentSequenceStart;
+      iPoolWrite = iCurrentSequenceStart;
 
-        iCurrentSequenceSize = 0;
-        continue;
-      }
+      iCurrentSequenceSize = 0;
+      continue;
+    }
 
-      int nextSequenceIndex = (iSequenceWrite + 1)&(MAX_CHAINS-1);
+    int nextSequenceIndex = (iSequenceWrite + 1)&(MAX_CHAINS-1);
 
-      if (iSequenceReady == nextSequenceIndex) {
-        //DBG("readSequences() => sequence_pool_overflow %d", sequence_pool_overflow);
-        // overflow
-        statistics->sequence_pool_overflow++;
-        return 1;
-      }
+    if (iSequenceReady == nextSequenceIndex) {
+      //DBG("readSequences() => sequence_pool_overflow %d", sequence_pool_overflow);
+      // overflow
+      statistics->sequence_pool_overflow++;
+      return;
+    }
 
-      // Put new sequence into queue
+    // Put new sequence into queue
 
-      iSequenceSize[iSequenceWrite] = (int16_t)iCurrentSequenceSize;
-      iSequenceStart[iSequenceWrite] = (int16_t)iCurrentSequenceStart;
-      uSequenceStartTime[iSequenceWrite] = uCurrentSequenceStartTime;
+    iSequenceSize[iSequenceWrite] = (int16_t)iCurrentSequenceSize;
+    iSequenceStart[iSequenceWrite] = (int16_t)iCurrentSequenceStart;
+    uSequenceStartTime[iSequenceWrite] = uCurrentSequenceStartTime;
+    uSequenceCloseTime[iSequenceWrite] = metrics_clock();
 
-      iSequenceWrite = nextSequenceIndex;
+    iSequenceWrite = nextSequenceIndex;
 
-      iCurrentSequenceStart = iPoolWrite;
-      iCurrentSequenceSize = 0;
-      statistics->sequences++;
-    }
+    iCurrentSequenceStart = iPoolWrite;
+    iCurrentSequenceSize = 0;
+    statistics->sequences++;
   }
-  return 1;
 }
 
-#else // use pigpio
+#endif
+
+#if !defined(USE_GPIO_TS) && !defined(TEST_DECODING) // use pigpio
 
 void Receiver::interruptCallback(int gpio, int level, uint32_t tick, void* userdata) {
   Receiver* receiver = (Receiver*)userdata;
   receiver->handleInterrupt(level, tick);
 }
 
+#endif
+
+#if !defined(USE_GPIO_TS)
+// In the test build it is called by the load test (tools/capture_load_test.cpp).
 void Receiver::handleInterrupt(int level, uint32_t time) {
+#ifndef TEST_DECODING
+  if (!isCallbackThreadConfigured) { // callbacks are called by a thread of pigpio
+    isCallbackThreadConfigured = true;
+    configureThread("Interrupt callback");
+  }
+#endif
   statistics->interrupted++;
 
   uint32_t duration = time - nLastTime;
@@ -646,7 +682,10 @@ void Receiver::handleInterrupt(int level, uint32_t time) {
     if (duration <= min_duration) return; // interval is too short
 
     int nextIndex = (iPoolWrite+1)&(POOL_SIZE-1);
-    if (iPoolRead == nextIndex) return;	// no free space in pool
+    if (iPoolRead == nextIndex) { // no free space in pool
+      statistics->pool_overflow++;
+      return;
+    }
 
     // Start new sequence
 
@@ -738,6 +777,8 @@ void Receiver::handleInterrupt(int level, uint32_t time) {
 
       // the current sequence is already too long
     }
+  } else {
+    statistics->pool_overflow++;
   }
 
   // End of sequence
@@ -766,6 +807,7 @@ void Receiver::handleInterrupt(int level, uint32_t time) {
   iSequenceSize[iSequenceWrite] = (int16_t)iCurrentSequenceSize;
   iSequenceStart[iSequenceWrite] = (int16_t)iCurrentSequenceStart;
   uSequenceStartTime[iSequenceWrite] = uCurrentSequenceStartTime;
+  uSequenceCloseTime[iSequenceWrite] = metrics_clock();
 
 //  sequenceIsReady(nextSequenceIndex);
   iSequenceWrite = nextSequenceIndex;
@@ -782,6 +824,12 @@ void* Receiver::decoderThreadFunction(void *context) {
     return NULL;
 }
 
+// Applies settings of command "realtime" to the calling thread.
+void Receiver::configureThread(const char* thread_name) {
+  if (cfg->realtime_priority != 0 || cfg->realtime_cpus != 0) set_thread_realtime(thread_name, cfg->realtime_priority, cfg->realtime_cpus);
+  if (cfg->lock_memory) prefault_stack();
+}
+
 void Receiver::startDecoder() {
   //DBG("startDecoder()");
   if (!isDecoderStarted) {
@@ -789,8 +837,6 @@ void Receiver::startDecoder() {
     //pthread_mutex_init(&sequencePoolLock, NULL);
     //pthread_cond_init(&sequenceReadyForDecoding, NULL);
 
-    initMessageQueue();
-
     int rc = pthread_create(&decoderThreadId, NULL, decoderThreadFunction, (void*)this);
     if (rc != 0) {
       printf("Error code %d from pthread_create()\n", rc);
@@ -801,6 +847,7 @@ void Receiver::startDecoder() {
 
 void Receiver::decoder() {
   Log->log("Decoder thread has been started");
+  configureThread("Decoder"); // it also reads sequences from gpio-ts
   while (!stopDecoder) {
 #if defined(USE_GPIO_TS) || defined(TEST_DECODING)
 
@@ -821,38 +868,46 @@ void Receiver::decoder() {
     //pthread_mutex_lock(&sequencePoolLock);
     while (!stopDecoder && iSequenceReady == iSequenceWrite) {
       //pthread_cond_wait(&sequenceReadyForDecoding, &sequencePoolLock);
-      gpioSleep(PI_TIME_RELATIVE, 0, 500000); // = 0.5 second
+      gpioSleep(PI_TIME_RELATIVE, 0, DECODER_POLL_INTERVAL_US);
     }
     //pthread_mutex_unlock(&sequencePoolLock);
 #endif
 
-    ReceivedData* message = createNewMessage();
-    if (message == NULL) continue;
-
-    bool decoded = false;
-    for (int protocol_index = 0; protocol_index<NUMBER_OF_PROTOCOLS; protocol_index++) {
-      Protocol* protocol = Protocol::protocols[protocol_index];
-      if (protocol != NULL && (protocol->protocol_bit&protocols) != 0 && (protocol->getFeatures(NULL)&FEATURE_RF) != 0) {
-        message->decodingStatus = 0;
-        decoded = protocol->decode(message);
-        message->detailedDecodingStatus[protocol_index] = message->decodingStatus;
-        message->detailedDecodedBits[protocol_index] = message->decodedBits;
-        if (decoded) break;
-      }
-    }
-    // TODO do not queue the message if it is not decoded and no need to print undecoded messages.
-
-    // put new message into output queue
-    pthread_mutex_lock(&messageQueueLock);
-    *lastMessagePtr = message;
-    lastMessagePtr = &message->next;
-    pthread_cond_broadcast(&messageReady);
-    pthread_mutex_unlock(&messageQueueLock);
+    decodeSequence();
   }
   Log->log("Decoder stopped");
   isDecoderStarted = false;
 }
 
+// Decodes the next sequence from the pool and puts the message into the queue.
+void Receiver::decodeSequence() {
+  ReceivedData* message = createNewMessage();
+  if (message == NULL) return;
+  message->trace[TRACE_DECODE_STARTED] = metrics_clock();
+
+  bool decoded = false;
+  for (int protocol_index = 0; protocol_index<NUMBER_OF_PROTOCOLS; protocol_index++) {
+    Protocol* protocol = Protocol::protocols[protocol_index];
+    if (protocol != NULL && (protocol->protocol_bit&protocols) != 0 && (protocol->getFeatures(NULL)&FEATURE_RF) != 0) {
+      message->decodingStatus = 0;
+      decoded = protocol->decode(message);
+      message->detailedDecodingStatus[protocol_index] = message->decodingStatus;
+      message->detailedDecodedBits[protocol_index] = message->decodedBits;
+      if (decoded) break;
+    }
+  }
+  if (decoded)
+    statistics->decoded++;
+  else
+    statistics->undecoded++;
+  // TODO do not queue the message if it is not decoded and no need to print undecoded messages.
+
+  // put new message into output queue
+  message->trace[TRACE_DECODE_FINISHED] = metrics_clock();
+  __atomic_fetch_add(&statistics->queued, 1, __ATOMIC_RELAXED);
+  messageQueue.push(message);
+}
+
 
 #ifdef INCLUDE_POLLSTER
 void* Receiver::pollsterThreadFunction(void *context) {
@@ -868,7 +923,8 @@ void Receiver::startPollster() {
     isPollsterInitialized = true;
     pthread_cond_init(&pollsterCondition, NULL);
 
-    initMessageQueue();
+    if (w1Devices == NULL) w1Devices = new W1Devices();
+    w1Devices->setReaders(cfg->w1_readers);
 
     isPollsterStarted = true;
     int rc = pthread_create(&pollsterThreadId, NULL, pollsterThreadFunction, (void*)this);
@@ -883,154 +939,80 @@ void Receiver::startPollster() {
 void Receiver::pollster() {
   Log->log("Pollster thread has been started");
 
-  unsigned waittime = 15; // Poll interval in seconds TODO calculate
-
   struct timespec timeToWait;
 
+  pthread_mutex_lock(&pollsterLock);
   while (!stopPollster) {
-    pollW1();
+    pthread_mutex_unlock(&pollsterLock);
+    time_t next_poll = pollW1();
+    pthread_mutex_lock(&pollsterLock);
+    if (stopPollster || stopped) break;
 
     clock_gettime(CLOCK_REALTIME, &timeToWait);
-    timeToWait.tv_sec += waittime;
+    if (next_poll <= timeToWait.tv_sec) continue;
+    timeToWait.tv_sec = next_poll;
+    timeToWait.tv_nsec = 0;
 
     int rc = pthread_cond_timedwait(&pollsterCondition, &pollsterLock, &timeToWait);
     //DBG("Receiver::pollster() pthread_cond_timedwait() => %d", rc);
-    if (rc == 0) {
-      if (stopPollster || stopped) break;
-      continue;
-    }
-    if (rc != ETIMEDOUT) {
+    if (rc != 0 && rc != ETIMEDOUT) {
       printf("Error code %d from pthread_cond_timedwait()\n", rc);
       break;
     }
   }
+  pthread_mutex_unlock(&pollsterLock);
   Log->log("Pollster thread has been stopped");
   isDecoderStarted = false;
 }
 
-static uint32_t get_W1_id(const char* p) {
-  uint32_t result = 0;
-  for(int i=0; i<8; i++) {
-    result <<= 4;
-    char ch = *p++;
-    if (ch >= '0' && ch <= '9') {
-      result |= ch-'0';
-    } else if (ch >= 'a' && ch <= 'f') {
-      result |= ch-'a'+10;
-    } else return 0;
-  }
-  return result;
-}
-
-
-struct ReceivedDataDS18B20 : public ReceivedData {
-  char name[16];
-};
-
-// Poll DS18B20 devices
-void Receiver::pollW1() {
+// Poll DS18B20 devices whose time has come. Returns the time of the next poll.
+time_t Receiver::pollW1() {
+  time_t now = time(NULL);
 
   Protocol* protocol = Protocol::protocols[PROTOCOL_INDEX_DS18B20];
-  if (protocol == NULL || (protocol->protocol_bit&protocols) == 0) return;
-
-  ReceivedDataDS18B20* messages = NULL;
-  ReceivedDataDS18B20** last_msg_ptr = &messages;
-
-  struct dirent *ep;
-  DIR* dirp = opendir(W1_DEVICES_PATH);
-  if (dirp != NULL) {
-    while ((ep = readdir(dirp)) != NULL) {
-      // Ex: 28-000004ce62c7
-      const char* name = ep->d_name;
-      if (*name == '.') continue;
-      size_t namelen = strlen(name);
-      if (namelen != 15 || strncmp(name, "28-0000", 7) != 0) continue;
-      uint32_t id = get_W1_id(name+7);
-      if (id == 0) continue;
-
-      ReceivedDataDS18B20* message = (ReceivedDataDS18B20*)malloc(sizeof(ReceivedDataDS18B20));
-      memset((void*)message, 0, sizeof(ReceivedData));
-      memcpy(message->name, name, 15*sizeof(char));
-
-      message->sensorData.u32.hi = id;
-      message->sensorData.protocol = protocol;
-      message->sensorData.def = NULL;
-      *last_msg_ptr = message;
-      last_msg_ptr = (ReceivedDataDS18B20**)&message->next;
-    }
-    (void)closedir(dirp);
+  if (protocol == NULL || (protocol->protocol_bit&protocols) == 0) return now+W1_DEFAULT_POLL_INTERVAL;
+
+  W1Device** polled;
+  size_t polled_count = w1Devices->poll(now, polled);
+
+  ReceivedData* messages = NULL;
+  ReceivedData* last_message = NULL;
+  uint32_t count = 0;
+  for (size_t index = 0; index < polled_count; index++) {
+    W1Device* device = polled[index];
+    uint64_t id = ((uint64_t)PROTOCOL_INDEX_DS18B20<<48) | device->id;
+    SensorDef* def = SensorDef::find(id);
+    unsigned interval = def != NULL && def->poll_interval != 0 ? def->poll_interval : cfg->w1_poll_interval;
+    device->next_poll = now+interval;
+
+    ReceivedData* message = (ReceivedData*)malloc(sizeof(ReceivedData));
+    if (message == NULL) continue;
+    memset((void*)message, 0, sizeof(ReceivedData));
+    message->sensorData.u32.hi = device->id;
+    message->sensorData.u32.low = device->status == 0 ? device->value : 0;
+    message->sensorData.protocol = protocol;
+    message->sensorData.def = NULL;
+    message->decodingStatus = device->status;
+    message->detailedDecodingStatus[PROTOCOL_INDEX_DS18B20] = device->status;
+    message->trace[TRACE_DECODE_FINISHED] = metrics_clock(); // the value has been read
+    if (device->status != 0) statistics->w1_errors++;
+
+    if (last_message == NULL) messages = message; else last_message->next = message;
+    last_message = message;
+    count++;
   }
 
   if (messages != NULL) {
-    char filepath[W1_DEVICES_PATH_LEN+26]; // /sys/bus/w1/devices/28-000004ce62c7/w1_slave
-    strcpy(filepath, W1_DEVICES_PATH);
-    char* name_p = filepath+strlen(W1_DEVICES_PATH);
-    *name_p++ = '/';
-
-    ReceivedDataDS18B20* message = messages;
-    while (message != NULL) {
-      uint16_t decodingStatus = 1;
-      strcpy(name_p, message->name);
-      strcpy(name_p+15, "/w1_slave");
-        decodingStatus = 1;
-      FILE* file = fopen(filepath, "r");
-      if (file != NULL) {
-        ssize_t bytesread;
-        // 3e 01 4b 46 7f ff 02 10 6c : crc=6c YES
-        // 3e 01 4b 46 7f ff 02 10 6c t=19875
-        decodingStatus = 2;
-        if((bytesread=getline(&line_buffer, &line_buffer_len, file)) != -1 && bytesread >= 39 && strncmp(line_buffer+36, "YES", 3) == 0) {
-          decodingStatus = 3;
-          if((bytesread=getline(&line_buffer, &line_buffer_len, file)) != -1 && bytesread >= 30 && strncmp(line_buffer+27, "t=", 2) == 0) {
-            decodingStatus = 4;
-            const char* p = line_buffer+29;
-            long n = 0;
-            char ch = *p++;
-            if (ch>='0' && ch<='9') {
-              do {
-                n = n*10+(ch-'0');
-                ch = *p++;
-              } while (ch>='0' && ch<='9');
-              if (ch == '\0' || ch == '\n' || ch == '\r') {
-                message->sensorData.u32.low = (uint32_t)n;
-                decodingStatus = 0;
-              }
-            }
-          }
-        }
-        fclose(file);
-      } else {
-        message->decodingStatus |= 1;
-        //DBG("Receiver::pollW1() Could not open file\"%s\".", filepath);
-      }
-      message->decodingStatus = decodingStatus;
-      message->detailedDecodingStatus[PROTOCOL_INDEX_DS18B20] = decodingStatus;
-      message = (ReceivedDataDS18B20*)message->next;
-    }
-
     // Put new messages into output queue
-    pthread_mutex_lock(&messageQueueLock);
-
-    *lastMessagePtr = messages;
-    lastMessagePtr = (ReceivedData**)last_msg_ptr;
-
-    pthread_cond_broadcast(&messageReady);
-    pthread_mutex_unlock(&messageQueueLock);
+    __atomic_fetch_add(&statistics->queued, count, __ATOMIC_RELAXED);
+    messageQueue.push(messages, last_message);
   }
+  return w1Devices->getNextPollTime(now);
 }
 
 #endif
 
 
-void Receiver::initMessageQueue() {
-  //DBG("Receiver::initMessageQueue");
-  if (!isMessageQueueInitialized) {
-    pthread_mutex_init(&messageQueueLock, NULL);
-    pthread_cond_init(&messageReady, NULL);
-    isMessageQueueInitialized = true;
-  }
-}
-
 ReceivedData* Receiver::createNewMessage() {
   if (iSequenceReady == iSequenceWrite) return NULL;
 
@@ -1044,6 +1026,8 @@ ReceivedData* Receiver::createNewMessage() {
   ReceivedData* message = (ReceivedData*)ptr;
   message->iSequenceSize = iCurrentSequenceSize;
   message->uSequenceStartTime = uCurrentSequenceStartTime;
+  memset(message->trace, 0, sizeof(message->trace));
+  message->trace[TRACE_SEQUENCE_CLOSED] = uSequenceCloseTime[index];
 
   int16_t* pSequence = (int16_t*)((uint8_t*)ptr + sizeof(ReceivedData));
   message->pSequence = pSequence;
@@ -1078,25 +1062,50 @@ void Receiver::destroyMessage(ReceivedData* message) {
   free((void*)message);
 }
 
+// Messages are taken from the queue in batches so the main thread is woken up once per batch.
 bool Receiver::waitForMessage(ReceivedMessage& message) {
-  ReceivedData* data = NULL;
-
-  pthread_mutex_lock(&messageQueueLock);
-  while (!stopped && !stopMessageReader && timerEvent==0 && (data = firstMessage) == NULL) {
-    pthread_cond_wait(&messageReady, &messageQueueLock);
-  }
+  if (batch == NULL && !isEventRaised()) waitForMessages(batch, MESSAGE_BATCH_SIZE);
+  ReceivedData* data = batch;
   if (data != NULL) {
-    firstMessage = data->next;
-    if (firstMessage == NULL) lastMessagePtr = &firstMessage;
+    batch = data->next;
+    data->next = NULL;
+    data->trace[TRACE_DEQUEUED] = metrics_clock();
   }
-  pthread_mutex_unlock(&messageQueueLock);
-  if (data != NULL) data->next = NULL;
   message.setData(data);
   return data != NULL;
 }
 
+uint32_t Receiver::waitForMessages(ReceivedData*& batch, uint32_t max) {
+  ReceivedData** last_ptr = &batch;
+  uint32_t count = 0;
+  while (true) {
+    ReceivedData* data;
+    while (count < max && (data = messageQueue.pop()) != NULL) {
+      *last_ptr = data;
+      last_ptr = &data->next;
+      count++;
+    }
+    if (count != 0 || isEventRaised()) break;
+
+    // Flags of events are set before notify() so they are either seen here or the wait returns immediately.
+    uint32_t notifications = messageQueue.prepareWait();
+    if (!messageQueue.isEmpty() || isEventRaised()) {
+      messageQueue.cancelWait();
+      continue;
+    }
+    messageQueue.wait(notifications);
+  }
+  *last_ptr = NULL;
+  if (count != 0) __atomic_fetch_add(&statistics->dequeued, count, __ATOMIC_RELAXED);
+  return count;
+}
+
+bool Receiver::isEventRaised() {
+  return stopped || stopMessageReader || timerEvent != 0 || reloadEvent != 0;
+}
+
 bool Receiver::available() {
-  return firstMessage != NULL;
+  return batch != NULL || !messageQueue.isEmpty();
 }
 
 void Receiver::timerHandler(void *context) {
@@ -1106,9 +1115,7 @@ void Receiver::timerHandler(void *context) {
 
 void Receiver::raiseTimerEvent() {
   timerEvent = 1;
-  pthread_mutex_lock(&messageQueueLock);
-  pthread_cond_broadcast(&messageReady);
-  pthread_mutex_unlock(&messageQueueLock);
+  messageQueue.notify();
 
   if ((cfg->options&VERBOSITY_PRINT_STATISTICS) != 0) printStatistics();
 }
@@ -1117,6 +1124,15 @@ bool Receiver::checkAndResetTimerEvent() {
   return __sync_lock_test_and_set(&timerEvent, 0) != 0;
 }
 
+void Receiver::raiseReloadEvent() {
+  reloadEvent = 1;
+  messageQueue.notify();
+}
+
+bool Receiver::checkAndResetReloadEvent() {
+  return __sync_lock_test_and_set(&reloadEvent, 0) != 0;
+}
+
 void Receiver::setTimer(uint32_t millis) {
   if (uCurrentStatisticsTimer == millis) return; // ignore repeated calls
 
@@ -1153,17 +1169,31 @@ void Receiver::printStatisticsPeriodically(uint32_t millis) {
 
 void Receiver::printStatistics() {
 #ifdef TEST_DECODING
-  Log->info("statistics(%d): sequences=%ld dropped=%ld overflow=%ld\n",
-      gpio, statistics->sequences, statistics->dropped, statistics->sequence_pool_overflow);
+  Log->info("statistics(%d): sequences=%ld dropped=%ld overflow=%ld pool_overflow=%ld\n",
+      gpio, statistics->sequences, statistics->dropped, statistics->sequence_pool_overflow, statistics->pool_overflow);
 
 #elif defined(USE_GPIO_TS)
-  Log->info("statistics(%d): sequences=%ld dropped=%ld overflow=%ld\n",
-      gpio, statistics->sequences, statistics->dropped, statistics->sequence_pool_overflow);
+  Log->info("statistics(%d): sequences=%ld dropped=%ld overflow=%ld pool_overflow=%ld\n",
+      gpio, statistics->sequences, statistics->dropped, statistics->sequence_pool_overflow, statistics->pool_overflow);
 #else
-  printf("statistics: sequences=%d skipped=%d dropped=%d corrected=%d overflow=%d\n",
-      statistics->sequences, statistics->skipped, statistics->dropped, statistics->corrected, statistics->sequence_pool_overflow);
+  printf("statistics: sequences=%d skipped=%d dropped=%d corrected=%d overflow=%d pool_overflow=%d\n",
+      statistics->sequences, statistics->skipped, statistics->dropped, statistics->corrected, statistics->sequence_pool_overflow, statistics->pool_overflow);
 #endif
+  printLatencies();
+}
+// Medians and 99th percentiles of latencies of stages of messages since the start.
+void Receiver::printLatencies() {
+  char buffer[512];
+  int len = 0;
+  for (int index = 0; index < NUMBER_OF_LATENCIES && len < (int)sizeof(buffer); index++) {
+    const MetricsLatencyHistogram& histogram = statistics->latency[index];
+    uint32_t median = histogram.quantile(0.5);
+    if (median == 0) continue;
+    len += snprintf(buffer+len, sizeof(buffer)-len, " %s=%u/%u", latency_names[index], median, histogram.quantile(0.99));
+  }
+  if (len > 0) Log->info("latency(us p50/p99):%s", buffer);
 }
+
 void Receiver::printDebugStatistics() {
 #ifdef TEST_DECODING
 
@@ -1179,3 +1209,82 @@ void Receiver::printDebugStatistics() {
       statistics->interrupted, statistics->sequences, statistics->skipped, statistics->dropped, statistics->corrected, statistics->sequence_pool_overflow);
 #endif
 }
+
+#ifdef INCLUDE_HTTPD
+void Receiver::metricsCollector(void* context, MetricsWriter& writer) {
+  ((Receiver*)context)->writeMetrics(writer);
+}
+
+// Counters are read without locks, the decoder and the main loop are not blocked by requests /metrics.
+void Receiver::writeMetrics(MetricsWriter& writer) {
+  char labels[32];
+  snprintf(labels, sizeof(labels), "gpio=\"%d\"", gpio);
+
+  // receiver
+  writer.header("sequences_total", "counter", "Received sequences of pulses");
+  writer.value("sequences_total", labels, metrics_load(statistics->sequences));
+  writer.header("sequences_dropped_total", "counter", "Sequences dropped because they are too short or too long");
+  writer.value("sequences_dropped_total", labels, metrics_load(statistics->dropped));
+  writer.header("sequence_pool_overflows_total", "counter", "Sequences lost because the pool of sequences was full");
+  writer.value("sequence_pool_overflows_total", labels, metrics_load(statistics->sequence_pool_overflow));
+  writer.header("pulse_pool_overflows_total", "counter", "Pulses lost because the pool of durations was full");
+  writer.value("pulse_pool_overflows_total", labels, metrics_load(statistics->pool_overflow));
+#ifdef TEST_DECODING
+#elif defined(USE_GPIO_TS)
+  // counters of kernel module gpio-ts
+  long irq_data_overflow_counter = ioctl(fd, GPIOTS_IOCTL_GET_IRQ_OVERFLOW_CNT);
+  long buffer_overflow_counter = ioctl(fd, GPIOTS_IOCTL_GET_BUF_OVERFLOW_CNT);
+  long isr_counter = ioctl(fd, GPIOTS_IOCTL_GET_ISR_CNT);
+  if (isr_counter >= 0) {
+    writer.header("gpiots_interrupts_total", "counter", "Interrupts handled by gpio-ts");
+    writer.value("gpiots_interrupts_total", labels, isr_counter);
+  }
+  if (irq_data_overflow_counter >= 0) {
+    writer.header("gpiots_irq_overflows_total", "counter", "Interrupts lost by gpio-ts because its IRQ data buffer was full");
+    writer.value("gpiots_irq_overflows_total", labels, irq_data_overflow_counter);
+  }
+  if (buffer_overflow_counter >= 0) {
+    writer.header("gpiots_buffer_overflows_total", "counter", "Pulses lost by gpio-ts because its buffer was full");
+    writer.value("gpiots_buffer_overflows_total", labels, buffer_overflow_counter);
+  }
+#else
+  writer.header("interrupts_total", "counter", "Interrupts received from pigpio");
+  writer.value("interrupts_total", labels, metrics_load(statistics->interrupted));
+  writer.header("pulses_skipped_total", "counter", "Short pulses skipped by the noise filter");
+  writer.value("pulses_skipped_total", labels, metrics_load(statistics->skipped));
+  writer.header("pulses_corrected_total", "counter", "Pulses corrected by the noise filter");
+  writer.value("pulses_corrected_total", labels, metrics_load(statistics->corrected));
+#endif
+
+  // decoder
+  writer.counter("messages_decoded_total", "Sequences decoded by one of protocols", metrics_load(statistics->decoded));
+  writer.counter("messages_undecoded_total", "Sequences that were not decoded by any protocol", metrics_load(statistics->undecoded));
+  writer.counter("manchester_errors_total", "Sequences with bad Manchester code", metrics_load(statistics->bad_manchester));
+  writer.counter("manchester_out_of_sync_total", "Sequences with Manchester code out of sync", metrics_load(statistics->manchester_OOS));
+  writer.counter("w1_errors_total", "Failed reads of DS18B20 sensors", metrics_load(statistics->w1_errors));
+
+  // queue between the decoder and the main loop
+  uint32_t dequeued = metrics_load(statistics->dequeued);
+  uint32_t queued = metrics_load(statistics->queued);
+  int32_t length = (int32_t)(queued-dequeued);
+  writer.counter("queue_messages_total", "Messages put into the queue of received messages", queued);
+  writer.gauge("queue_length", "Messages waiting in the queue of received messages", length < 0 ? 0 : length);
+
+  // main loop, sinks and rules
+  writer.counter("messages_corrupted_total", "Decoded messages with wrong checksum", metrics_load(statistics->corrupted));
+  writer.counter("server_requests_total", "Requests to InfluxDB or REST server", metrics_load(statistics->server_requests));
+  writer.counter("server_errors_total", "Failed requests to InfluxDB or REST server", metrics_load(statistics->server_errors));
+  writer.header("server_request_duration_seconds", "histogram", "Duration of requests to InfluxDB or REST server");
+  writer.histogram("server_request_duration_seconds", NULL, statistics->server_request_duration);
+  writer.counter("mqtt_published_total", "Messages published to MQTT broker", metrics_load(statistics->mqtt_published));
+  writer.counter("mqtt_errors_total", "Messages that could not be published to MQTT broker", metrics_load(statistics->mqtt_errors));
+  writer.counter("rules_matched_total", "Rules with matched conditions", metrics_load(statistics->rules_matched));
+
+  // latencies of stages of messages, see TRACE_*
+  writer.header("message_latency_seconds", "histogram", "Latency of stages of messages from the end of the sequence of pulses to the acknowledgement of the sink");
+  for (int index = 0; index < NUMBER_OF_LATENCIES; index++) {
+    snprintf(labels, sizeof(labels), "stage=\"%s\"", latency_names[index]);
+    writer.histogram("message_latency_seconds", labels, statistics->latency[index]);
+  }
+}
+#endif
@@ -17,6 +17,7 @@
 
 #ifdef TEST_DECODING
 #include <unistd.h>
+#include "gpio-ts.h"
 #elif defined(USE_GPIO_TS)
 #include <unistd.h>
 #include <fcntl.h>
@@ -29,13 +30,20 @@
 
 #include "../utils/Logger.hpp"
 #include "../utils/Bits.hpp"
+#include "../utils/Metrics.hpp"
+#include "../utils/MessageQueue.hpp"
 #include "ReceivedMessage.hpp"
+#ifdef INCLUDE_POLLSTER
+#include "W1Devices.hpp"
+#endif
 
 #define POOL_SIZE 4096
 #define MAX_CHAINS 64
 #define MIN_SEQUENCE_LENGTH 85
 #define MAX_SEQUENCE_LENGTH 400
 #define MANCHESTER_BUFFER_SIZE 25
+#define MESSAGE_BATCH_SIZE 16
+#define DECODER_POLL_INTERVAL_US 500000 // pigpio build: how often the decoder checks for new sequences
 
 // Noise filter
 #define IGNORABLE_SKIP 60
@@ -79,11 +87,22 @@ public:
 
   bool available();
   bool waitForMessage(ReceivedMessage& message);
+  // Takes up to max queued messages linked through field "next". Waits if the queue is empty until a message
+  // is received or an event is raised. Returns the number of taken messages. The caller must free them.
+  uint32_t waitForMessages(ReceivedData*& batch, uint32_t max);
 
   bool checkAndResetTimerEvent();
+  // Wakes up the thread that waits for messages, e.g. when new configuration is ready to be applied.
+  void raiseReloadEvent();
+  bool checkAndResetReloadEvent();
   void printStatistics();
   void printStatisticsPeriodically(uint32_t millis);
   void printDebugStatistics();
+  void printLatencies();
+#ifdef INCLUDE_HTTPD
+  void writeMetrics(MetricsWriter& writer);
+  static void metricsCollector(void* context, MetricsWriter& writer);
+#endif
 
   void setProtocols(unsigned protocols);
 
@@ -117,20 +136,25 @@ private:
 
 #if defined(USE_GPIO_TS)||defined(TEST_DECODING)
   int readSequences();
-#else
+  void putItems(uint32_t* items, int n_items);
+#endif
+#if !defined(USE_GPIO_TS)
   void handleInterrupt(int level, uint32_t tick);
 #endif
   void endOfSequence();
+  void initLimits();
   void decoder();
+  void decodeSequence();
   void startDecoder();
-  void initMessageQueue();
+  void configureThread(const char* thread_name);
+  bool isEventRaised();
   void resetReceiverBuffer();
 
 #ifdef INCLUDE_POLLSTER
   static void* pollsterThreadFunction(void *context);
   void startPollster();
   void pollster();
-  void pollW1();
+  time_t pollW1();
 #endif
 
   void addBit(bool bit);
@@ -155,6 +179,9 @@ private:
 #elif defined(USE_GPIO_TS)
   int fd; // gpiots file
 #else
+  bool isCallbackThreadConfigured;
+#endif
+#if !defined(USE_GPIO_TS)
   int nNoiseFilterCounter;
   uint32_t nLastGoodTime;
 #endif
@@ -176,20 +203,18 @@ private:
 
   // cyclic buffer for sequences
   volatile uint32_t uSequenceStartTime[MAX_CHAINS];
+  volatile uint64_t uSequenceCloseTime[MAX_CHAINS]; // metrics_clock() when the end of the sequence was received
   volatile int16_t iSequenceStart[MAX_CHAINS];
   volatile int16_t iSequenceSize[MAX_CHAINS];
 
   // output queue
-  pthread_mutex_t messageQueueLock;
-  pthread_cond_t messageReady;
+  MessageQueue<ReceivedData> messageQueue;
+  ReceivedData* batch; // messages taken from the queue but not returned by waitForMessage() yet
 #ifdef INCLUDE_POLLSTER
   pthread_mutex_t pollsterLock;
   pthread_cond_t pollsterCondition;
 #endif
 
-  ReceivedData* firstMessage;
-  ReceivedData** lastMessagePtr;
-
   //pthread_mutex_t sequencePoolLock;
   //pthread_cond_t sequenceReadyForDecoding;
 
@@ -198,8 +223,7 @@ private:
 #ifdef INCLUDE_POLLSTER
   pthread_t pollsterThreadId;
 
-  char* line_buffer = NULL;
-  size_t line_buffer_len = 0;
+  W1Devices* w1Devices;
 
   bool isPollsterInitialized;
   bool isPollsterStarted;
@@ -211,14 +235,18 @@ private:
   bool isEnabled;
   bool isPollsterEnabled;
   bool isDecoderStarted;
-  bool isMessageQueueInitialized;
   bool stopDecoder;
   bool stopMessageReader;
   volatile bool stopped;
 #ifdef TEST_DECODING
   bool waitAfterReading;
 #endif
-  int timerEvent;
+  volatile int timerEvent;
+  volatile int reloadEvent;
+
+#ifdef TEST_DECODING
+  friend class CaptureLoadTest; // tools/capture_load_test.cpp feeds the capture path directly
+#endif
 };
 
 #endif
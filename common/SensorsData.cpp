@@ -17,7 +17,9 @@
 #include "SensorsData.hpp"
 #include "Config.hpp"
 
-SensorDef* SensorDef::sensorDefs = NULL;
+SensorDefs SensorDef::initialDefs;
+std::atomic<SensorDefs*> SensorDef::currentDefs(&SensorDef::initialDefs);
+thread_local SensorDefs* SensorDef::loadingDefs = NULL;
 
 //-------------------------------------------------------------
 void ActionRule::execute(const char* message, class Config& cfg) {
@@ -362,12 +364,14 @@ size_t SensorData::generateInfluxData(int start, void*& buffer, size_t& buffer_s
 }
 
 size_t SensorDataStored::generateJsonEx(int start, void*& buffer, size_t& buffer_size, int options) {
-  size_t size = generateJsonContent(start, buffer, buffer_size, options);
+  SensorData data;
+  getData(data);
+  size_t size = data.generateJsonContent(start, buffer, buffer_size, options);
   char* ptr = (char*)buffer+start;
   size_t remain = buffer_size-start;
 
 #ifdef INCLUDE_HTTPD
-  uint32_t features = getFeatures();
+  uint32_t features = data.getFeatures();
   if ((features&FEATURE_TEMPERATURE) != 0) {
     unsigned count = temperatureHistory.getCount();
     if (count != 0) {
@@ -397,6 +401,9 @@ size_t SensorDataStored::generateJsonEx(int start, void*& buffer, size_t& buffer
 size_t SensorDataStored::generateJsonLine(int start, void*& buffer, size_t& buffer_size, RestRequestType requestType, int options) {
   if (def == NULL || def->quoted == NULL) return 0;
 
+  SensorData data;
+  getData(data);
+
   if (requestType == RestRequestType::Brief) {
     Log->error("Invalid call of %s", "SensorDataStored::generateJsonLine");
     return 0;
@@ -417,25 +424,25 @@ size_t SensorDataStored::generateJsonLine(int start, void*& buffer, size_t& buff
   switch (requestType) {
   case RestRequestType::TemperatureF10:
   case RestRequestType::TemperatureC10:
-    if (!hasTemperature()) return 0;
-    len = snprintf(ptr, remain, "%s:%d", def->quoted, getTemperature10(requestType==RestRequestType::TemperatureC10));
+    if (!data.hasTemperature()) return 0;
+    len = snprintf(ptr, remain, "%s:%d", def->quoted, data.getTemperature10(requestType==RestRequestType::TemperatureC10));
     break;
 
   case RestRequestType::TemperatureF:
   case RestRequestType::TemperatureC:
-    if (!hasTemperature()) return 0;
-    len = snprintf(ptr, remain, "%s:%s", def->quoted, t2d(getTemperature10(requestType==RestRequestType::TemperatureC), t2d_buffer));
+    if (!data.hasTemperature()) return 0;
+    len = snprintf(ptr, remain, "%s:%s", def->quoted, t2d(data.getTemperature10(requestType==RestRequestType::TemperatureC), t2d_buffer));
 
     break;
 
   case RestRequestType::Humidity:
-    if (!hasHumidity()) return 0;
-    len = snprintf(ptr, remain, "%s:%d", def->quoted, getHumidity());
+    if (!data.hasHumidity()) return 0;
+    len = snprintf(ptr, remain, "%s:%d", def->quoted, data.getHumidity());
     break;
 
   case RestRequestType::Battery:
-    if (!hasBatteryStatus()) return 0;
-    len = snprintf(ptr, remain, "%s:%s", def->quoted, getBatteryStatus() ? "true" :"false");
+    if (!data.hasBatteryStatus()) return 0;
+    len = snprintf(ptr, remain, "%s:%s", def->quoted, data.getBatteryStatus() ? "true" :"false");
     break;
 
   default:
@@ -447,7 +454,10 @@ size_t SensorDataStored::generateJsonLine(int start, void*& buffer, size_t& buff
 size_t SensorDataStored::generateJsonLineBrief(int start, void*& buffer, size_t& buffer_size, time_t current_time, int options) {
   if (def == NULL || def->quoted == NULL) return 0;
 
-  const char* type_name = getSensorTypeLongName();
+  SensorData data;
+  getData(data);
+
+  const char* type_name = data.getSensorTypeLongName();
   if (type_name == NULL) return 0;
 
   // {"name":"Backyard","last":99999,"temperature":-33.6,"humidity":66,"battery_ok":true,"t_hist":10000,"h_hist":10000}
@@ -464,26 +474,26 @@ size_t SensorDataStored::generateJsonLineBrief(int start, void*& buffer, size_t&
   int len = snprintf(ptr, remain, "{\"name\":%s", def->quoted);
   if (!check_buffer(remain, len, "SensorDataStored::generateJsonLineBrief")) return 0;
 
-  if (data_time != 0) {
-    long diff_minutes = lround( difftime(current_time, data_time)/60 );
+  if (data.data_time != 0) {
+    long diff_minutes = lround( difftime(current_time, data.data_time)/60 );
     len += snprintf(ptr+len, remain-len, ",\"last\":%ld", diff_minutes);
     if (!check_buffer(remain, len, "SensorDataStored::generateJsonLineBrief")) return 0;
   }
 
-  bool hasT = hasTemperature();
+  bool hasT = data.hasTemperature();
   if (hasT) {
     char t2d_buffer[T2D_BUFFER_SIZE];
-    int t = getTemperature10((options&OPTION_CELSIUS) != 0);
+    int t = data.getTemperature10((options&OPTION_CELSIUS) != 0);
     len += snprintf(ptr+len, remain-len, ",\"temperature\":%s", t2d(t, t2d_buffer));
     if (!check_buffer(remain, len, "SensorDataStored::generateJsonLineBrief")) return 0;
   }
-  bool hasH = hasHumidity();
+  bool hasH = data.hasHumidity();
   if (hasH) {
-    len += snprintf(ptr+len, remain-len, ",\"humidity\":%d", getHumidity());
+    len += snprintf(ptr+len, remain-len, ",\"humidity\":%d", data.getHumidity());
     if (!check_buffer(remain, len, "SensorDataStored::generateJsonLineBrief")) return 0;
   }
-  if (hasBatteryStatus()) {
-    len += snprintf(ptr+len, remain-len, ",\"battery_ok\":%s", getBatteryStatus() ? "true" :"false");
+  if (data.hasBatteryStatus()) {
+    len += snprintf(ptr+len, remain-len, ",\"battery_ok\":%s", data.getBatteryStatus() ? "true" :"false");
     if (!check_buffer(remain, len, "SensorDataStored::generateJsonLineBrief")) return 0;
   }
 #ifdef INCLUDE_HTTPD
@@ -509,7 +519,10 @@ size_t SensorDataStored::generateJsonLineBrief(int start, void*& buffer, size_t&
 size_t SensorsData::generateJson(void*& buffer, size_t& buffer_size, RestRequestType requestType, int options) {
   int nItems = 0;
   SensorDataStored** snapshot = getSnapshot(nItems);
-  if (snapshot == NULL || nItems <= 0) return 0;
+  if (snapshot == NULL || nItems <= 0) {
+    releaseSnapshot();
+    return 0;
+  }
 
   size_t result;
   if (requestType == RestRequestType::AllData) {
@@ -570,7 +583,7 @@ size_t SensorsData::generateJson(void*& buffer, size_t& buffer_size, RestRequest
     result = total_len;
   }
 
-  free(snapshot);
+  releaseSnapshot();
   return result;
 }
 
@@ -23,9 +23,13 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <mutex>
+#include <atomic>
+#include <sched.h>
 #include "../utils/Logger.hpp"
 #include "../utils/Utils.hpp"
+#include "../utils/HashIndex.hpp"
 #include "../protocols/Protocol.hpp"
+#include "History.hpp"
 
 #define TEMPERATURE_IS_CHANGED       METRIC_TEMPERATURE
 #define HUMIDITY_IS_CHANGED          METRIC_HUMIDITY
@@ -35,8 +39,6 @@
 #define NEW_UID                      8
 #define TIME_NOT_CHANGED            16
 
-#define HISTORY_DEPTH_HOURS         24
-
 //-------------------------------------------------------------
 // Compiled message format
 
@@ -287,10 +289,30 @@ public:
 };
 
 
+//-------------------------------------------------------------
+// Set of sensor definitions from one configuration.
+// When configuration is reloaded a new set is built by the thread that parses it and then the set is published.
+// Replaced sets are never freed because other threads may still use their definitions.
+struct SensorDef;
+
+typedef struct SensorDefs {
+  struct SensorDef* first;
+  HashIndex<struct SensorDef> idIndex;
+  HashIndex<struct SensorDef> nameIndex;
+} SensorDefs;
+
 //-------------------------------------------------------------
 typedef struct SensorDef {
 private:
-  static SensorDef* sensorDefs;
+  static SensorDefs initialDefs;
+  static std::atomic<SensorDefs*> currentDefs;
+  static thread_local SensorDefs* loadingDefs; // the set that is being built by this thread
+
+  // The set that is being built by this thread (if any) or the current one.
+  static SensorDefs* defs() {
+    SensorDefs* result = loadingDefs;
+    return result != NULL ? result : currentDefs.load(std::memory_order_acquire);
+  }
 
   SensorDef* next;
 
@@ -304,28 +326,26 @@ public:
   const char* quoted;
   const char* influxdb_quoted;
   struct SensorDataStored* data;
+  unsigned poll_interval;                 // seconds, 0 means the default interval of polled sensors
 
   static SensorDef* find(uint64_t id) {
-    for (SensorDef* p = sensorDefs; p != NULL; p = p->next) {
-      if (p->id == id) return p;
-    }
-    return NULL;
+    return defs()->idIndex.find(id);
   }
 
   static SensorDef* find(const char* name) {
-    if (name != NULL) {
-      size_t len = strlen(name);
-      for (SensorDef* p = sensorDefs; p != NULL; p = p->next) {
-        if (p->name_len == len && strcmp(p->name, name) == 0) return p;
-      }
-    }
-    return NULL;
+    if (name == NULL) return NULL;
+    return find(name, strlen(name));
   }
 
   static SensorDef* find(const char* name, size_t name_len) {
     if (name != NULL) {
-      for (SensorDef* p = sensorDefs; p != NULL; p = p->next) {
-        if (p->name_len == name_len && strncmp(p->name, name, name_len) == 0) return p;
+      SensorDefs* sensorDefs = defs();
+      SensorDef* p = sensorDefs->nameIndex.find(HashIndex<SensorDef>::hash(name, name_len));
+      if (p != NULL && p->name_len == name_len && strncmp(p->name, name, name_len) == 0) return p;
+      if (p != NULL) { // hash collision
+        for (p = sensorDefs->first; p != NULL; p = p->next) {
+          if (p->name_len == name_len && strncmp(p->name, name, name_len) == 0) return p;
+        }
       }
     }
     return NULL;
@@ -345,9 +365,10 @@ public:
     if (name_len <= 0 || name == NULL) return SENSOR_NAME_MISSING;
     if (name_len > SENSOR_NAME_MAX_LEN) return SENSOR_NAME_TOO_LONG;
 
+    SensorDefs* sensorDefs = defs();
     unsigned new_index = 0;
-    SensorDef** pdef = &sensorDefs;
-    SensorDef* def = sensorDefs;
+    SensorDef** pdef = &sensorDefs->first;
+    SensorDef* def = sensorDefs->first;
     while (def != NULL) {
       if (def->id == id) {
         result = def;
@@ -410,225 +431,58 @@ public:
     def->next = NULL;
     def->rules = NULL;
     def->data = NULL;
+    def->poll_interval = 0;
     def->index = new_index;
     *pdef = def;
+    sensorDefs->idIndex.put(id, def);
+    uint64_t name_hash = HashIndex<SensorDef>::hash(sensor_name, name_len);
+    if (sensorDefs->nameIndex.find(name_hash) == NULL) sensorDefs->nameIndex.put(name_hash, def);
     result = def;
     return SENSOR_DEF_WAS_ADDED;
   }
 
-  void addRule(AbstractRuleWithSchedule* rule) {
-    if (rule != NULL) rule->linkTo(rules);
-  }
-  AbstractRuleWithSchedule* getRules() {
-    return rules;
-  }
-
-} SensorDef;
-
-//-------------------------------------------------------------
-enum class ValueConversion : int { None=0, F2C=1, C2F=2 };
-
-
-typedef struct HistoryData {
-  time_t time;
-  int32_t value;
-
-  size_t generateJson(int start, void*& buffer, size_t& buffer_size, ValueConversion convertion, bool x10, bool time_UTC) {
-
-    char dt[TIME2STR_BUFFER_SIZE];
-    convert_time(&time, dt, TIME2STR_BUFFER_SIZE, time_UTC);
-
-    // {"t":"2020-12-31 00:00:00+05:00","y":-12345678900}
-    size_t required_buffer_size = (size_t)start+(strlen(dt)+12+14)*sizeof(unsigned char);
-    char* ptr = (char*)resize_buffer(required_buffer_size, buffer, buffer_size)+start;
-    size_t remain = buffer_size-start;
-
-    int32_t converted_value = value;
-    switch (convertion) {
-    case ValueConversion::None:
-      break;
-    case ValueConversion::F2C:
-      converted_value = ((value-320)*5)/9;
-      break;
-    case ValueConversion::C2F:
-      converted_value = (value*9)/5+320;
-      break;
-    }
-    int len;
-    if (x10) {
-      len = snprintf(ptr, remain, "{\"t\":\"%s\",\"y\":%d}", dt, converted_value );
-    } else {
-      char t2d_buffer[T2D_BUFFER_SIZE];
-      uint32_t dummy = 0;
-      len = snprintf(ptr, remain, "{\"t\":\"%s\",\"y\":%s}", dt, t2d(converted_value, t2d_buffer, dummy));
-    }
-
-    return (size_t)len;
+  // Definitions added by this thread go to a new empty set until endLoading() is called.
+  // Other threads keep using the current set.
+  static void beginLoading() {
+    SensorDefs* sensorDefs = new SensorDefs();
+    sensorDefs->first = NULL;
+    loadingDefs = sensorDefs;
   }
 
-} HistoryData;
-
-
-typedef struct HistoryListItem {
-  HistoryListItem* next;
-  HistoryData data;
-} HistoryListItem;
-
-
-typedef struct History {
-private:
-  HistoryListItem* first;
-  HistoryListItem* last;
-  std::mutex chain_mutex;
-  RestRequestType datatype;
-  unsigned count;
-
-public:
-  HistoryListItem* add(time_t time, int32_t value) {
-    HistoryListItem* item = new HistoryListItem();
-    item->data.time = time;
-    item->data.value = value;
-    item->next = NULL;
-    chain_mutex.lock();
-    if (last != NULL) last->next = item;
-    last = item;
-    if  (first == NULL) first = item;
-    count++;
-    chain_mutex.unlock();
-    return item;
+  // Returns the set that was built by this thread. It has not been published yet.
+  static SensorDefs* endLoading() {
+    SensorDefs* result = loadingDefs;
+    loadingDefs = NULL;
+    return result;
   }
 
-  bool isEmpty() {
-    return first == NULL;
+  // Frees a set that has never been published, e.g. if reloaded configuration is not valid.
+  static void discard(SensorDefs* sensorDefs) {
+    if (sensorDefs == NULL) return;
+    SensorDef* def = sensorDefs->first;
+    while (def != NULL) {
+      SensorDef* next = def->next;
+      free((void*)def->name); // quoted names are in the same block
+      free(def);
+      def = next;
+    }
+    delete sensorDefs;
   }
 
-  unsigned getCount() { return count; }
-
-  void truncate() {
-    struct tm tm;
-    time_t now = time(NULL);
-    localtime_r(&now, &tm);
-    tm.tm_hour -= HISTORY_DEPTH_HOURS;
-    time_t from_time = mktime(&tm);
-    truncate(from_time);
+  // Makes the set current for all threads.
+  static void publish(SensorDefs* sensorDefs) {
+    if (sensorDefs != NULL) currentDefs.store(sensorDefs, std::memory_order_release);
   }
 
-  void truncate(time_t from) {
-    chain_mutex.lock();
-    HistoryListItem* record = first;
-    if (record == NULL) {
-      last = NULL;
-    } else {
-      if (from != 0) {
-        while (record != NULL && record->data.time < from) {
-          HistoryListItem* next = record->next;
-          delete record;
-          first = record = next;
-          if ( record == NULL) last = NULL;
-          count--;
-        }
-      }
-    }
-    chain_mutex.unlock();
+  void addRule(AbstractRuleWithSchedule* rule) {
+    if (rule != NULL) rule->linkTo(rules);
   }
-
-  // Copy data for the requested time range.
-  // Return the size of result array in argument count.
-  HistoryData* get(time_t from, time_t to, unsigned& count) {
-    HistoryData* result = NULL;
-    count = 0;
-
-    time_t truncate_time = 0;
-    if (from == 0) {
-      struct tm tm;
-      time_t now = time(NULL);
-      localtime_r(&now, &tm);
-      tm.tm_hour -= HISTORY_DEPTH_HOURS;
-      truncate_time = mktime(&tm);
-    }
-
-    chain_mutex.lock();
-
-    HistoryListItem* record = first;
-    if (record != NULL) {
-      if (truncate_time != 0) {
-        // remove outdated history
-        while (record != NULL && record->data.time < truncate_time) {
-          HistoryListItem* next = record->next;
-          delete record;
-          first = record = next;
-          if ( record == NULL) last = NULL;
-          count--;
-        }
-      }
-      if (record != NULL && from != 0) {
-        while (record != NULL && record->data.time >= from) record = record->next;
-      }
-
-      if (record != NULL) {
-        HistoryListItem* r = record;
-        int result_size = 0;
-        do {
-          if (to != 0 && r->data.time > to) break;
-          result_size++;
-        } while ((r = r->next) != NULL);
-        if (result_size > 0) {
-          count = result_size;
-          HistoryData* pdata = result = (HistoryData*)calloc(result_size, sizeof(HistoryData));
-          r = record;
-          for (int index = 0; index<result_size; index++) {
-            pdata->time = r->data.time;
-            pdata->value = r->data.value;
-            pdata++;
-            r = r->next;
-          }
-        }
-      }
-    }
-    chain_mutex.unlock();
-
-    return result;
+  AbstractRuleWithSchedule* getRules() {
+    return rules;
   }
 
-  size_t generateJson(time_t from, time_t to, void*& buffer, size_t& buffer_size, ValueConversion convertion, bool x10, bool time_UTC) {
-    unsigned count = 0;
-
-    // Take all requested items safely first then generate JSON
-    HistoryData* pdata = get(from, to, count);
-    if (pdata == NULL || count == 0) return 0;
-
-// {"t":"2020-12-31 00:00:00+05:00","y":-12345678900}
-#define JSON_HISTORY_RECORD_SIZE  54
-    // [<record>,<record>]
-    size_t required_buffer_size = (count*(JSON_HISTORY_RECORD_SIZE+1)-1+3)*sizeof(unsigned char);
-    char* pchars = (char*)resize_buffer(required_buffer_size, buffer, buffer_size);
-    size_t len = 1;
-    size_t total_len = 1;
-    *pchars = '[';
-    pchars[1]  = '\0';
-    HistoryData* pd = pdata;
-    for (unsigned index = 0; index<count; index++) {
-      if (total_len > 1) {
-        pchars[total_len] = ',';
-        pchars[++total_len] = '\0';
-      }
-      len = pd->generateJson(total_len, buffer, buffer_size, convertion, x10, time_UTC);
-      if (len > 0) {
-        total_len += len;
-      } else if (total_len > 1) { // remove last comma
-        pchars[--total_len] = '\0';
-      }
-      pd++;
-    }
-
-    pchars[total_len++] = ']';
-    pchars[total_len] = '\0';
-
-    free((void*)pdata);
-    return total_len;
-  }
+} SensorDef;
 
-} History;
 
 
 //-------------------------------------------------------------
@@ -752,11 +606,36 @@ public:
 } SensorData;
 
 typedef struct SensorDataStored : SensorData  {
+  // Seqlock for fields of SensorData: the value is odd while the main thread updates them.
+  // Other threads must read these fields with getData().
+  std::atomic<uint32_t> sequence;
+  time_t last_seen; // updated by the main thread only
+  uint32_t received; // number of received messages, updated by the main thread only
+  bool was_defined;  // the sensor has been defined in configuration (maybe before reloading), such items are never evicted
 #ifdef INCLUDE_HTTPD
   History temperatureHistory;
   History humidityHistory;
 #endif
 
+  void beginUpdate() {
+    sequence.store(sequence.load(std::memory_order_relaxed)+1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+
+  void endUpdate() {
+    sequence.store(sequence.load(std::memory_order_relaxed)+1, std::memory_order_release);
+  }
+
+  // Get consistent copy of the current data. The writer is never blocked by readers.
+  void getData(SensorData& data) {
+    uint32_t seq;
+    do {
+      while (((seq = sequence.load(std::memory_order_acquire))&1) != 0) sched_yield();
+      memcpy((void*)&data, (void*)static_cast<SensorData*>(this), sizeof(SensorData));
+      std::atomic_thread_fence(std::memory_order_acquire);
+    } while (sequence.load(std::memory_order_relaxed) != seq);
+  }
+
   size_t generateJsonEx(int start, void*& buffer, size_t& buffer_size, int options); // includes history counts
   size_t generateJsonLine(int start, void*& buffer, size_t& buffer_size, RestRequestType requestType, int options);
   size_t generateJsonLineBrief(int start, void*& buffer, size_t& buffer_size, time_t current_time, int options);
@@ -765,14 +644,133 @@ typedef struct SensorDataStored : SensorData  {
 
 //-------------------------------------------------------------
 
+//-------------------------------------------------------------
+// Immutable list of stored sensors. A new list is published on each change of the set of sensors.
+typedef struct SensorsList {
+  SensorsList* retired;
+  SensorDataStored* evicted; // the item that was removed from this list when it was replaced
+  int size;
+  SensorDataStored* items[1];
+} SensorsList;
+
+typedef struct SensorsDataStatistics {
+  uint32_t evicted_expired;  // undefined sensors removed after TTL
+  uint32_t evicted_lru;      // undefined sensors removed because the table was full
+  uint32_t rejected;         // new undefined sensors that were not stored because the table was full
+} SensorsDataStatistics;
+
+// How often undefined sensors are checked for expiration (seconds)
+#define SENSORS_EXPIRATION_CHECK_INTERVAL 60
+
+// Called after the data of a defined sensor has been changed. It is called in the thread that updates
+// sensors data so it must not block.
+typedef void (*SensorsDataListener)(void* context, SensorDataStored* item, int changed);
+
 class SensorsData {
 private:
-  std::mutex items_mutex;
-  SensorDataStored** items;
-  int size;
-#define SENSORS_DATA_INITIAL_CAPACITY 32
-  int capacity;
+  std::mutex items_mutex; // serializes changes of the list
+  HashIndex<SensorDataStored> id_index; // key is Protocol::getId()
+  std::atomic<SensorsList*> items;
+  SensorsList* retired;   // replaced lists that still may be used by readers
+  std::atomic<int> readers;
+  std::atomic<uint32_t> generation; // incremented on any change of stored data
   int options;
+  unsigned max_count;       // 0 means unlimited
+  unsigned undefined_ttl;   // seconds, 0 means unlimited
+  time_t next_expiration_check;
+  // counters of SensorsDataStatistics, they are read by threads of HTTPD
+  std::atomic<uint32_t> evicted_expired;
+  std::atomic<uint32_t> evicted_lru;
+  std::atomic<uint32_t> rejected;
+  SensorsDataListener listener;
+  void* listener_context;
+
+  static void freeItem(SensorDataStored* item) {
+#ifdef INCLUDE_HTTPD
+    item->temperatureHistory.clear();
+    item->humidityHistory.clear();
+#endif
+    free(item);
+  }
+
+  static SensorsList* allocList(int size) {
+    SensorsList* list = (SensorsList*)calloc(1, sizeof(SensorsList)+(size > 0 ? size-1 : 0)*sizeof(SensorDataStored*));
+    if (list != NULL) list->size = size;
+    return list;
+  }
+
+  // Must be called with locked items_mutex.
+  void publish(SensorsList* list, SensorDataStored* evicted) {
+    SensorsList* old = items.exchange(list);
+    if (old != NULL) {
+      old->retired = retired;
+      old->evicted = evicted;
+      retired = old;
+    }
+    // Readers that come after this point see the new list only.
+    if (readers.load() == 0) {
+      while (retired != NULL) {
+        SensorsList* next = retired->retired;
+        if (retired->evicted != NULL) freeItem(retired->evicted);
+        free(retired);
+        retired = next;
+      }
+    }
+  }
+
+  // Remove sensor from the table. Must be called with locked items_mutex.
+  bool evict(SensorDataStored* item) {
+    SensorsList* list = items.load();
+    if (list == NULL) return false;
+    SensorsList* new_list = allocList(list->size-1);
+    if (new_list == NULL) {
+      Log->error("Out of memory");
+      return false;
+    }
+    int new_index = 0;
+    for (int index = 0; index<list->size; index++) {
+      SensorDataStored* p = list->items[index];
+      if (p != item) new_list->items[new_index++] = p;
+    }
+    if (new_index == list->size) { // not found
+      free(new_list);
+      return false;
+    }
+    id_index.remove(item->getId());
+    publish(new_list, item);
+    generation++;
+    return true;
+  }
+
+  // Find the least recently heard sensor without definition. Must be called with locked items_mutex.
+  SensorDataStored* findLeastRecentlyHeardUndefined() {
+    SensorsList* list = items.load();
+    if (list == NULL) return NULL;
+    SensorDataStored* result = NULL;
+    for (int index = 0; index<list->size; index++) {
+      SensorDataStored* p = list->items[index];
+      if (p->def == NULL && !p->was_defined && (result == NULL || p->last_seen < result->last_seen)) result = p;
+    }
+    return result;
+  }
+
+  // Remove undefined sensors that were not heard during undefined_ttl seconds.
+  void evictExpired(time_t now) {
+    if (undefined_ttl == 0 || now < next_expiration_check) return;
+    next_expiration_check = now+SENSORS_EXPIRATION_CHECK_INTERVAL;
+    time_t expiration_time = now-undefined_ttl;
+    items_mutex.lock();
+    SensorDataStored* item;
+    while ((item = findLeastRecentlyHeardUndefined()) != NULL && item->last_seen < expiration_time) {
+#ifndef NDEBUG
+      uint64_t id = item->getId();
+      DBG("Removed expired undefined sensor id=%08lx %08lx", (long unsigned)(id>>32), (long unsigned)(id &0xffffffffU));
+#endif
+      if (!evict(item)) break;
+      evicted_expired.fetch_add(1, std::memory_order_relaxed);
+    }
+    items_mutex.unlock();
+  }
 
   SensorDataStored* add(SensorData* data, time_t& data_time) {
     SensorDataStored* new_item = (SensorDataStored*)calloc(1, sizeof(SensorDataStored));
@@ -807,22 +805,39 @@ private:
       }
     }
 
+    new_item->last_seen = time(NULL);
+    new_item->received = 1;
+    new_item->was_defined = def != NULL;
+
     items_mutex.lock();
 
-    int new_index = size;
-    int new_size = size+1;
-    if (new_size > capacity) {
-      int new_capacity = capacity + 8;
-      SensorDataStored** new_items = (SensorDataStored**)realloc(items, new_capacity*sizeof(SensorDataStored*));
-      if (new_items != NULL) {
+    SensorsList* list = items.load();
+    int size = list == NULL ? 0 : list->size;
+    if (max_count != 0 && (unsigned)size >= max_count) {
+      // The table is full. Replace the least recently heard sensor that has no definition.
+      SensorDataStored* lru = findLeastRecentlyHeardUndefined();
+      if (lru == NULL && def == NULL) {
         items_mutex.unlock();
-        Log->error("Out of memory");
+        free(new_item);
+        rejected.fetch_add(1, std::memory_order_relaxed);
         return NULL;
       }
-      items = new_items;
-      capacity = new_capacity;
+      if (lru != NULL && evict(lru)) {
+        evicted_lru.fetch_add(1, std::memory_order_relaxed);
+        list = items.load();
+        size = list == NULL ? 0 : list->size;
+      }
     }
+    SensorsList* new_list = allocList(size+1);
+    if (new_list == NULL) {
+      items_mutex.unlock();
+      free(new_item);
+      Log->error("Out of memory");
+      return NULL;
+    }
+    if (size > 0) memcpy(new_list->items, list->items, size*sizeof(SensorDataStored*));
 
+    int new_index = size;
     if (def != NULL && new_index > 0) {
       // Insert new item accordingly to the order of sensor definitions in configuration file.
       // Then any REST requests will return data with respect of the order of definitions in configuration file.
@@ -830,15 +845,18 @@ private:
       unsigned def_index = def->index;
       // Bubble insert from the end of the array.
       do {
-        SensorDataStored* item = items[new_index-1];
+        SensorDataStored* item = new_list->items[new_index-1];
         SensorDef* item_def = item->def;
         if (item_def != NULL && item_def->index <= def_index) break;
-        items[new_index] = item;
+        new_list->items[new_index] = item;
       } while (--new_index > 0);
     }
 
-    items[new_index] = new_item;
-    size = new_size;
+    new_list->items[new_index] = new_item;
+    if (!id_index.put(data->getId(), new_item)) Log->error("Out of memory");
+    if (def != NULL) __atomic_store_n(&def->data, new_item, __ATOMIC_RELEASE);
+    publish(new_list, NULL);
+    generation++;
 
     items_mutex.unlock();
 #ifdef INCLUDE_HTTPD
@@ -850,91 +868,101 @@ private:
     return new_item;
   }
 
+  // Returns the current list of stored sensors without copying.
+  // The list must be released with releaseSnapshot() even if count is 0.
   SensorDataStored** getSnapshot(int& count) {
-    SensorDataStored** result = NULL;
-    count = 0;
-    items_mutex.lock();
-    if (size > 0) {
-      size_t copy_size = size*sizeof(SensorDataStored*);
-      result = (SensorDataStored**)malloc(copy_size);
-      if (result != NULL) {
-        memcpy(result, items, copy_size);
-        count = size;
-      }
+    readers++;
+    SensorsList* list = items.load();
+    if (list == NULL) {
+      count = 0;
+      return NULL;
     }
-    items_mutex.unlock();
-    return result;
+    count = list->size;
+    return list->items;
+  }
+
+  void releaseSnapshot() {
+    readers--;
   }
 
   size_t generateJsonAllData(SensorDataStored** items, int nItems, void*& buffer, size_t& buffer_size, int options);
 
 public:
   SensorsData(int options) {
-    items = (SensorDataStored**)calloc(SENSORS_DATA_INITIAL_CAPACITY, sizeof(SensorDataStored*));
-    capacity = SENSORS_DATA_INITIAL_CAPACITY;
-    size = 0;
+    items.store(NULL);
+    retired = NULL;
+    readers.store(0);
+    generation.store(0);
     this->options = options;
+    max_count = 0;
+    undefined_ttl = 0;
+    next_expiration_check = 0;
+    evicted_expired.store(0);
+    evicted_lru.store(0);
+    rejected.store(0);
+    listener = NULL;
+    listener_context = NULL;
   }
-  SensorsData(int capacity, int options) {
-    if (capacity <= 0) capacity = SENSORS_DATA_INITIAL_CAPACITY;
-    items = (SensorDataStored**)calloc(capacity, sizeof(SensorDataStored*));
-    this->capacity = capacity;
-    size = 0;
-    this->options = options;
+  SensorsData(int capacity, int options) : SensorsData(options) {
   }
 
   ~SensorsData() {
     items_mutex.lock();
-    if ( items != NULL) {
-      for (int index = 0; index<size; index++) {
-        SensorDataStored* item = items[index];
+    SensorsList* list = items.exchange(NULL);
+    if (list != NULL) {
+      for (int index = 0; index<list->size; index++) {
+        SensorDataStored* item = list->items[index];
         if (item != NULL) {
-          free(item);
-          items[index] = NULL;
+          freeItem(item);
+          list->items[index] = NULL;
         }
       }
-      free(items);
-      items = NULL;
+      free(list);
+    }
+    while (retired != NULL) {
+      SensorsList* next = retired->retired;
+      if (retired->evicted != NULL) freeItem(retired->evicted);
+      free(retired);
+      retired = next;
     }
-    size = 0;
-    capacity = 0;
     items_mutex.unlock();
   }
 
-  inline int getSize() { return size; }
+  inline int getSize() {
+    SensorsList* list = items.load();
+    return list == NULL ? 0 : list->size;
+  }
 
   int getOptions() { return options; }
-/*
-  SensorDataStored* getData(Protocol* protocol, int channel, uint8_t rolling_code = -1) {
-    if (protocol == NULL) return NULL;
-    SensorDataStored* result = NULL;
-    items_mutex.lock();
-    for (int index = 0; index<size; index++) {
-      SensorDataStored* p = items[index];
-      if (p != NULL && p->protocol == protocol && protocol->sameId(p, channel, rolling_code)) {
-        result = p;
-        break;
-      }
-    }
-    items_mutex.unlock();
-    return result;
+
+  // Limit the number of stored sensors and the time of keeping sensors that are not defined in configuration.
+  void setLimits(unsigned max_count, unsigned undefined_ttl) {
+    this->max_count = max_count;
+    this->undefined_ttl = undefined_ttl;
+  }
+
+  unsigned getMaxCount() { return max_count; }
+
+  void setListener(SensorsDataListener listener, void* context) {
+    this->listener_context = context;
+    this->listener = listener;
+  }
+
+  void getStatistics(SensorsDataStatistics& result) {
+    result.evicted_expired = evicted_expired.load(std::memory_order_relaxed);
+    result.evicted_lru = evicted_lru.load(std::memory_order_relaxed);
+    result.rejected = rejected.load(std::memory_order_relaxed);
   }
-*/
+
+  // The generation is changed on any change of stored data. It can be used to validate cached responses.
+  uint32_t getGeneration() { return generation.load(std::memory_order_acquire); }
+
   SensorDataStored* find(SensorData* sensorData) {
-    SensorDataStored* result = NULL;
     Protocol* protocol = sensorData->protocol;
-    if (protocol != NULL ) {
-      items_mutex.lock();
-      for (int index = 0; index<size; index++) {
-        SensorDataStored* p = items[index];
-        if (p != NULL && protocol == p->protocol && protocol->equals(sensorData, p)) {
-          result = p;
-          break;
-        }
-      }
-      items_mutex.unlock();
-    }
-    return result;
+    if (protocol == NULL) return NULL;
+    SensorDataStored* p = id_index.find(protocol->getId(sensorData));
+    if (p != NULL && protocol == p->protocol && protocol->equals(sensorData, p)) return p;
+    return NULL;
   }
 
   // Find sensor data by the name defined in the config
@@ -950,20 +978,16 @@ public:
     return def == NULL ? NULL : find(def);
   }
 
+  // Called by threads of HTTPD. Only the thread that updates data sets def->data. Items of defined sensors
+  // are never evicted so the result can be used after the reader count is released.
   SensorDataStored* find(SensorDef* def) {
     if (def == NULL) return NULL;
-    SensorDataStored* result = def->data;
+    SensorDataStored* result = __atomic_load_n(&def->data, __ATOMIC_ACQUIRE);
     if (result == NULL) {
-      items_mutex.lock();
-      for (int index = 0; index<size; index++) {
-        SensorDataStored* sensorData = items[index];
-        if (sensorData != NULL && sensorData->def == def) {
-          result = sensorData;
-          def->data = sensorData;
-          break;
-        }
-      }
-      items_mutex.unlock();
+      readers++;
+      result = id_index.find(def->id);
+      if (result != NULL && __atomic_load_n(&result->def, __ATOMIC_ACQUIRE) != def) result = NULL;
+      readers--;
     }
     return result;
   }
@@ -972,19 +996,27 @@ public:
     Protocol* protocol = sensorData->protocol;
     if (protocol == NULL) return 0;
 
+    time_t now = time(NULL);
+    evictExpired(now);
+
     int changed;
     SensorDataStored* item = find(sensorData);
     if (item != NULL) {
+      item->last_seen = now;
+      item->received++;
+      item->beginUpdate();
       changed = protocol->update(sensorData, item, data_time, max_unchanged_gap);
+      item->endUpdate();
+      if (changed != 0) generation++;
     } else {
       // A new (unknown) sensor
-      item = add(sensorData, data_time);
       changed = protocol->getMetrics(sensorData) | NEW_UID;
+      item = add(sensorData, data_time);
+      if (item == NULL) return changed;
     }
 #ifdef INCLUDE_HTTPD
     if (item->def != NULL && (changed&DATA_IS_CHANGED) != 0) {
       struct tm tm;
-      time_t now = time(NULL);
       localtime_r(&now, &tm);
       tm.tm_hour -= HISTORY_DEPTH_HOURS;
       time_t from_time = mktime(&tm);
@@ -998,20 +1030,85 @@ public:
       }
     }
 #endif
+    if (listener != NULL && item->def != NULL && (changed&(DATA_IS_CHANGED|BATTERY_STATUS_IS_CHANGED)) != 0) {
+      listener(listener_context, item, changed);
+    }
     return changed;
   }
 
+  // Binds stored items to the sensor definitions that have been published after reloading of configuration
+  // and orders them accordingly to the new order of definitions. Must be called by the thread that updates data.
+  void rebindDefinitions() {
+    items_mutex.lock();
+    SensorsList* list = items.load();
+    int size = list == NULL ? 0 : list->size;
+    SensorsList* new_list = allocList(size);
+    if (new_list == NULL) {
+      items_mutex.unlock();
+      Log->error("Out of memory");
+      return;
+    }
+    for (int index = 0; index<size; index++) {
+      SensorDataStored* item = list->items[index];
+      SensorDef* def = SensorDef::find(item->getId());
+      if (def != item->def) {
+        item->beginUpdate();
+        __atomic_store_n(&item->def, def, __ATOMIC_RELEASE);
+        item->endUpdate();
+      }
+      int new_index = index;
+      if (def != NULL) {
+        __atomic_store_n(&def->data, item, __ATOMIC_RELEASE);
+        item->was_defined = true;
+        // Bubble insert like in add(): undefined sensors are moved after defined ones.
+        while (new_index > 0) {
+          SensorDataStored* p = new_list->items[new_index-1];
+          if (p->def != NULL && p->def->index <= def->index) break;
+          new_list->items[new_index] = p;
+          new_index--;
+        }
+      }
+      new_list->items[new_index] = item;
+    }
+    publish(new_list, NULL);
+    generation++;
+    items_mutex.unlock();
+  }
+
   size_t generateJsonAllData(void*& buffer, size_t& buffer_size) {
     int nItems = 0;
     SensorDataStored** snapshot = getSnapshot(nItems);
-    if (snapshot == NULL || nItems <= 0) return 0;
-
-    size_t result = generateJsonAllData(snapshot, nItems, buffer, buffer_size, options);
-
-    free(snapshot);
+    size_t result = 0;
+    if (snapshot != NULL && nItems > 0) result = generateJsonAllData(snapshot, nItems, buffer, buffer_size, options);
+    releaseSnapshot();
     return result;
   }
 
+  // Copies the defined sensors from one snapshot of the list (in the order of definitions) into a new array.
+  // Items of defined sensors are never evicted (even if the configuration is reloaded without their definitions)
+  // so the pointers stay valid after the snapshot is released.
+  // The array must be freed by the caller. Returns the number of items or -1 if there is no memory.
+  int getDefinedSensors(SensorDataStored**& result) {
+    result = NULL;
+    int nItems = 0;
+    SensorDataStored** snapshot = getSnapshot(nItems);
+    int count = 0;
+    if (snapshot != NULL && nItems > 0) {
+      result = (SensorDataStored**)malloc(nItems*sizeof(SensorDataStored*));
+      if (result == NULL) {
+        releaseSnapshot();
+        Log->error("Out of memory");
+        return -1;
+      }
+      for (int index = 0; index < nItems; index++) {
+        SensorDataStored* item = snapshot[index];
+        if (item->def != NULL) result[count++] = item;
+      }
+    }
+    releaseSnapshot();
+    return count;
+  }
+
   size_t generateJson(void*& buffer, size_t& buffer_size, RestRequestType requestType, int options);
 
 };
@@ -0,0 +1,374 @@
+/*
+ * W1Devices.cpp
+ *
+ *  Created on: October 18, 2026
+ *      Author: Alex Konshin
+ */
+
+#include "Receiver.hpp"
+#include "Config.hpp"
+
+#ifdef INCLUDE_POLLSTER
+
+#include <dirent.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/inotify.h>
+
+#include "W1Devices.hpp"
+
+#define W1_BUS_MASTER_PREFIX "w1_bus_master"
+#define W1_BULK_READ_FILE "therm_bulk_read"
+
+static uint32_t get_W1_id(const char* p) {
+  uint32_t result = 0;
+  for(int i=0; i<8; i++) {
+    result <<= 4;
+    char ch = *p++;
+    if (ch >= '0' && ch <= '9') {
+      result |= ch-'0';
+    } else if (ch >= 'a' && ch <= 'f') {
+      result |= ch-'a'+10;
+    } else return 0;
+  }
+  return result;
+}
+
+//-------------------------------------------------------------
+W1Devices::W1Devices() {
+  devices = NULL;
+  count = 0;
+  capacity = 0;
+  due = NULL;
+  bulk_read_paths = NULL;
+  bulk_read_count = 0;
+  next_scan = 0;
+  scan_required = true;
+  readers = W1_DEFAULT_READERS;
+
+  pthread_mutex_init(&pool_mutex, NULL);
+  pthread_cond_init(&work_condition, NULL);
+  pthread_cond_init(&done_condition, NULL);
+  started_readers = 0;
+  stopping = false;
+  work = NULL;
+  work_count = 0;
+  work_next = 0;
+  work_done = 0;
+
+  inotify_fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+  if (inotify_fd >= 0 && inotify_add_watch(inotify_fd, W1_DEVICES_PATH, IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO|IN_ONLYDIR) < 0) {
+    close(inotify_fd);
+    inotify_fd = -1;
+  }
+}
+
+W1Devices::~W1Devices() {
+  pthread_mutex_lock(&pool_mutex);
+  stopping = true;
+  pthread_cond_broadcast(&work_condition);
+  pthread_mutex_unlock(&pool_mutex);
+  for (unsigned index = 0; index < started_readers; index++) pthread_join(reader_threads[index].thread, NULL);
+  pthread_cond_destroy(&done_condition);
+  pthread_cond_destroy(&work_condition);
+  pthread_mutex_destroy(&pool_mutex);
+
+  if (inotify_fd >= 0) close(inotify_fd);
+  for (size_t index = 0; index < bulk_read_count; index++) free(bulk_read_paths[index]);
+  if (bulk_read_paths != NULL) free(bulk_read_paths);
+  if (devices != NULL) free(devices);
+  if (due != NULL) free(due);
+}
+
+// Builds the list of devices again. Devices that were already known keep their schedule.
+void W1Devices::scan(time_t now) {
+  __atomic_store_n(&scan_required, false, __ATOMIC_RELAXED);
+  next_scan = now+W1_RESCAN_INTERVAL;
+
+  DIR* dirp = opendir(W1_DEVICES_PATH);
+  if (dirp == NULL) {
+    count = 0;
+    return;
+  }
+
+  W1Device* new_devices = NULL;
+  size_t new_count = 0;
+  size_t new_capacity = 0;
+  for (size_t index = 0; index < bulk_read_count; index++) free(bulk_read_paths[index]);
+  bulk_read_count = 0;
+
+  struct dirent *ep;
+  while ((ep = readdir(dirp)) != NULL) {
+    const char* name = ep->d_name;
+    if (*name == '.') continue;
+
+    if (strncmp(name, W1_BUS_MASTER_PREFIX, sizeof(W1_BUS_MASTER_PREFIX)-1) == 0) {
+      char* path = (char*)malloc(W1_DEVICES_PATH_LEN+strlen(name)+sizeof(W1_BULK_READ_FILE)+1);
+      if (path == NULL) continue;
+      sprintf(path, W1_DEVICES_PATH "/%s/" W1_BULK_READ_FILE, name);
+      char** paths = access(path, R_OK|W_OK) != 0 ? NULL :
+          (char**)realloc(bulk_read_paths, (bulk_read_count+1)*sizeof(char*));
+      if (paths == NULL) {
+        free(path);
+        continue;
+      }
+      bulk_read_paths = paths;
+      bulk_read_paths[bulk_read_count++] = path;
+      continue;
+    }
+
+    // Ex: 28-000004ce62c7
+    if (strlen(name) != W1_DEVICE_NAME_LEN || strncmp(name, "28-0000", 7) != 0) continue;
+    uint32_t id = get_W1_id(name+7);
+    if (id == 0) continue;
+
+    if (new_count >= new_capacity) {
+      size_t grown_capacity = new_capacity == 0 ? 8 : new_capacity*2;
+      W1Device* grown = (W1Device*)realloc(new_devices, grown_capacity*sizeof(W1Device));
+      if (grown == NULL) break;
+      new_devices = grown;
+      new_capacity = grown_capacity;
+    }
+    W1Device* device = &new_devices[new_count++];
+    memcpy(device->name, name, W1_DEVICE_NAME_LEN+1);
+    device->id = id;
+    device->next_poll = 0;
+    device->status = 0;
+    device->value = 0;
+    device->bulk = false;
+    for (size_t index = 0; index < count; index++) {
+      if (devices[index].id == id) {
+        device->next_poll = devices[index].next_poll;
+        break;
+      }
+    }
+  }
+  (void)closedir(dirp);
+
+  // Sensors of a bus master are its subdirectories.
+  for (size_t index = 0; index < new_count; index++) {
+    W1Device* device = &new_devices[index];
+    for (size_t master = 0; master < bulk_read_count && !device->bulk; master++) {
+      const char* path = bulk_read_paths[master];
+      char device_path[W1_DEVICES_PATH_LEN+NAME_MAX+W1_DEVICE_NAME_LEN+3];
+      snprintf(device_path, sizeof(device_path), "%.*s%s",
+          (int)(strlen(path)-(sizeof(W1_BULK_READ_FILE)-1)), path, device->name);
+      device->bulk = access(device_path, F_OK) == 0;
+    }
+  }
+
+  W1Device** new_due = new_capacity == 0 ? NULL : (W1Device**)malloc(new_capacity*sizeof(W1Device*));
+  if (new_capacity != 0 && new_due == NULL) {
+    free(new_devices);
+    __atomic_store_n(&scan_required, true, __ATOMIC_RELAXED);
+    return;
+  }
+  if (devices != NULL) free(devices);
+  if (due != NULL) free(due);
+  devices = new_devices;
+  due = new_due;
+  count = new_count;
+  capacity = new_capacity;
+}
+
+// Returns true if inotify reported changes since the last call.
+bool W1Devices::isDirectoryChanged() {
+  if (inotify_fd < 0) return false;
+  bool changed = false;
+  char events[1024] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+  while (::read(inotify_fd, events, sizeof(events)) > 0) changed = true;
+  return changed;
+}
+
+//-------------------------------------------------------------
+size_t W1Devices::poll(time_t now, W1Device**& polled) {
+  if (__atomic_load_n(&scan_required, __ATOMIC_RELAXED) || now >= next_scan || isDirectoryChanged()) scan(now);
+
+  // Devices on bus masters without therm_bulk_read go first, they are read by the pool.
+  size_t due_count = 0;
+  for (size_t index = 0; index < count; index++) {
+    if (!devices[index].bulk && devices[index].next_poll <= now) due[due_count++] = &devices[index];
+  }
+  size_t parallel_count = due_count;
+  for (size_t index = 0; index < count; index++) {
+    if (devices[index].bulk && devices[index].next_poll <= now) due[due_count++] = &devices[index];
+  }
+  polled = due;
+  if (due_count == 0) return 0;
+
+  startReading(due, parallel_count);
+  size_t bulk_count = due_count-parallel_count;
+  if (bulk_count != 0 && bulkRead()) {
+    // values are already converted so reading is fast
+    for (size_t index = parallel_count; index < due_count; index++) read(due[index]);
+    bulk_count = 0;
+  }
+  finishReading();
+  if (bulk_count != 0) {
+    // conversion could not be started so each device does it when it is read
+    startReading(due+parallel_count, bulk_count);
+    finishReading();
+  }
+  return due_count;
+}
+
+time_t W1Devices::getNextPollTime(time_t now) {
+  // The pollster also wakes up periodically to check inotify events.
+  time_t result = now+W1_DEFAULT_POLL_INTERVAL;
+  if (next_scan < result) result = next_scan;
+  for (size_t index = 0; index < count; index++) {
+    if (devices[index].next_poll < result) result = devices[index].next_poll;
+  }
+  return result;
+}
+
+//-------------------------------------------------------------
+// Starts conversion on all sensors of all bus masters that support it and waits until it is finished.
+bool W1Devices::bulkRead() {
+  if (bulk_read_count == 0) return false;
+
+  bool triggered = false;
+  for (size_t index = 0; index < bulk_read_count; index++) {
+    int fd = open(bulk_read_paths[index], O_WRONLY);
+    if (fd < 0) continue;
+    if (write(fd, "trigger\n", 8) == 8) triggered = true;
+    close(fd);
+  }
+  if (!triggered) return false;
+
+  // Reading of therm_bulk_read returns -1 while conversion is in progress on at least one sensor.
+  for (unsigned waited = 0; ; waited += 100) {
+    bool converting = false;
+    for (size_t index = 0; index < bulk_read_count && !converting; index++) {
+      int fd = open(bulk_read_paths[index], O_RDONLY);
+      if (fd < 0) continue;
+      char buffer[16];
+      ssize_t length = ::read(fd, buffer, sizeof(buffer)-1);
+      close(fd);
+      if (length <= 0) continue;
+      buffer[length] = '\0';
+      if (strtol(buffer, NULL, 10) == -1) converting = true;
+    }
+    if (!converting) break;
+    if (waited >= W1_BULK_READ_TIMEOUT_MS) {
+      Log->error("Conversion of temperature by 1-wire sensors was not finished in %d ms.", W1_BULK_READ_TIMEOUT_MS);
+      break;
+    }
+    usleep(100000);
+  }
+  return true;
+}
+
+void W1Devices::setReaders(unsigned readers) {
+  pthread_mutex_lock(&pool_mutex);
+  this->readers = readers == 0 ? 1 : readers > W1_MAX_READERS ? W1_MAX_READERS : readers;
+  pthread_mutex_unlock(&pool_mutex);
+}
+
+// Gives devices to the pool. Threads are started when they are needed for the first time and are kept running.
+void W1Devices::startReading(W1Device** devices, size_t count) {
+  pthread_mutex_lock(&pool_mutex);
+  work = devices;
+  work_count = count;
+  work_next = 0;
+  work_done = 0;
+  if (count > 1) {
+    unsigned wanted = (readers < count ? readers : (unsigned)count)-1; // the pollster thread is one of the readers
+    while (started_readers < wanted) {
+      W1Reader* reader = &reader_threads[started_readers];
+      reader->devices = this;
+      reader->index = started_readers+1;
+      int rc = pthread_create(&reader->thread, NULL, readerThreadFunction, (void*)reader);
+      if (rc != 0) {
+        Log->error("Error code %d from pthread_create()", rc);
+        break;
+      }
+      started_readers++;
+    }
+    pthread_cond_broadcast(&work_condition);
+  }
+  pthread_mutex_unlock(&pool_mutex);
+}
+
+// The pollster thread reads devices that have not been taken by the pool yet and waits for the rest.
+void W1Devices::finishReading() {
+  pthread_mutex_lock(&pool_mutex);
+  while (work_next < work_count) {
+    W1Device* device = work[work_next++];
+    pthread_mutex_unlock(&pool_mutex);
+    read(device);
+    pthread_mutex_lock(&pool_mutex);
+    work_done++;
+  }
+  while (work_done < work_count) pthread_cond_wait(&done_condition, &pool_mutex);
+  work = NULL;
+  work_count = 0;
+  work_next = 0;
+  work_done = 0;
+  pthread_mutex_unlock(&pool_mutex);
+}
+
+void W1Devices::reader(unsigned index) {
+  pthread_mutex_lock(&pool_mutex);
+  while (true) {
+    // threads above the current number of readers stay idle
+    while (!stopping && (work_next >= work_count || index >= readers)) pthread_cond_wait(&work_condition, &pool_mutex);
+    if (stopping) break;
+    W1Device* device = work[work_next++];
+    pthread_mutex_unlock(&pool_mutex);
+    read(device);
+    pthread_mutex_lock(&pool_mutex);
+    if (++work_done == work_count) pthread_cond_signal(&done_condition);
+  }
+  pthread_mutex_unlock(&pool_mutex);
+}
+
+void* W1Devices::readerThreadFunction(void* context) {
+  W1Reader* reader = (W1Reader*)context;
+  reader->devices->reader(reader->index);
+  return NULL;
+}
+
+// Reads w1_slave of the device:
+// 3e 01 4b 46 7f ff 02 10 6c : crc=6c YES
+// 3e 01 4b 46 7f ff 02 10 6c t=19875
+void W1Devices::read(W1Device* device) {
+  char filepath[W1_DEVICES_PATH_LEN+W1_DEVICE_NAME_LEN+10];
+  sprintf(filepath, W1_DEVICES_PATH "/%s/w1_slave", device->name);
+
+  device->status = 1;
+  int fd = open(filepath, O_RDONLY);
+  if (fd < 0) {
+    if (errno == ENOENT) __atomic_store_n(&scan_required, true, __ATOMIC_RELAXED); // the device was detached
+    return;
+  }
+  char buffer[128];
+  size_t length = 0;
+  ssize_t rc;
+  while (length < sizeof(buffer)-1 && (rc = ::read(fd, buffer+length, sizeof(buffer)-1-length)) > 0) length += rc;
+  close(fd);
+  buffer[length] = '\0';
+
+  device->status = 2;
+  const char* line_end = strchr(buffer, '\n');
+  if (line_end == NULL || line_end+1-buffer < 39 || strncmp(buffer+36, "YES", 3) != 0) return;
+  device->status = 3;
+  const char* line = line_end+1;
+  if (strlen(line) < 30 || strncmp(line+27, "t=", 2) != 0) return;
+  device->status = 4;
+  const char* p = line+29;
+  long n = 0;
+  char ch = *p++;
+  if (ch>='0' && ch<='9') {
+    do {
+      n = n*10+(ch-'0');
+      ch = *p++;
+    } while (ch>='0' && ch<='9');
+    if (ch == '\0' || ch == '\n' || ch == '\r') {
+      device->value = (uint32_t)n;
+      device->status = 0;
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,99 @@
+/*
+ * W1Devices.hpp
+ *
+ *  Created on: October 18, 2026
+ *      Author: Alex Konshin
+ */
+
+#ifndef W1DEVICES_HPP_
+#define W1DEVICES_HPP_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <pthread.h>
+
+//-------------------------------------------------------------
+// DS18B20 sensors on 1-wire buses that are polled by the pollster thread.
+//
+// Reading of w1_slave of a sensor blocks for the temperature conversion (~750ms). If the bus master of a sensor
+// supports therm_bulk_read then conversions of all its sensors are started at once and the following reads return
+// immediately. Sensors on other bus masters are read in parallel by a pool of threads that are started once and
+// wait for work between polls. Both happen at the same time.
+// The list of devices is cached. It is refreshed when inotify reports changes of the devices directory,
+// when a device cannot be opened and every W1_RESCAN_INTERVAL seconds because sysfs does not generate
+// inotify events when devices are attached or detached.
+
+#define W1_DEVICE_NAME_LEN 15          // 28-000004ce62c7
+#define W1_DEFAULT_POLL_INTERVAL 15    // seconds
+#define W1_DEFAULT_READERS 4
+#define W1_MAX_READERS 16
+#define W1_RESCAN_INTERVAL 300         // seconds
+#define W1_BULK_READ_TIMEOUT_MS 2000
+
+typedef struct W1Device {
+  char name[W1_DEVICE_NAME_LEN+1];
+  uint32_t id;
+  time_t next_poll;
+  uint16_t status;                     // 0 if the value has been read successfully
+  uint32_t value;                      // temperature, 1/1000 of degree C
+  bool bulk;                           // the bus master supports therm_bulk_read
+} W1Device;
+
+class W1Devices;
+
+typedef struct W1Reader {
+  W1Devices* devices;
+  unsigned index;                      // the pollster thread is reader 0, threads of the pool start from 1
+  pthread_t thread;
+} W1Reader;
+
+class W1Devices {
+private:
+  W1Device* devices;
+  size_t count;
+  size_t capacity;
+  W1Device** due;                      // devices that are being polled, capacity is the same
+  char** bulk_read_paths;              // therm_bulk_read files of bus masters
+  size_t bulk_read_count;
+  int inotify_fd;
+  time_t next_scan;
+  bool scan_required;
+  unsigned readers;
+
+  // pool of reader threads, the pollster thread is one of the readers too
+  pthread_mutex_t pool_mutex;
+  pthread_cond_t work_condition;
+  pthread_cond_t done_condition;
+  W1Reader reader_threads[W1_MAX_READERS-1];
+  unsigned started_readers;
+  bool stopping;
+  W1Device** work;                     // devices that are read by the pool
+  size_t work_count;
+  size_t work_next;
+  size_t work_done;
+
+  void scan(time_t now);
+  bool isDirectoryChanged();
+  bool bulkRead();
+  void startReading(W1Device** devices, size_t count);
+  void finishReading();
+  void read(W1Device* device);
+  void reader(unsigned index);
+  static void* readerThreadFunction(void* context);
+
+public:
+  W1Devices();
+  ~W1Devices();
+
+  void setReaders(unsigned readers);
+
+  // Reads devices that should be polled at the time. Returns the number of read devices in the array "polled".
+  // The caller must set next_poll of each of them.
+  size_t poll(time_t now, W1Device**& polled);
+
+  // Returns the time when the next device should be polled.
+  time_t getNextPollTime(time_t now);
+};
+
+#endif /* W1DEVICES_HPP_ */
@@ -4,5 +4,5 @@
 
 USER_OBJS :=
 
-LIBS := -lpigpio -lmicrohttpd -lrt -lcurl
+LIBS := -lpigpio -lmicrohttpd -lz -lrt -lcurl
 
@@ -6,20 +6,26 @@
 CPP_SRCS += \
 ../common/Config.cpp \
 ../common/ConfigParser.cpp \
+../common/ConfigReloader.cpp \
 ../common/Receiver.cpp \
-../common/SensorsData.cpp 
+../common/SensorsData.cpp \
+../common/W1Devices.cpp 
 
 CPP_DEPS += \
 ./common/Config.d \
 ./common/ConfigParser.d \
+./common/ConfigReloader.d \
 ./common/Receiver.d \
-./common/SensorsData.d 
+./common/SensorsData.d \
+./common/W1Devices.d 
 
 OBJS += \
 ./common/Config.o \
 ./common/ConfigParser.o \
+./common/ConfigReloader.o \
 ./common/Receiver.o \
-./common/SensorsData.o 
+./common/SensorsData.o \
+./common/W1Devices.o 
 
 
 # Each subdirectory must supply rules for building sources it contributes
@@ -34,7 +40,7 @@ common/%.o: ../common/%.cpp common/subdir.mk
 clean: clean-common
 
 clean-common:
-	-$(RM) ./common/Config.d ./common/Config.o ./common/ConfigParser.d ./common/ConfigParser.o ./common/Receiver.d ./common/Receiver.o ./common/SensorsData.d ./common/SensorsData.o
+	-$(RM) ./common/Config.d ./common/Config.o ./common/ConfigParser.d ./common/ConfigParser.o ./common/ConfigReloader.d ./common/ConfigReloader.o ./common/Receiver.d ./common/Receiver.o ./common/SensorsData.d ./common/SensorsData.o ./common/W1Devices.d ./common/W1Devices.o
 
 .PHONY: clean-common
 
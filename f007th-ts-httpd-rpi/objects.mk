@@ -4,5 +4,5 @@
 
 USER_OBJS :=
 
-LIBS := -lrt -lcurl -lmicrohttpd
+LIBS := -lrt -lcurl -lmicrohttpd -lz
 
@@ -4,18 +4,30 @@
 
 # Add inputs and outputs from these tool invocations to the build variables 
 CPP_SRCS += \
+../utils/EventStream.cpp \
 ../utils/HTTPD.cpp \
 ../utils/Logger.cpp \
+../utils/Metrics.cpp \
+../utils/Realtime.cpp \
+../utils/StaticFiles.cpp \
 ../utils/Utils.cpp 
 
 CPP_DEPS += \
+./utils/EventStream.d \
 ./utils/HTTPD.d \
 ./utils/Logger.d \
+./utils/Metrics.d \
+./utils/Realtime.d \
+./utils/StaticFiles.d \
 ./utils/Utils.d 
 
 OBJS += \
+./utils/EventStream.o \
 ./utils/HTTPD.o \
 ./utils/Logger.o \
+./utils/Metrics.o \
+./utils/Realtime.o \
+./utils/StaticFiles.o \
 ./utils/Utils.o 
 
 
@@ -31,7 +43,7 @@ utils/%.o: ../utils/%.cpp utils/subdir.mk
 clean: clean-utils
 
 clean-utils:
-	-$(RM) ./utils/HTTPD.d ./utils/HTTPD.o ./utils/Logger.d ./utils/Logger.o ./utils/Utils.d ./utils/Utils.o
+	-$(RM) ./utils/EventStream.d ./utils/EventStream.o ./utils/HTTPD.d ./utils/HTTPD.o ./utils/Logger.d ./utils/Logger.o ./utils/Metrics.d ./utils/Metrics.o ./utils/Realtime.d ./utils/Realtime.o ./utils/StaticFiles.d ./utils/StaticFiles.o ./utils/Utils.d ./utils/Utils.o
 
 .PHONY: clean-utils
 
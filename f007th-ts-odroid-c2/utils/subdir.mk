@@ -5,14 +5,17 @@
 # Add inputs and outputs from these tool invocations to the build variables 
 CPP_SRCS += \
 ../utils/Logger.cpp \
+../utils/Realtime.cpp \
 ../utils/Utils.cpp 
 
 CPP_DEPS += \
 ./utils/Logger.d \
+./utils/Realtime.d \
 ./utils/Utils.d 
 
 OBJS += \
 ./utils/Logger.o \
+./utils/Realtime.o \
 ./utils/Utils.o 
 
 
@@ -28,7 +31,7 @@ utils/%.o: ../utils/%.cpp utils/subdir.mk
 clean: clean-utils
 
 clean-utils:
-	-$(RM) ./utils/Logger.d ./utils/Logger.o ./utils/Utils.d ./utils/Utils.o
+	-$(RM) ./utils/Logger.d ./utils/Logger.o ./utils/Realtime.d ./utils/Realtime.o ./utils/Utils.d ./utils/Utils.o
 
 .PHONY: clean-utils
 
@@ -4,5 +4,5 @@
 
 USER_OBJS :=
 
-LIBS := -lrt -lcurl -lmicrohttpd -lmosquitto -lmosquittopp
+LIBS := -lrt -lcurl -lmicrohttpd -lz -lmosquitto -lmosquittopp
 
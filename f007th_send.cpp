@@ -12,6 +12,7 @@
 
 #include "common/SensorsData.hpp"
 #include "common/Config.hpp"
+#include "common/ConfigReloader.hpp"
 
 #ifdef INCLUDE_HTTPD
 #include "utils/HTTPD.hpp"
@@ -19,18 +20,74 @@
 
 static bool send(ReceivedMessage& message, Config& cfg, int changed, void*& data_buffer, size_t& buffer_size, char* response_buffer, FILE* log);
 
+static bool isSameString(const char* s1, const char* s2) {
+  if (s1 == NULL || s2 == NULL) return s1 == s2;
+  return strcmp(s1, s2) == 0;
+}
+
+#ifdef INCLUDE_HTTPD
+// Settings that are used only when the server is started.
+static bool isHttpdChanged(Config* cfg, Config* new_cfg) {
+  return new_cfg->httpd_port != cfg->httpd_port ||
+      new_cfg->httpd_threads != cfg->httpd_threads ||
+      new_cfg->httpd_max_connections != cfg->httpd_max_connections ||
+      new_cfg->httpd_max_connections_per_ip != cfg->httpd_max_connections_per_ip ||
+      new_cfg->httpd_timeout != cfg->httpd_timeout ||
+      new_cfg->httpd_max_age != cfg->httpd_max_age ||
+      !isSameString(new_cfg->www_root, cfg->www_root);
+}
+#endif
+
+#ifdef INCLUDE_MQTT
+static bool isMqttChanged(Config* cfg, Config* new_cfg) {
+  return new_cfg->mqtt_enable != cfg->mqtt_enable ||
+      new_cfg->mqtt_broker_port != cfg->mqtt_broker_port ||
+      new_cfg->mqtt_keepalive != cfg->mqtt_keepalive ||
+      !isSameString(new_cfg->mqtt_broker_host, cfg->mqtt_broker_host) ||
+      !isSameString(new_cfg->mqtt_client_id, cfg->mqtt_client_id) ||
+      !isSameString(new_cfg->mqtt_username, cfg->mqtt_username) ||
+      !isSameString(new_cfg->mqtt_password, cfg->mqtt_password);
+}
+#endif
+
+// Settings that are applied only after restart.
+static bool isRestartRequired(Config* cfg, Config* new_cfg) {
+  return new_cfg->gpio != cfg->gpio ||
+      new_cfg->min_sequence_length != cfg->min_sequence_length ||
+      new_cfg->max_duration != cfg->max_duration ||
+      new_cfg->min_duration != cfg->min_duration ||
+      new_cfg->realtime_priority != cfg->realtime_priority ||
+      new_cfg->realtime_cpus != cfg->realtime_cpus ||
+      new_cfg->lock_memory != cfg->lock_memory ||
+#ifdef INCLUDE_POLLSTER
+      new_cfg->w1_enable != cfg->w1_enable ||
+      new_cfg->w1_poll_interval != cfg->w1_poll_interval ||
+      new_cfg->w1_readers != cfg->w1_readers ||
+#endif
+      (new_cfg->options&(DUMP_SEQS_TO_FILE|DUMP_UNDECODED_SEQS_TO_FILE)) != (cfg->options&(DUMP_SEQS_TO_FILE|DUMP_UNDECODED_SEQS_TO_FILE)) ||
+      !isSameString(new_cfg->dump_file_path, cfg->dump_file_path) ||
+      !isSameString(new_cfg->log_file_path, cfg->log_file_path);
+}
+
 
 int main(int argc, char *argv[]) {
 
   if ( argc==1 ) Config::help();
 
-  Config cfg;
-  cfg.process_args(argc, argv);
+  Config* cfg = new Config();
+  cfg->process_args(argc, argv);
+  if (cfg->check_config) {
+    fputs("Configuration is valid.\n", stderr);
+    exit(0);
+  }
+
+  // must be created before any other thread
+  ConfigReloader reloader(argc, argv);
 
   FILE* log;
   { // setup log file
     const char* log_file_path;
-    if (cfg.log_file_path == NULL || cfg.log_file_path[0]=='\0') {
+    if (cfg->log_file_path == NULL || cfg->log_file_path[0]=='\0') {
 
 #ifdef TEST_DECODING
 #define LOG_FILE_OPEN_MODE "w"
@@ -45,26 +102,26 @@ int main(int argc, char *argv[]) {
         fprintf(stderr, "Failed to open log file \"%s\". Function realpath() returned error: %s\n", log_file_path, strerror(errno));
         exit(1);
       }
-      cfg.log_file_path = path;
+      cfg->log_file_path = path;
     } else {
-      log_file_path = cfg.log_file_path;
+      log_file_path = cfg->log_file_path;
     }
-    log = openFileForWriting(cfg.log_file_path, LOG_FILE_OPEN_MODE);
+    log = openFileForWriting(cfg->log_file_path, LOG_FILE_OPEN_MODE);
     if (log == NULL) {
-      fprintf(stderr, "Failed to open log file \"%s\": %s\n", cfg.log_file_path, strerror(errno));
+      fprintf(stderr, "Failed to open log file \"%s\": %s\n", cfg->log_file_path, strerror(errno));
       exit(1);
     }
-    fprintf(stderr, "Log file is \"%s\".\n", cfg.log_file_path);
+    fprintf(stderr, "Log file is \"%s\".\n", cfg->log_file_path);
   }
 
   FILE* dump_file = NULL;
-  if ((cfg.options&DUMP_SEQS_TO_FILE) != 0 && cfg.dump_file_path != NULL && *cfg.dump_file_path != '\0') {
-    dump_file = openFileForWriting(cfg.dump_file_path, "w");
+  if ((cfg->options&DUMP_SEQS_TO_FILE) != 0 && cfg->dump_file_path != NULL && *cfg->dump_file_path != '\0') {
+    dump_file = openFileForWriting(cfg->dump_file_path, "w");
     if (dump_file == NULL) {
-      fprintf(stderr, "Failed to open dump file \"%s\" for writing.\n", cfg.dump_file_path);
+      fprintf(stderr, "Failed to open dump file \"%s\" for writing.\n", cfg->dump_file_path);
       exit(1);
     }
-    fprintf(stderr, "Dump file is \"%s\".", cfg.dump_file_path);
+    fprintf(stderr, "Dump file is \"%s\".", cfg->dump_file_path);
   }
   fflush(stderr);
 
@@ -76,18 +133,22 @@ int main(int argc, char *argv[]) {
     exit(1);
   }
 
-  if (cfg.server_type!=ServerType::STDOUT && cfg.server_type!=ServerType::NONE) {
+  bool curl_initialized = false;
+  if (cfg->server_type!=ServerType::STDOUT && cfg->server_type!=ServerType::NONE) {
     curl_global_init(CURL_GLOBAL_ALL);
+    curl_initialized = true;
     response_buffer = (char*)malloc(SERVER_RESPONSE_BUFFER_SIZE*sizeof(char));
   }
 
-  SensorsData sensorsData(cfg.options);
+  SensorsData sensorsData(cfg->options);
+  sensorsData.setLimits(cfg->max_sensors, cfg->undefined_sensor_ttl);
 
-  Receiver receiver(&cfg);
+  Receiver receiver(cfg);
   Log->setLogFile(log);
+  Log->startWriter();
 #ifdef TEST_DECODING
-  receiver.setInputLogFile(cfg.input_log_file_path);
-  receiver.setWaitAfterReading(cfg.wait_after_reading);
+  receiver.setInputLogFile(cfg->input_log_file_path);
+  receiver.setWaitAfterReading(cfg->wait_after_reading);
 #endif
 
   ReceivedMessage message;
@@ -97,33 +158,38 @@ int main(int argc, char *argv[]) {
 #ifdef INCLUDE_HTTPD
   HTTPD* httpd = NULL;
 
-  if (cfg.httpd_port >= MIN_HTTPD_PORT && cfg.httpd_port<65535) {
+  if (cfg->httpd_port >= MIN_HTTPD_PORT && cfg->httpd_port<65535) {
     // start HTTPD server
-    Log->log("Starting HTTPD server on port %d...", cfg.httpd_port);
-    httpd = HTTPD::start(&sensorsData, &cfg);
+    Log->log("Starting HTTPD server on port %d...", cfg->httpd_port);
+    httpd = HTTPD::start(&sensorsData, cfg);
     if (httpd == NULL) {
-      Log->error("Could not start HTTPD server on port %d.", cfg.httpd_port);
+      Log->error("Could not start HTTPD server on port %d.", cfg->httpd_port);
+      Log->stopWriter();
       fclose(log);
       exit(1);
     }
+    httpd->setMetricsCollector(&Receiver::metricsCollector, &receiver);
   }
 #endif
 
 #ifdef INCLUDE_MQTT
-  if (!MqttPublisher::create(cfg)) {
+  if (!MqttPublisher::create(*cfg)) {
+    Log->stopWriter();
     fclose(log);
     exit(1);
   }
 #endif
 
-  if ((cfg.options&VERBOSITY_PRINT_STATISTICS) != 0) receiver.printStatisticsPeriodically(1000); // print statistics every second
+  if ((cfg->options&VERBOSITY_PRINT_STATISTICS) != 0) receiver.printStatisticsPeriodically(1000); // print statistics every second
+
+  reloader.start(&receiver);
 
 #define RULE_MESSAGE_MAX_SIZE 4096
   char rule_message_buffer[RULE_MESSAGE_MAX_SIZE];
 
-  bool verbose = (cfg.options&(VERBOSITY_INFO|VERBOSITY_DEBUG)) != 0;
+  bool verbose = (cfg->options&(VERBOSITY_INFO|VERBOSITY_DEBUG)) != 0;
 
-  if ((cfg.options&(VERBOSITY_INFO|VERBOSITY_DEBUG)) != 0) fputs("Receiving data...\n", stderr);
+  if ((cfg->options&(VERBOSITY_INFO|VERBOSITY_DEBUG)) != 0) fputs("Receiving data...\n", stderr);
   while(!receiver.isStopped()) {
     bool got_data = receiver.waitForMessage(message);
     if (receiver.isStopped()) break;
@@ -135,45 +201,46 @@ int main(int argc, char *argv[]) {
 
       bool is_message_printed = false;
 
-      if (dump_file != NULL && (cfg.options&(DUMP_SEQS_TO_FILE|DUMP_UNDECODED_SEQS_TO_FILE)) == DUMP_SEQS_TO_FILE) { // write the received sequence (if any) to the dump file
-        message.printInputSequence(dump_file, cfg.options);
+      if (dump_file != NULL && (cfg->options&(DUMP_SEQS_TO_FILE|DUMP_UNDECODED_SEQS_TO_FILE)) == DUMP_SEQS_TO_FILE) { // write the received sequence (if any) to the dump file
+        message.printInputSequence(dump_file, cfg->options);
         fflush(dump_file);
       }
 
-      if (verbose || ((cfg.options&VERBOSITY_PRINT_UNDECODED) != 0 && message.isUndecoded())) {
-        message.print(stdout, log, cfg.options);
+      if (verbose || ((cfg->options&VERBOSITY_PRINT_UNDECODED) != 0 && message.isUndecoded())) {
+        message.print(stdout, log, cfg->options);
         is_message_printed = true;
       }
       if (message.isUndecoded()) {
         if (verbose) fputs("Could not decode the received data.\n", stderr);
-        if (dump_file != NULL && (cfg.options&(DUMP_SEQS_TO_FILE|DUMP_UNDECODED_SEQS_TO_FILE)) == (DUMP_SEQS_TO_FILE|DUMP_UNDECODED_SEQS_TO_FILE)) {
+        if (dump_file != NULL && (cfg->options&(DUMP_SEQS_TO_FILE|DUMP_UNDECODED_SEQS_TO_FILE)) == (DUMP_SEQS_TO_FILE|DUMP_UNDECODED_SEQS_TO_FILE)) {
           // write undecoded received sequence to the dump file
-          message.printInputSequence(dump_file, cfg.options);
+          message.printInputSequence(dump_file, cfg->options);
           fflush(dump_file);
         }
       } else {
         bool isValid = message.isValid();
-        int changed = isValid ? message.update(sensorsData, cfg.max_unchanged_gap) : 0;
+        if (!isValid) statistics->corrupted++;
+        int changed = isValid ? message.update(sensorsData, cfg->max_unchanged_gap) : 0;
         if (changed != TIME_NOT_CHANGED) {
           int really_changed = changed;
-          if (changed == 0 && !cfg.changes_only && (isValid || (cfg.server_type != ServerType::InfluxDB && cfg.server_type != ServerType::NONE)))
+          if (changed == 0 && !cfg->changes_only && (isValid || (cfg->server_type != ServerType::InfluxDB && cfg->server_type != ServerType::NONE)))
             changed = TEMPERATURE_IS_CHANGED | HUMIDITY_IS_CHANGED | BATTERY_STATUS_IS_CHANGED;
           if (changed != 0) {
-            if (cfg.server_type == ServerType::STDOUT) {
+            if (cfg->server_type == ServerType::STDOUT) {
               if (!is_message_printed) // already printed
-                message.print(stdout, NULL, cfg.options);
-            } else if (cfg.server_type != ServerType::NONE) {
-              if (!send(message, cfg, changed, data_buffer, buffer_size, response_buffer, log) && verbose)
+                message.print(stdout, NULL, cfg->options);
+            } else if (cfg->server_type != ServerType::NONE) {
+              if (!send(message, *cfg, changed, data_buffer, buffer_size, response_buffer, log) && verbose)
                 Log->info("No data was sent to server.");
             }
           } else {
             if (verbose) {
-              if (cfg.server_type == ServerType::STDOUT) {
+              if (cfg->server_type == ServerType::STDOUT) {
                 if (!isValid)
                   fputs("Data is corrupted.\n", stderr);
                 else
                   fputs("Data is not changed.\n", stderr);
-              } else if (cfg.server_type != ServerType::NONE) {
+              } else if (cfg->server_type != ServerType::NONE) {
                 if (!isValid)
                   fputs("Data is corrupted and is not sent to server.\n", stderr);
                 else
@@ -186,28 +253,84 @@ int main(int argc, char *argv[]) {
             SensorData* sensorData = &message.data->sensorData;
             SensorDef* sensorDef = sensorData->def;
             if (sensorDef != NULL) {
-              bool debug = (cfg.options&VERBOSITY_DEBUG) != 0;
+              bool debug = (cfg->options&VERBOSITY_DEBUG) != 0;
+#ifdef INCLUDE_MQTT
+              if (MqttPublisher::instance != NULL) MqttPublisher::instance->setTraceOrigin(message.getStamp(TRACE_SEQUENCE_CLOSED));
+#endif
               AbstractRuleWithSchedule* rule = sensorDef->getRules();
               while (rule != NULL) {
                 BoundCheckResult checkResult = sensorData->checkRule(rule, really_changed);
                 if (checkResult != BoundCheckResult::Locked && checkResult != BoundCheckResult::NotApplicable) {
                   if (debug) Log->info("%s \"%s\" => MATCHED.", rule->getTypeName(), rule->id);
+                  statistics->rules_matched++;
                   uint32_t size = rule->formatMessage(rule_message_buffer, RULE_MESSAGE_MAX_SIZE, checkResult, sensorData);
-                  if (size > 0) rule->execute(rule_message_buffer, cfg);
+                  if (size > 0) rule->execute(rule_message_buffer, *cfg);
                   rule->applyLocks(checkResult);
                 }
                 rule = rule->next;
               }
+              message.stamp(TRACE_RULES_EVALUATED);
             }
           }
 
         }
       }
 
+      message.finishTrace((cfg->options&VERBOSITY_DEBUG) != 0);
     }
 
     if (receiver.checkAndResetTimerEvent()) {
-      if ((cfg.options&VERBOSITY_PRINT_STATISTICS) != 0) receiver.printStatistics();
+      if ((cfg->options&VERBOSITY_PRINT_STATISTICS) != 0) receiver.printStatistics();
+    }
+
+    if (receiver.checkAndResetReloadEvent()) {
+      Config* new_cfg = reloader.take();
+      if (new_cfg != NULL) {
+        // The default log file is not set by the parser.
+        if (new_cfg->log_file_path == NULL || new_cfg->log_file_path[0]=='\0') new_cfg->log_file_path = cfg->log_file_path;
+        if (isRestartRequired(cfg, new_cfg))
+          Log->info("Changes of GPIO pin, 1-Wire, real-time settings, log and dump files will be applied after restart.");
+
+        // Sensor definitions and rules of the new configuration are used starting from the next message.
+        SensorDef::publish(new_cfg->sensor_defs);
+        sensorsData.rebindDefinitions();
+        sensorsData.setLimits(new_cfg->max_sensors, new_cfg->undefined_sensor_ttl);
+        receiver.setProtocols(new_cfg->protocols);
+
+        if (!curl_initialized && new_cfg->server_type != ServerType::STDOUT && new_cfg->server_type != ServerType::NONE) {
+          curl_global_init(CURL_GLOBAL_ALL);
+          curl_initialized = true;
+          response_buffer = (char*)malloc(SERVER_RESPONSE_BUFFER_SIZE*sizeof(char));
+        }
+
+#ifdef INCLUDE_HTTPD
+        if (isHttpdChanged(cfg, new_cfg)) {
+          HTTPD::destroy(httpd);
+          if (new_cfg->httpd_port >= MIN_HTTPD_PORT && new_cfg->httpd_port<65535) {
+            Log->log("Starting HTTPD server on port %d...", new_cfg->httpd_port);
+            httpd = HTTPD::start(&sensorsData, new_cfg);
+            if (httpd == NULL)
+              Log->error("Could not start HTTPD server on port %d.", new_cfg->httpd_port);
+            else
+              httpd->setMetricsCollector(&Receiver::metricsCollector, &receiver);
+          }
+        } else if (httpd != NULL) {
+          httpd->setConfig(new_cfg);
+        }
+#endif
+
+#ifdef INCLUDE_MQTT
+        if (isMqttChanged(cfg, new_cfg)) {
+          MqttPublisher::destroy();
+          MqttPublisher::create(*new_cfg);
+        }
+#endif
+
+        // The old configuration is not freed because it can be still used by other threads.
+        cfg = new_cfg;
+        verbose = (cfg->options&(VERBOSITY_INFO|VERBOSITY_DEBUG)) != 0;
+        Log->log("Configuration has been reloaded.");
+      }
     }
   }
 
@@ -219,15 +342,16 @@ int main(int argc, char *argv[]) {
   HTTPD::destroy(httpd);
 #endif
 
-  if ((cfg.options&VERBOSITY_INFO) != 0) fputs("\nExiting...\n", stderr);
+  if ((cfg->options&VERBOSITY_INFO) != 0) fputs("\nExiting...\n", stderr);
 
   // finally
   if (dump_file != NULL) fclose(dump_file);
   free(data_buffer);
   if (response_buffer != NULL) free(response_buffer);
   Log->log("Exiting...");
+  Log->stopWriter();
   fclose(log);
-  if (cfg.server_type != ServerType::STDOUT && cfg.server_type != ServerType::NONE) curl_global_cleanup();
+  if (curl_initialized) curl_global_cleanup();
 
   exit(0);
 }
@@ -330,7 +454,13 @@ bool send(ReceivedMessage& message, Config& cfg, int changed, void*& data_buffer
   curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &write_callback);
   curl_easy_setopt(curl, CURLOPT_WRITEDATA, &data);
 
+  struct timespec started;
+  clock_gettime(CLOCK_MONOTONIC, &started);
+  statistics->server_requests++;
+  message.stamp(TRACE_SINK_ENQUEUED);
   CURLcode rc = curl_easy_perform(curl);
+  uint64_t responded = metrics_clock();
+  statistics->server_request_duration.observeSince(started);
   if (rc != CURLE_OK)
     Log->error("Sending data to %s failed: %s", cfg.server_url, curl_easy_strerror(rc));
 
@@ -351,12 +481,18 @@ bool send(ReceivedMessage& message, Config& cfg, int changed, void*& data_buffer
       Log->error("Got HTTP status code %ld.", http_code);
     if (data.response_remain <= 0) data.response_remain = 1;
     response_buffer[SERVER_RESPONSE_BUFFER_SIZE-data.response_remain] = '\0';
+    flockfile(log); // the writer thread of Log writes into the same file
     fputs(response_buffer, log);
     fputc('\n', log);
     fflush(log);
+    funlockfile(log);
   } else if (rc == CURLE_ABORTED_BY_CALLBACK) {
     Log->error("HTTP request was aborted.");
   }
+  if (success)
+    message.data->trace[TRACE_SINK_ACKED] = responded;
+  else
+    statistics->server_errors++;
   curl_easy_cleanup(curl);
   if (headers != NULL) curl_slist_free_all(headers);
   if (verbose) fputs("===> return from send()\n", stderr);
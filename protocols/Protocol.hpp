@@ -52,16 +52,42 @@
 
 #include "../utils/Bits.hpp"
 #include "../utils/Logger.hpp"
+#include "../utils/Metrics.hpp"
 
 struct SensorData;
 struct ReceivedData;
 class ReceivedMessage;
 enum class BoundCheckResult;
 
+//-------------------------------------------------------------
+// Trace of a message from the end of its sequence of pulses to the acknowledgement of the sink.
+// Stamps are values of metrics_clock() kept in ReceivedData::trace, 0 if the message did not pass the stage.
+// Indexes are in the order the stages are passed by the main loop.
+#define TRACE_SEQUENCE_CLOSED   0  // the receiver has got the end of the sequence
+#define TRACE_DECODE_STARTED    1
+#define TRACE_DECODE_FINISHED   2  // the message is put into the queue
+#define TRACE_DEQUEUED          3  // the main loop has taken the message from the queue
+#define TRACE_STATE_UPDATED     4  // sensors data is updated, the message is printed and dumped before
+#define TRACE_SINK_ENQUEUED     5  // data is formatted and the request is started
+#define TRACE_SINK_ACKED        6  // InfluxDB or REST server has accepted the data
+#define TRACE_RULES_EVALUATED   7
+#define NUMBER_OF_TRACE_STAMPS  8
+
+// Latency histograms. LATENCY_* index of a stage is the index of its stamp, the latency of a stage is the time
+// from the previous stamp that is set. The index of the first stamp is used for the whole way to the sink.
+#define LATENCY_END_TO_END      TRACE_SEQUENCE_CLOSED
+#define LATENCY_MQTT_ACK        NUMBER_OF_TRACE_STAMPS      // publishing to MQTT broker until PUBACK
+#define LATENCY_MQTT_END_TO_END (NUMBER_OF_TRACE_STAMPS+1)  // the end of the sequence until PUBACK
+#define NUMBER_OF_LATENCIES     (NUMBER_OF_TRACE_STAMPS+2)
+
+static const char* const latency_names[NUMBER_OF_LATENCIES] = {
+  "end_to_end", "sequence_queue", "decode", "message_queue", "state_update", "sink_enqueue", "sink_ack", "rules",
+  "mqtt_ack", "mqtt_end_to_end"
+};
+
 //-------------------------------------------------------------
 typedef struct Statistics {
-#ifdef TEST_DECODING
-#elif !defined(USE_GPIO_TS)
+#if !defined(USE_GPIO_TS) // the test build also has the handler of interrupts for load tests
   uint32_t interrupted;
   uint32_t skipped;
   uint32_t corrected;
@@ -69,8 +95,24 @@ typedef struct Statistics {
   uint32_t sequences;
   uint32_t dropped;
   uint32_t sequence_pool_overflow;
+  uint32_t pool_overflow;         // pulses lost because the pool of durations was full
   uint32_t bad_manchester;
   uint32_t manchester_OOS;
+  uint32_t decoded;               // messages decoded by the decoder thread
+  uint32_t undecoded;
+  uint32_t w1_errors;             // failed reads of DS18B20 sensors
+  // queue of messages between the decoder/pollster and the main loop (updated with atomic adds, no lock)
+  uint32_t queued;
+  uint32_t dequeued;
+  // main loop
+  uint32_t corrupted;             // decoded messages with wrong checksum
+  uint32_t server_requests;       // requests to InfluxDB or REST server
+  uint32_t server_errors;
+  uint32_t mqtt_published;
+  uint32_t mqtt_errors;
+  uint32_t rules_matched;
+  MetricsHistogram server_request_duration;
+  MetricsLatencyHistogram latency[NUMBER_OF_LATENCIES];
 } Statistics;
 
 extern Statistics* statistics;
@@ -125,16 +167,19 @@ public:
     return NULL;
   }
 
+  // It is called again when configuration is reloaded so the masks must never have intermediate values.
   static void initialize() {
-    registered_protocols = 0;
-    rf_protocols = 0;
+    uint32_t registered = 0;
+    uint32_t rf = 0;
     for (int protocol_index = 0; protocol_index<NUMBER_OF_PROTOCOLS; protocol_index++) {
       Protocol* protocol = protocols[protocol_index];
       if (protocol != NULL) {
-        registered_protocols |= protocol->protocol_bit;
-        if ((protocol->features&FEATURE_RF) != 0) rf_protocols |= protocol->protocol_bit;
+        registered |= protocol->protocol_bit;
+        if ((protocol->features&FEATURE_RF) != 0) rf |= protocol->protocol_bit;
       }
     }
+    registered_protocols = registered;
+    rf_protocols = rf;
   }
 
   uint32_t protocol_bit;
@@ -0,0 +1,361 @@
+/*
+ * capture_load_test.cpp
+ *
+ * Load test of the capture path of Receiver under RF noise.
+ * Synthetic edges (valid frames mixed with random noise pulses, see edge_generator.hpp) are fed in real time
+ * into the same code that runs on the board:
+ *   - interrupt mode: Receiver::handleInterrupt() as it is called by pigpio, the decoder polls the pool
+ *     of sequences every DECODER_POLL_INTERVAL_US as in the pigpio build,
+ *   - gpio-ts mode: edges go through an emulation of the buffer of kernel module gpio-ts
+ *     (see gpio_ts_emulation.hpp) and items are put into the pool by Receiver::putItems() as readSequences() does.
+ * One run is done for each noise rate. Results are printed in JSON: the share of valid frames that were decoded,
+ * overflow counters of the pool of durations, the queue of sequences and the buffer of gpio-ts,
+ * and CPU time of the capturing and decoding threads.
+ *
+ *   capture-load-test -m interrupt -n 0,300,1000,3000,10000,30000 -d 60 > noise.json
+ *
+ *   capture-load-test [-m interrupt|gpio-ts] [-n <noise edges/s>,...] [-f <frames/s>] [-d <seconds>] [-w <min>,<max>] [-c] [-j <jitter us>] [-s <seed>]
+ *
+ *  Created on: October 18, 2026
+ *      Author: Alex Konshin
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <pthread.h>
+
+#include "../protocols/Protocol.hpp"
+#include "../common/SensorsData.hpp"
+#include "../common/Receiver.hpp"
+#include "../common/Config.hpp"
+#include "edge_generator.hpp"
+#include "gpio_ts_emulation.hpp"
+
+#define MODE_INTERRUPT 0
+#define MODE_GPIO_TS   1
+
+#define MAX_NOISE_RATES 32
+#define DEFAULT_FRAMES_PER_SECOND 4
+#define DEFAULT_DURATION 5
+#define DEFAULT_NOISE_MIN_WIDTH 5
+#define DEFAULT_NOISE_MAX_WIDTH 300
+#define FLUSH_DELAY 100000   // microseconds after the last edge, ends the last sequence
+#define MAX_SLEEP_AHEAD 1000 // microseconds, edges that are due sooner are fed without sleeping
+#define GPIO_TS_READ_ITEMS 512
+#define GPIO_TS_READ_TIMEOUT 100 // milliseconds
+
+static const char* mode_names[] = { "interrupt", "gpio-ts" };
+
+typedef struct RunResult {
+  uint32_t decoded_frames[NUMBER_OF_PROTOCOLS];
+  uint32_t total_decoded;
+  uint32_t messages;
+  uint64_t capture_cpu_ns;
+  uint64_t decoder_cpu_ns;
+  uint64_t elapsed_ns;
+  uint64_t max_lag_ns;
+  long gpiots_isr_count;
+  long gpiots_buffer_overflows;
+} RunResult;
+
+static uint64_t timespec_ns(const struct timespec& ts) {
+  return (uint64_t)ts.tv_sec*1000000000ULL+ts.tv_nsec;
+}
+
+static uint64_t now_ns(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return timespec_ns(ts);
+}
+
+static void help() {
+  fputs(
+    "Usage: capture-load-test [-m interrupt|gpio-ts] [-n <noise edges/s>,...] [-f <frames/s>] [-d <seconds>] [-w <min>,<max>] [-c] [-j <jitter us>] [-s <seed>]\n"
+    "  -m <mode>               capture path: \"interrupt\" (pigpio build, default) or \"gpio-ts\"\n"
+    "  -n <rates>              comma separated list of rates of noise edges per second, default 0,300,1000,3000,10000,30000\n"
+    "  -f <frames/s>           average rate of valid frames, default 4\n"
+    "  -d <seconds>            duration of each run, default 5\n"
+    "  -w <min>,<max>          range of widths of noise pulses in microseconds, default 5,300\n"
+    "  -c                      noise is not suppressed during frames so it corrupts them\n"
+    "  -j <jitter>             maximal deviation of durations of frames in microseconds, default 20\n"
+    "  -s <seed>               seed of the random generator\n",
+    stderr);
+  exit(1);
+}
+
+static long get_number(const char* arg, long min, long max) {
+  char* end;
+  long value = strtol(arg, &end, 10);
+  if (*arg == '\0' || *end != '\0' || value < min || value > max) {
+    fprintf(stderr, "ERROR: Invalid value \"%s\".\n", arg);
+    help();
+  }
+  return value;
+}
+
+// Parses a comma separated list of numbers. Returns the number of values.
+static int get_numbers(const char* arg, long* values, int max_count, long min, long max) {
+  int count = 0;
+  const char* p = arg;
+  while (true) {
+    char* end;
+    long value = strtol(p, &end, 10);
+    if (end == p || (*end != ',' && *end != '\0') || value < min || value > max || count >= max_count) {
+      fprintf(stderr, "ERROR: Invalid value \"%s\".\n", arg);
+      help();
+    }
+    values[count++] = value;
+    if (*end == '\0') break;
+    p = end+1;
+  }
+  return count;
+}
+
+//-------------------------------------------------------------
+class CaptureLoadTest {
+private:
+  Receiver* receiver;
+  GpioTsEmulation* emulation;
+  int mode;
+  const EdgeTimeline* timeline;
+  RunResult* result;
+  volatile bool feeding;
+
+  static void* feederThreadFunction(void* context) {
+    ((CaptureLoadTest*)context)->feeder();
+    return NULL;
+  }
+  static void* decoderThreadFunction(void* context) {
+    ((CaptureLoadTest*)context)->decoder();
+    return NULL;
+  }
+
+  void feedEdge(uint32_t time, int level) {
+    if (mode == MODE_GPIO_TS)
+      emulation->edge(time, level);
+    else
+      receiver->handleInterrupt(level, time);
+  }
+
+  // Works as the interrupt handler: edges are fed at their time.
+  void feeder() {
+    uint64_t started = now_ns(CLOCK_MONOTONIC);
+    uint64_t max_lag = 0;
+    for (size_t index = 0; index <= timeline->count; index++) {
+      uint32_t time;
+      int level;
+      if (index < timeline->count) {
+        time = timeline->edges[index].time;
+        level = (int)timeline->edges[index].level;
+      } else { // the level is low already, this edge only ends the last sequence
+        time = (timeline->count == 0 ? 0 : timeline->edges[timeline->count-1].time)+FLUSH_DELAY;
+        level = 1;
+      }
+      uint64_t due = started+(uint64_t)time*1000;
+      uint64_t now = now_ns(CLOCK_MONOTONIC);
+      if (now+MAX_SLEEP_AHEAD*1000 < due) {
+        struct timespec ts;
+        ts.tv_sec = (time_t)(due/1000000000ULL);
+        ts.tv_nsec = (long)(due%1000000000ULL);
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+      } else if (now > due && now-due > max_lag) {
+        max_lag = now-due;
+      }
+      feedEdge(time, level);
+    }
+    result->capture_cpu_ns = now_ns(CLOCK_THREAD_CPUTIME_ID);
+    result->max_lag_ns = max_lag;
+    if (mode == MODE_GPIO_TS) emulation->close();
+    feeding = false;
+  }
+
+  // Works as Receiver::decoder() of the build.
+  void decoder() {
+    uint32_t items[GPIO_TS_READ_ITEMS];
+    while (true) {
+      if (receiver->iSequenceReady == receiver->iSequenceWrite) {
+        if (mode == MODE_GPIO_TS) {
+          int n_items = emulation->read(items, GPIO_TS_READ_ITEMS, GPIO_TS_READ_TIMEOUT);
+          if (n_items < 0) break;
+          receiver->putItems(items, n_items);
+        } else {
+          if (!feeding && receiver->iSequenceReady == receiver->iSequenceWrite) break;
+          usleep(DECODER_POLL_INTERVAL_US);
+        }
+        continue;
+      }
+      receiver->decodeSequence();
+    }
+    result->decoder_cpu_ns = now_ns(CLOCK_THREAD_CPUTIME_ID);
+    receiver->raiseReloadEvent();
+  }
+
+public:
+  CaptureLoadTest(Receiver* receiver, GpioTsEmulation* emulation, int mode) {
+    this->receiver = receiver;
+    this->emulation = emulation;
+    this->mode = mode;
+    timeline = NULL;
+    result = NULL;
+    feeding = false;
+    receiver->initLimits();
+    emulation->min_duration = (uint32_t)receiver->min_duration;
+    emulation->max_duration = (uint32_t)receiver->max_duration;
+    emulation->min_seq_len = (uint32_t)receiver->min_sequence_length;
+  }
+
+  bool run(const EdgeTimeline& timeline, RunResult& result) {
+    memset(&result, 0, sizeof(result));
+    memset(statistics, 0, sizeof(Statistics));
+    receiver->resetReceiverBuffer();
+    emulation->reset();
+    this->timeline = &timeline;
+    this->result = &result;
+    feeding = true;
+
+    uint64_t started = now_ns(CLOCK_MONOTONIC);
+    pthread_t feeder_thread;
+    pthread_t decoder_thread;
+    if (pthread_create(&feeder_thread, NULL, feederThreadFunction, this) != 0) {
+      fputs("ERROR: Cannot create thread.\n", stderr);
+      return false;
+    }
+    if (pthread_create(&decoder_thread, NULL, decoderThreadFunction, this) != 0) {
+      fputs("ERROR: Cannot create thread.\n", stderr);
+      pthread_join(feeder_thread, NULL);
+      return false;
+    }
+
+    // Works as the main loop: takes decoded messages from the queue.
+    while (true) {
+      ReceivedData* batch;
+      receiver->waitForMessages(batch, MESSAGE_BATCH_SIZE);
+      while (batch != NULL) {
+        ReceivedData* message = batch;
+        batch = message->next;
+        result.messages++;
+        Protocol* protocol = message->sensorData.protocol;
+        if (protocol != NULL) {
+          result.decoded_frames[protocol->protocol_index]++;
+          result.total_decoded++;
+        }
+        free(message);
+      }
+      if (receiver->checkAndResetReloadEvent() && !receiver->available()) break;
+    }
+
+    pthread_join(feeder_thread, NULL);
+    pthread_join(decoder_thread, NULL);
+    result.elapsed_ns = now_ns(CLOCK_MONOTONIC)-started;
+    result.gpiots_isr_count = emulation->isr_counter;
+    result.gpiots_buffer_overflows = emulation->buffer_overflow_counter;
+    return true;
+  }
+};
+
+//-------------------------------------------------------------
+int main(int argc, char *argv[]) {
+  int mode = MODE_INTERRUPT;
+  long noise_rates[MAX_NOISE_RATES] = { 0, 300, 1000, 3000, 10000, 30000 };
+  int noise_rates_count = 6;
+  long widths[2] = { DEFAULT_NOISE_MIN_WIDTH, DEFAULT_NOISE_MAX_WIDTH };
+  long frames_per_second = DEFAULT_FRAMES_PER_SECOND;
+  long duration = DEFAULT_DURATION;
+  int jitter = DEFAULT_GENERATOR_JITTER;
+  bool noise_during_frames = false;
+  uint32_t seed = 12345;
+
+  int c;
+  while ((c = getopt(argc, argv, "m:n:f:d:w:cj:s:h")) != -1) {
+    switch (c) {
+    case 'm':
+      if (strcmp(optarg, "interrupt") == 0)
+        mode = MODE_INTERRUPT;
+      else if (strcmp(optarg, "gpio-ts") == 0)
+        mode = MODE_GPIO_TS;
+      else {
+        fprintf(stderr, "ERROR: Invalid mode \"%s\".\n", optarg);
+        help();
+      }
+      break;
+    case 'n': noise_rates_count = get_numbers(optarg, noise_rates, MAX_NOISE_RATES, 0, 1000000); break;
+    case 'f': frames_per_second = get_number(optarg, 0, 40); break;
+    case 'd': duration = get_number(optarg, 1, 3600); break;
+    case 'w':
+      if (get_numbers(optarg, widths, 2, 1, 10000) != 2 || widths[0] > widths[1]) {
+        fprintf(stderr, "ERROR: Invalid value \"%s\".\n", optarg);
+        help();
+      }
+      break;
+    case 'c': noise_during_frames = true; break;
+    case 'j': jitter = (int)get_number(optarg, 0, 100); break;
+    case 's': seed = (uint32_t)get_number(optarg, 1, 0x7fffffff); break;
+    default: help();
+    }
+  }
+
+  Config cfg;
+  cfg.protocols = Protocol::rf_protocols;
+  Receiver receiver(&cfg);
+  GpioTsEmulation emulation;
+  CaptureLoadTest test(&receiver, &emulation, mode);
+
+  printf("{\n  \"mode\":\"%s\",\n  \"duration\":%ld,\n  \"frames_per_second\":%ld,\n  \"noise_min_width\":%ld,\n  \"noise_max_width\":%ld,\n"
+      "  \"noise_during_frames\":%s,\n  \"seed\":%u,\n  \"pool_size\":%d,\n  \"max_chains\":%d,\n  \"runs\":[",
+      mode_names[mode], duration, frames_per_second, widths[0], widths[1], noise_during_frames ? "true" : "false", seed, POOL_SIZE, MAX_CHAINS);
+
+  for (int index = 0; index < noise_rates_count; index++) {
+    EdgeGeneratorOptions options;
+    options.duration = (uint32_t)duration*1000000;
+    options.frames_per_second = (double)frames_per_second;
+    options.noise_edges_per_second = (double)noise_rates[index];
+    options.noise_min_width = (int)widths[0];
+    options.noise_max_width = (int)widths[1];
+    options.jitter = jitter;
+    options.seed = seed+index;
+    options.protocols = Protocol::rf_protocols;
+    options.noise_during_frames = noise_during_frames;
+
+    EdgeTimeline timeline;
+    if (!generate_edges(options, timeline)) {
+      fputs("ERROR: Out of memory.\n", stderr);
+      return 1;
+    }
+    RunResult result;
+    bool ok = test.run(timeline, result);
+    if (!ok) {
+      free_edge_timeline(timeline);
+      return 1;
+    }
+
+    double seconds = result.elapsed_ns/1e9;
+    printf("%s\n    {\"noise_edges_per_second\":%ld,\"edges\":%lu,\"noise_pulses\":%u,\"frames\":%u,\"decoded_frames\":%u,\"recovery\":%.4f,\n"
+        "     \"sequences\":%u,\"dropped\":%u,\"undecoded\":%u,\"sequence_pool_overflow\":%u,\"pool_overflow\":%u,",
+        index == 0 ? "" : ",", noise_rates[index], (unsigned long)timeline.count, timeline.noise_pulses, timeline.total_frames,
+        result.total_decoded, timeline.total_frames == 0 ? 1.0 : (double)result.total_decoded/timeline.total_frames,
+        statistics->sequences, statistics->dropped, statistics->undecoded, statistics->sequence_pool_overflow, statistics->pool_overflow);
+    if (mode == MODE_GPIO_TS)
+      printf("\"gpiots_isr_count\":%ld,\"gpiots_buffer_overflows\":%ld,", result.gpiots_isr_count, result.gpiots_buffer_overflows);
+    else
+      printf("\"skipped\":%u,\"corrected\":%u,", statistics->skipped, statistics->corrected);
+    printf("\n     \"capture_cpu_percent\":%.2f,\"decoder_cpu_percent\":%.2f,\"max_feed_lag_us\":%llu,\n     \"decoded_by_protocol\":{",
+        result.capture_cpu_ns/1e7/seconds, result.decoder_cpu_ns/1e7/seconds, (unsigned long long)(result.max_lag_ns/1000));
+    bool first = true;
+    for (int protocol_index = 0; protocol_index < NUMBER_OF_PROTOCOLS; protocol_index++) {
+      if (timeline.frames[protocol_index] == 0) continue;
+      Protocol* protocol = Protocol::protocols[protocol_index];
+      printf("%s\"%s\":[%u,%u]", first ? "" : ",", protocol->protocol_class,
+          result.decoded_frames[protocol_index], timeline.frames[protocol_index]);
+      first = false;
+    }
+    fputs("}}", stdout);
+    fflush(stdout);
+    free_edge_timeline(timeline);
+  }
+  fputs("\n  ]\n}\n", stdout);
+  return 0;
+}
@@ -0,0 +1,300 @@
+/*
+ * decoder_bench.cpp
+ *
+ * Microbenchmark of decoders of RF protocols.
+ * It measures the time of one call of Protocol::decode() for each RF protocol separately for
+ *   - success path: sequences that the protocol decodes,
+ *   - failure path: valid frames of other protocols,
+ *   - noise: random sequences and recorded sequences that no protocol decodes.
+ * Sequences are valid frames synthesized for each protocol (see sequence_generator.hpp), random noise and
+ * optionally a corpus of recorded sequences: logs of f007th-send with option -V or input logs of the test build
+ * (lines "... sequence size=N: d1, d2, ..."). Each recorded sequence is assigned to the protocol that decodes it.
+ * Results are printed in JSON so they can be compared between commits on the same board:
+ *
+ *   decoder-bench -r 2000 f007th-send.log > before.json
+ *
+ *   decoder-bench [-r <repetitions>] [-n <frames per protocol>] [-z <noise sequences>] [-j <jitter us>] [-s <seed>] [<log file>...]
+ *
+ *  Created on: October 18, 2026
+ *      Author: Alex Konshin
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "../protocols/Protocol.hpp"
+#include "../common/SensorsData.hpp"
+#include "../common/Receiver.hpp"
+#include "sequence_generator.hpp"
+
+#define DEFAULT_REPETITIONS 1000
+#define DEFAULT_FRAMES 16
+#define DEFAULT_NOISE 64
+#define NOISE_MIN_DURATION 100
+#define NOISE_MAX_DURATION 2000
+#define NOISE_MIN_SIZE 32
+
+#define SET_SUCCESS 0
+#define SET_FAILURE 1
+#define SET_NOISE   2
+#define NUMBER_OF_SETS 3
+
+static const char* set_names[NUMBER_OF_SETS] = { "success", "failure", "noise" };
+
+typedef struct Corpus {
+  ReceivedData** messages;
+  int* decoded_by;              // index of the protocol that decodes the sequence or -1
+  bool* recorded;
+  int count;
+  int capacity;
+} Corpus;
+
+typedef struct SetResult {
+  int sequences;
+  uint64_t attempts;
+  uint64_t decoded;
+  double ns_per_attempt;
+} SetResult;
+
+static uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec*1000000000ULL+ts.tv_nsec;
+}
+
+static void help() {
+  fputs(
+    "Usage: decoder-bench [-r <repetitions>] [-n <frames per protocol>] [-z <noise sequences>] [-j <jitter us>] [-s <seed>] [<log file>...]\n"
+    "  -r <repetitions>        number of passes over each set of sequences, default 1000\n"
+    "  -n <frames>             number of synthesized valid frames of each protocol, default 16\n"
+    "  -z <noise sequences>    number of random sequences, default 64\n"
+    "  -j <jitter>             maximal deviation of synthesized durations in microseconds, default 20\n"
+    "  -s <seed>               seed of the random generator\n"
+    "  <log file>              log with recorded sequences (f007th-send -V or input log of the test build)\n",
+    stderr);
+  exit(1);
+}
+
+static long get_number(const char* arg, long min, long max) {
+  char* end;
+  long value = strtol(arg, &end, 10);
+  if (*arg == '\0' || *end != '\0' || value < min || value > max) {
+    fprintf(stderr, "ERROR: Invalid value \"%s\".\n", arg);
+    help();
+  }
+  return value;
+}
+
+static ReceivedData* create_message(const int16_t* sequence, int size) {
+  ReceivedData* message = (ReceivedData*)malloc(sizeof(ReceivedData)+size*sizeof(int16_t));
+  if (message == NULL) return NULL;
+  memset(message, 0, sizeof(ReceivedData));
+  message->pSequence = (int16_t*)((uint8_t*)message+sizeof(ReceivedData));
+  memcpy(message->pSequence, sequence, size*sizeof(int16_t));
+  message->iSequenceSize = (int16_t)size;
+  return message;
+}
+
+static inline bool decode(Protocol* protocol, ReceivedData* message) {
+  message->sensorData.u64 = 0;
+  message->sensorData.protocol = NULL;
+  message->decodingStatus = 0;
+  message->decodedBits = 0;
+  message->protocol_tried_manchester = 0;
+  return protocol->decode(message);
+}
+
+static bool add_sequence(Corpus& corpus, const int16_t* sequence, int size, bool recorded) {
+  if (corpus.count >= corpus.capacity) {
+    int capacity = corpus.capacity == 0 ? 256 : corpus.capacity*2;
+    ReceivedData** messages = (ReceivedData**)realloc(corpus.messages, capacity*sizeof(ReceivedData*));
+    if (messages != NULL) corpus.messages = messages;
+    int* decoded_by = (int*)realloc(corpus.decoded_by, capacity*sizeof(int));
+    if (decoded_by != NULL) corpus.decoded_by = decoded_by;
+    bool* recorded_flags = (bool*)realloc(corpus.recorded, capacity*sizeof(bool));
+    if (recorded_flags != NULL) corpus.recorded = recorded_flags;
+    if (messages == NULL || decoded_by == NULL || recorded_flags == NULL) return false;
+    corpus.capacity = capacity;
+  }
+  ReceivedData* message = create_message(sequence, size);
+  if (message == NULL) return false;
+  corpus.messages[corpus.count] = message;
+  corpus.decoded_by[corpus.count] = -1;
+  corpus.recorded[corpus.count] = recorded;
+  corpus.count++;
+  return true;
+}
+
+// Reads lines "... sequence size=N: d1, d2, ..." in the same way as Receiver::readSequences().
+static int load_log(Corpus& corpus, const char* path) {
+  FILE* file = fopen(path, "r");
+  if (file == NULL) {
+    fprintf(stderr, "ERROR: Cannot open file \"%s\".\n", path);
+    return -1;
+  }
+  int16_t sequence[MAX_SEQUENCE_LENGTH];
+  int loaded = 0;
+  char* line = NULL;
+  size_t bufsize = 0;
+  while (getline(&line, &bufsize, file) != -1) {
+    const char* p = strstr(line, "sequence size=");
+    if (p == NULL || (p-line) > 60) continue;
+    p = strchr(p, ':');
+    if (p == NULL) continue;
+    p++;
+    int size = 0;
+    while (size < MAX_SEQUENCE_LENGTH) {
+      char* end;
+      long duration = strtol(p, &end, 10);
+      if (end == p || duration <= 0 || duration > INT16_MAX) break;
+      sequence[size++] = (int16_t)duration;
+      p = end;
+      while (*p == ',' || *p == ' ') p++;
+    }
+    if (size < NOISE_MIN_SIZE) continue;
+    if (!add_sequence(corpus, sequence, size, true)) break;
+    loaded++;
+  }
+  free(line);
+  fclose(file);
+  return loaded;
+}
+
+static SetResult run_set(Protocol* protocol, Corpus& corpus, int set, int repetitions) {
+  SetResult result;
+  memset(&result, 0, sizeof(result));
+
+  ReceivedData** messages = (ReceivedData**)malloc(corpus.count*sizeof(ReceivedData*));
+  if (messages == NULL) return result;
+  int count = 0;
+  for (int index = 0; index < corpus.count; index++) {
+    int decoded_by = corpus.decoded_by[index];
+    int message_set = decoded_by == protocol->protocol_index ? SET_SUCCESS : decoded_by >= 0 ? SET_FAILURE : SET_NOISE;
+    if (message_set == set) messages[count++] = corpus.messages[index];
+  }
+  result.sequences = count;
+  if (count == 0) {
+    free(messages);
+    return result;
+  }
+
+  // warm up caches and branch predictors
+  for (int index = 0; index < count; index++) decode(protocol, messages[index]);
+
+  uint64_t decoded = 0;
+  uint64_t start = now_ns();
+  for (int repetition = 0; repetition < repetitions; repetition++) {
+    for (int index = 0; index < count; index++) {
+      if (decode(protocol, messages[index])) decoded++;
+    }
+  }
+  uint64_t elapsed = now_ns()-start;
+
+  result.attempts = (uint64_t)count*repetitions;
+  result.decoded = decoded;
+  result.ns_per_attempt = (double)elapsed/result.attempts;
+  free(messages);
+  return result;
+}
+
+int main(int argc, char *argv[]) {
+  int repetitions = DEFAULT_REPETITIONS;
+  int frames = DEFAULT_FRAMES;
+  int noise = DEFAULT_NOISE;
+  int jitter = DEFAULT_GENERATOR_JITTER;
+  uint32_t seed = 12345;
+
+  int c;
+  while ((c = getopt(argc, argv, "r:n:z:j:s:h")) != -1) {
+    switch (c) {
+    case 'r': repetitions = (int)get_number(optarg, 1, 100000000); break;
+    case 'n': frames = (int)get_number(optarg, 0, 100000); break;
+    case 'z': noise = (int)get_number(optarg, 0, 100000); break;
+    case 'j': jitter = (int)get_number(optarg, 0, 100); break;
+    case 's': seed = (uint32_t)get_number(optarg, 1, 0x7fffffff); break;
+    default: help();
+    }
+  }
+
+  Protocol::initialize();
+
+  Corpus corpus;
+  memset(&corpus, 0, sizeof(corpus));
+
+  int recorded = 0;
+  for (int index = optind; index < argc; index++) {
+    int loaded = load_log(corpus, argv[index]);
+    if (loaded < 0) return 1;
+    recorded += loaded;
+  }
+
+  SequenceGenerator generator(seed, jitter);
+  int16_t sequence[GENERATED_SEQUENCE_MAX_SIZE];
+  int generated_frames[NUMBER_OF_PROTOCOLS];
+  memset(generated_frames, 0, sizeof(generated_frames));
+  for (int protocol_index = 0; protocol_index < NUMBER_OF_PROTOCOLS; protocol_index++) {
+    for (int index = 0; index < frames; index++) {
+      int size = generator.generate(protocol_index, sequence);
+      if (size == 0) break;
+      add_sequence(corpus, sequence, size, false);
+      generated_frames[protocol_index]++;
+    }
+  }
+  for (int index = 0; index < noise; index++) {
+    int size = NOISE_MIN_SIZE+generator.random()%(GENERATED_SEQUENCE_MAX_SIZE-NOISE_MIN_SIZE+1);
+    size = generator.generateNoise(sequence, size, NOISE_MIN_DURATION, NOISE_MAX_DURATION);
+    add_sequence(corpus, sequence, size, false);
+  }
+
+  // Assign each sequence to the first protocol that decodes it, in the same order as the decoder thread tries them.
+  for (int index = 0; index < corpus.count; index++) {
+    for (int protocol_index = 0; protocol_index < NUMBER_OF_PROTOCOLS; protocol_index++) {
+      Protocol* protocol = Protocol::protocols[protocol_index];
+      if (protocol == NULL || (protocol->features&FEATURE_RF) == 0) continue;
+      if (decode(protocol, corpus.messages[index])) {
+        corpus.decoded_by[index] = protocol_index;
+        break;
+      }
+    }
+  }
+
+  printf("{\n  \"repetitions\":%d,\n  \"seed\":%u,\n  \"jitter\":%d,\n  \"recorded_sequences\":%d,\n  \"noise_sequences\":%d,\n  \"protocols\":[",
+      repetitions, seed, jitter, recorded, noise);
+  bool first = true;
+  for (int protocol_index = 0; protocol_index < NUMBER_OF_PROTOCOLS; protocol_index++) {
+    Protocol* protocol = Protocol::protocols[protocol_index];
+    if (protocol == NULL || (protocol->features&FEATURE_RF) == 0) continue;
+
+    int recorded_decoded = 0;
+    int generated_decoded = 0;
+    for (int index = 0; index < corpus.count; index++) {
+      if (corpus.decoded_by[index] != protocol_index) continue;
+      if (corpus.recorded[index])
+        recorded_decoded++;
+      else
+        generated_decoded++;
+    }
+
+    printf("%s\n    {\"protocol\":\"%s\",\"generated_frames\":%d,\"generated_decoded\":%d,\"recorded_decoded\":%d",
+        first ? "" : ",", protocol->protocol_class, generated_frames[protocol_index], generated_decoded, recorded_decoded);
+    first = false;
+    for (int set = 0; set < NUMBER_OF_SETS; set++) {
+      SetResult result = run_set(protocol, corpus, set, repetitions);
+      printf(",\n      \"%s\":{\"sequences\":%d,\"attempts\":%llu,\"decoded\":%llu,\"ns_per_attempt\":%.1f}",
+          set_names[set], result.sequences, (unsigned long long)result.attempts, (unsigned long long)result.decoded, result.ns_per_attempt);
+    }
+    fputs("}", stdout);
+    fflush(stdout);
+  }
+  fputs("\n  ]\n}\n", stdout);
+
+  for (int index = 0; index < corpus.count; index++) free(corpus.messages[index]);
+  free(corpus.messages);
+  free(corpus.decoded_by);
+  free(corpus.recorded);
+  return 0;
+}
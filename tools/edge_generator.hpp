@@ -0,0 +1,198 @@
+/*
+ * edge_generator.hpp
+ *
+ * Generator of edges of the signal on the output of RF receiver for load tests.
+ * Valid frames of supported protocols (see sequence_generator.hpp) are sent at the given average rate.
+ * As real transmitters do, a frame that ends with the low level is sent twice so its last interval is not lost
+ * in the gap after the transmission. Noise pulses of random width are separated by random gaps that are not
+ * shorter than the minimal width (shifted Poisson process) to get the given rate of edges, so the rate cannot exceed
+ * 2 edges per the average width of a pulse plus the minimal width.
+ * By default the noise is suppressed during frames as AGC of the receiver does with strong signals.
+ * Otherwise the receiver output is high if either a frame or the noise is high, so noise that hits a frame corrupts it.
+ *
+ *  Created on: October 18, 2026
+ *      Author: Alex Konshin
+ */
+
+#ifndef TOOLS_EDGE_GENERATOR_HPP_
+#define TOOLS_EDGE_GENERATOR_HPP_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "sequence_generator.hpp"
+
+#define FRAME_MIN_GAP 20000  // microseconds, longer than any max_duration so each frame is a separate sequence
+
+typedef struct Edge {
+  uint32_t time;             // microseconds from the start
+  uint32_t level;            // level after the edge
+} Edge;
+
+typedef struct EdgeGeneratorOptions {
+  uint32_t duration;         // microseconds
+  double frames_per_second;
+  double noise_edges_per_second;
+  int noise_min_width;       // microseconds
+  int noise_max_width;
+  int jitter;                // microseconds, see SequenceGenerator
+  uint32_t seed;
+  uint32_t protocols;        // mask of protocols of frames
+  bool noise_during_frames;  // noise is not suppressed during frames
+} EdgeGeneratorOptions;
+
+typedef struct EdgeTimeline {
+  Edge* edges;
+  size_t count;
+  uint32_t frames[NUMBER_OF_PROTOCOLS];   // number of complete frames of each protocol
+  uint32_t total_frames;
+  uint32_t noise_pulses;
+} EdgeTimeline;
+
+typedef struct HighInterval {
+  uint32_t start;
+  uint32_t end;
+} HighInterval;
+
+typedef struct HighIntervals {
+  HighInterval* items;
+  size_t count;
+  size_t capacity;
+} HighIntervals;
+
+static bool add_high_interval(HighIntervals& intervals, uint32_t start, uint32_t end) {
+  if (intervals.count >= intervals.capacity) {
+    size_t capacity = intervals.capacity == 0 ? 1024 : intervals.capacity*2;
+    HighInterval* items = (HighInterval*)realloc(intervals.items, capacity*sizeof(HighInterval));
+    if (items == NULL) return false;
+    intervals.items = items;
+    intervals.capacity = capacity;
+  }
+  intervals.items[intervals.count].start = start;
+  intervals.items[intervals.count].end = end;
+  intervals.count++;
+  return true;
+}
+
+static void free_edge_timeline(EdgeTimeline& timeline) {
+  if (timeline.edges != NULL) free(timeline.edges);
+  memset(&timeline, 0, sizeof(timeline));
+}
+
+// Fills the timeline with edges of frames and noise for the duration. Returns false if memory cannot be allocated.
+static bool generate_edges(const EdgeGeneratorOptions& options, EdgeTimeline& timeline) {
+  memset(&timeline, 0, sizeof(timeline));
+  SequenceGenerator generator(options.seed, options.jitter);
+
+  HighIntervals frames;
+  HighIntervals spans;       // whole frames
+  HighIntervals noise;
+  memset(&frames, 0, sizeof(frames));
+  memset(&spans, 0, sizeof(spans));
+  memset(&noise, 0, sizeof(noise));
+  bool ok = true;
+
+  // frames, protocols are taken in turn
+  if (options.frames_per_second > 0) {
+    double interval = 1000000.0/options.frames_per_second;
+    int16_t sequence[GENERATED_SEQUENCE_MAX_SIZE*2];
+    uint32_t start = (uint32_t)(generator.random()%(uint32_t)interval);
+    int protocol_index = 0;
+    while (ok) {
+      int size = 0;
+      for (int attempt = 0; attempt < NUMBER_OF_PROTOCOLS && size == 0; attempt++) {
+        protocol_index = (protocol_index+1)%NUMBER_OF_PROTOCOLS;
+        if (((1u<<protocol_index)&options.protocols) != 0) size = generator.generate(protocol_index, sequence);
+      }
+      if (size == 0) break; // no protocols
+      if ((size&1) == 0) { // repeat the frame
+        memcpy(sequence+size, sequence, size*sizeof(int16_t));
+        size *= 2;
+      }
+
+      uint64_t end = start;
+      for (int index = 0; index < size; index++) end += sequence[index];
+      if (end > options.duration) break;
+
+      uint32_t time = start;
+      for (int index = 0; index < size && ok; index += 2) {
+        ok = add_high_interval(frames, time, time+sequence[index]);
+        time += sequence[index];
+        if (index+1 < size) time += sequence[index+1];
+      }
+      if (ok) ok = add_high_interval(spans, start, (uint32_t)end);
+      timeline.frames[protocol_index]++;
+      timeline.total_frames++;
+
+      uint64_t next = start+(uint64_t)(interval*(0.5+(generator.random()%1000)/1000.0));
+      if (next < end+FRAME_MIN_GAP) next = end+FRAME_MIN_GAP;
+      if (next >= options.duration) break;
+      start = (uint32_t)next;
+    }
+  }
+
+  // noise pulses
+  if (options.noise_edges_per_second > 0) {
+    int width_range = options.noise_max_width-options.noise_min_width+1;
+    double mean_gap = 2000000.0/options.noise_edges_per_second-(options.noise_min_width+options.noise_max_width)/2.0
+        -options.noise_min_width; // two edges per pulse
+    if (mean_gap < 1) mean_gap = 1;
+    double time = 0;
+    size_t span_index = 0;
+    while (ok) {
+      double u = (generator.random()%1000000+1)/1000001.0;
+      time += options.noise_min_width-log(u)*mean_gap;
+      if (time >= options.duration) break;
+      uint32_t start = (uint32_t)time;
+      uint32_t width = options.noise_min_width+(width_range <= 1 ? 0 : generator.random()%width_range);
+      if (!options.noise_during_frames) {
+        while (span_index < spans.count && spans.items[span_index].end < start) span_index++;
+        if (span_index < spans.count && spans.items[span_index].start <= start+width) { // suppressed
+          time = spans.items[span_index].end;
+          continue;
+        }
+      }
+      ok = add_high_interval(noise, start, start+width);
+      timeline.noise_pulses++;
+      time += width;
+    }
+  }
+
+  // union of both lists, each of them is sorted by start
+  if (ok) {
+    timeline.edges = (Edge*)malloc((frames.count+noise.count)*2*sizeof(Edge)+sizeof(Edge));
+    ok = timeline.edges != NULL;
+  }
+  size_t frame_index = 0;
+  size_t noise_index = 0;
+  while (ok && (frame_index < frames.count || noise_index < noise.count)) {
+    bool take_frame = noise_index >= noise.count ||
+        (frame_index < frames.count && frames.items[frame_index].start <= noise.items[noise_index].start);
+    HighInterval interval = take_frame ? frames.items[frame_index++] : noise.items[noise_index++];
+    while (true) {
+      if (frame_index < frames.count && frames.items[frame_index].start <= interval.end) {
+        if (frames.items[frame_index].end > interval.end) interval.end = frames.items[frame_index].end;
+        frame_index++;
+      } else if (noise_index < noise.count && noise.items[noise_index].start <= interval.end) {
+        if (noise.items[noise_index].end > interval.end) interval.end = noise.items[noise_index].end;
+        noise_index++;
+      } else {
+        break;
+      }
+    }
+    timeline.edges[timeline.count].time = interval.start;
+    timeline.edges[timeline.count++].level = 1;
+    timeline.edges[timeline.count].time = interval.end;
+    timeline.edges[timeline.count++].level = 0;
+  }
+
+  if (frames.items != NULL) free(frames.items);
+  if (spans.items != NULL) free(spans.items);
+  if (noise.items != NULL) free(noise.items);
+  if (!ok) free_edge_timeline(timeline);
+  return ok;
+}
+
+#endif /* TOOLS_EDGE_GENERATOR_HPP_ */
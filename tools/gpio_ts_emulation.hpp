@@ -0,0 +1,168 @@
+/*
+ * gpio_ts_emulation.hpp
+ *
+ * User-space emulation of the buffer of kernel module gpio-ts as it is seen by readers of /dev/gpiotsN.
+ * Edges are converted into items make_item(status, duration) where status is the level of the interval.
+ * An interval shorter than min_duration or longer than max_duration ends the current sequence, which is
+ * published with an item of STATUS_NOISE if it has at least min_seq_len items and discarded otherwise.
+ * A sequence always starts with the high level. If the buffer is full then the current sequence is lost.
+ * If notify_fd is set then a byte is written into it when a sequence is published so readers can select() on
+ * the other end of the pipe.
+ *
+ *  Created on: October 18, 2026
+ *      Author: Alex Konshin
+ */
+
+#ifndef TOOLS_GPIO_TS_EMULATION_HPP_
+#define TOOLS_GPIO_TS_EMULATION_HPP_
+
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "../common/gpio-ts.h"
+
+#define GPIO_TS_EMULATION_BUFFER_SIZE 2048  // N_BUFFER_ITEMS of the module
+#define GPIO_TS_EMULATION_MAX_SEQ_LEN (GPIO_TS_EMULATION_BUFFER_SIZE-4)
+
+class GpioTsEmulation {
+private:
+  pthread_mutex_t lock;
+  pthread_cond_t readable;
+  uint32_t buffer[GPIO_TS_EMULATION_BUFFER_SIZE];
+  // positions grow forever, index in the buffer is position&(GPIO_TS_EMULATION_BUFFER_SIZE-1)
+  uint32_t read_position;
+  uint32_t write_position;           // end of published items
+  uint32_t current_seq_len;          // items of the current sequence after write_position
+  uint32_t last_time;
+  bool has_last_time;
+  bool closed;
+
+  void put(uint32_t item) {
+    buffer[(write_position+current_seq_len++)&(GPIO_TS_EMULATION_BUFFER_SIZE-1)] = item;
+  }
+
+  void endSequence(uint32_t duration) {
+    if (current_seq_len >= min_seq_len && current_seq_len > 0) {
+      if (duration > GPIO_TS_MAX_DURATION) duration = GPIO_TS_MAX_DURATION;
+      put(make_item(STATUS_NOISE, duration));
+      write_position += current_seq_len;
+      pthread_cond_signal(&readable);
+      if (notify_fd >= 0) {
+        ssize_t rc = ::write(notify_fd, "", 1); // it fails only if the pipe is full but then it is readable anyway
+        (void)rc;
+      }
+    }
+    current_seq_len = 0;
+  }
+
+public:
+  uint32_t min_duration;
+  uint32_t max_duration;
+  uint32_t min_seq_len;
+  volatile bool enabled;             // GPIOTS_IOCTL_START/GPIOTS_IOCTL_SUSPEND
+  int notify_fd;
+  // counters as returned by ioctl GPIOTS_IOCTL_GET_*_CNT
+  long isr_counter;
+  long buffer_overflow_counter;
+
+  GpioTsEmulation() {
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&readable, NULL);
+    min_duration = DEFAULT_MIN_DURATION;
+    max_duration = DEFAULT_MAX_DURATION;
+    min_seq_len = DEFAULT_MIN_SEQ_LEN;
+    enabled = true;
+    notify_fd = -1;
+    reset();
+  }
+  ~GpioTsEmulation() {
+    pthread_cond_destroy(&readable);
+    pthread_mutex_destroy(&lock);
+  }
+
+  void reset() {
+    pthread_mutex_lock(&lock);
+    read_position = 0;
+    write_position = 0;
+    current_seq_len = 0;
+    has_last_time = false;
+    closed = false;
+    isr_counter = 0;
+    buffer_overflow_counter = 0;
+    pthread_mutex_unlock(&lock);
+  }
+
+  // Called for each edge in the order of time (the interrupt handler). Level is the level after the edge.
+  void edge(uint32_t time, int level) {
+    if (!enabled) return;
+    pthread_mutex_lock(&lock);
+    isr_counter++;
+    if (!has_last_time) {
+      has_last_time = true;
+      last_time = time;
+      pthread_mutex_unlock(&lock);
+      return;
+    }
+    uint32_t duration = time-last_time;
+    last_time = time;
+    int interval_level = level == 0 ? 1 : 0;
+
+    if (duration < min_duration || duration > max_duration) {
+      endSequence(duration);
+    } else if (current_seq_len != 0 || interval_level == 1) {
+      if (write_position+current_seq_len+2-read_position > GPIO_TS_EMULATION_BUFFER_SIZE) { // reserve one item for the end of sequence
+        buffer_overflow_counter++;
+        current_seq_len = 0;
+      } else {
+        put(make_item(interval_level, duration));
+        if (current_seq_len >= GPIO_TS_EMULATION_MAX_SEQ_LEN) endSequence(0);
+      }
+    }
+    pthread_mutex_unlock(&lock);
+  }
+
+  // Publishes the current sequence and wakes up readers that wait for data.
+  void close() {
+    pthread_mutex_lock(&lock);
+    endSequence(GPIO_TS_MAX_DURATION);
+    closed = true;
+    pthread_cond_broadcast(&readable);
+    pthread_mutex_unlock(&lock);
+  }
+
+  bool available() {
+    pthread_mutex_lock(&lock);
+    bool result = read_position != write_position;
+    pthread_mutex_unlock(&lock);
+    return result;
+  }
+
+  // Returns the number of items copied into the array, 0 on timeout or (-1) if it is closed and all items were read.
+  int read(uint32_t* items, int max_items, int timeout_ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms/1000;
+    deadline.tv_nsec += (long)(timeout_ms%1000)*1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&lock);
+    while (read_position == write_position && !closed) {
+      if (pthread_cond_timedwait(&readable, &lock, &deadline) == ETIMEDOUT) break;
+    }
+    int count = 0;
+    while (count < max_items && read_position != write_position) {
+      items[count++] = buffer[(read_position++)&(GPIO_TS_EMULATION_BUFFER_SIZE-1)];
+    }
+    if (count == 0 && closed) count = -1;
+    pthread_mutex_unlock(&lock);
+    return count;
+  }
+};
+
+#endif /* TOOLS_GPIO_TS_EMULATION_HPP_ */
@@ -0,0 +1,486 @@
+/*
+ * gpio_ts_shim.cpp
+ *
+ * User-space stand-in for kernel module gpio-ts so the production receiver built with USE_GPIO_TS can be run
+ * and benchmarked end to end on a machine without the module (e.g. x86 dev box).
+ * The library is preloaded into f007th-send. It intercepts access("/sys/class/gpio-ts"), open("/dev/gpiotsN"),
+ * ioctl(), read() and close() of that file. The file descriptor is the read end of a pipe that becomes readable when
+ * a sequence is ready, so select() works as usual, and read() returns items make_item(status, duration) from
+ * the emulation of the buffer of the module (see gpio_ts_emulation.hpp). Limits set by ioctl are applied,
+ * counters of interrupts and buffer overflows are returned by ioctl.
+ * Edges are replayed with real timing from
+ *   - a log with sequences (f007th-send -V or input log of the test build), sequences are placed at their timestamps
+ *     (seconds) and separated by at least GPIO_TS_EMULATION_GAP milliseconds,
+ *   - or the generator of frames and noise (see edge_generator.hpp).
+ * Options are passed in environment variables:
+ *   GPIO_TS_EMULATION_INPUT=<log file>      replay sequences from the log instead of the generator
+ *   GPIO_TS_EMULATION_GAP=<ms>              minimal gap between replayed sequences, default 20
+ *   GPIO_TS_EMULATION_FRAMES=<frames/s>     average rate of generated frames, default 1
+ *   GPIO_TS_EMULATION_NOISE=<edges/s>       rate of generated noise edges, default 0
+ *   GPIO_TS_EMULATION_WIDTHS=<min>,<max>    range of widths of noise pulses in microseconds, default 5,300
+ *   GPIO_TS_EMULATION_DURATION=<seconds>    duration of one pass of the generator, default 60
+ *   GPIO_TS_EMULATION_PASSES=<n>            number of passes, 0 means forever, default 1
+ *   GPIO_TS_EMULATION_SEED=<n>              seed of the generator
+ *   GPIO_TS_EMULATION_EXIT=1                send SIGINT to the process 1 second after the last pass
+ *
+ *   make libgpio-ts-shim.so
+ *   GPIO_TS_EMULATION_NOISE=3000 GPIO_TS_EMULATION_EXIT=1 LD_PRELOAD=./libgpio-ts-shim.so f007th-send -g 27 -A
+ *
+ *  Created on: October 18, 2026
+ *      Author: Alex Konshin
+ */
+
+#undef _FORTIFY_SOURCE // read() must not be an inline wrapper here
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "edge_generator.hpp"
+#include "gpio_ts_emulation.hpp"
+
+#define SHIM_CLASS_PATH "/sys/class/gpio-ts"
+#define SHIM_DEVICE_PREFIX "/dev/gpiots"
+#define SHIM_PASS_GAP 1000000    // microseconds between passes, it also ends the last sequence of the pass
+#define SHIM_MAX_SLEEP 100000    // microseconds, the feeder checks whether it must stop at least this often
+#define SHIM_SLEEP_AHEAD 1000    // microseconds, edges that are due sooner are fed without sleeping
+#define SHIM_END_PULSE 10        // microseconds, high pulse that ends a replayed sequence that ends with low level
+
+typedef int (*open_function)(const char* path, int flags, ...);
+typedef int (*access_function)(const char* path, int mode);
+typedef int (*ioctl_function)(int fd, unsigned long request, ...);
+typedef ssize_t (*read_function)(int fd, void* buffer, size_t count);
+typedef ssize_t (*read_chk_function)(int fd, void* buffer, size_t count, size_t buffer_size);
+typedef int (*close_function)(int fd);
+
+typedef struct ShimOptions {
+  const char* input;
+  uint32_t gap;              // microseconds
+  EdgeGeneratorOptions generator;
+  unsigned passes;
+  bool exit;
+} ShimOptions;
+
+static open_function real_open = NULL;
+static open_function real_open64 = NULL;
+static access_function real_access = NULL;
+static ioctl_function real_ioctl = NULL;
+static read_function real_read = NULL;
+static read_chk_function real_read_chk = NULL;
+static close_function real_close = NULL;
+
+static pthread_mutex_t device_lock = PTHREAD_MUTEX_INITIALIZER;
+static volatile int device_fd = -1;
+static int notify_fd = -1;
+static int device_flags = 0;
+static GpioTsEmulation* emulation = NULL;
+static pthread_t feeder_thread;
+static volatile bool stop_feeder = false;
+static ShimOptions options;
+static EdgeTimeline input_timeline;
+
+__attribute__((constructor))
+static void shim_init() {
+  real_open = (open_function)dlsym(RTLD_NEXT, "open");
+  real_open64 = (open_function)dlsym(RTLD_NEXT, "open64");
+  real_access = (access_function)dlsym(RTLD_NEXT, "access");
+  real_ioctl = (ioctl_function)dlsym(RTLD_NEXT, "ioctl");
+  real_read = (read_function)dlsym(RTLD_NEXT, "read");
+  real_read_chk = (read_chk_function)dlsym(RTLD_NEXT, "__read_chk");
+  real_close = (close_function)dlsym(RTLD_NEXT, "close");
+}
+
+static bool is_device(int fd) {
+  return fd >= 0 && fd == device_fd;
+}
+
+//-------------------------------------------------------------
+static bool get_option(const char* name, long& value, long min, long max) {
+  const char* text = getenv(name);
+  if (text == NULL || *text == '\0') return true;
+  char* end;
+  long n = strtol(text, &end, 10);
+  if (*end != '\0' || n < min || n > max) {
+    fprintf(stderr, "gpio-ts-shim: Invalid value \"%s\" of %s.\n", text, name);
+    return false;
+  }
+  value = n;
+  return true;
+}
+
+static bool get_options(ShimOptions& options) {
+  memset(&options, 0, sizeof(options));
+  options.input = getenv("GPIO_TS_EMULATION_INPUT");
+  if (options.input != NULL && *options.input == '\0') options.input = NULL;
+
+  long gap = FRAME_MIN_GAP/1000;
+  long frames = 1;
+  long noise = 0;
+  long duration = 60;
+  long passes = 1;
+  long seed = 12345;
+  long exit = 0;
+  long widths[2] = { 5, 300 };
+  if (!get_option("GPIO_TS_EMULATION_GAP", gap, 1, 3600000) ||
+      !get_option("GPIO_TS_EMULATION_FRAMES", frames, 0, 40) ||
+      !get_option("GPIO_TS_EMULATION_NOISE", noise, 0, 1000000) ||
+      !get_option("GPIO_TS_EMULATION_DURATION", duration, 1, 3600) ||
+      !get_option("GPIO_TS_EMULATION_PASSES", passes, 0, 1000000) ||
+      !get_option("GPIO_TS_EMULATION_SEED", seed, 1, 0x7fffffff) ||
+      !get_option("GPIO_TS_EMULATION_EXIT", exit, 0, 1)) {
+    return false;
+  }
+  const char* text = getenv("GPIO_TS_EMULATION_WIDTHS");
+  if (text != NULL && *text != '\0') {
+    char* end;
+    widths[0] = strtol(text, &end, 10);
+    if (*end == ',') widths[1] = strtol(end+1, &end, 10);
+    if (*end != '\0' || widths[0] < 1 || widths[0] > widths[1] || widths[1] > 10000) {
+      fprintf(stderr, "gpio-ts-shim: Invalid value \"%s\" of GPIO_TS_EMULATION_WIDTHS.\n", text);
+      return false;
+    }
+  }
+
+  options.gap = (uint32_t)gap*1000;
+  options.passes = (unsigned)passes;
+  options.exit = exit != 0;
+  options.generator.duration = (uint32_t)duration*1000000;
+  options.generator.frames_per_second = (double)frames;
+  options.generator.noise_edges_per_second = (double)noise;
+  options.generator.noise_min_width = (int)widths[0];
+  options.generator.noise_max_width = (int)widths[1];
+  options.generator.jitter = DEFAULT_GENERATOR_JITTER;
+  options.generator.seed = (uint32_t)seed;
+  options.generator.protocols = (1u<<NUMBER_OF_PROTOCOLS)-1; // the generator skips protocols that it does not support
+  return true;
+}
+
+//-------------------------------------------------------------
+static bool add_edge(EdgeTimeline& timeline, size_t& capacity, uint32_t time, uint32_t level) {
+  if (timeline.count >= capacity) {
+    size_t new_capacity = capacity == 0 ? 4096 : capacity*2;
+    Edge* edges = (Edge*)realloc(timeline.edges, new_capacity*sizeof(Edge));
+    if (edges == NULL) return false;
+    timeline.edges = edges;
+    capacity = new_capacity;
+  }
+  timeline.edges[timeline.count].time = time;
+  timeline.edges[timeline.count++].level = level;
+  return true;
+}
+
+// Returns the time of the line in seconds or (-1) if the line does not start with a timestamp.
+// Both formats of the log are accepted: "2026-10-18 12:30:45-0400 " and "2026-10-18T16:30:45Z ".
+static time_t get_line_time(const char* line) {
+  struct tm tm;
+  memset(&tm, 0, sizeof(tm));
+  char separator;
+  if (sscanf(line, "%4d-%2d-%2d%c%2d:%2d:%2d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &separator,
+      &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 7 || (separator != ' ' && separator != 'T')) {
+    return -1;
+  }
+  tm.tm_year -= 1900;
+  tm.tm_mon--;
+  return timegm(&tm); // only differences are used so the time zone does not matter
+}
+
+// Reads lines "... sequence size=N: d1, d2, ..." and converts sequences into edges.
+static bool load_input(const char* path, uint32_t gap, EdgeTimeline& timeline) {
+  memset(&timeline, 0, sizeof(timeline));
+  FILE* file = fopen(path, "r");
+  if (file == NULL) {
+    fprintf(stderr, "gpio-ts-shim: Cannot open file \"%s\".\n", path);
+    return false;
+  }
+  size_t capacity = 0;
+  uint64_t end = 0;
+  time_t first_time = -1;
+  bool ok = true;
+  char* line = NULL;
+  size_t bufsize = 0;
+  while (ok && getline(&line, &bufsize, file) != -1) {
+    const char* p = strstr(line, "sequence size=");
+    if (p == NULL || (p-line) > 60) continue;
+    p = strchr(p, ':');
+    if (p == NULL) continue;
+    p++;
+
+    uint64_t start = timeline.count == 0 ? gap : end+gap;
+    time_t line_time = get_line_time(line);
+    if (line_time >= 0) {
+      if (first_time < 0) first_time = line_time;
+      uint64_t scheduled = (uint64_t)(line_time-first_time)*1000000+gap;
+      if (line_time >= first_time && scheduled > start) start = scheduled;
+    }
+    if (start > UINT32_MAX-SHIM_PASS_GAP) break; // it is long enough
+
+    uint64_t time = start;
+    uint32_t level = 1;
+    size_t first_edge = timeline.count;
+    while (ok) {
+      char* number_end;
+      long duration = strtol(p, &number_end, 10);
+      if (number_end == p || duration <= 0 || duration > INT16_MAX) break;
+      ok = add_edge(timeline, capacity, (uint32_t)time, level);
+      time += duration;
+      level ^= 1;
+      p = number_end;
+      while (*p == ',' || *p == ' ') p++;
+    }
+    if (!ok || timeline.count == first_edge) continue;
+    if (level == 1) { // the last interval was low, a short pulse ends it
+      ok = add_edge(timeline, capacity, (uint32_t)time, 1);
+      time += SHIM_END_PULSE;
+    }
+    if (ok) ok = add_edge(timeline, capacity, (uint32_t)time, 0);
+    end = time;
+    timeline.total_frames++;
+  }
+  free(line);
+  fclose(file);
+  if (!ok) {
+    fprintf(stderr, "gpio-ts-shim: Out of memory.\n");
+    free_edge_timeline(timeline);
+    return false;
+  }
+  if (timeline.count == 0) {
+    fprintf(stderr, "gpio-ts-shim: No sequences in file \"%s\".\n", path);
+    return false;
+  }
+  return true;
+}
+
+//-------------------------------------------------------------
+static uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec*1000000000ULL+ts.tv_nsec;
+}
+
+// Sleeps until the time. Returns false if the feeder must stop.
+static bool sleep_until(uint64_t due) {
+  while (!stop_feeder) {
+    uint64_t now = now_ns();
+    if (now+SHIM_SLEEP_AHEAD*1000ULL >= due) return true;
+    uint64_t wakeup = due-now > SHIM_MAX_SLEEP*1000ULL ? now+SHIM_MAX_SLEEP*1000ULL : due;
+    struct timespec ts;
+    ts.tv_sec = (time_t)(wakeup/1000000000ULL);
+    ts.tv_nsec = (long)(wakeup%1000000000ULL);
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+  }
+  return false;
+}
+
+// Works as the interrupt handler of the module: edges are fed at their time.
+static void* feeder_thread_function(void* context) {
+  uint64_t started = now_ns();
+  uint64_t offset = 0; // microseconds, start of the current pass
+  for (unsigned pass = 0; options.passes == 0 || pass < options.passes; pass++) {
+    EdgeTimeline generated;
+    const EdgeTimeline* timeline = &input_timeline;
+    if (options.input == NULL) {
+      EdgeGeneratorOptions generator = options.generator;
+      generator.seed += pass;
+      if (!generate_edges(generator, generated)) {
+        fprintf(stderr, "gpio-ts-shim: Out of memory.\n");
+        break;
+      }
+      timeline = &generated;
+    }
+
+    for (size_t index = 0; index < timeline->count && !stop_feeder; index++) {
+      uint64_t time = offset+timeline->edges[index].time;
+      if (!sleep_until(started+time*1000)) break;
+      emulation->edge((uint32_t)time, (int)timeline->edges[index].level);
+    }
+    offset += (timeline->count == 0 ? 0 : timeline->edges[timeline->count-1].time)+SHIM_PASS_GAP;
+    if (options.input == NULL) free_edge_timeline(generated);
+    if (stop_feeder) return NULL;
+  }
+
+  // rising edge after the gap ends the last sequence
+  if (!sleep_until(started+offset*1000)) return NULL;
+  emulation->edge((uint32_t)offset, 1);
+  if (options.exit) {
+    if (!sleep_until(started+(offset+SHIM_PASS_GAP)*1000)) return NULL;
+    kill(getpid(), SIGINT);
+  }
+  return NULL;
+}
+
+//-------------------------------------------------------------
+static int open_device(const char* path, int flags) {
+  char* end;
+  long gpio = strtol(path+sizeof(SHIM_DEVICE_PREFIX)-1, &end, 10);
+  if (*end != '\0' || gpio < 0 || gpio > 64) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  pthread_mutex_lock(&device_lock);
+  if (device_fd >= 0) { // only one device is emulated
+    pthread_mutex_unlock(&device_lock);
+    errno = EBUSY;
+    return -1;
+  }
+  if (!get_options(options) || (options.input != NULL && !load_input(options.input, options.gap, input_timeline))) {
+    pthread_mutex_unlock(&device_lock);
+    errno = EINVAL;
+    return -1;
+  }
+  int fds[2];
+  if (pipe2(fds, O_NONBLOCK|O_CLOEXEC) != 0) {
+    int err = errno;
+    free_edge_timeline(input_timeline);
+    pthread_mutex_unlock(&device_lock);
+    errno = err;
+    return -1;
+  }
+  emulation = new GpioTsEmulation();
+  emulation->notify_fd = fds[1];
+  notify_fd = fds[1];
+  device_flags = flags;
+  stop_feeder = false;
+  if (pthread_create(&feeder_thread, NULL, feeder_thread_function, NULL) != 0) {
+    real_close(fds[0]);
+    real_close(fds[1]);
+    delete emulation;
+    emulation = NULL;
+    free_edge_timeline(input_timeline);
+    pthread_mutex_unlock(&device_lock);
+    errno = ENOMEM;
+    return -1;
+  }
+  device_fd = fds[0];
+  pthread_mutex_unlock(&device_lock);
+  fprintf(stderr, "gpio-ts-shim: Emulating %s (%s).\n", path, options.input != NULL ? options.input : "generator");
+  return fds[0];
+}
+
+static ssize_t read_device(int fd, void* buffer, size_t count) {
+  uint32_t* items = (uint32_t*)buffer;
+  int max_items = (int)(count/sizeof(uint32_t));
+  if (max_items == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  char bytes[64];
+  while (real_read(fd, bytes, sizeof(bytes)) > 0) {} // reset readiness of the file
+  int n_items;
+  while ((n_items = emulation->read(items, max_items, (device_flags&O_NONBLOCK) != 0 ? 0 : 1000)) == 0) {
+    if ((device_flags&O_NONBLOCK) != 0) {
+      errno = EAGAIN;
+      return -1;
+    }
+  }
+  if (n_items < 0) return 0;
+  if (emulation->available()) {
+    ssize_t rc = write(notify_fd, "", 1); // the rest of items is still readable
+    (void)rc;
+  }
+  return (ssize_t)n_items*sizeof(uint32_t);
+}
+
+static int close_device(int fd) {
+  pthread_mutex_lock(&device_lock);
+  device_fd = -1;
+  stop_feeder = true;
+  pthread_join(feeder_thread, NULL);
+  int rc = real_close(fd);
+  real_close(notify_fd);
+  notify_fd = -1;
+  delete emulation;
+  emulation = NULL;
+  free_edge_timeline(input_timeline);
+  pthread_mutex_unlock(&device_lock);
+  return rc;
+}
+
+//-------------------------------------------------------------
+// Interceptors
+
+extern "C" {
+
+int access(const char* path, int mode) __THROW {
+  if (strcmp(path, SHIM_CLASS_PATH) == 0) return 0;
+  return real_access(path, mode);
+}
+
+int open(const char* path, int flags, ...) {
+  if (strncmp(path, SHIM_DEVICE_PREFIX, sizeof(SHIM_DEVICE_PREFIX)-1) == 0) return open_device(path, flags);
+  va_list args;
+  va_start(args, flags);
+  mode_t mode = (flags&(O_CREAT|O_TMPFILE)) != 0 ? va_arg(args, mode_t) : 0;
+  va_end(args);
+  return real_open(path, flags, mode);
+}
+
+int open64(const char* path, int flags, ...) {
+  if (strncmp(path, SHIM_DEVICE_PREFIX, sizeof(SHIM_DEVICE_PREFIX)-1) == 0) return open_device(path, flags);
+  va_list args;
+  va_start(args, flags);
+  mode_t mode = (flags&(O_CREAT|O_TMPFILE)) != 0 ? va_arg(args, mode_t) : 0;
+  va_end(args);
+  return real_open64(path, flags, mode);
+}
+
+int ioctl(int fd, unsigned long request, ...) __THROW {
+  va_list args;
+  va_start(args, request);
+  unsigned long argument = va_arg(args, unsigned long);
+  va_end(args);
+  if (!is_device(fd)) return real_ioctl(fd, request, argument);
+
+  switch (request) {
+  case GPIOTS_IOCTL_START:
+    emulation->enabled = true;
+    return 0;
+  case GPIOTS_IOCTL_SUSPEND:
+    emulation->enabled = false;
+    return 0;
+  case GPIOTS_IOCTL_SET_MIN_DURATION:
+    emulation->min_duration = (uint32_t)argument;
+    return 0;
+  case GPIOTS_IOCTL_SET_MAX_DURATION:
+    emulation->max_duration = (uint32_t)argument;
+    return 0;
+  case GPIOTS_IOCTL_SET_MIN_SEQ_LEN:
+    emulation->min_seq_len = (uint32_t)argument;
+    return 0;
+  case GPIOTS_IOCTL_GET_IRQ_OVERFLOW_CNT:
+    return 0; // edges are never lost before the buffer
+  case GPIOTS_IOCTL_GET_BUF_OVERFLOW_CNT:
+    return (int)__atomic_load_n(&emulation->buffer_overflow_counter, __ATOMIC_RELAXED);
+  case GPIOTS_IOCTL_GET_ISR_CNT:
+    return (int)__atomic_load_n(&emulation->isr_counter, __ATOMIC_RELAXED);
+  }
+  errno = ENOTTY;
+  return -1;
+}
+
+ssize_t read(int fd, void* buffer, size_t count) {
+  if (is_device(fd)) return read_device(fd, buffer, count);
+  return real_read(fd, buffer, count);
+}
+
+ssize_t __read_chk(int fd, void* buffer, size_t count, size_t buffer_size) {
+  if (is_device(fd)) return read_device(fd, buffer, count < buffer_size ? count : buffer_size);
+  return real_read_chk(fd, buffer, count, buffer_size);
+}
+
+int close(int fd) {
+  if (is_device(fd)) return close_device(fd);
+  return real_close(fd);
+}
+
+}
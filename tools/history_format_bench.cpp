@@ -0,0 +1,160 @@
+/*
+ * history_format_bench.cpp
+ *
+ * Benchmark of the formats of history responses (json, columnar and binary).
+ * Fills the history of one sensor with points and prints the size of the response
+ * (plain and compressed with gzip) and the time of its generation for each format.
+ * With option -p it also measures responses downsampled to the given number of points by LTTB and min/max,
+ * e.g. 30 days of readings every minute for a chart 1000 pixels wide:
+ *
+ *   history-format-bench -n 43200 -p 1000
+ *
+ *   history-format-bench [-n <points>] [-i <interval seconds>] [-r <repetitions>] [-p <chart points>]
+ *
+ *  Created on: October 18, 2026
+ *      Author: Alex Konshin
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <zlib.h>
+
+#define HISTORY_DEPTH_HOURS (24*366)
+#include "../common/History.hpp"
+
+#define DEFAULT_POINTS 1440
+#define DEFAULT_INTERVAL 60
+#define DEFAULT_REPETITIONS 200
+
+static uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec*1000000000ULL+ts.tv_nsec;
+}
+
+static size_t gzip_size(const void* data, size_t size) {
+  uLongf compressed_size = compressBound(size)+32;
+  void* compressed = malloc(compressed_size);
+  if (compressed == NULL) return 0;
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  size_t result = 0;
+  if (deflateInit2(&stream, 6, Z_DEFLATED, 15+16, 8, Z_DEFAULT_STRATEGY) == Z_OK) {
+    stream.next_in = (Bytef*)data;
+    stream.avail_in = size;
+    stream.next_out = (Bytef*)compressed;
+    stream.avail_out = compressed_size;
+    if (deflate(&stream, Z_FINISH) == Z_STREAM_END) result = stream.total_out;
+    deflateEnd(&stream);
+  }
+  free(compressed);
+  return result;
+}
+
+static void help() {
+  fputs(
+    "Usage: history-format-bench [-n <points>] [-i <interval seconds>] [-r <repetitions>] [-p <chart points>]\n"
+    "  -n  number of points in the history, default is 1440 (one day with readings every minute)\n"
+    "  -i  interval between points in seconds, default is 60\n"
+    "  -r  number of generations of each format, default is 200\n"
+    "  -p  downsample responses to this number of points with LTTB and min/max\n",
+    stderr);
+}
+
+int main(int argc, char** argv) {
+  unsigned points = DEFAULT_POINTS;
+  unsigned interval = DEFAULT_INTERVAL;
+  unsigned repetitions = DEFAULT_REPETITIONS;
+  unsigned chart_points = 0;
+
+  int c;
+  while ((c = getopt(argc, argv, "n:i:r:p:")) != -1) {
+    switch (c) {
+    case 'n':
+      points = (unsigned)atoi(optarg);
+      break;
+    case 'i':
+      interval = (unsigned)atoi(optarg);
+      break;
+    case 'r':
+      repetitions = (unsigned)atoi(optarg);
+      break;
+    case 'p':
+      chart_points = (unsigned)atoi(optarg);
+      break;
+    default:
+      help();
+      return 1;
+    }
+  }
+  if (points == 0 || interval == 0 || repetitions == 0 || (chart_points != 0 && chart_points < MIN_DOWNSAMPLE_POINTS)) {
+    help();
+    return 1;
+  }
+
+  // History must be zero-initialized like in SensorDataStored.
+  History* history = (History*)calloc(1, sizeof(History));
+  if (history == NULL) return 1;
+
+  // Temperature x10 in Fahrenheit with a small random walk and jitter of timestamps like real sensors.
+  srand(1);
+  time_t time = ::time(NULL)-(time_t)points*interval;
+  int32_t value = 700;
+  for (unsigned index = 0; index < points; index++) {
+    time += interval+(rand()%3)-1;
+    value += (rand()%5)-2;
+    history->add(time, value);
+  }
+
+  static const char* names[] = { "json", "columnar", "binary" };
+  static const char* method_names[] = { "none", "lttb", "minmax" };
+  printf("%u points, %u repetitions\n", points, repetitions);
+  printf("%-10s %-8s %8s %10s %10s %12s %12s\n", "format", "sampling", "points", "bytes", "gzip", "bytes/point", "us/response");
+  int methods = chart_points == 0 ? 1 : 3;
+  for (int m = 0; m < methods; m++) {
+    DownsampleMethod method = (DownsampleMethod)m;
+    unsigned max_points = method == DownsampleMethod::none ? 0 : chart_points;
+    for (int format = 0; format < 3; format++) {
+      void* buffer = NULL;
+      size_t buffer_size = 0;
+      size_t size = 0;
+      unsigned returned = 0;
+      time_t last_time;
+      uint64_t started = now_ns();
+      for (unsigned r = 0; r < repetitions; r++) {
+        switch ((HistoryFormat)format) {
+        case HistoryFormat::json:
+          size = history->generateJson(0, 0, 0, max_points, method, buffer, buffer_size, ValueConversion::None, false, false, last_time);
+          break;
+        case HistoryFormat::columnar:
+          size = history->generateColumnarJson(0, 0, 0, max_points, method, buffer, buffer_size, ValueConversion::None, false, last_time);
+          break;
+        case HistoryFormat::binary:
+          size = history->generateBinary(0, 0, 0, max_points, method, buffer, buffer_size, ValueConversion::None, 10, last_time);
+          break;
+        }
+      }
+      uint64_t elapsed = now_ns()-started;
+      if (size >= HISTORY_BINARY_HEADER_SIZE && (HistoryFormat)format == HistoryFormat::binary) {
+        const uint8_t* p = (const uint8_t*)buffer+4;
+        returned = p[0]|(p[1]<<8)|(p[2]<<16)|((unsigned)p[3]<<24);
+      }
+      if ((HistoryFormat)format == HistoryFormat::binary) {
+        printf("%-10s %-8s %8u %10zu %10zu %12.1f %12.1f\n", names[format], method_names[m], returned, size, gzip_size(buffer, size),
+            returned == 0 ? 0.0 : (double)size/returned, (double)elapsed/repetitions/1000);
+      } else {
+        printf("%-10s %-8s %8s %10zu %10zu %12s %12.1f\n", names[format], method_names[m], "", size, gzip_size(buffer, size),
+            "", (double)elapsed/repetitions/1000);
+      }
+      free(buffer);
+    }
+  }
+
+  history->clear();
+  free(history);
+  return 0;
+}
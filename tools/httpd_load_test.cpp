@@ -0,0 +1,335 @@
+/*
+ * httpd_load_test.cpp
+ *
+ * Load test of the built-in HTTP server.
+ * Keeps the given number of keep-alive connections busy with GET requests and prints
+ * the number of requests per second and the latency percentiles.
+ *
+ *   httpd-load-test [-h <host>] [-p <port>] [-c <clients>] [-d <seconds>] [-u <url>]
+ *
+ *  Created on: October 18, 2026
+ *      Author: Alex Konshin
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#define DEFAULT_HOST "127.0.0.1"
+#define DEFAULT_PORT "8888"
+#define DEFAULT_URL "/api/sensors"
+#define DEFAULT_CLIENTS 100
+#define DEFAULT_DURATION 10
+#define MAX_CLIENTS 10000
+#define MAX_REQUEST 1024
+#define INITIAL_RESPONSE_BUFFER_SIZE 16384
+
+typedef struct Client {
+  int fd;
+  uint64_t started;     // time when the current request was sent, ns
+  char* buffer;
+  size_t buffer_size;
+  size_t received;
+} Client;
+
+typedef struct Latencies {
+  uint32_t* items;      // microseconds
+  size_t count;
+  size_t capacity;
+} Latencies;
+
+static struct addrinfo* address = NULL;
+static char request[MAX_REQUEST];
+static size_t request_len = 0;
+static uint64_t errors = 0;
+static uint64_t reconnects = 0;
+static uint64_t bytes_received = 0;
+
+//-------------------------------------------------------------
+static uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec*1000000000ULL+ts.tv_nsec;
+}
+
+static bool add_latency(Latencies& latencies, uint64_t ns) {
+  if (latencies.count >= latencies.capacity) {
+    size_t capacity = latencies.capacity == 0 ? 65536 : latencies.capacity*2;
+    uint32_t* items = (uint32_t*)realloc(latencies.items, capacity*sizeof(uint32_t));
+    if (items == NULL) return false;
+    latencies.items = items;
+    latencies.capacity = capacity;
+  }
+  uint64_t us = ns/1000;
+  latencies.items[latencies.count++] = us > UINT32_MAX ? UINT32_MAX : (uint32_t)us;
+  return true;
+}
+
+static int compare_uint32(const void* a, const void* b) {
+  uint32_t x = *(const uint32_t*)a;
+  uint32_t y = *(const uint32_t*)b;
+  return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static uint32_t percentile(Latencies& latencies, double p) {
+  if (latencies.count == 0) return 0;
+  size_t index = (size_t)(p*(latencies.count-1)/100.0+0.5);
+  return latencies.items[index];
+}
+
+//-------------------------------------------------------------
+static bool send_request(Client& client) {
+  client.received = 0;
+  client.started = now_ns();
+  // The request is small so it always fits into the socket buffer of a connection without pending data.
+  ssize_t sent = send(client.fd, request, request_len, MSG_NOSIGNAL);
+  return sent == (ssize_t)request_len;
+}
+
+static bool connect_client(int epfd, Client& client) {
+  int fd = socket(address->ai_family, SOCK_STREAM, 0);
+  if (fd < 0) return false;
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  if (connect(fd, address->ai_addr, address->ai_addrlen) != 0) {
+    close(fd);
+    return false;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0)|O_NONBLOCK);
+
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.ptr = &client;
+  if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event) != 0) {
+    close(fd);
+    return false;
+  }
+  client.fd = fd;
+  return send_request(client);
+}
+
+static void disconnect_client(Client& client) {
+  if (client.fd >= 0) {
+    close(client.fd); // also removes the descriptor from epoll set
+    client.fd = -1;
+  }
+}
+
+// Returns the length of complete response, 0 if the response is incomplete or -1 if it is malformed.
+// The flag keep_alive is cleared if the server is going to close the connection.
+static ssize_t check_response(Client& client, bool& keep_alive) {
+  client.buffer[client.received] = '\0';
+  char* end_of_headers = strstr(client.buffer, "\r\n\r\n");
+  if (end_of_headers == NULL) return 0;
+  size_t headers_len = end_of_headers+4-client.buffer;
+
+  if (strncmp(client.buffer, "HTTP/1.", 7) != 0) return -1;
+  int status = atoi(client.buffer+9);
+
+  long content_length = -1;
+  bool chunked = false;
+  keep_alive = true;
+  for (char* line = strstr(client.buffer, "\r\n")+2; line < end_of_headers; line = strstr(line, "\r\n")+2) {
+    if (strncasecmp(line, "Content-Length:", 15) == 0) {
+      content_length = atol(line+15);
+    } else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0) {
+      char* value = line+18;
+      while (*value == ' ') value++;
+      if (strncasecmp(value, "chunked", 7) == 0) chunked = true;
+    } else if (strncasecmp(line, "Connection:", 11) == 0) {
+      char* value = line+11;
+      while (*value == ' ') value++;
+      if (strncasecmp(value, "close", 5) == 0) keep_alive = false;
+    }
+  }
+
+  size_t response_len;
+  if (chunked) {
+    char* end = strstr(end_of_headers+4, "\r\n0\r\n\r\n");
+    if (end == NULL) return 0;
+    response_len = end+7-client.buffer;
+  } else if (content_length >= 0) {
+    response_len = headers_len+content_length;
+    if (client.received < response_len) return 0;
+  } else {
+    return -1;
+  }
+  if (status != 200 && status != 304) errors++;
+  return (ssize_t)response_len;
+}
+
+//-------------------------------------------------------------
+static void help() {
+  fputs(
+    "Usage: httpd-load-test [-h <host>] [-p <port>] [-c <clients>] [-d <seconds>] [-u <url>]\n"
+    "  -h <host>     host name or address of the server (default " DEFAULT_HOST ")\n"
+    "  -p <port>     port of the server (default " DEFAULT_PORT ")\n"
+    "  -c <clients>  number of concurrent keep-alive connections (default 100)\n"
+    "  -d <seconds>  duration of the test (default 10)\n"
+    "  -u <url>      requested URL (default " DEFAULT_URL ")\n",
+    stderr);
+  exit(1);
+}
+
+int main(int argc, char *argv[]) {
+  const char* host = DEFAULT_HOST;
+  const char* port = DEFAULT_PORT;
+  const char* url = DEFAULT_URL;
+  int number_of_clients = DEFAULT_CLIENTS;
+  int duration = DEFAULT_DURATION;
+
+  int c;
+  while ((c = getopt(argc, argv, "h:p:c:d:u:")) != -1) {
+    switch (c) {
+    case 'h': host = optarg; break;
+    case 'p': port = optarg; break;
+    case 'c': number_of_clients = atoi(optarg); break;
+    case 'd': duration = atoi(optarg); break;
+    case 'u': url = optarg; break;
+    default: help();
+    }
+  }
+  if (number_of_clients < 1 || number_of_clients > MAX_CLIENTS || duration < 1 || *url != '/') help();
+
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  int rc = getaddrinfo(host, port, &hints, &address);
+  if (rc != 0) {
+    fprintf(stderr, "ERROR: Cannot resolve address of %s:%s: %s\n", host, port, gai_strerror(rc));
+    return 1;
+  }
+
+  request_len = snprintf(request, MAX_REQUEST, "GET %s HTTP/1.1\r\nHost: %s:%s\r\nConnection: keep-alive\r\n\r\n", url, host, port);
+  if (request_len >= MAX_REQUEST) {
+    fputs("ERROR: URL is too long.\n", stderr);
+    return 1;
+  }
+
+  int epfd = epoll_create1(0);
+  if (epfd < 0) {
+    perror("ERROR: epoll_create1");
+    return 1;
+  }
+
+  Client* clients = (Client*)calloc(number_of_clients, sizeof(Client));
+  if (clients == NULL) {
+    fputs("ERROR: Out of memory.\n", stderr);
+    return 1;
+  }
+  for (int i = 0; i < number_of_clients; i++) {
+    Client& client = clients[i];
+    client.fd = -1;
+    client.buffer_size = INITIAL_RESPONSE_BUFFER_SIZE;
+    client.buffer = (char*)malloc(client.buffer_size+1);
+    if (client.buffer == NULL) {
+      fputs("ERROR: Out of memory.\n", stderr);
+      return 1;
+    }
+    if (!connect_client(epfd, client)) {
+      fprintf(stderr, "ERROR: Cannot connect to %s:%s (client #%d): %s\n", host, port, i+1, strerror(errno));
+      return 1;
+    }
+  }
+
+  Latencies latencies;
+  memset(&latencies, 0, sizeof(latencies));
+
+  struct epoll_event events[64];
+  uint64_t started = now_ns();
+  uint64_t finish = started+(uint64_t)duration*1000000000ULL;
+  uint64_t now = started;
+  while (now < finish) {
+    int n = epoll_wait(epfd, events, 64, 100);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      perror("ERROR: epoll_wait");
+      return 1;
+    }
+    for (int i = 0; i < n; i++) {
+      Client& client = *(Client*)events[i].data.ptr;
+      bool failed = false;
+      bool keep_alive = true;
+      for (;;) {
+        if (client.received == client.buffer_size) {
+          size_t buffer_size = client.buffer_size*2;
+          char* buffer = (char*)realloc(client.buffer, buffer_size+1);
+          if (buffer == NULL) {
+            fputs("ERROR: Out of memory.\n", stderr);
+            return 1;
+          }
+          client.buffer = buffer;
+          client.buffer_size = buffer_size;
+        }
+        ssize_t received = recv(client.fd, client.buffer+client.received, client.buffer_size-client.received, 0);
+        if (received > 0) {
+          client.received += received;
+          bytes_received += received;
+          continue;
+        }
+        if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) failed = true;
+        if (received < 0 && errno == EINTR) continue;
+        break;
+      }
+
+      ssize_t response_len = client.received == 0 ? 0 : check_response(client, keep_alive);
+      if (response_len > 0) {
+        add_latency(latencies, now_ns()-client.started);
+        if (keep_alive && !failed) {
+          if (!send_request(client)) failed = true;
+          continue;
+        }
+      } else if (response_len < 0) {
+        errors++;
+        failed = true;
+      }
+      if (failed || !keep_alive) {
+        if (response_len == 0 && client.received != 0) errors++;
+        disconnect_client(client);
+        reconnects++;
+        if (!connect_client(epfd, client)) {
+          fprintf(stderr, "ERROR: Cannot reconnect to %s:%s: %s\n", host, port, strerror(errno));
+          return 1;
+        }
+      }
+    }
+    now = now_ns();
+  }
+
+  double elapsed = (now-started)/1e9;
+  qsort(latencies.items, latencies.count, sizeof(uint32_t), compare_uint32);
+
+  printf("URL:          http://%s:%s%s\n", host, port, url);
+  printf("Clients:      %d\n", number_of_clients);
+  printf("Duration:     %.2f s\n", elapsed);
+  printf("Requests:     %zu\n", latencies.count);
+  printf("Errors:       %llu\n", (unsigned long long)errors);
+  printf("Reconnects:   %llu\n", (unsigned long long)reconnects);
+  printf("Throughput:   %.1f requests/s, %.1f KB/s\n", latencies.count/elapsed, bytes_received/elapsed/1024);
+  printf("Latency (ms): p50=%.3f p90=%.3f p99=%.3f max=%.3f\n",
+      percentile(latencies, 50)/1000.0, percentile(latencies, 90)/1000.0, percentile(latencies, 99)/1000.0,
+      latencies.count == 0 ? 0.0 : latencies.items[latencies.count-1]/1000.0);
+
+  for (int i = 0; i < number_of_clients; i++) {
+    disconnect_client(clients[i]);
+    free(clients[i].buffer);
+  }
+  free(clients);
+  free(latencies.items);
+  freeaddrinfo(address);
+  close(epfd);
+  return errors == 0 ? 0 : 2;
+}
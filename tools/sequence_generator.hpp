@@ -0,0 +1,266 @@
+/*
+ * sequence_generator.hpp
+ *
+ * Generator of synthetic sequences of durations (in microseconds) for development tools.
+ * It produces one valid frame of each supported RF protocol with random data and small jitter of durations,
+ * and random noise. Durations alternate high and low levels starting from high, as in sequences captured
+ * by the receiver.
+ *
+ *  Created on: October 18, 2026
+ *      Author: Alex Konshin
+ */
+
+#ifndef TOOLS_SEQUENCE_GENERATOR_HPP_
+#define TOOLS_SEQUENCE_GENERATOR_HPP_
+
+#include <stdint.h>
+#include <string.h>
+
+#include "../protocols/Protocol.hpp"
+
+#define GENERATED_SEQUENCE_MAX_SIZE 256
+#define GENERATED_FRAME_MAX_BITS 128
+#define DEFAULT_GENERATOR_JITTER 20
+
+class SequenceGenerator {
+private:
+  uint32_t random_state;
+  int jitter;
+  int16_t* sequence;
+  int size;
+  uint8_t bits[GENERATED_FRAME_MAX_BITS];
+  int bits_count;
+
+  void add(int duration) {
+    if (size >= GENERATED_SEQUENCE_MAX_SIZE) return;
+    if (jitter > 0) duration += (int)(random()%(2*jitter+1))-jitter;
+    sequence[size++] = (int16_t)duration;
+  }
+  void addPulse(int hi, int lo) {
+    add(hi);
+    add(lo);
+  }
+
+  void addBits(uint32_t value, int count) {
+    for (int index = count-1; index >= 0 && bits_count < GENERATED_FRAME_MAX_BITS; index--) {
+      bits[bits_count++] = (value>>index)&1;
+    }
+  }
+  uint32_t getBits(int from, int count) {
+    uint32_t result = 0;
+    for (int index = from; index < from+count; index++) result = (result<<1)|bits[index];
+    return result;
+  }
+
+  static uint8_t crc8_step(uint8_t crc, int polynomial) {
+    for (int bit = 0; bit < 8; bit++) crc = (crc&0x80) != 0 ? (crc<<1)^polynomial : crc<<1;
+    return crc;
+  }
+  static int parity(uint32_t value) {
+    return __builtin_parity(value);
+  }
+
+  // Ambient Weather F007TH: Manchester, "1" is high-to-low transition in the middle of the bit.
+  // 16 bits of preamble 0xfffd, fixed ID 0x45, 32 bits of data and 8 bits of LFSR hash of ID and data.
+  int generateF007TH() {
+    uint32_t temperature = 720+random()%400; // F*10+400
+    uint32_t data = ((random()&255)<<24)|((random()&7)<<20)|(temperature<<8)|(20+random()%70);
+    addBits(0xfffd, 16);
+    addBits(0x45, 8);
+    addBits(data, 32);
+    int mask = 0x7C;
+    int hash = 0x64;
+    for (int index = 16; index < 56; index++) {
+      int bit = mask&1;
+      mask = (((mask&0xff)>>1)|(mask<<7))&0xff;
+      if (bit) mask ^= 0x18;
+      if (bits[index]) hash ^= mask;
+    }
+    addBits(hash&255, 8);
+    addBits(0, 4);
+    addManchester(460, 920, 540, 1080);
+    return size;
+  }
+
+  // LaCrosse TX141: four 833/833 pulses of preamble, then 40 bits of PWM with period ~720.
+  // ID(8), flags(4), temperature(12, C*10+500), humidity(8), CRC-8 (polynomial 0x31) of ID..humidity and zero byte.
+  int generateTX141() {
+    uint32_t data = ((random()&255)<<24)|((random()&3)<<20)|((500+random()%400)<<8)|(20+random()%70);
+    uint8_t crc = 0;
+    for (int shift = 24; shift >= 0; shift -= 8) crc = crc8_step(crc^((data>>shift)&255), 0x31);
+    crc = crc8_step(crc, 0x31);
+    addBits(data, 32);
+    addBits(crc, 8);
+    for (int index = 0; index < 4; index++) addPulse(833, 833);
+    for (int index = 0; index < bits_count; index++) {
+      if (bits[index])
+        addPulse(450, 260);
+      else
+        addPulse(250, 480);
+    }
+    return size;
+  }
+
+  // AcuRite 00592TXR: four 600/600 pulses of sync, then 56 bits: "0" is 200/400, "1" is 400/200.
+  // Bytes 2..5 have even parity, byte 6 is the sum of bytes 0..5.
+  int generate00592TXR() {
+    uint8_t bytes[7];
+    bytes[0] = (uint8_t)(((random()&3)<<6)|(random()&0x3f));
+    bytes[1] = (uint8_t)random();
+    bytes[2] = 0x44;
+    bytes[3] = (uint8_t)(20+random()%70);
+    uint32_t temperature = 1000+random()%400; // C*10+1000
+    bytes[4] = (uint8_t)((temperature>>7)&0x0f);
+    bytes[5] = (uint8_t)(temperature&0x7f);
+    if (parity(bytes[2]^bytes[3]^bytes[4]^bytes[5])) bytes[2] |= 0x80;
+    unsigned checksum = 0;
+    for (int index = 0; index < 6; index++) checksum += bytes[index];
+    bytes[6] = (uint8_t)checksum;
+    for (int index = 0; index < 7; index++) addBits(bytes[index], 8);
+    for (int index = 0; index < 4; index++) addPulse(600, 600);
+    for (int index = 0; index < bits_count; index++) {
+      if (bits[index])
+        addPulse(400, 200);
+      else
+        addPulse(200, 400);
+    }
+    add(600);
+    return size;
+  }
+
+  // Fine Offset WH2: eight "1" bits of preamble, then 40 bits of PWM: "1" is 500/930, "0" is 1500/930.
+  // Type(4)=4, ID(8), temperature(12), humidity(8), CRC-8 (polynomial 0x31).
+  int generateWH2() {
+    uint32_t data = (4<<28)|((random()&255)<<20)|((random()%400)<<8)|(20+random()%70);
+    uint8_t crc = 0;
+    for (int shift = 24; shift >= 0; shift -= 8) crc = crc8_step(crc^((data>>shift)&255), 0x31);
+    addBits(255, 8);
+    addBits(data, 32);
+    addBits(crc, 8);
+    for (int index = 0; index < bits_count; index++) addPulse(bits[index] ? 500 : 1500, 930);
+    return size;
+  }
+
+  // TFA Twin Plus 30.3049: PPM with pulses 500, "0" is gap 2000, "1" is gap 4000. 36 bits, the least significant first.
+  // Bit 31 is always 1, bits 21..23 are signs of temperature, bits 32..35 are the sum of nibbles of bits 0..31.
+  int generateTFA303049() {
+    uint32_t n = 0x80000000|(random()&0x7f1fffff);
+    uint32_t checksum = 0;
+    for (uint32_t value = n; value != 0; value >>= 4) checksum += value&15;
+    uint64_t data = ((uint64_t)(checksum&15)<<32)|n;
+    for (int index = 0; index < 36; index++) addPulse(500, ((data>>index)&1) != 0 ? 4000 : 2000);
+    add(500);
+    return size;
+  }
+
+  // Auriol HG02832: 375 and three 775/925 pairs of sync, then 40 bits: "1" is 550/300, "0" is 250/600.
+  // ID(8), flags(4), temperature(12), humidity(8), checksum (CRC-8 step of 0x53 xor data bytes).
+  int generateHG02832() {
+    uint32_t data = ((random()&255)<<24)|((random()&0xf)<<20)|((random()%0x800)<<8)|(20+random()%70);
+    uint8_t checksum = crc8_step((uint8_t)(0x53^data^(data>>8)^(data>>16)^(data>>24)), 0x31);
+    addBits(data, 32);
+    addBits(checksum, 8);
+    add(375);
+    for (int index = 0; index < 3; index++) addPulse(775, 925);
+    add(775);
+    for (int index = 0; index < bits_count; index++) {
+      if (bits[index])
+        addPulse(550, 300);
+      else
+        addPulse(250, 600);
+    }
+    return size;
+  }
+
+  // LaCrosse TX7U: 44 bits, "0" is 1300/1000, "1" is 525/1000. Header 0x0a, type(4), ID(7), parity of value,
+  // value (3 BCD digits), copy of the 2 most significant digits, the sum of nibbles.
+  int generateTX7U() {
+    uint32_t value = ((random()%10)<<8)|((random()%10)<<4)|(random()%10);
+    uint32_t id = 1+random()%127;
+    addBits(0x0a, 8);
+    addBits(0, 4);
+    addBits(id, 7);
+    addBits(parity(value), 1);
+    addBits(value, 12);
+    addBits(value>>4, 8);
+    uint32_t checksum = 0;
+    for (int index = 0; index < 40; index += 4) checksum += getBits(index, 4);
+    addBits(checksum&15, 4);
+    for (int index = 0; index < bits_count; index++) {
+      if (index+1 < bits_count)
+        addPulse(bits[index] ? 525 : 1300, 1000);
+      else
+        add(bits[index] ? 525 : 1300);
+    }
+    return size;
+  }
+
+  // Converts bits into Manchester halves and merges halves with the same level.
+  void addManchester(int short_hi, int long_hi, int short_lo, int long_lo) {
+    uint8_t levels[2*GENERATED_FRAME_MAX_BITS];
+    int count = 0;
+    for (int index = 0; index < bits_count; index++) {
+      levels[count++] = bits[index];
+      levels[count++] = !bits[index];
+    }
+    int index = 0;
+    while (index < count && levels[index] == 0) index++; // the sequence starts from the high level
+    while (index < count) {
+      int length = 1;
+      while (index+length < count && levels[index+length] == levels[index] && length < 2) length++;
+      if (levels[index])
+        add(length == 1 ? short_hi : long_hi);
+      else
+        add(length == 1 ? short_lo : long_lo);
+      index += length;
+    }
+  }
+
+public:
+  SequenceGenerator(uint32_t seed, int jitter) {
+    random_state = seed == 0 ? 1 : seed;
+    this->jitter = jitter < 0 ? 0 : jitter;
+    sequence = NULL;
+    size = 0;
+    bits_count = 0;
+  }
+
+  // xorshift32
+  uint32_t random() {
+    uint32_t x = random_state;
+    x ^= x<<13;
+    x ^= x>>17;
+    x ^= x<<5;
+    random_state = x;
+    return x;
+  }
+
+  // Writes one frame of the protocol into the buffer of GENERATED_SEQUENCE_MAX_SIZE items.
+  // Returns the size of the sequence or 0 if the protocol is not supported by the generator.
+  int generate(int protocol_index, int16_t* buffer) {
+    sequence = buffer;
+    size = 0;
+    bits_count = 0;
+    switch (protocol_index) {
+    case PROTOCOL_INDEX_F007TH: return generateF007TH();
+    case PROTOCOL_INDEX_TX141: return generateTX141();
+    case PROTOCOL_INDEX_00592TXR: return generate00592TXR();
+    case PROTOCOL_INDEX_WH2: return generateWH2();
+    case PROTOCOL_INDEX_TFA303049: return generateTFA303049();
+    case PROTOCOL_INDEX_HG02832: return generateHG02832();
+    case PROTOCOL_INDEX_TX7U: return generateTX7U();
+    }
+    return 0;
+  }
+
+  // Writes random durations uniformly distributed in the range.
+  int generateNoise(int16_t* buffer, int count, int min_duration, int max_duration) {
+    if (count > GENERATED_SEQUENCE_MAX_SIZE) count = GENERATED_SEQUENCE_MAX_SIZE;
+    for (int index = 0; index < count; index++) {
+      buffer[index] = (int16_t)(min_duration+random()%(max_duration-min_duration+1));
+    }
+    return count;
+  }
+};
+
+#endif /* TOOLS_SEQUENCE_GENERATOR_HPP_ */
@@ -0,0 +1,313 @@
+/*
+ * EventStream.cpp
+ *
+ *  Created on: October 18, 2026
+ *      Author: Alex Konshin
+ */
+
+#include <microhttpd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "../common/SensorsData.hpp"
+#include "../common/Config.hpp"
+#include "Logger.hpp"
+#include "Utils.hpp"
+#include "EventStream.hpp"
+
+#define EVENT_STREAM_BLOCK_SIZE 1024
+#define EVENT_DATA_PREFIX "data: "
+#define EVENT_DATA_PREFIX_LEN 6
+
+static const char* keepalive_event = ": ping\n\n";
+
+//-------------------------------------------------------------
+EventStream::EventStream(bool can_suspend, int options) {
+  pthread_mutex_init(&mutex, NULL);
+  pthread_cond_init(&condition, NULL);
+  clients = NULL;
+  number_of_clients = 0;
+  this->can_suspend = can_suspend;
+  this->options = options;
+  keepalive_started = false;
+  stopped = false;
+  event_buffer = NULL;
+  event_buffer_size = 0;
+  events = 0;
+  dropped = 0;
+}
+
+EventStream::~EventStream() {
+  stop();
+  // libmicrohttpd has been stopped so there are no connections that use clients.
+  EventStreamClient* client = clients;
+  while (client != NULL) {
+    EventStreamClient* next = client->next;
+    free(client);
+    client = next;
+  }
+  clients = NULL;
+  if (event_buffer != NULL) free(event_buffer);
+  pthread_cond_destroy(&condition);
+  pthread_mutex_destroy(&mutex);
+}
+
+bool EventStream::start() {
+  if (keepalive_started) return true;
+  int rc = pthread_create(&keepalive_thread, NULL, keepaliveThreadFunction, (void*)this);
+  if (rc != 0) {
+    Log->error("Error code %d from pthread_create()", rc);
+    return false;
+  }
+  keepalive_started = true;
+  return true;
+}
+
+// Closes all streams. It must be called before stopping libmicrohttpd because suspended connections must be resumed.
+void EventStream::stop() {
+  pthread_mutex_lock(&mutex);
+  stopped = true;
+  for (EventStreamClient* client = clients; client != NULL; client = client->next) {
+    if (client->released.load()) continue;
+    client->closed = true;
+    if (client->suspended) {
+      client->suspended = false;
+      MHD_resume_connection(client->connection);
+    }
+  }
+  pthread_cond_broadcast(&condition);
+  pthread_mutex_unlock(&mutex);
+
+  if (keepalive_started) {
+    pthread_join(keepalive_thread, NULL);
+    keepalive_started = false;
+  }
+}
+
+// It does not lock the mutex so it never delays publishing of events. The number of clients may include
+// disconnected clients that have not been released yet.
+void EventStream::getStatistics(EventStreamStatistics& stats) {
+  stats.clients = __atomic_load_n(&number_of_clients, __ATOMIC_RELAXED);
+  stats.events = __atomic_load_n(&events, __ATOMIC_RELAXED);
+  stats.dropped = __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+}
+
+//-------------------------------------------------------------
+// Must be called with locked mutex. Returns false if there is no room in the buffer.
+bool EventStream::append(EventStreamClient* client, const char* data, size_t len) {
+  size_t available = EVENT_STREAM_CLIENT_BUFFER_SIZE-(client->head-client->tail);
+  if (available < len) return false;
+  size_t index = client->head%EVENT_STREAM_CLIENT_BUFFER_SIZE;
+  size_t first = EVENT_STREAM_CLIENT_BUFFER_SIZE-index;
+  if (first >= len) {
+    memcpy(client->buffer+index, data, len);
+  } else {
+    memcpy(client->buffer+index, data, first);
+    memcpy(client->buffer, data+first, len-first);
+  }
+  client->head += len;
+  return true;
+}
+
+// Must be called with locked mutex.
+void EventStream::wakeUp(EventStreamClient* client) {
+  if (client->suspended) {
+    client->suspended = false;
+    MHD_resume_connection(client->connection);
+  }
+}
+
+// Must be called with locked mutex.
+void EventStream::releaseClients() {
+  EventStreamClient** ptr = &clients;
+  EventStreamClient* client;
+  while ((client = *ptr) != NULL) {
+    if (client->released.load()) {
+      *ptr = client->next;
+      free(client);
+      number_of_clients--;
+    } else {
+      ptr = &client->next;
+    }
+  }
+}
+
+//-------------------------------------------------------------
+struct MHD_Response* EventStream::subscribe(struct MHD_Connection* connection, SensorDef* def, int metrics, bool celsius) {
+  EventStreamClient* client = (EventStreamClient*)calloc(1, sizeof(EventStreamClient));
+  if (client == NULL) return NULL;
+  client->stream = this;
+  client->connection = connection;
+  client->def = def;
+  client->metrics = metrics;
+  client->celsius = celsius;
+  client->released.store(false);
+
+  char retry[32];
+  int len = snprintf(retry, sizeof(retry), "retry: %d\n\n", EVENT_STREAM_RETRY);
+  append(client, retry, len);
+
+  struct MHD_Response* response = MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, EVENT_STREAM_BLOCK_SIZE, &reader, client, &freeClient);
+  if (response == NULL) {
+    free(client);
+    return NULL;
+  }
+  MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "text/event-stream");
+  MHD_add_response_header(response, MHD_HTTP_HEADER_CACHE_CONTROL, "no-cache");
+  MHD_add_response_header(response, "X-Accel-Buffering", "no"); // for nginx used as reverse proxy
+
+  pthread_mutex_lock(&mutex);
+  releaseClients();
+  bool accepted = !stopped && number_of_clients < EVENT_STREAM_MAX_CLIENTS;
+  if (accepted) {
+    client->next = clients;
+    clients = client;
+    number_of_clients++;
+  }
+  pthread_mutex_unlock(&mutex);
+
+  if (!accepted) {
+    MHD_destroy_response(response);
+    free(client);
+    return NULL;
+  }
+  return response;
+}
+
+ssize_t EventStream::reader(void* cls, uint64_t pos, char* buf, size_t max) {
+  EventStreamClient* client = (EventStreamClient*)cls;
+  EventStream* stream = client->stream;
+
+  pthread_mutex_lock(&stream->mutex);
+  size_t available;
+  while ((available = client->head-client->tail) == 0) {
+    if (client->closed) {
+      pthread_mutex_unlock(&stream->mutex);
+      return MHD_CONTENT_READER_END_OF_STREAM;
+    }
+    if (stream->can_suspend) {
+      // The connection is resumed by the next event or keep-alive message.
+      client->suspended = true;
+      MHD_suspend_connection(client->connection);
+      pthread_mutex_unlock(&stream->mutex);
+      return 0;
+    }
+    // Thread per connection mode: this thread serves only this connection.
+    pthread_cond_wait(&stream->condition, &stream->mutex);
+  }
+
+  size_t len = available < max ? available : max;
+  size_t index = client->tail%EVENT_STREAM_CLIENT_BUFFER_SIZE;
+  size_t first = EVENT_STREAM_CLIENT_BUFFER_SIZE-index;
+  if (first >= len) {
+    memcpy(buf, client->buffer+index, len);
+  } else {
+    memcpy(buf, client->buffer+index, first);
+    memcpy(buf+first, client->buffer, len-first);
+  }
+  client->tail += len;
+  pthread_mutex_unlock(&stream->mutex);
+  return (ssize_t)len;
+}
+
+// Called by libmicrohttpd when the response is destroyed. The client is freed later by the stream.
+void EventStream::freeClient(void* cls) {
+  EventStreamClient* client = (EventStreamClient*)cls;
+  client->released.store(true);
+}
+
+//-------------------------------------------------------------
+void EventStream::listener(void* context, SensorDataStored* item, int changed) {
+  ((EventStream*)context)->publish(item, changed);
+}
+
+// Called by the thread that updates sensors data.
+void EventStream::publish(SensorDataStored* item, int changed) {
+  if (item == NULL || item->def == NULL) return;
+
+  pthread_mutex_lock(&mutex);
+  releaseClients();
+  bool has_clients = number_of_clients > 0;
+  pthread_mutex_unlock(&mutex);
+  if (!has_clients) return;
+
+  // Events in Fahrenheit and Celsius are stored one after another in the same buffer.
+  time_t now = time(NULL);
+  size_t offsets[2];
+  size_t lengths[2];
+  size_t start = 0;
+  for (int celsius = 0; celsius < 2; celsius++) {
+    int event_options = celsius ? (options|OPTION_CELSIUS) : (options&~OPTION_CELSIUS);
+    size_t len = item->generateJsonLineBrief(start+EVENT_DATA_PREFIX_LEN, event_buffer, event_buffer_size, now, event_options);
+    if (len == 0) return;
+    char* ptr = (char*)resize_buffer(start+EVENT_DATA_PREFIX_LEN+len+3, event_buffer, event_buffer_size);
+    if (ptr == NULL) return;
+    memcpy(ptr+start, EVENT_DATA_PREFIX, EVENT_DATA_PREFIX_LEN);
+    len += EVENT_DATA_PREFIX_LEN;
+    ptr[start+len++] = '\n';
+    ptr[start+len++] = '\n';
+    offsets[celsius] = start;
+    lengths[celsius] = len;
+    start += len;
+  }
+  const char* data = (const char*)event_buffer;
+
+  pthread_mutex_lock(&mutex);
+  events++;
+  for (EventStreamClient* client = clients; client != NULL; client = client->next) {
+    if (client->released.load() || client->closed) continue;
+    if (client->def != NULL && client->def->id != item->def->id) continue; // definitions are replaced when configuration is reloaded
+    if ((client->metrics&changed) == 0) continue;
+
+    if (client->dropped != 0) {
+      char notice[64];
+      int len = snprintf(notice, sizeof(notice), "event: dropped\ndata: {\"count\":%u}\n\n", client->dropped);
+      size_t available = EVENT_STREAM_CLIENT_BUFFER_SIZE-(client->head-client->tail);
+      if (available < len+lengths[client->celsius]) {
+        client->dropped++;
+        dropped++;
+        continue;
+      }
+      append(client, notice, len);
+      client->dropped = 0;
+    }
+    if (!append(client, data+offsets[client->celsius], lengths[client->celsius])) {
+      client->dropped++;
+      dropped++;
+      continue;
+    }
+    wakeUp(client);
+  }
+  if (!can_suspend) pthread_cond_broadcast(&condition);
+  pthread_mutex_unlock(&mutex);
+}
+
+//-------------------------------------------------------------
+void* EventStream::keepaliveThreadFunction(void* context) {
+  ((EventStream*)context)->keepalive();
+  return NULL;
+}
+
+// Sends comments to idle streams. It keeps proxies from closing the connections and detects disconnected clients.
+void EventStream::keepalive() {
+  size_t len = strlen(keepalive_event);
+  pthread_mutex_lock(&mutex);
+  while (!stopped) {
+    struct timespec timeToWait;
+    clock_gettime(CLOCK_REALTIME, &timeToWait);
+    timeToWait.tv_sec += EVENT_STREAM_KEEPALIVE_INTERVAL;
+    int rc = pthread_cond_timedwait(&condition, &mutex, &timeToWait);
+    if (stopped) break;
+    if (rc != ETIMEDOUT) continue;
+
+    releaseClients();
+    for (EventStreamClient* client = clients; client != NULL; client = client->next) {
+      if (client->released.load() || client->closed) continue;
+      if (client->head == client->tail && append(client, keepalive_event, len)) wakeUp(client);
+    }
+    if (!can_suspend) pthread_cond_broadcast(&condition);
+  }
+  pthread_mutex_unlock(&mutex);
+}
@@ -0,0 +1,97 @@
+/*
+ * EventStream.hpp
+ *
+ *  Created on: October 18, 2026
+ *      Author: Alex Konshin
+ */
+
+#ifndef UTILS_EVENTSTREAM_HPP_
+#define UTILS_EVENTSTREAM_HPP_
+
+#include <pthread.h>
+#include <atomic>
+
+#include "../common/SensorsData.hpp"
+
+//-------------------------------------------------------------
+// Stream of Server-Sent Events with changes of sensors data (request /api/stream).
+//
+// Each client has its own bounded ring buffer. The thread that updates sensors data only copies
+// the event into buffers of subscribed clients and never waits for them. If the buffer of a slow client
+// is full then the event is dropped for this client and the client receives event "dropped" with
+// the number of lost events when there is room again, so it can reload the full list of sensors.
+//
+// Connections without data are suspended (if libmicrohttpd allows it) and resumed when an event arrives.
+// In thread per connection mode the connection thread waits for events instead.
+
+#define EVENT_STREAM_MAX_CLIENTS 32
+#define EVENT_STREAM_CLIENT_BUFFER_SIZE 8192
+#define EVENT_STREAM_KEEPALIVE_INTERVAL 15 // seconds
+#define EVENT_STREAM_RETRY 5000 // milliseconds, the delay before reconnecting that is sent to clients
+
+typedef struct EventStreamClient {
+  EventStreamClient* next;
+  class EventStream* stream;
+  struct MHD_Connection* connection;
+  SensorDef* def;       // NULL means all sensors
+  int metrics;          // mask of *_IS_CHANGED bits
+  bool celsius;
+  bool suspended;
+  bool closed;
+  std::atomic<bool> released; // set when libmicrohttpd does not use the client anymore
+  uint32_t dropped;     // number of events dropped since the last delivered event
+  size_t head;          // total number of bytes written to the buffer
+  size_t tail;          // total number of bytes read from the buffer
+  char buffer[EVENT_STREAM_CLIENT_BUFFER_SIZE];
+} EventStreamClient;
+
+typedef struct EventStreamStatistics {
+  unsigned clients;
+  uint32_t events;
+  uint32_t dropped;
+} EventStreamStatistics;
+
+class EventStream {
+private:
+  pthread_mutex_t mutex;
+  pthread_cond_t condition;
+  EventStreamClient* clients;
+  unsigned number_of_clients;
+  bool can_suspend;
+  int options;
+
+  pthread_t keepalive_thread;
+  bool keepalive_started;
+  volatile bool stopped;
+
+  // They are used only by the thread that updates sensors data.
+  void* event_buffer;
+  size_t event_buffer_size;
+
+  uint32_t events;
+  uint32_t dropped;
+
+  bool append(EventStreamClient* client, const char* data, size_t len);
+  void wakeUp(EventStreamClient* client);
+  void releaseClients();
+
+  static ssize_t reader(void* cls, uint64_t pos, char* buf, size_t max);
+  static void freeClient(void* cls);
+  static void* keepaliveThreadFunction(void* context);
+  void keepalive();
+
+public:
+  EventStream(bool can_suspend, int options);
+  ~EventStream();
+
+  bool start();
+  void stop();
+
+  struct MHD_Response* subscribe(struct MHD_Connection* connection, SensorDef* def, int metrics, bool celsius);
+  void publish(SensorDataStored* item, int changed);
+  void getStatistics(EventStreamStatistics& stats);
+
+  static void listener(void* context, SensorDataStored* item, int changed);
+};
+
+#endif /* UTILS_EVENTSTREAM_HPP_ */
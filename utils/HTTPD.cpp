@@ -10,6 +10,10 @@
  */
 
 #include <microhttpd.h>
+#include <unistd.h>
+#include <limits.h>
+#include <atomic>
+#include <zlib.h>
 
 // required for downloading files
 #include <sys/stat.h>
@@ -31,51 +35,119 @@
 
 static const char* version_response_text = "{\"application_version\":\"" RF_RECEIVER_VERSION "\",\"api_version\":\"" REST_API_VERSION "\"}";
 
-#define request_params(request_name) REQUEST_ ## request_name ## _ARGS
-#define max_number_of_params(request_name) (sizeof(request_params(request_name))/sizeof(const char*))
-
-static const char* request_params(temperature)[] = {
-#define REQ_TEMPERATURE_PARAM_SCALE 0
-  "scale"
+//-------------------------------------------------------------
+// Parameters of API requests.
+// All parameters of all requests are in one table sorted by name, so a parameter is found by binary search
+// and its value is stored in RequestParams by index. Each route defines the mask of parameters it accepts.
+// Numbers and flags are parsed when the request arrives, so handlers get typed values.
+
+enum class ParamType : int {
+  string=0,
+  number=1,   // unsigned decimal number
+  flag=2      // "0" or "1"
 };
 
-static const char* request_params(temperature_history)[] = {
-#define REQ_TEMPERATURE_HISTORY_PARAM_SCALE 0
-  "scale",
-#define REQ_TEMPERATURE_HISTORY_PARAM_UTC 1
-  "utc",
-//#define REQ_TEMPERATURE_HISTORY_PARAM_FROM 2
-//  "from"
-//#define REQ_TEMPERATURE_HISTORY_PARAM_TO 3
-//  "to"
+typedef struct ParamSpec {
+  const char* name;
+  ParamType type;
+} ParamSpec;
+
+enum RequestParam : int {
+  PARAM_AFTER=0,
+  PARAM_CELSIUS,
+  PARAM_DOWNSAMPLE,
+  PARAM_FORMAT,
+  PARAM_FROM,
+  PARAM_LIMIT,
+  PARAM_METRICS,
+  PARAM_POINTS,
+  PARAM_SCALE,
+  PARAM_SENSOR,
+  PARAM_SENSORS,
+  PARAM_TO,
+  PARAM_UTC,
+  NUMBER_OF_PARAMS
 };
 
-static const char* request_params(humidity_history)[] = {
-#define REQ_HUMIDITY_HISTORY_PARAM_UTC 0
-  "utc",
-//#define REQ_HUMIDITY_HISTORY_PARAM_FROM 1
-//  "from"
-//#define REQ_HUMIDITY_HISTORY_PARAM_TO 2
-//  "to"
+// Must be sorted by name and in the same order as RequestParam.
+static constexpr ParamSpec param_specs[] = {
+  { "after",      ParamType::number },
+  { "celsius",    ParamType::flag },
+  { "downsample", ParamType::string },
+  { "format",     ParamType::string },
+  { "from",       ParamType::number },
+  { "limit",      ParamType::number },
+  { "metrics",    ParamType::string },
+  { "points",     ParamType::number },
+  { "scale",      ParamType::string },
+  { "sensor",     ParamType::string },
+  { "sensors",    ParamType::string },
+  { "to",         ParamType::number },
+  { "utc",        ParamType::flag }
 };
 
-static const char* request_params(sensors)[] = {
-#define REQ_SENSORS_PARAM_UTC 0
-  "utc",
-#define REQ_SENSORS_PARAM_CELSIUS 1
-  "celsius",
-#define REQ_SENSORS_PARAM_FORMAT 2
-  "format",
-};
+static constexpr bool str_less(const char* a, const char* b) {
+  return *a == *b ? (*a != '\0' && str_less(a+1, b+1)) : (unsigned char)*a < (unsigned char)*b;
+}
+static constexpr bool param_specs_sorted(int index) {
+  return index+1 >= NUMBER_OF_PARAMS || (str_less(param_specs[index].name, param_specs[index+1].name) && param_specs_sorted(index+1));
+}
+static_assert(sizeof(param_specs)/sizeof(ParamSpec) == NUMBER_OF_PARAMS, "param_specs does not match RequestParam");
+static_assert(param_specs_sorted(0), "param_specs must be sorted by name");
+
+#define PARAM(p) (1U<<(p))
+#define ANY_PARAMS UINT32_MAX  // parameters are not checked
+
+typedef struct RequestParams {
+  uint32_t present;                     // mask of parameters with non-empty values
+  const char* values[NUMBER_OF_PARAMS];
+  uint64_t numbers[NUMBER_OF_PARAMS];   // parsed values of numbers and flags
+
+  bool has(RequestParam param) const { return (present&PARAM(param)) != 0; }
+  const char* get(RequestParam param) const { return has(param) ? values[param] : NULL; }
+  uint64_t getNumber(RequestParam param) const { return has(param) ? numbers[param] : 0; }
+} RequestParams;
 
 enum class SensorsRequestFormat : int { full=0, brief=1 };
 
+// Response header with the time of the last returned history point.
+// It can be passed back in parameter "after" to get only new points.
+#define HISTORY_CURSOR_HEADER "X-History-Cursor"
+
 // Max total length of request (without arguments)
 #define MAX_URL 256
-// Max length of request name
-#define MAX_REQ_LEN 12
-// Max number of defined parameters in all requests
-#define MAX_NUMBER_OF_PARAMS 4
+
+//-------------------------------------------------------------
+// State of one request. It lives on the stack of process_request().
+// A handler either queues the response itself and returns the result of MHD_queue_response() or
+// puts the generated data into the buffer and returns RESPONSE_GENERATED.
+
+#define RESPONSE_GENERATED -1
+
+typedef struct HttpRequest {
+  HTTPD* httpd;
+  struct MHD_Connection* connection;
+  const char* item;             // <item> of /api/<name>/<item>, NULL if there is no item
+  RequestParams params;
+  bool accepts_gzip;
+
+  void* buffer;
+  size_t buffer_size;
+  size_t data_size;
+  const char* content_type;
+  time_t history_cursor;
+
+  char cache_key[MAX_RESPONSE_CACHE_KEY];  // empty if the response is not cached
+  uint32_t generation;
+  time_t cache_time;
+} HttpRequest;
+
+// Returns cached response (or status 304) if it is valid for the key in request.cache_key.
+#define return_cached_response(request, time_dependent) { \
+  int ret = request.httpd->respondFromCache(request.connection, request.cache_key, request.accepts_gzip, time_dependent, \
+      request.generation, request.cache_time); \
+  if (ret != -1) return ret; \
+}
 
 
 static MHD_Response* make_html_response(const char* html_text) {
@@ -84,14 +156,26 @@ static MHD_Response* make_html_response(const char* html_text) {
   return response;
 }
 
+static std::atomic<uint32_t> error_responses(0);
+
+// Requests are processed by several threads so the lazily created response is published atomically.
 #define html_error_response(name,error_code,html_text) \
-static struct MHD_Response* name ## _response = NULL; \
+static std::atomic<struct MHD_Response*> name ## _response(NULL); \
 static int error_ ## name (struct MHD_Connection* connection) { \
-  if (name ## _response == NULL) name ## _response = make_html_response(html_text); \
-  return MHD_queue_response(connection, error_code, name ## _response); \
+  error_responses.fetch_add(1, std::memory_order_relaxed); \
+  struct MHD_Response* response = name ## _response.load(); \
+  if (response == NULL) { \
+    struct MHD_Response* expected = NULL; \
+    response = make_html_response(html_text); \
+    if (!name ## _response.compare_exchange_strong(expected, response)) { \
+      MHD_destroy_response(response); \
+      response = expected; \
+    } \
+  } \
+  return MHD_queue_response(connection, error_code, response); \
 } \
 
-#define destroy_html_error_response(name) { if (name ## _response != NULL) { MHD_destroy_response(name ## _response); name ## _response = NULL; } }
+#define destroy_html_error_response(name) { struct MHD_Response* response = name ## _response.exchange(NULL); if (response != NULL) MHD_destroy_response(response); }
 
 /**
  * Response returned for refused uploads.
@@ -101,12 +185,14 @@ html_error_response(bad_request, MHD_HTTP_BAD_REQUEST, "<html><head><title>Bad r
 html_error_response(data_not_found, MHD_HTTP_NOT_FOUND, "<html><head><title>Data not found</title></head><body>404: Data not found</body></html>");
 html_error_response(not_supported, MHD_HTTP_NOT_FOUND, "<html><head><title>Not supported</title></head><body>404: Requested metric is not supported by the sensor</body></html>");
 html_error_response(out_of_memory, MHD_HTTP_INSUFFICIENT_STORAGE, "<html><head><title>Out of memory</title></head><body>507: Out of memeory</body></html>");
+html_error_response(too_many_streams, MHD_HTTP_SERVICE_UNAVAILABLE, "<html><head><title>Too many streams</title></head><body>503: Too many event streams</body></html>");
 
 static void destroy_html_responses() {
   destroy_html_error_response(request_refused);
   destroy_html_error_response(bad_request);
   destroy_html_error_response(data_not_found);
   destroy_html_error_response(not_supported);
+  destroy_html_error_response(too_many_streams);
 }
 
 //-------------------------------------------------------------
@@ -115,60 +201,288 @@ HTTPD::HTTPD(SensorsData* sensorsData, Config* cfg) {
   this->sensorsData = sensorsData;
   this->cfg = cfg;
   daemon = NULL;
+  staticFiles = NULL;
+  eventStream = NULL;
   no_home_page = false;
+  started = time(NULL);
+
+  pthread_rwlock_init(&cache_lock, NULL);
+  for (int index = 0; index < RESPONSE_CACHE_SIZE; index++) {
+    CachedResponse& entry = cache[index];
+    entry.key[0] = '\0';
+    entry.generation = 0;
+    entry.time = 0;
+    entry.gzip = false;
+    entry.response = NULL;
+    entry.last_used.store(0, std::memory_order_relaxed);
+  }
+  cache_clock.store(0, std::memory_order_relaxed);
+  cache_hits.store(0, std::memory_order_relaxed);
+  cache_misses.store(0, std::memory_order_relaxed);
+  cache_not_modified.store(0, std::memory_order_relaxed);
+  compressed_responses.store(0, std::memory_order_relaxed);
+  requests.store(0, std::memory_order_relaxed);
+  memset(&request_duration, 0, sizeof(request_duration));
+  metrics_collector = NULL;
+  metrics_collector_context = NULL;
+
+  pthread_mutex_init(&sensor_metrics_lock, NULL);
+  sensor_metrics = NULL;
+  sensor_metrics_size = 0;
+  sensor_metrics_generation = 0;
+  sensor_metrics_time = 0;
 }
 
 HTTPD::~HTTPD() {
   stop();
   destroy_html_responses();
+  clearCache();
+  pthread_rwlock_destroy(&cache_lock);
+  if (sensor_metrics != NULL) free(sensor_metrics);
+  pthread_mutex_destroy(&sensor_metrics_lock);
 }
 
 //-------------------------------------------------------------
-struct ReqParamProcessingData {
-  HTTPD* httpd;
-  const char** param_names;
-  const char** param_values;
-  int max_params;
-  bool success;
-};
+// The time of server start is a part of ETag because the generation of sensors data starts from 0 after restart.
+void HTTPD::makeETag(char* etag, uint32_t generation, time_t time, bool gzip) {
+  const char* suffix = gzip ? "-gz" : "";
+  if (time == 0)
+    snprintf(etag, MAX_ETAG, "\"%lx-%x%s\"", (unsigned long)started, generation, suffix);
+  else
+    snprintf(etag, MAX_ETAG, "\"%lx-%x-%lx%s\"", (unsigned long)started, generation, (unsigned long)time, suffix);
+}
 
-static int param_iterator(void* cls, enum MHD_ValueKind kind, const char* key, const char* value) {
+static bool etag_matches(const char* if_none_match, const char* etag) {
+  if (if_none_match == NULL) return false;
+  while (*if_none_match == ' ') if_none_match++;
+  if (strcmp(if_none_match, "*") == 0) return true;
+  return strstr(if_none_match, etag) != NULL;
+}
 
-  ReqParamProcessingData* req_param_processing_data = (ReqParamProcessingData*)cls;
-  if ((req_param_processing_data->httpd->cfg->options&VERBOSITY_INFO) != 0) Log->log(" \"%s\" = \"%s\"", key, value);
-
-  bool found = false;
-  if (key != NULL && req_param_processing_data->param_names != NULL && req_param_processing_data->max_params > 0 ) {
-    for (int param_index = 0; param_index<req_param_processing_data->max_params; param_index++) {
-      const char* param_name = req_param_processing_data->param_names[param_index];
-      if (key != NULL && strcmp(param_name, key) == 0) {
-        found = true;
-        req_param_processing_data->param_values[param_index] = value;
-        break;
-      }
+/*
+ * Responds with status 304 if the client has the current version of the response or with cached response
+ * if it is still valid. Returns -1 if the response must be generated. In this case the response must be
+ * passed to queueResponse() with the returned generation and time.
+ */
+int HTTPD::respondFromCache(struct MHD_Connection* connection, const char* key, bool gzip, bool time_dependent, uint32_t& generation, time_t& time) {
+  generation = sensorsData->getGeneration();
+  time = time_dependent ? ::time(NULL) : 0;
+
+  char etag[MAX_ETAG];
+  makeETag(etag, generation, time, gzip);
+  if (etag_matches(MHD_lookup_connection_value(connection, MHD_HEADER_KIND, MHD_HTTP_HEADER_IF_NONE_MATCH), etag)) {
+    cache_not_modified++;
+    struct MHD_Response* response = MHD_create_response_from_buffer(0, (void*)"", MHD_RESPMEM_PERSISTENT);
+    if (response == NULL) return MHD_NO;
+    MHD_add_response_header(response, MHD_HTTP_HEADER_ETAG, etag);
+    MHD_add_response_header(response, MHD_HTTP_HEADER_CACHE_CONTROL, "no-cache");
+    if (cfg->httpd_compression_level > 0) MHD_add_response_header(response, MHD_HTTP_HEADER_VARY, MHD_HTTP_HEADER_ACCEPT_ENCODING);
+    int ret = MHD_queue_response(connection, MHD_HTTP_NOT_MODIFIED, response);
+    MHD_destroy_response(response);
+    return ret;
+  }
+
+  int ret = -1;
+  pthread_rwlock_rdlock(&cache_lock);
+  for (int index = 0; index < RESPONSE_CACHE_SIZE; index++) {
+    CachedResponse& entry = cache[index];
+    if (entry.response != NULL && entry.generation == generation && entry.time == time && entry.gzip == gzip && strcmp(entry.key, key) == 0) {
+      entry.last_used.store(++cache_clock, std::memory_order_relaxed);
+      // The cache holds a reference to the response so it cannot be destroyed while it is being queued.
+      ret = MHD_queue_response(connection, MHD_HTTP_OK, entry.response);
+      break;
     }
   }
-  if (!found) req_param_processing_data->success = false;
-  return MHD_YES;
+  pthread_rwlock_unlock(&cache_lock);
+
+  if (ret == -1)
+    cache_misses++;
+  else
+    cache_hits++;
+  return ret;
+}
+
+/*
+ * Queues newly generated response and passes it to the cache. The caller must not destroy the response.
+ */
+int HTTPD::queueResponse(struct MHD_Connection* connection, const char* key, bool gzip, uint32_t generation, time_t time, struct MHD_Response* response) {
+  char etag[MAX_ETAG];
+  makeETag(etag, generation, time, gzip);
+  MHD_add_response_header(response, MHD_HTTP_HEADER_ETAG, etag);
+  MHD_add_response_header(response, MHD_HTTP_HEADER_CACHE_CONTROL, "no-cache");
+  int ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
+
+  struct MHD_Response* replaced = NULL;
+  pthread_rwlock_wrlock(&cache_lock);
+  CachedResponse* found = NULL;
+  CachedResponse* lru = NULL;
+  for (int index = 0; index < RESPONSE_CACHE_SIZE; index++) {
+    CachedResponse& entry = cache[index];
+    if (entry.response == NULL || (entry.gzip == gzip && strcmp(entry.key, key) == 0)) {
+      found = &entry;
+      break;
+    }
+    if (lru == NULL || entry.last_used.load(std::memory_order_relaxed) < lru->last_used.load(std::memory_order_relaxed)) lru = &entry;
+  }
+  if (found == NULL) found = lru;
+  if (found->response != NULL && found->gzip == gzip && strcmp(found->key, key) == 0 &&
+      ((int32_t)(found->generation-generation) > 0 || (found->generation == generation && found->time >= time))) {
+    // Another thread has already cached the same or a newer response.
+    replaced = response;
+  } else {
+    replaced = found->response;
+    strncpy(found->key, key, MAX_RESPONSE_CACHE_KEY-1);
+    found->key[MAX_RESPONSE_CACHE_KEY-1] = '\0';
+    found->generation = generation;
+    found->time = time;
+    found->gzip = gzip;
+    found->response = response;
+    found->last_used.store(++cache_clock, std::memory_order_relaxed);
+  }
+  pthread_rwlock_unlock(&cache_lock);
+
+  if (replaced != NULL) MHD_destroy_response(replaced);
+  return ret;
 }
 
-static int process_params(HTTPD* httpd, struct MHD_Connection* connection, const char* p, const char** param_names, int max_params, const char** param_values, bool& success) {
+void HTTPD::clearCache() {
+  pthread_rwlock_wrlock(&cache_lock);
+  for (int index = 0; index < RESPONSE_CACHE_SIZE; index++) {
+    CachedResponse& entry = cache[index];
+    if (entry.response != NULL) {
+      MHD_destroy_response(entry.response);
+      entry.response = NULL;
+    }
+    entry.key[0] = '\0';
+  }
+  pthread_rwlock_unlock(&cache_lock);
+}
 
-  struct ReqParamProcessingData req_param_processing_data;
-  req_param_processing_data.httpd = httpd;
-  req_param_processing_data.param_names = param_names;
-  req_param_processing_data.max_params = max_params;
-  req_param_processing_data.param_values = param_values;
-  req_param_processing_data.success = true;
+void HTTPD::getCacheStatistics(ResponseCacheStatistics& stats) {
+  stats.hits = cache_hits.load(std::memory_order_relaxed);
+  stats.misses = cache_misses.load(std::memory_order_relaxed);
+  stats.not_modified = cache_not_modified.load(std::memory_order_relaxed);
+  stats.compressed = compressed_responses.load(std::memory_order_relaxed);
+}
 
-  MHD_get_connection_values(connection, MHD_GET_ARGUMENT_KIND, (MHD_KeyValueIterator)&param_iterator, (void*)&req_param_processing_data);
+/*
+ * Compresses the response body with gzip. Returns NULL if the data cannot be compressed or it does not become shorter.
+ * The result must be freed by the caller.
+ */
+void* HTTPD::compress(const void* data, size_t size, size_t& compressed_size) {
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  // windowBits 15+16 selects gzip header and trailer instead of zlib ones
+  if (deflateInit2(&stream, cfg->httpd_compression_level, Z_DEFLATED, 15+16, 8, Z_DEFAULT_STRATEGY) != Z_OK) return NULL;
+
+  size_t bound = deflateBound(&stream, size);
+  Bytef* result = (Bytef*)malloc(bound);
+  if (result == NULL) {
+    deflateEnd(&stream);
+    return NULL;
+  }
+  stream.next_in = (Bytef*)data;
+  stream.avail_in = size;
+  stream.next_out = result;
+  stream.avail_out = bound;
+  int rc = deflate(&stream, Z_FINISH);
+  compressed_size = stream.total_out;
+  deflateEnd(&stream);
+  if (rc != Z_STREAM_END || compressed_size >= size) {
+    free(result);
+    return NULL;
+  }
 
-  if (!req_param_processing_data.success) return error_bad_request(connection);
+  // The response can stay in the cache for a long time so the unused tail of the buffer is returned.
+  void* shrunk = realloc(result, compressed_size);
+  compressed_responses++;
+  return shrunk != NULL ? shrunk : result;
+}
 
-  success = true;
+//-------------------------------------------------------------
+// Parse unsigned number. Returns false on error.
+static bool parse_unsigned_param(const char* value, uint64_t& result) {
+  if (value == NULL || *value == '\0') return true;
+  uint64_t n = 0;
+  const char* p = value;
+  char ch;
+  while ((ch=*p++) != '\0') {
+    if (ch < '0' || ch > '9') return false;
+    uint64_t next = n*10+(ch-'0');
+    if (next < n) return false; // overflow
+    n = next;
+  }
+  result = n;
+  return true;
+}
+
+// Returns index of the parameter or -1 if there is no such parameter.
+static int find_param(const char* name) {
+  int low = 0;
+  int high = NUMBER_OF_PARAMS-1;
+  while (low <= high) {
+    int middle = (low+high)/2;
+    int cmp = strcmp(name, param_specs[middle].name);
+    if (cmp == 0) return middle;
+    if (cmp < 0) high = middle-1; else low = middle+1;
+  }
+  return -1;
+}
+
+struct ParamIteratorContext {
+  HTTPD* httpd;
+  RequestParams* params;
+  uint32_t allowed;
+  bool success;
+};
+
+static int param_iterator(void* cls, enum MHD_ValueKind kind, const char* key, const char* value) {
+  ParamIteratorContext* context = (ParamIteratorContext*)cls;
+  if ((context->httpd->cfg->options&VERBOSITY_INFO) != 0) Log->log(" \"%s\" = \"%s\"", key, value);
+
+  int index = key == NULL ? -1 : find_param(key);
+  if (index < 0 || (context->allowed&PARAM(index)) == 0) {
+    context->success = false;
+    return MHD_NO;
+  }
+  if (value == NULL || *value == '\0') return MHD_YES; // the same as missing parameter
+
+  RequestParams* params = context->params;
+  switch (param_specs[index].type) {
+  case ParamType::number:
+    if (!parse_unsigned_param(value, params->numbers[index])) {
+      context->success = false;
+      return MHD_NO;
+    }
+    break;
+  case ParamType::flag:
+    if (value[1] != '\0' || (value[0] != '0' && value[0] != '1')) {
+      context->success = false;
+      return MHD_NO;
+    }
+    params->numbers[index] = value[0]-'0';
+    break;
+  default:
+    break;
+  }
+  params->values[index] = value;
+  params->present |= PARAM(index);
   return MHD_YES;
 }
 
+// Parses arguments of the request into request.params. Returns false if there is unknown or invalid parameter.
+static bool parse_params(HttpRequest& request, uint32_t allowed) {
+  request.params.present = 0;
+  if (allowed == ANY_PARAMS) return true;
+  ParamIteratorContext context;
+  context.httpd = request.httpd;
+  context.params = &request.params;
+  context.allowed = allowed;
+  context.success = true;
+  MHD_get_connection_values(request.connection, MHD_GET_ARGUMENT_KIND, (MHD_KeyValueIterator)&param_iterator, (void*)&context);
+  return context.success;
+}
+
 //-------------------------------------------------------------
 static SensorDataStored* find_requested_sensor_data(const char* name, SensorsData* sensorsData) {
   const char* p = name;
@@ -190,76 +504,17 @@ static SensorDataStored* find_requested_sensor_data(const char* name, SensorsDat
 }
 
 //-------------------------------------------------------------
-typedef struct FileExt2Mime {
-  const char* ext;
-  const char* mime;
-} FileExt2Mime;
-
-static struct FileExt2Mime ext2mime[] = {
-    { "html", "text/html" },
-    { "htm", "text/html" },
-    { "css", "text/css" },
-    { "xml", "application/xml" },
-    { "xhtml", "application/xhtml+xml" },
-    { "js", "text/javascript" },
-    { "json", "application/json" },
-    { "txt", "text/plain" },
-    { "png", "image/png" },
-    { "jpeg", "image/jpeg" },
-    { "jpg", "image/jpeg" },
-    { "png", "image/png" },
-    { "gif", "image/gif" },
-    { "bmp", "image/bmp" },
-    { "ttf", "font/ttf" },
-    { "woff", "font/woff" },
-    { "woff2", "font/woff2" },
-    { "mp3", "audio/mpeg" },
-    { "aac", "audio/aac" },
-    { "mid", "audio/midi" },
-    { "midi", "audio/midi" },
-    { "wav", "audio/wav" },
-    { "weba", "audio/webm" },
-    { "webm", "video/webm" },
-    { "webp", "image/webp" },
-    { "zip", "application/zip" },
-    { "gz", "application/gzip" },
-    { "7z", "application/x-7z-compressed" },
-    { NULL, NULL }
-};
-
-
-static const char* filepath2mime(const char* filepath) {
-  if (filepath == NULL) return NULL;
-  size_t pathlen = strlen(filepath);
-  if (pathlen == 0) return NULL;
-  size_t ext_len = 0;
-  const char* p = filepath+pathlen;
-  char ch;
-  while (--p != filepath && (ch=*p) != '.') {
-    if (ch == '/') return NULL; // no extension
-    ext_len++;
-  }
-  const char* ext = p+1;
-
-  struct FileExt2Mime* record = ext2mime;
-  const char* recext;
-  while ((recext=record->ext) != NULL) {
-    if (strlen(recext) == ext_len && strcmp(ext,recext) == 0) return record->mime;
-    record++;
-  }
-  return NULL;
-}
-
-//-------------------------------------------------------------
-static const char* get_www_file_path(const char* www_root, const char* url) {
-  if (www_root == NULL) return NULL;
+// Builds the path of the file in www_root in the buffer. Returns false if the path is too long.
+static bool get_www_file_path(const char* www_root, const char* url, char* filepath, size_t size) {
+  if (www_root == NULL) return false;
   size_t www_root_len = strlen(www_root);
-  size_t pathlen = strlen(url)+www_root_len+1;
-  char* filepath = (char*)malloc(pathlen);
-  if (filepath == NULL) return NULL;
-  strcpy(filepath, www_root);
-  strcpy(filepath+www_root_len, www_root[www_root_len-1] == '/' ? url+1 : url);
-  return filepath;
+  if (www_root_len == 0) return false;
+  if (www_root[www_root_len-1] == '/') url++;
+  size_t url_len = strlen(url);
+  if (www_root_len+url_len >= size) return false;
+  memcpy(filepath, www_root, www_root_len);
+  memcpy(filepath+www_root_len, url, url_len+1);
+  return true;
 }
 
 //-------------------------------------------------------------
@@ -276,7 +531,7 @@ static int download_file(struct MHD_Connection * connection, const char* filepat
   }
   if (fd == -1) return error_data_not_found(connection);
 
-  const char *mime = filepath2mime(filepath);
+  const char *mime = StaticFiles::getMimeType(filepath);
 /*
 #ifdef MHD_HAVE_LIBMAGIC
   if (mime == NULL) {
@@ -303,22 +558,838 @@ static int download_file(struct MHD_Connection * connection, const char* filepat
 }
 
 //-------------------------------------------------------------
-// Returns false on error
-static bool update_options(int& options, int bit, const char* value) {
-  if (value != NULL && *value != '\0') {
-    if (strcmp("0", value) == 0) {
-      if ((options&bit) != 0) options &= ~bit;
-    } else if (strcmp("1", value) == 0) {
-      if ((options&bit) == 0) options |= bit;
+// Sets or clears the bit of options accordingly to the flag parameter if it is present.
+static int update_options(int options, int bit, const RequestParams& params, RequestParam param) {
+  if (params.has(param)) {
+    if (params.getNumber(param) != 0) options |= bit; else options &= ~bit;
+  }
+  return options;
+}
+
+//-------------------------------------------------------------
+// Parse comma separated list of metrics (temperature, humidity, battery). Returns false on error.
+static bool parse_metrics_param(const char* value, int& metrics) {
+  if (value == NULL || *value == '\0') return true;
+  int result = 0;
+  const char* p = value;
+  while (*p != '\0') {
+    const char* end = strchr(p, ',');
+    size_t len = end == NULL ? strlen(p) : (size_t)(end-p);
+    if (len == 11 && strncmp(p, "temperature", len) == 0) {
+      result |= TEMPERATURE_IS_CHANGED;
+    } else if (len == 8 && strncmp(p, "humidity", len) == 0) {
+      result |= HUMIDITY_IS_CHANGED;
+    } else if (len == 7 && strncmp(p, "battery", len) == 0) {
+      result |= BATTERY_STATUS_IS_CHANGED;
     } else {
       return false;
     }
+    if (end == NULL) break;
+    p = end+1;
   }
+  if (result == 0) return false;
+  metrics = result;
   return true;
 }
 
 //-------------------------------------------------------------
-static int process_request(
+// Parse the format of history response. Returns false on error.
+static bool parse_history_format(const char* value, HistoryFormat& format) {
+  if (value == NULL || *value == '\0' || strcmp(value, "json") == 0) {
+    format = HistoryFormat::json;
+  } else if (strcmp(value, "columnar") == 0) {
+    format = HistoryFormat::columnar;
+  } else if (strcmp(value, "binary") == 0) {
+    format = HistoryFormat::binary;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Generates history in the requested format.
+static size_t generate_history(History& history, HistoryFormat format, time_t from, time_t to, unsigned limit, unsigned points, DownsampleMethod method,
+    void*& buffer, size_t& buffer_size, ValueConversion convertion, bool x10, uint32_t divisor, bool time_UTC, time_t& last_time) {
+  switch (format) {
+  case HistoryFormat::columnar:
+    return history.generateColumnarJson(from, to, limit, points, method, buffer, buffer_size, convertion, x10, last_time);
+  case HistoryFormat::binary:
+    return history.generateBinary(from, to, limit, points, method, buffer, buffer_size, convertion, divisor, last_time);
+  default:
+    return history.generateJson(from, to, limit, points, method, buffer, buffer_size, convertion, x10, time_UTC, last_time);
+  }
+}
+
+//-------------------------------------------------------------
+// Parameters of downsampling of history for charts:
+//   points=<n>                  max number of returned points, 0 means all points
+//   downsample=lttb|minmax      the method of selecting points, default is lttb
+// Returns false on error
+static bool get_history_downsampling(const RequestParams& params, unsigned& points, DownsampleMethod& method) {
+  uint64_t max_points = params.getNumber(PARAM_POINTS);
+  if (max_points > UINT_MAX || (max_points != 0 && max_points < MIN_DOWNSAMPLE_POINTS)) return false;
+  points = (unsigned)max_points;
+  const char* method_value = params.get(PARAM_DOWNSAMPLE);
+  if (method_value == NULL || strcmp(method_value, "lttb") == 0) {
+    method = DownsampleMethod::lttb;
+  } else if (strcmp(method_value, "minmax") == 0) {
+    method = DownsampleMethod::minmax;
+  } else {
+    return false;
+  }
+  if (points == 0) method = DownsampleMethod::none;
+  return true;
+}
+
+//-------------------------------------------------------------
+// Parameters of history requests:
+//   from=<time>   the earliest time of returned points (seconds since epoch)
+//   to=<time>     the latest time of returned points (seconds since epoch)
+//   after=<time>  return only points after this time (the value of header X-History-Cursor from previous response)
+//   limit=<n>     max number of returned points
+// Returns false on error
+static bool get_history_range(const RequestParams& params, time_t& from, time_t& to, unsigned& limit) {
+  uint64_t from_time = params.getNumber(PARAM_FROM);
+  uint64_t to_time = params.getNumber(PARAM_TO);
+  uint64_t after_time = params.getNumber(PARAM_AFTER);
+  uint64_t max_points = params.getNumber(PARAM_LIMIT);
+  if (from_time > INT32_MAX || to_time > INT32_MAX || after_time >= INT32_MAX || max_points > UINT_MAX) return false;
+  if (after_time != 0 && after_time+1 > from_time) from_time = after_time+1;
+  from = (time_t)from_time;
+  to = (time_t)to_time;
+  limit = (unsigned)max_points;
+  if (to != 0 && from > to) return false;
+  return true;
+}
+
+//-------------------------------------------------------------
+// Parse parameter "scale" of temperature history (F, C, F10 or C10). Returns false on error.
+static bool parse_temperature_scale(const char* value, bool& celsius, bool& x10) {
+  if (value == NULL) return true;
+  if (strcmp("F10", value) == 0) {
+    celsius = false;
+    x10 = true;
+  } else if (strcmp("C10", value) == 0) {
+    celsius = true;
+    x10 = true;
+  } else if (strcmp("F", value) == 0) {
+    celsius = false;
+    x10 = false;
+  } else if (strcmp("C", value) == 0) {
+    celsius = true;
+    x10 = false;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+static ValueConversion get_temperature_conversion(SensorDataStored* item, bool requested_celsius) {
+  bool value_is_celcius = item->isRawTemperatureCelsius();
+  if (value_is_celcius == requested_celsius) return ValueConversion::None;
+  return requested_celsius ? ValueConversion::F2C : ValueConversion::C2F;
+}
+
+//-------------------------------------------------------------
+// Response of request /api/history with the history of several sensors:
+//   [{"name":<name>,"metric":"temperature","cursor":<time>,"data":<history>},...]
+// The list of series is taken from one snapshot of sensors data and the time range is fixed when the request arrives.
+// Series are generated one by one when libmicrohttpd asks for the next block of the response, so only one series
+// is kept in memory. The response is compressed on the fly if the client accepts gzip.
+
+#define HISTORY_STREAM_BLOCK_SIZE (16*1024)
+
+typedef struct HistorySeries {
+  SensorDataStored* item;
+  char name[SENSOR_NAME_MAX_LEN*2+3]; // quoted, copied because the definition can be removed by reloading
+  bool humidity;
+  ValueConversion convertion;
+} HistorySeries;
+
+typedef struct HistoryStream {
+  HistorySeries* series;
+  int count;
+  int next;                 // index of the next series, count means the end of the array
+  HistoryFormat format;
+  time_t from;
+  time_t to;
+  unsigned limit;
+  unsigned points;
+  DownsampleMethod method;
+  bool x10;
+  bool time_UTC;
+  bool gzip;
+  bool finished;            // all data has been passed to deflate()
+  bool ended;
+  z_stream zstream;
+  void* buffer;             // the current chunk of the response
+  size_t buffer_size;
+  size_t data_size;
+  size_t offset;
+} HistoryStream;
+
+static void free_history_stream(void* cls) {
+  HistoryStream* stream = (HistoryStream*)cls;
+  if (stream->gzip) deflateEnd(&stream->zstream);
+  if (stream->buffer != NULL) free(stream->buffer);
+  if (stream->series != NULL) free(stream->series);
+  free(stream);
+}
+
+// Generates the next chunk of the response. Returns false if there is no more data or no memory.
+static bool next_history_chunk(HistoryStream* stream) {
+  stream->offset = 0;
+  stream->data_size = 0;
+  if (stream->next > stream->count) return false;
+  if (stream->next == stream->count) {
+    stream->next++;
+    char* ptr = (char*)resize_buffer(2, stream->buffer, stream->buffer_size);
+    if (ptr == NULL) return false;
+    if (stream->count == 0) ptr[stream->data_size++] = '[';
+    ptr[stream->data_size++] = ']';
+    return true;
+  }
+
+  HistorySeries* series = &stream->series[stream->next];
+  SensorDataStored* item = series->item;
+  time_t last_time = 0;
+  size_t len = series->humidity ?
+      generate_history(item->humidityHistory, stream->format, stream->from, stream->to, stream->limit, stream->points, stream->method,
+          stream->buffer, stream->buffer_size, ValueConversion::None, true, 1, stream->time_UTC, last_time) :
+      generate_history(item->temperatureHistory, stream->format, stream->from, stream->to, stream->limit, stream->points, stream->method,
+          stream->buffer, stream->buffer_size, series->convertion, stream->x10, 10, stream->time_UTC, last_time);
+  if (len == 0) { // no points
+    char* ptr = (char*)resize_buffer(2, stream->buffer, stream->buffer_size);
+    if (ptr == NULL) return false;
+    ptr[0] = '[';
+    ptr[1] = ']';
+    len = 2;
+  }
+  if (last_time == 0) last_time = stream->from != 0 ? stream->from-1 : 0;
+
+  const char* name = series->name;
+  size_t name_len = strlen(name);
+  char head[16];
+  int head_len = snprintf(head, sizeof(head), "%s{\"name\":", stream->next == 0 ? "[" : ",");
+  char tail[80];
+  int tail_len = snprintf(tail, sizeof(tail), ",\"metric\":\"%s\",\"cursor\":%lld,\"data\":",
+      series->humidity ? "humidity" : "temperature", (long long)last_time);
+  size_t prefix_len = head_len+name_len+tail_len;
+  char* ptr = (char*)resize_buffer(prefix_len+len+1, stream->buffer, stream->buffer_size);
+  if (ptr == NULL) return false;
+  memmove(ptr+prefix_len, ptr, len);
+  memcpy(ptr, head, head_len);
+  memcpy(ptr+head_len, name, name_len);
+  memcpy(ptr+head_len+name_len, tail, tail_len);
+  ptr[prefix_len+len] = '}';
+  stream->data_size = prefix_len+len+1;
+  stream->next++;
+  return true;
+}
+
+static ssize_t read_history_stream(void* cls, uint64_t pos, char* buf, size_t max) {
+  HistoryStream* stream = (HistoryStream*)cls;
+  if (!stream->gzip) {
+    while (stream->offset == stream->data_size) {
+      if (stream->next > stream->count) return MHD_CONTENT_READER_END_OF_STREAM;
+      if (!next_history_chunk(stream)) return MHD_CONTENT_READER_END_WITH_ERROR;
+    }
+    size_t len = stream->data_size-stream->offset;
+    if (len > max) len = max;
+    memcpy(buf, (char*)stream->buffer+stream->offset, len);
+    stream->offset += len;
+    return (ssize_t)len;
+  }
+
+  if (stream->ended) return MHD_CONTENT_READER_END_OF_STREAM;
+  z_stream& zstream = stream->zstream;
+  for (;;) {
+    if (stream->offset == stream->data_size && !stream->finished) {
+      if (stream->next > stream->count) {
+        stream->finished = true;
+      } else if (!next_history_chunk(stream)) {
+        return MHD_CONTENT_READER_END_WITH_ERROR;
+      }
+    }
+    zstream.next_in = (Bytef*)stream->buffer+stream->offset;
+    zstream.avail_in = stream->data_size-stream->offset;
+    zstream.next_out = (Bytef*)buf;
+    zstream.avail_out = max;
+    int rc = deflate(&zstream, stream->finished ? Z_FINISH : Z_NO_FLUSH);
+    if (rc == Z_STREAM_ERROR) return MHD_CONTENT_READER_END_WITH_ERROR;
+    stream->offset = stream->data_size-zstream.avail_in;
+    size_t len = max-zstream.avail_out;
+    if (rc == Z_STREAM_END) {
+      stream->ended = true;
+      return len != 0 ? (ssize_t)len : MHD_CONTENT_READER_END_OF_STREAM;
+    }
+    if (len != 0) return (ssize_t)len;
+  }
+}
+
+// Creates the response for request /api/history. Takes ownership of the array of series.
+static struct MHD_Response* create_history_stream_response(HistorySeries* series, int count, HistoryFormat format,
+    time_t from, time_t to, unsigned limit, unsigned points, DownsampleMethod method, bool x10, bool time_UTC, int compression_level) {
+  HistoryStream* stream = (HistoryStream*)calloc(1, sizeof(HistoryStream));
+  if (stream == NULL) {
+    if (series != NULL) free(series);
+    return NULL;
+  }
+  stream->series = series;
+  stream->count = count;
+  stream->format = format;
+  stream->from = from;
+  stream->to = to;
+  stream->limit = limit;
+  stream->points = points;
+  stream->method = method;
+  stream->x10 = x10;
+  stream->time_UTC = time_UTC;
+  if (compression_level > 0) {
+    if (deflateInit2(&stream->zstream, compression_level, Z_DEFLATED, 15+16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+      free_history_stream(stream);
+      return NULL;
+    }
+    stream->gzip = true;
+  }
+  struct MHD_Response* response = MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, HISTORY_STREAM_BLOCK_SIZE,
+      &read_history_stream, stream, &free_history_stream);
+  if (response == NULL) free_history_stream(stream);
+  return response;
+}
+
+//-------------------------------------------------------------
+// Handlers of API requests
+
+// /api/temperature: the current temperature from all defined sensors
+static int handle_temperature(HttpRequest& request) {
+  SensorsData* sensorsData = request.httpd->sensorsData;
+  RestRequestType requestType;
+  const char* value = request.params.get(PARAM_SCALE);
+  if (value != NULL) {
+    if (strcmp("F10", value) == 0) {
+      requestType = RestRequestType::TemperatureF10;
+    } else if (strcmp("C10", value) == 0) {
+      requestType = RestRequestType::TemperatureC10;
+    } else if (strcmp("F", value) == 0) {
+      requestType = RestRequestType::TemperatureF;
+    } else if (strcmp("C", value) == 0) {
+      requestType = RestRequestType::TemperatureC;
+    } else {
+      return error_bad_request(request.connection);
+    }
+  } else {
+    requestType = (sensorsData->getOptions()&OPTION_CELSIUS) != 0 ? RestRequestType::TemperatureC10 : RestRequestType::TemperatureF10;
+  }
+
+  snprintf(request.cache_key, MAX_RESPONSE_CACHE_KEY, "temperature?t=%d", (int)requestType);
+  return_cached_response(request, false);
+  request.data_size = sensorsData->generateJson(request.buffer, request.buffer_size, requestType, 0);
+  return RESPONSE_GENERATED;
+}
+
+// /api/temperature/<name>: temperature history of the sensor
+static int handle_temperature_history(HttpRequest& request) {
+  SensorsData* sensorsData = request.httpd->sensorsData;
+  const RequestParams& params = request.params;
+
+  bool x10 = false;
+  bool requested_celsius = (sensorsData->getOptions()&OPTION_CELSIUS) != 0;
+  if (!parse_temperature_scale(params.get(PARAM_SCALE), requested_celsius, x10)) return error_bad_request(request.connection);
+
+  SensorDataStored* sensorData = find_requested_sensor_data(request.item, sensorsData);
+  if (sensorData == NULL) return error_data_not_found(request.connection);
+  SensorDef* def = __atomic_load_n(&sensorData->def, __ATOMIC_ACQUIRE); // can be unbound by reloading of configuration
+  if (def == NULL) return error_data_not_found(request.connection);
+  SensorData data;
+  sensorData->getData(data);
+  if (!data.hasTemperature()) return error_not_supported(request.connection);
+
+  ValueConversion convertion = get_temperature_conversion(sensorData, requested_celsius);
+  bool time_UTC = (update_options(sensorsData->getOptions(), OPTION_UTC, params, PARAM_UTC)&OPTION_UTC) != 0;
+
+  time_t from, to;
+  unsigned limit;
+  unsigned points;
+  DownsampleMethod method;
+  HistoryFormat format;
+  if (!get_history_range(params, from, to, limit) || !get_history_downsampling(params, points, method) ||
+      !parse_history_format(params.get(PARAM_FORMAT), format)) return error_bad_request(request.connection);
+  if (format == HistoryFormat::binary) request.content_type = "application/octet-stream";
+
+  snprintf(request.cache_key, MAX_RESPONSE_CACHE_KEY, "temperature/%u?c=%d&x=%d&u=%d&f=%ld&t=%ld&l=%u&o=%d&p=%u&d=%d",
+      def->index, (int)requested_celsius, (int)x10, (int)time_UTC, (long)from, (long)to, limit, (int)format, points, (int)method);
+  return_cached_response(request, false);
+  request.data_size = generate_history(sensorData->temperatureHistory, format, from, to, limit, points, method,
+      request.buffer, request.buffer_size, convertion, x10, 10, time_UTC, request.history_cursor);
+  if (request.history_cursor == 0) request.history_cursor = from != 0 ? from-1 : 0;
+  return RESPONSE_GENERATED;
+}
+
+// /api/humidity: the current humidity from all defined sensors that support this metric
+static int handle_humidity(HttpRequest& request) {
+  strcpy(request.cache_key, "humidity");
+  return_cached_response(request, false);
+  request.data_size = request.httpd->sensorsData->generateJson(request.buffer, request.buffer_size, RestRequestType::Humidity, 0);
+  return RESPONSE_GENERATED;
+}
+
+// /api/humidity/<name>: humidity history of the sensor
+static int handle_humidity_history(HttpRequest& request) {
+  SensorsData* sensorsData = request.httpd->sensorsData;
+  const RequestParams& params = request.params;
+
+  SensorDataStored* sensorData = find_requested_sensor_data(request.item, sensorsData);
+  if (sensorData == NULL) return error_data_not_found(request.connection);
+  SensorDef* def = __atomic_load_n(&sensorData->def, __ATOMIC_ACQUIRE); // can be unbound by reloading of configuration
+  if (def == NULL) return error_data_not_found(request.connection);
+  SensorData data;
+  sensorData->getData(data);
+  if (!data.hasHumidity()) return error_not_supported(request.connection);
+
+  bool time_UTC = (update_options(sensorsData->getOptions(), OPTION_UTC, params, PARAM_UTC)&OPTION_UTC) != 0;
+
+  time_t from, to;
+  unsigned limit;
+  unsigned points;
+  DownsampleMethod method;
+  HistoryFormat format;
+  if (!get_history_range(params, from, to, limit) || !get_history_downsampling(params, points, method) ||
+      !parse_history_format(params.get(PARAM_FORMAT), format)) return error_bad_request(request.connection);
+  if (format == HistoryFormat::binary) request.content_type = "application/octet-stream";
+
+  snprintf(request.cache_key, MAX_RESPONSE_CACHE_KEY, "humidity/%u?u=%d&f=%ld&t=%ld&l=%u&o=%d&p=%u&d=%d",
+      def->index, (int)time_UTC, (long)from, (long)to, limit, (int)format, points, (int)method);
+  return_cached_response(request, false);
+  request.data_size = generate_history(sensorData->humidityHistory, format, from, to, limit, points, method,
+      request.buffer, request.buffer_size, ValueConversion::None, true, 1, time_UTC, request.history_cursor);
+  if (request.history_cursor == 0) request.history_cursor = from != 0 ? from-1 : 0;
+  return RESPONSE_GENERATED;
+}
+
+// /api/sensors: the current data from all defined sensors
+static int handle_sensors(HttpRequest& request) {
+  SensorsData* sensorsData = request.httpd->sensorsData;
+  const RequestParams& params = request.params;
+
+  int options = sensorsData->getOptions();
+  options = update_options(options, OPTION_UTC, params, PARAM_UTC);
+  options = update_options(options, OPTION_CELSIUS, params, PARAM_CELSIUS);
+
+  SensorsRequestFormat requestFormat;
+  const char* format_value = params.get(PARAM_FORMAT);
+  if (format_value == NULL || strcmp(format_value, "0") == 0 || strcmp(format_value, "full") == 0) {
+    requestFormat = SensorsRequestFormat::full;
+  } else if (strcmp(format_value, "1") == 0 || strcmp(format_value, "brief") == 0) {
+    requestFormat = SensorsRequestFormat::brief;
+  } else {
+    return error_bad_request(request.connection);
+  }
+
+  // Brief format contains the time since the last update so it is valid only during the current second.
+  snprintf(request.cache_key, MAX_RESPONSE_CACHE_KEY, "sensors?o=%d&f=%d", options, (int)requestFormat);
+  return_cached_response(request, requestFormat == SensorsRequestFormat::brief);
+
+  RestRequestType requestType = requestFormat == SensorsRequestFormat::brief ? RestRequestType::Brief : RestRequestType::AllData;
+  request.data_size = sensorsData->generateJson(request.buffer, request.buffer_size, requestType, options);
+  return RESPONSE_GENERATED;
+}
+
+// /api/stream: Server-Sent Events with changes of sensors data
+static int handle_stream(HttpRequest& request) {
+  HTTPD* httpd = request.httpd;
+  const RequestParams& params = request.params;
+  EventStream* eventStream = httpd->eventStream;
+  if (eventStream == NULL) return error_request_refused(request.connection);
+
+  SensorDef* def = NULL;
+  const char* sensor_name = params.get(PARAM_SENSOR);
+  if (sensor_name != NULL) {
+    def = SensorDef::find(sensor_name);
+    if (def == NULL) return error_data_not_found(request.connection);
+  }
+  int metrics = DATA_IS_CHANGED|BATTERY_STATUS_IS_CHANGED;
+  if (!parse_metrics_param(params.get(PARAM_METRICS), metrics)) return error_bad_request(request.connection);
+  int options = update_options(httpd->sensorsData->getOptions(), OPTION_CELSIUS, params, PARAM_CELSIUS);
+
+  struct MHD_Response* response = eventStream->subscribe(request.connection, def, metrics, (options&OPTION_CELSIUS) != 0);
+  if (response == NULL) return error_too_many_streams(request.connection);
+  int ret = MHD_queue_response(request.connection, MHD_HTTP_OK, response);
+  MHD_destroy_response(response);
+  return ret;
+}
+
+// /api/history: history of several sensors in one response
+static int handle_history(HttpRequest& request) {
+  HTTPD* httpd = request.httpd;
+  SensorsData* sensorsData = httpd->sensorsData;
+  const RequestParams& params = request.params;
+  struct MHD_Connection* connection = request.connection;
+
+  int metrics = DATA_IS_CHANGED;
+  if (!parse_metrics_param(params.get(PARAM_METRICS), metrics) || (metrics&~DATA_IS_CHANGED) != 0) return error_bad_request(connection);
+  bool x10 = false;
+  bool requested_celsius = (sensorsData->getOptions()&OPTION_CELSIUS) != 0;
+  if (!parse_temperature_scale(params.get(PARAM_SCALE), requested_celsius, x10)) return error_bad_request(connection);
+  bool time_UTC = (update_options(sensorsData->getOptions(), OPTION_UTC, params, PARAM_UTC)&OPTION_UTC) != 0;
+
+  time_t from, to;
+  unsigned limit;
+  unsigned points;
+  DownsampleMethod method;
+  HistoryFormat format;
+  if (!get_history_range(params, from, to, limit) || !get_history_downsampling(params, points, method) ||
+      !parse_history_format(params.get(PARAM_FORMAT), format) || format == HistoryFormat::binary) return error_bad_request(connection);
+  // All series end at the same time even if new points arrive while the response is being sent.
+  if (to == 0) to = time(NULL);
+
+  SensorDataStored** items;
+  int nItems = sensorsData->getDefinedSensors(items);
+  if (nItems < 0) return error_out_of_memory(connection);
+
+  // Select sensors. Parameter "sensors" is a comma separated list of names, all defined sensors by default.
+  const char* names = params.get(PARAM_SENSORS);
+  if (names != NULL) {
+    int count = 0;
+    const char* name = names;
+    for (;;) {
+      const char* end = strchr(name, ',');
+      size_t name_len = end == NULL ? strlen(name) : (size_t)(end-name);
+      SensorDef* def = SensorDef::find(name, name_len);
+      int index = 0;
+      if (def != NULL) {
+        while (index < nItems && __atomic_load_n(&items[index]->def, __ATOMIC_ACQUIRE) != def) index++;
+      }
+      if (def == NULL || index == nItems) {
+        if (items != NULL) free(items);
+        return error_data_not_found(connection);
+      }
+      if (index >= count) { // selected sensors are moved to the beginning, duplicates are ignored
+        SensorDataStored* item = items[index];
+        items[index] = items[count];
+        items[count++] = item;
+      }
+      if (end == NULL) break;
+      name = end+1;
+    }
+    nItems = count;
+  }
+
+  HistorySeries* series = NULL;
+  int nSeries = 0;
+  if (nItems > 0) {
+    series = (HistorySeries*)malloc(2*nItems*sizeof(HistorySeries));
+    if (series == NULL) {
+      free(items);
+      return error_out_of_memory(connection);
+    }
+    for (int index = 0; index < nItems; index++) {
+      SensorDataStored* item = items[index];
+      SensorDef* def = __atomic_load_n(&item->def, __ATOMIC_ACQUIRE);
+      if (def == NULL) continue; // removed by reloading of configuration
+      if ((metrics&TEMPERATURE_IS_CHANGED) != 0 && item->hasTemperature()) {
+        HistorySeries* s = &series[nSeries++];
+        s->item = item;
+        strcpy(s->name, def->quoted);
+        s->humidity = false;
+        s->convertion = get_temperature_conversion(item, requested_celsius);
+      }
+      if ((metrics&HUMIDITY_IS_CHANGED) != 0 && item->hasHumidity()) {
+        HistorySeries* s = &series[nSeries++];
+        s->item = item;
+        strcpy(s->name, def->quoted);
+        s->humidity = true;
+        s->convertion = ValueConversion::None;
+      }
+    }
+  }
+  if (items != NULL) free(items);
+
+  Config* cfg = httpd->cfg;
+  struct MHD_Response* response = create_history_stream_response(series, nSeries, format, from, to, limit, points, method, x10, time_UTC,
+      request.accepts_gzip ? cfg->httpd_compression_level : 0);
+  if (response == NULL) return error_out_of_memory(connection);
+  MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "application/json");
+  if (request.accepts_gzip) MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_ENCODING, "gzip");
+  if (cfg->httpd_compression_level > 0) MHD_add_response_header(response, MHD_HTTP_HEADER_VARY, MHD_HTTP_HEADER_ACCEPT_ENCODING);
+  int ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
+  MHD_destroy_response(response);
+  return ret;
+}
+
+// /api/stats: internal counters
+#define STATS_BUFFER_SIZE 2048
+static int handle_stats(HttpRequest& request) {
+  HTTPD* httpd = request.httpd;
+  SensorsData* sensorsData = httpd->sensorsData;
+
+  SensorsDataStatistics stats;
+  sensorsData->getStatistics(stats);
+  ResponseCacheStatistics cache_stats;
+  httpd->getCacheStatistics(cache_stats);
+  EventStreamStatistics stream_stats;
+  memset(&stream_stats, 0, sizeof(stream_stats));
+  if (httpd->eventStream != NULL) httpd->eventStream->getStatistics(stream_stats);
+  request.buffer = malloc(STATS_BUFFER_SIZE);
+  if (request.buffer == NULL) return error_out_of_memory(request.connection);
+  request.buffer_size = STATS_BUFFER_SIZE;
+  char* buffer = (char*)request.buffer;
+  int len = snprintf(buffer, STATS_BUFFER_SIZE,
+      "{\"sensors\":%d,\"max_sensors\":%u,\"evicted_expired\":%u,\"evicted_lru\":%u,\"rejected\":%u,"
+      "\"cache_hits\":%u,\"cache_misses\":%u,\"not_modified\":%u,"
+      "\"compressed\":%u,"
+      "\"stream_clients\":%u,\"stream_events\":%u,\"stream_dropped\":%u,\"latency\":{",
+      sensorsData->getSize(), sensorsData->getMaxCount(), stats.evicted_expired, stats.evicted_lru, stats.rejected,
+      cache_stats.hits, cache_stats.misses, cache_stats.not_modified,
+      cache_stats.compressed,
+      stream_stats.clients, stream_stats.events, stream_stats.dropped);
+
+  // medians and 99th percentiles of latencies of stages of messages in microseconds
+  bool first = true;
+  for (int index = 0; index < NUMBER_OF_LATENCIES && len > 0 && len < STATS_BUFFER_SIZE; index++) {
+    const MetricsLatencyHistogram& histogram = statistics->latency[index];
+    uint32_t median = histogram.quantile(0.5);
+    if (median == 0) continue;
+    len += snprintf(buffer+len, STATS_BUFFER_SIZE-len, "%s\"%s\":{\"p50\":%u,\"p99\":%u}",
+        first ? "" : ",", latency_names[index], median, histogram.quantile(0.99));
+    first = false;
+  }
+  if (len > 0 && len < STATS_BUFFER_SIZE) len += snprintf(buffer+len, STATS_BUFFER_SIZE-len, "}}");
+  request.data_size = len > 0 && len < STATS_BUFFER_SIZE ? (size_t)len : 0;
+  return RESPONSE_GENERATED;
+}
+
+//-------------------------------------------------------------
+// Readings of sensors in Prometheus text format.
+// Only sensors defined in configuration are exported, so sensors of neighbours do not add series.
+
+// name=" + the escaped name + protocol, channel and rolling code
+#define MAX_SENSOR_LABELS (2*MAX_SENSOR_NAME_LEN+1+128)
+
+typedef struct SensorSample {
+  SensorData data;
+  uint32_t received;
+  time_t last_seen;
+  char labels[MAX_SENSOR_LABELS];
+} SensorSample;
+
+static bool format_sensor_labels(SensorDef* def, SensorData& data, char* labels, size_t size) {
+  char name[2*MAX_SENSOR_NAME_LEN+1]; // every character can be escaped
+  if (!escape_label_value(def->name, name, sizeof(name))) return false;
+  uint32_t features = data.getFeatures();
+  char channel[16] = "";
+  if ((features&FEATURE_CHANNEL) != 0) {
+    const char* channel_name = data.getChannelName();
+    if (channel_name != NULL)
+      snprintf(channel, sizeof(channel), "%s", channel_name);
+    else
+      snprintf(channel, sizeof(channel), "%d", data.getChannelNumber());
+  }
+  char rolling_code[16] = "";
+  if ((features&FEATURE_ROLLING_CODE) != 0) snprintf(rolling_code, sizeof(rolling_code), "%d", data.getRollingCode());
+  int len = snprintf(labels, size, "name=\"%s\",protocol=\"%s\",channel=\"%s\",rolling_code=\"%s\"",
+      name, data.getSensorTypeName(), channel, rolling_code);
+  return len > 0 && (size_t)len < size;
+}
+
+static void generate_sensor_metrics(SensorsData* sensorsData, MetricsWriter& writer, time_t now) {
+  SensorDataStored** items;
+  int count = sensorsData->getDefinedSensors(items);
+  if (count <= 0) {
+    if (items != NULL) free(items);
+    return;
+  }
+  SensorSample* samples = (SensorSample*)malloc(count*sizeof(SensorSample));
+  if (samples == NULL) {
+    free(items);
+    Log->error("Out of memory");
+    return;
+  }
+  int n = 0;
+  for (int index = 0; index < count; index++) {
+    SensorDataStored* item = items[index];
+    // The definition can be unbound by reloading of configuration after getDefinedSensors().
+    SensorDef* def = __atomic_load_n(&item->def, __ATOMIC_ACQUIRE);
+    if (def == NULL) continue;
+    SensorSample& sample = samples[n];
+    item->getData(sample.data);
+    sample.received = metrics_load(item->received);
+    sample.last_seen = metrics_load(item->last_seen);
+    if (format_sensor_labels(def, sample.data, sample.labels, MAX_SENSOR_LABELS)) n++;
+  }
+  free(items);
+
+  // Samples of one metric must be grouped together.
+  char t2d_buffer[T2D_BUFFER_SIZE];
+  writer.header("sensor_temperature_celsius", "gauge", "Last temperature reported by the sensor");
+  for (int index = 0; index < n; index++) {
+    SensorSample& sample = samples[index];
+    if (sample.data.hasTemperature()) writer.value("sensor_temperature_celsius", sample.labels, t2d(sample.data.getTemperature10(true), t2d_buffer));
+  }
+  writer.header("sensor_humidity_percent", "gauge", "Last relative humidity reported by the sensor");
+  for (int index = 0; index < n; index++) {
+    SensorSample& sample = samples[index];
+    if (sample.data.hasHumidity()) writer.value("sensor_humidity_percent", sample.labels, (uint64_t)sample.data.getHumidity());
+  }
+  writer.header("sensor_battery_ok", "gauge", "1 if the battery of the sensor is OK, 0 if it is low");
+  for (int index = 0; index < n; index++) {
+    SensorSample& sample = samples[index];
+    if (sample.data.hasBatteryStatus()) writer.value("sensor_battery_ok", sample.labels, sample.data.getBatteryStatus() ? 1 : 0);
+  }
+  writer.header("sensor_last_seen_seconds", "gauge", "Seconds since the last message from the sensor");
+  for (int index = 0; index < n; index++) {
+    SensorSample& sample = samples[index];
+    writer.value("sensor_last_seen_seconds", sample.labels, now > sample.last_seen ? now-sample.last_seen : 0);
+  }
+  writer.header("sensor_received_total", "counter", "Messages received from the sensor");
+  for (int index = 0; index < n; index++) {
+    SensorSample& sample = samples[index];
+    writer.value("sensor_received_total", sample.labels, sample.received);
+  }
+  free(samples);
+}
+
+// The text is generated once per generation of sensors data and second, so several Prometheus servers
+// that scrape the same receiver share it.
+void HTTPD::writeSensorMetrics(MetricsWriter& writer) {
+  uint32_t generation = sensorsData->getGeneration();
+  time_t now = time(NULL);
+  pthread_mutex_lock(&sensor_metrics_lock);
+  if (sensor_metrics == NULL || sensor_metrics_generation != generation || sensor_metrics_time != now) {
+    MetricsWriter sensors;
+    generate_sensor_metrics(sensorsData, sensors, now);
+    if (!sensors.failed()) {
+      if (sensor_metrics != NULL) free(sensor_metrics);
+      sensor_metrics_size = sensors.getSize();
+      sensor_metrics = sensors.detach();
+      sensor_metrics_generation = generation;
+      sensor_metrics_time = now;
+    }
+  }
+  if (sensor_metrics != NULL && sensor_metrics_generation == generation && sensor_metrics_time == now)
+    writer.write(sensor_metrics, sensor_metrics_size);
+  pthread_mutex_unlock(&sensor_metrics_lock);
+}
+
+// /metrics: sensor readings and internal counters in Prometheus text format
+static int handle_metrics(HttpRequest& request) {
+  HTTPD* httpd = request.httpd;
+  SensorsData* sensorsData = httpd->sensorsData;
+  MetricsWriter writer;
+
+  // receiver, decoder, queue, sinks and rules
+  httpd->collectMetrics(writer);
+
+  SensorsDataStatistics stats;
+  sensorsData->getStatistics(stats);
+  writer.gauge("sensors", "Stored sensors", sensorsData->getSize());
+  writer.gauge("sensors_max", "Max number of stored sensors, 0 means unlimited", sensorsData->getMaxCount());
+  writer.header("sensors_evicted_total", "counter", "Undefined sensors removed from the table");
+  writer.value("sensors_evicted_total", "reason=\"expired\"", stats.evicted_expired);
+  writer.value("sensors_evicted_total", "reason=\"lru\"", stats.evicted_lru);
+  writer.counter("sensors_rejected_total", "New undefined sensors that were not stored because the table was full", stats.rejected);
+  writer.counter("data_changes_total", "Changes of stored sensors data", sensorsData->getGeneration());
+  httpd->writeSensorMetrics(writer);
+
+  ResponseCacheStatistics cache_stats;
+  httpd->getCacheStatistics(cache_stats);
+  writer.gauge("start_time_seconds", "Start time of HTTPD server since unix epoch", httpd->started);
+  writer.counter("http_requests_total", "Processed HTTP requests", httpd->requests.load(std::memory_order_relaxed));
+  writer.counter("http_errors_total", "HTTP responses with error status", error_responses.load(std::memory_order_relaxed));
+  writer.header("http_request_duration_seconds", "histogram", "Time of creating HTTP responses");
+  writer.histogram("http_request_duration_seconds", NULL, httpd->request_duration);
+  writer.counter("http_cache_hits_total", "API responses returned from the cache", cache_stats.hits);
+  writer.counter("http_cache_misses_total", "API responses that were generated", cache_stats.misses);
+  writer.counter("http_not_modified_total", "Responses with status 304", cache_stats.not_modified);
+  writer.counter("http_compressed_responses_total", "Responses compressed with gzip", cache_stats.compressed);
+
+  if (httpd->eventStream != NULL) {
+    EventStreamStatistics stream_stats;
+    httpd->eventStream->getStatistics(stream_stats);
+    writer.gauge("stream_clients", "Connected clients of /api/stream", stream_stats.clients);
+    writer.counter("stream_events_total", "Events published to /api/stream", stream_stats.events);
+    writer.counter("stream_events_dropped_total", "Events dropped for slow clients of /api/stream", stream_stats.dropped);
+  }
+
+  LoggerStatistics log_stats;
+  Log->getStatistics(log_stats);
+  writer.counter("log_messages_total", "Messages written to the log", log_stats.written);
+  writer.counter("log_messages_dropped_total", "Log messages dropped because the queue was full", log_stats.dropped);
+  writer.counter("log_messages_suppressed_total", "Repeated log messages that were not written", log_stats.suppressed);
+
+  if (writer.failed()) return error_out_of_memory(request.connection);
+  request.data_size = writer.getSize();
+  request.buffer = writer.detach();
+  request.buffer_size = request.data_size;
+  request.content_type = "text/plain; version=0.0.4; charset=utf-8";
+  return RESPONSE_GENERATED;
+}
+
+// /api/version
+static int handle_version(HttpRequest& request) {
+  struct MHD_Response* response = MHD_create_response_from_buffer(strlen(version_response_text)*sizeof(char), (void*)version_response_text, MHD_RESPMEM_PERSISTENT);
+  MHD_add_response_header(response, "Content-Type", "application/json");
+  int ret = MHD_queue_response(request.connection, MHD_HTTP_OK, response);
+  MHD_destroy_response(response);
+  return ret;
+}
+
+//-------------------------------------------------------------
+// Routes of API requests /api/<name> and /api/<name>/<item>.
+// The table is sorted by name and the route is found by binary search.
+
+typedef int (*RequestHandler)(HttpRequest& request);
+
+typedef struct ApiRoute {
+  const char* name;
+  RequestHandler handler;       // /api/<name>
+  uint32_t params;              // parameters accepted by handler
+  RequestHandler item_handler;  // /api/<name>/<item>, NULL if it is not supported
+  uint32_t item_params;         // parameters accepted by item_handler
+} ApiRoute;
+
+#define HISTORY_PARAMS (PARAM(PARAM_UTC)|PARAM(PARAM_FROM)|PARAM(PARAM_TO)|PARAM(PARAM_LIMIT)|PARAM(PARAM_AFTER)|PARAM(PARAM_FORMAT)|\
+    PARAM(PARAM_POINTS)|PARAM(PARAM_DOWNSAMPLE))
+
+static constexpr ApiRoute api_routes[] = {
+  { "history", &handle_history, HISTORY_PARAMS|PARAM(PARAM_SENSORS)|PARAM(PARAM_METRICS)|PARAM(PARAM_SCALE), NULL, 0 },
+  { "humidity", &handle_humidity, 0, &handle_humidity_history, HISTORY_PARAMS },
+  { "sensors", &handle_sensors, PARAM(PARAM_UTC)|PARAM(PARAM_CELSIUS)|PARAM(PARAM_FORMAT), NULL, 0 },
+  { "stats", &handle_stats, ANY_PARAMS, NULL, 0 },
+  { "stream", &handle_stream, PARAM(PARAM_SENSOR)|PARAM(PARAM_METRICS)|PARAM(PARAM_CELSIUS), NULL, 0 },
+  { "temperature", &handle_temperature, PARAM(PARAM_SCALE), &handle_temperature_history, HISTORY_PARAMS|PARAM(PARAM_SCALE) },
+  { "version", &handle_version, ANY_PARAMS, NULL, 0 }
+};
+
+#define NUMBER_OF_API_ROUTES ((int)(sizeof(api_routes)/sizeof(ApiRoute)))
+
+static constexpr bool api_routes_sorted(int index) {
+  return index+1 >= NUMBER_OF_API_ROUTES || (str_less(api_routes[index].name, api_routes[index+1].name) && api_routes_sorted(index+1));
+}
+static_assert(api_routes_sorted(0), "api_routes must be sorted by name");
+
+// Finds the route by name that is not terminated by '\0'.
+static const ApiRoute* find_route(const char* name, size_t len) {
+  int low = 0;
+  int high = NUMBER_OF_API_ROUTES-1;
+  while (low <= high) {
+    int middle = (low+high)/2;
+    const char* route_name = api_routes[middle].name;
+    int cmp = strncmp(name, route_name, len);
+    if (cmp == 0 && route_name[len] != '\0') cmp = -1; // the name is a prefix of the route name
+    if (cmp == 0) return &api_routes[middle];
+    if (cmp < 0) high = middle-1; else low = middle+1;
+  }
+  return NULL;
+}
+
+//-------------------------------------------------------------
+// libmicrohttpd calls the handler the first time when only headers of the request are received. The context pointer
+// of the request is set to this marker then and the response is created in the next call. The pointer is reset to NULL
+// by libmicrohttpd for each new request on the connection.
+static const char request_headers_received = 0;
+
+static int handle_request(
     void* cls,
     struct MHD_Connection * connection,
     const char* url,
@@ -326,23 +1397,13 @@ static int process_request(
     const char* version,
     const char* upload_data,
     size_t* upload_data_size,
-    void** ptr
+    void** con_cls
 ) {
 
   HTTPD* httpd = (HTTPD*)cls;
   SensorsData* sensorsData = httpd->sensorsData;
   Config* cfg = httpd->cfg;
 
-  if (strcmp(method, "GET") != 0) return MHD_NO; // unexpected method
-
-  //FIXME it looks suspicious
-  static int dummy;
-  if (&dummy != *ptr) {
-    // The first time only the headers are valid, do not respond in the first round...
-    *ptr = &dummy;
-    return MHD_YES;
-  }
-  *ptr = NULL; // clear context pointer
   if (*upload_data_size != 0) return MHD_NO; // upload data in a GET!?
 
   if (url == NULL || *url != '/') return MHD_NO;
@@ -352,213 +1413,78 @@ static int process_request(
   size_t url_len = strlen(url);
   if (url_len > MAX_URL) return error_bad_request(connection);
 
-  void* buffer = NULL;
-  size_t buffer_size = 0;
-  size_t data_size = 0;
+  HttpRequest request;
+  request.httpd = httpd;
+  request.connection = connection;
+  request.item = NULL;
+  request.params.present = 0;
+  request.accepts_gzip = cfg->httpd_compression_level > 0 &&
+      (StaticFiles::getAcceptedEncodings(MHD_lookup_connection_value(connection, MHD_HEADER_KIND, MHD_HTTP_HEADER_ACCEPT_ENCODING))&ACCEPT_ENCODING_GZIP) != 0;
+  request.buffer = NULL;
+  request.buffer_size = 0;
+  request.data_size = 0;
+  request.content_type = "application/json";
+  request.history_cursor = 0;
+  request.cache_key[0] = '\0';
+  request.generation = 0;
+  request.cache_time = 0;
 
   struct MHD_Response* response;
 
   if (url_len == 1) { // no path
 
+    if (httpd->staticFiles != NULL) {
+      int ret = httpd->staticFiles->respond(connection, "/index.html");
+      if (ret != -1) return ret;
+    }
     if (!httpd->no_home_page) { // Home page exists or has not checked yet.
       // If home page exist then return it in the response
       const char* www_root = cfg->www_root;
-      if (www_root != NULL) {
+      char home_page_file[PATH_MAX];
+      if (www_root != NULL && get_www_file_path(www_root, "/index.html", home_page_file, sizeof(home_page_file)) &&
+          access(home_page_file, R_OK) == 0) {
         // Try to show home page
-        const char* home_page_file = get_www_file_path(www_root, "/index.html");
-        if(home_page_file != NULL && access(home_page_file, R_OK) == 0) {
-          int ret = download_file(connection, home_page_file);
-          free((void*)home_page_file);
-          return ret;
-        }
+        return download_file(connection, home_page_file);
       }
       httpd->no_home_page = true;
     }
 
-    data_size = sensorsData->generateJson(buffer, buffer_size, RestRequestType::AllData, cfg->options);
+    snprintf(request.cache_key, MAX_RESPONSE_CACHE_KEY, "all?o=%d", cfg->options);
+    return_cached_response(request, false);
+    request.data_size = sensorsData->generateJson(request.buffer, request.buffer_size, RestRequestType::AllData, cfg->options);
+
+  } else if (strcmp(url, "/metrics") == 0) {
+
+    int ret = handle_metrics(request);
+    if (ret != RESPONSE_GENERATED) return ret;
 
 #define API_REQ_PREFIX "/api/"
 #define API_REQ_PREFIX_LEN 5
   } else if (url_len>5 && strncmp(url, API_REQ_PREFIX, API_REQ_PREFIX_LEN) == 0) {
 
-    const char* api_req = url+API_REQ_PREFIX_LEN;
-    const char* p = api_req;
-    int len = 0;
-    char ch = '\0';
-    while ((ch=*p) >= 'a' && ch <='z') {
-      if (++len >= MAX_REQ_LEN) return error_bad_request(connection);
-      p++;
-    }
-    if (ch == '?') return error_bad_request(connection);
-
-    const char* params[MAX_NUMBER_OF_PARAMS];
-    //memset(params, MAX_NUMBER_OF_PARAMS, sizeof(const char*));
-    for (int index=0; index<MAX_NUMBER_OF_PARAMS; index++) {
-      params[index] = NULL;
+    // /api/<name> or /api/<name>/<item>
+    const char* name = url+API_REQ_PREFIX_LEN;
+    const char* p = name;
+    char ch;
+    while ((ch=*p) >= 'a' && ch <='z') p++;
+    if (ch != '\0' && ch != '/') return error_bad_request(connection);
+    const ApiRoute* route = find_route(name, p-name);
+    if (route == NULL) return error_bad_request(connection);
+
+    RequestHandler handler = route->handler;
+    uint32_t allowed_params = route->params;
+    if (ch == '/' && *++p != '\0') {
+      if (route->item_handler == NULL) return error_bad_request(connection);
+      request.item = p;
+      handler = route->item_handler;
+      allowed_params = route->item_params;
     }
+    if (!parse_params(request, allowed_params)) return error_bad_request(connection);
 
-#define is_req(req, str, len) (strlen(req) == len && strncmp(req, str, len) == 0)
-    if (is_req("temperature", api_req, len)) {
-
-      if (ch == '/' && *++p != '\0') {
-        // temperature history
-
-        bool success = false;
-        int result = process_params(httpd, connection, p, request_params(temperature_history), max_number_of_params(temperature_history), params, success);
-        if (!success) return result;
-
-        bool x10;
-        bool requested_celsius;
-        const char* value = params[REQ_TEMPERATURE_HISTORY_PARAM_SCALE];
-        if (value != NULL) {
-          if (strcmp("F10", value) == 0) {
-            requested_celsius = false;
-            x10 = true;
-          } else if (strcmp("C10", value) == 0) {
-            requested_celsius = true;
-            x10 = true;
-          } else if (strcmp("F", value) == 0) {
-            requested_celsius = false;
-            x10 = false;
-          } else if (strcmp("C", value) == 0) {
-            requested_celsius = true;
-            x10 = false;
-          } else {
-            return error_bad_request(connection);
-          }
-        } else {
-          requested_celsius = (sensorsData->getOptions()&OPTION_CELSIUS) != 0;
-          x10 = false;
-        }
-
-        SensorDataStored* sensorData = find_requested_sensor_data(p, sensorsData);
-        if (sensorData == NULL) return error_data_not_found(connection);
-        if (!sensorData->hasTemperature()) return error_not_supported(connection);
-
-        bool value_is_celcius = sensorData->isRawTemperatureCelsius();
-
-        ValueConversion convertion;
-        if (value_is_celcius == requested_celsius) {
-          convertion = ValueConversion::None;
-        } else if (requested_celsius) {
-          convertion = ValueConversion::F2C;
-        } else {
-          convertion = ValueConversion::C2F;
-        }
-
-        int options = sensorsData->getOptions();
-        if (!update_options(options, OPTION_UTC, params[REQ_TEMPERATURE_HISTORY_PARAM_UTC])) return error_bad_request(connection);
-        bool time_UTC = (options&OPTION_UTC) != 0;
-
-        time_t from = 0; // TODO
-        time_t to = 0; // TODO
-
-        data_size = sensorData->temperatureHistory.generateJson(from, to, buffer, buffer_size, convertion, x10, time_UTC);
-
-      } else {
-        // current temperature from all defined sensors
-
-        bool success = false;
-        int result = process_params(httpd, connection, p, request_params(temperature), max_number_of_params(temperature), params, success);
-        if (!success) return result;
-
-        RestRequestType requestType;
-        const char* value = params[REQ_TEMPERATURE_PARAM_SCALE];
-        if (value != NULL) {
-          if (strcmp("F10", value) == 0) {
-            requestType = RestRequestType::TemperatureF10;
-          } else if (strcmp("C10", value) == 0) {
-            requestType = RestRequestType::TemperatureC10;
-          } else if (strcmp("F", value) == 0) {
-            requestType = RestRequestType::TemperatureF;
-          } else if (strcmp("C", value) == 0) {
-            requestType = RestRequestType::TemperatureC;
-          } else {
-            return error_bad_request(connection);
-          }
-        } else {
-          requestType = (sensorsData->getOptions()&OPTION_CELSIUS) != 0 ? RestRequestType::TemperatureC10 : RestRequestType::TemperatureF10;
-        }
-
-        // The current temperature from all defined sensors
-        data_size = sensorsData->generateJson(buffer, buffer_size, requestType, 0);
-      }
-
-    } else if (is_req("humidity", api_req, len)) {
-      if (ch == '/' && *++p != '\0') {
-        // humidity history
-
-        bool success = false;
-        int result = process_params(httpd, connection, p, request_params(humidity_history), max_number_of_params(humidity_history), params, success);
-        if (!success) return result;
-
-        SensorDataStored* sensorData = find_requested_sensor_data(p, sensorsData);
-        if (sensorData == NULL) return error_data_not_found(connection);
-        if (!sensorData->hasHumidity()) return error_not_supported(connection);
-
-        int options = sensorsData->getOptions();
-        if (!update_options(options, OPTION_UTC, params[REQ_HUMIDITY_HISTORY_PARAM_UTC])) return error_bad_request(connection);
-        bool time_UTC = (options&OPTION_UTC) != 0;
-
-        time_t from = 0; // TODO
-        time_t to = 0; // TODO
-
-        data_size = sensorData->humidityHistory.generateJson(from, to, buffer, buffer_size, ValueConversion::None, false, time_UTC);
-
-      } else {
-        // The current humidity from all defined sensors that supports this metric
-
-        bool success = false;
-        int result = process_params(httpd, connection, p, /*request_params(humidity)*/NULL, /*max_number_of_params(humidity)*/0, params, success);
-        if (!success) return result;
-
-        data_size = sensorsData->generateJson(buffer, buffer_size, RestRequestType::Humidity, 0);
-      }
-
-    } else if (is_req("sensors", api_req, len)) {
-      if (ch == '\0') {
-        bool success = false;
-        int result = process_params(httpd, connection, p, request_params(sensors), max_number_of_params(sensors), params, success);
-        if (!success) return result;
-
-        int options = sensorsData->getOptions();
-        if (!update_options(options, OPTION_UTC, params[REQ_SENSORS_PARAM_UTC])) return error_bad_request(connection);
-        if (!update_options(options, OPTION_CELSIUS, params[REQ_SENSORS_PARAM_CELSIUS])) return error_bad_request(connection);
-
-        SensorsRequestFormat requestFormat;
-        const char* format_value = params[REQ_SENSORS_PARAM_FORMAT];
-        if (format_value == NULL || *format_value == '\0' || strcmp(format_value, "0") == 0 || strcmp(format_value, "full") == 0) {
-          requestFormat = SensorsRequestFormat::full;
-        } else if (strcmp(format_value, "1") == 0 || strcmp(format_value, "brief") == 0) {
-          requestFormat = SensorsRequestFormat::brief;
-        } else {
-          return error_bad_request(connection);
-        }
-
-        switch(requestFormat) {
-        case SensorsRequestFormat::full:
-          data_size = sensorsData->generateJson(buffer, buffer_size, RestRequestType::AllData, options); // current data from all defined sensors
-          break;
-        case SensorsRequestFormat::brief:
-          data_size = sensorsData->generateJson(buffer, buffer_size, RestRequestType::Brief, options);
-          break;
-        default:
-          return error_bad_request(connection);
-        }
-      } else {
-        return error_bad_request(connection);
-      }
-
-    } else if (is_req("version", api_req, len)) {
-
-      response = MHD_create_response_from_buffer(strlen(version_response_text)*sizeof(char), (void*)version_response_text, MHD_RESPMEM_PERSISTENT);
-      MHD_add_response_header(response, "Content-Type", "application/json");
-      int ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
-      MHD_destroy_response(response);
+    int ret = handler(request);
+    if (ret != RESPONSE_GENERATED) {
+      if (request.buffer != NULL) free(request.buffer);
       return ret;
-
-    } else {
-      return error_bad_request(connection);
     }
 
   } else {
@@ -586,27 +1512,84 @@ static int process_request(
         return error_bad_request(connection);
       }
     }
-    const char* filepath = get_www_file_path(www_root, url);
-    if (filepath == NULL) return error_out_of_memory(connection);
+    if (httpd->staticFiles != NULL) {
+      int ret = httpd->staticFiles->respond(connection, url);
+      if (ret != -1) return ret;
+    }
+
+    // The file is too big to be cached or it has been just created.
+    char filepath[PATH_MAX];
+    if (!get_www_file_path(www_root, url, filepath, sizeof(filepath))) return error_bad_request(connection);
 
     //Log->info("  file = \"%s\"", filepath);
-    int ret = download_file(connection, filepath);
+    return download_file(connection, filepath);
+  }
 
-    free((void*)filepath);
-    return ret;
+  void* buffer = request.buffer;
+  size_t data_size = request.data_size;
+  bool compressed = false;
+  if (request.accepts_gzip && data_size != 0 && data_size >= cfg->httpd_compression_threshold) {
+    size_t compressed_size = 0;
+    void* compressed_data = httpd->compress(buffer, data_size, compressed_size);
+    if (compressed_data != NULL) {
+      free(buffer);
+      buffer = compressed_data;
+      data_size = compressed_size;
+      compressed = true;
+    }
   }
 
-  if (data_size == 0)
+  if (data_size == 0) {
+    if (buffer != NULL) free(buffer);
     response = MHD_create_response_from_buffer(2, (void*)"[]", MHD_RESPMEM_PERSISTENT);
-  else
+  } else {
     response = MHD_create_response_from_buffer(data_size, buffer, MHD_RESPMEM_MUST_FREE);
-  MHD_add_response_header(response, "Content-Type", "application/json");
+    if (response == NULL) free(buffer);
+  }
+  if (response == NULL) return error_out_of_memory(connection);
+  MHD_add_response_header(response, "Content-Type", request.content_type);
+  if (compressed) MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_ENCODING, "gzip");
+  if (cfg->httpd_compression_level > 0) MHD_add_response_header(response, MHD_HTTP_HEADER_VARY, MHD_HTTP_HEADER_ACCEPT_ENCODING);
+  if (request.history_cursor != 0) {
+    char cursor[24];
+    snprintf(cursor, sizeof(cursor), "%llu", (unsigned long long)request.history_cursor);
+    MHD_add_response_header(response, HISTORY_CURSOR_HEADER, cursor);
+  }
+
+  if (request.cache_key[0] != '\0') return httpd->queueResponse(connection, request.cache_key, request.accepts_gzip, request.generation, request.cache_time, response);
 
   int ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
   MHD_destroy_response(response);
   return ret;
 }
 
+// Measures the time of creating responses. The time of sending is not included.
+static int process_request(
+    void* cls,
+    struct MHD_Connection * connection,
+    const char* url,
+    const char* method,
+    const char* version,
+    const char* upload_data,
+    size_t* upload_data_size,
+    void** con_cls
+) {
+  if (strcmp(method, "GET") != 0) return MHD_NO; // unexpected method
+
+  if (*con_cls == NULL) {
+    *con_cls = (void*)&request_headers_received;
+    return MHD_YES;
+  }
+
+  HTTPD* httpd = (HTTPD*)cls;
+  struct timespec started;
+  clock_gettime(CLOCK_MONOTONIC, &started);
+  int ret = handle_request(cls, connection, url, method, version, upload_data, upload_data_size, con_cls);
+  httpd->requests.fetch_add(1, std::memory_order_relaxed);
+  httpd->request_duration.observeSince(started);
+  return ret;
+}
+
 //-------------------------------------------------------------
 HTTPD* HTTPD::start(SensorsData* sensorsData, Config* cfg) {
   if (sensorsData == NULL || cfg == NULL) return NULL;
@@ -614,16 +1597,66 @@ HTTPD* HTTPD::start(SensorsData* sensorsData, Config* cfg) {
 
   int port = cfg->httpd_port;
   if (port >= MIN_HTTPD_PORT && port<65535) {
+    int threads = cfg->httpd_threads;
+    if (threads < 0) {
+      long cores = sysconf(_SC_NPROCESSORS_ONLN);
+      threads = cores < 1 ? 1 : cores > MAX_HTTPD_THREADS ? MAX_HTTPD_THREADS : (int)cores;
+    }
+
+    unsigned int flags;
+    if (threads == 0) {
+      flags = MHD_USE_THREAD_PER_CONNECTION;
+    } else if (MHD_is_feature_supported(MHD_FEATURE_EPOLL) == MHD_YES) {
+      flags = MHD_USE_EPOLL_INTERNAL_THREAD;
+    } else {
+      flags = MHD_USE_POLL_INTERNAL_THREAD;
+    }
+    const char* polling = (flags == MHD_USE_EPOLL_INTERNAL_THREAD) ? "epoll" : "poll";
+    // Idle event streams are suspended so they do not occupy threads of the pool.
+    if (threads != 0) flags |= MHD_ALLOW_SUSPEND_RESUME;
+
+    struct MHD_OptionItem options[5];
+    int n = 0;
+    if (threads > 1) options[n++] = { MHD_OPTION_THREAD_POOL_SIZE, (intptr_t)threads, NULL };
+    if (cfg->httpd_max_connections != 0) options[n++] = { MHD_OPTION_CONNECTION_LIMIT, (intptr_t)cfg->httpd_max_connections, NULL };
+    if (cfg->httpd_max_connections_per_ip != 0) options[n++] = { MHD_OPTION_PER_IP_CONNECTION_LIMIT, (intptr_t)cfg->httpd_max_connections_per_ip, NULL };
+    if (cfg->httpd_timeout != 0) options[n++] = { MHD_OPTION_CONNECTION_TIMEOUT, (intptr_t)cfg->httpd_timeout, NULL };
+    options[n] = { MHD_OPTION_END, 0, NULL };
+
+    // Everything that is used by request handlers is created before the daemon starts to accept connections.
+    if (cfg->www_root != NULL) {
+      httpd->staticFiles = new StaticFiles(cfg->www_root, cfg->httpd_max_age);
+      httpd->staticFiles->start();
+    }
+    EventStream* eventStream = new EventStream(threads != 0, sensorsData->getOptions());
+    if (eventStream->start()) {
+      httpd->eventStream = eventStream;
+      sensorsData->setListener(&EventStream::listener, eventStream);
+    } else {
+      delete eventStream;
+    }
+
     httpd->daemon =
       MHD_start_daemon(
-        MHD_USE_THREAD_PER_CONNECTION,
+        flags,
         port,
         NULL,
         NULL,
         (MHD_AccessHandlerCallback)&process_request,
         (void*)httpd,
+        MHD_OPTION_ARRAY, options,
         MHD_OPTION_END
       );
+    if (httpd->daemon == NULL) {
+      delete httpd;
+      return NULL;
+    }
+    if ((cfg->options&VERBOSITY_INFO) != 0) {
+      if (threads == 0)
+        Log->log("HTTPD server uses a thread per connection.");
+      else
+        Log->log("HTTPD server uses %s with %d thread(s).", polling, threads);
+    }
   }
 
   return httpd;
@@ -640,10 +1673,23 @@ void HTTPD::destroy(HTTPD*& httpd) {
 
 //-------------------------------------------------------------
 void HTTPD::stop() {
+  if (eventStream != NULL) {
+    sensorsData->setListener(NULL, NULL);
+    eventStream->stop();
+  }
   if (daemon != NULL) {
     MHD_stop_daemon(daemon);
     daemon = NULL;
     destroy_html_responses();
+    clearCache();
+  }
+  if (staticFiles != NULL) {
+    delete staticFiles;
+    staticFiles = NULL;
+  }
+  if (eventStream != NULL) {
+    delete eventStream;
+    eventStream = NULL;
   }
 }
 
@@ -8,19 +8,81 @@
 #ifndef HTTPD_HPP_
 #define HTTPD_HPP_
 
+#include <pthread.h>
+#include <atomic>
+
 #include "../common/SensorsData.hpp"
 #include "../common/Config.hpp"
+#include "StaticFiles.hpp"
+#include "EventStream.hpp"
+#include "Metrics.hpp"
 
 struct MHD_Daemon* start_httpd(int port, SensorsData* sensorsData, Config* cfg);
 void stop_httpd(struct MHD_Daemon* httpd);
 
+//-------------------------------------------------------------
+// Cache of generated API responses.
+// A response is valid while the generation of sensors data is not changed. Responses that depend on
+// the current time (e.g. brief list of sensors) are valid only during the second when they were created.
+// The cache owns one reference to each MHD response, libmicrohttpd holds other references while
+// the response is being sent so a replaced response is freed when the last connection is done with it.
+// Clients that accept gzip get a separate (compressed) variant of the response, so the compression is done
+// once per generation of data.
+
+#define RESPONSE_CACHE_SIZE 32
+#define MAX_RESPONSE_CACHE_KEY 128
+#define MAX_ETAG 48
+
+typedef struct CachedResponse {
+  char key[MAX_RESPONSE_CACHE_KEY];
+  uint32_t generation;
+  time_t time;                        // 0 if the response does not depend on the current time
+  bool gzip;                          // the variant for clients that accept gzip
+  struct MHD_Response* response;
+  std::atomic<uint32_t> last_used;
+} CachedResponse;
+
+typedef struct ResponseCacheStatistics {
+  uint32_t hits;
+  uint32_t misses;
+  uint32_t not_modified;
+  uint32_t compressed;                // number of compressed responses
+} ResponseCacheStatistics;
+
 class HTTPD {
 public:
   SensorsData* sensorsData;
   Config* cfg;
   int port;
   struct MHD_Daemon* daemon;
+  StaticFiles* staticFiles;
+  EventStream* eventStream;
   bool no_home_page = false;
+  time_t started;
+
+private:
+  pthread_rwlock_t cache_lock;
+  CachedResponse cache[RESPONSE_CACHE_SIZE];
+  std::atomic<uint32_t> cache_clock;
+  std::atomic<uint32_t> cache_hits;
+  std::atomic<uint32_t> cache_misses;
+  std::atomic<uint32_t> cache_not_modified;
+  std::atomic<uint32_t> compressed_responses;
+
+  MetricsCollector metrics_collector;
+  void* metrics_collector_context;
+
+  // Readings of sensors in the response /metrics. The text contains the age of the last reading
+  // so it is valid for one generation of sensors data during one second.
+  pthread_mutex_t sensor_metrics_lock;
+  void* sensor_metrics;
+  size_t sensor_metrics_size;
+  uint32_t sensor_metrics_generation;
+  time_t sensor_metrics_time;
+
+public:
+  std::atomic<uint32_t> requests;
+  MetricsHistogram request_duration;
 
   HTTPD(SensorsData* sensorsData, Config* cfg);
   ~HTTPD();
@@ -28,6 +90,29 @@ public:
   void start();
   void stop();
 
+  void makeETag(char* etag, uint32_t generation, time_t time, bool gzip);
+  int respondFromCache(struct MHD_Connection* connection, const char* key, bool gzip, bool time_dependent, uint32_t& generation, time_t& time);
+  int queueResponse(struct MHD_Connection* connection, const char* key, bool gzip, uint32_t generation, time_t time, struct MHD_Response* response);
+  void* compress(const void* data, size_t size, size_t& compressed_size);
+  void clearCache();
+  void getCacheStatistics(ResponseCacheStatistics& stats);
+
+  // Replaces configuration after reloading. Settings that are used when the server is started must not be changed.
+  void setConfig(Config* cfg) {
+    __atomic_store_n(&this->cfg, cfg, __ATOMIC_RELEASE);
+    clearCache();
+  }
+
+  // The collector adds metrics of other components to the response /metrics.
+  void setMetricsCollector(MetricsCollector collector, void* context) {
+    metrics_collector_context = context;
+    metrics_collector = collector;
+  }
+  void collectMetrics(MetricsWriter& writer) {
+    if (metrics_collector != NULL) metrics_collector(metrics_collector_context, writer);
+  }
+  void writeSensorMetrics(MetricsWriter& writer);
+
   static HTTPD* start(SensorsData* sensorsData, Config* cfg);
   static void destroy(HTTPD*& httpd);
 };
@@ -0,0 +1,204 @@
+/*
+ * HashIndex.hpp
+ *
+ *  Created on: October 18, 2026
+ *      Author: Alex Konshin
+ */
+
+#ifndef UTILS_HASHINDEX_HPP_
+#define UTILS_HASHINDEX_HPP_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+
+//-------------------------------------------------------------
+// Open addressing hash table (linear probing) that maps 64-bit keys to pointers.
+//
+// There must be only one writer at a time (callers serialize put/remove with their own mutex).
+// Readers do not take any lock. A slot is published by storing the value before the key,
+// removed slots become tombstones. Tombstones are never reused, so a slot whose key was seen by a reader
+// holds either the value of that key or NULL. They are dropped when the table is rehashed, the new table
+// is sized by the number of live entries, so churn of put/remove does not grow the table.
+// The replaced table is freed by the writer as soon as no reader is inside find() (like SensorsList).
+
+#define HASH_INDEX_MIN_CAPACITY 16
+#define HASH_INDEX_EMPTY        0ULL
+#define HASH_INDEX_TOMBSTONE    (~0ULL)
+
+template<typename T> class HashIndex {
+private:
+  typedef struct Slot {
+    std::atomic<uint64_t> key; // the stored key + 1, 0 is empty slot
+    std::atomic<T*> value;
+  } Slot;
+
+  typedef struct Table {
+    Table* retired;
+    size_t mask;
+    size_t used;   // live entries and tombstones
+    size_t live;
+    Slot slots[1];
+  } Table;
+
+  std::atomic<Table*> table;
+  std::atomic<int> readers; // threads inside find() or size()
+
+  static Table* allocTable(size_t capacity) {
+    Table* t = (Table*)calloc(1, sizeof(Table)+(capacity-1)*sizeof(Slot));
+    if (t != NULL) t->mask = capacity-1;
+    return t;
+  }
+
+  // Insert or replace the value. The table must have a free slot.
+  static void insert(Table* t, uint64_t stored_key, T* value) {
+    size_t index = hash(stored_key) & t->mask;
+    for (size_t n = 0; n <= t->mask; n++, index = (index+1) & t->mask) {
+      Slot& slot = t->slots[index];
+      uint64_t k = slot.key.load(std::memory_order_relaxed);
+      if (k == stored_key) {
+        slot.value.store(value, std::memory_order_release);
+        return;
+      }
+      if (k == HASH_INDEX_EMPTY) {
+        slot.value.store(value, std::memory_order_release);
+        slot.key.store(stored_key, std::memory_order_release);
+        t->used++;
+        t->live++;
+        return;
+      }
+    }
+    // impossible because of the load factor
+  }
+
+  // Frees replaced tables if no reader can see them. Writer only.
+  void freeRetired() {
+    Table* t = table.load();
+    if (t == NULL || t->retired == NULL) return;
+    // Readers that come after this point see the current table only.
+    if (readers.load() != 0) return;
+    Table* retired = t->retired;
+    t->retired = NULL;
+    while (retired != NULL) {
+      Table* next = retired->retired;
+      free(retired);
+      retired = next;
+    }
+  }
+
+public:
+  HashIndex() {
+    table.store(NULL, std::memory_order_relaxed);
+    readers.store(0, std::memory_order_relaxed);
+  }
+
+  ~HashIndex() {
+    Table* t = table.exchange(NULL);
+    while (t != NULL) {
+      Table* retired = t->retired;
+      free(t);
+      t = retired;
+    }
+  }
+
+  static inline uint64_t hash(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+  }
+
+  // FNV-1a
+  static inline uint64_t hash(const char* str, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+      h ^= (uint8_t)str[i];
+      h *= 0x100000001b3ULL;
+    }
+    return h;
+  }
+
+  T* find(uint64_t key) {
+    uint64_t stored_key = key+1;
+    if (stored_key == HASH_INDEX_TOMBSTONE) return NULL;
+    readers++;
+    T* result = NULL;
+    Table* t = table.load();
+    if (t != NULL) {
+      size_t index = hash(stored_key) & t->mask;
+      for (size_t n = 0; n <= t->mask; n++, index = (index+1) & t->mask) {
+        Slot& slot = t->slots[index];
+        uint64_t k = slot.key.load(std::memory_order_acquire);
+        if (k == HASH_INDEX_EMPTY) break;
+        if (k == stored_key) {
+          result = slot.value.load(std::memory_order_acquire);
+          if (result != NULL) break;
+        }
+      }
+    }
+    readers--;
+    return result;
+  }
+
+  // Writer only. Returns false if out of memory.
+  bool put(uint64_t key, T* value) {
+    uint64_t stored_key = key+1;
+    if (stored_key == HASH_INDEX_TOMBSTONE || value == NULL) return false;
+    freeRetired(); // tables that were busy at the last rehash
+    Table* t = table.load(std::memory_order_relaxed);
+    if (t == NULL || (t->used+1)*4 > (t->mask+1)*3) {
+      size_t capacity = HASH_INDEX_MIN_CAPACITY;
+      size_t live = t == NULL ? 0 : t->live;
+      while (capacity < (live+1)*2) capacity <<= 1;
+      Table* new_table = allocTable(capacity);
+      if (new_table == NULL) return false;
+      if (t != NULL) {
+        for (size_t index = 0; index <= t->mask; index++) {
+          Slot& slot = t->slots[index];
+          uint64_t k = slot.key.load(std::memory_order_relaxed);
+          T* v = slot.value.load(std::memory_order_relaxed);
+          if (k != HASH_INDEX_EMPTY && k != HASH_INDEX_TOMBSTONE && v != NULL) insert(new_table, k, v);
+        }
+      }
+      new_table->retired = t;
+      table.store(new_table);
+      t = new_table;
+      freeRetired();
+    }
+    insert(t, stored_key, value);
+    return true;
+  }
+
+  // Writer only.
+  void remove(uint64_t key) {
+    Table* t = table.load(std::memory_order_relaxed);
+    if (t == NULL) return;
+    uint64_t stored_key = key+1;
+    size_t index = hash(stored_key) & t->mask;
+    for (size_t n = 0; n <= t->mask; n++, index = (index+1) & t->mask) {
+      Slot& slot = t->slots[index];
+      uint64_t k = slot.key.load(std::memory_order_relaxed);
+      if (k == HASH_INDEX_EMPTY) return;
+      if (k == stored_key) {
+        slot.key.store(HASH_INDEX_TOMBSTONE, std::memory_order_release);
+        slot.value.store(NULL, std::memory_order_release);
+        t->live--;
+        return;
+      }
+    }
+  }
+
+  size_t size() {
+    readers++;
+    Table* t = table.load();
+    size_t result = t == NULL ? 0 : t->live;
+    readers--;
+    return result;
+  }
+
+};
+
+#endif /* UTILS_HASHINDEX_HPP_ */
@@ -5,7 +5,258 @@
  *  Created on: Apr 18, 2017
  *      Author: Alex Konshin
  */
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+
 #include "Logger.hpp"
 
 
 Logger* Logger::defaultLogger = new Logger();
+
+static const char* level_prefixes[] = { NULL, "WARNING: ", "ERROR: " };
+
+void Logger::init(FILE* logFile) {
+  this->logFile = logFile;
+  ring = NULL;
+  write_position.store(0);
+  writer_started.store(false);
+  stop_writer.store(false);
+  memset(&stats, 0, sizeof(stats));
+  read_position = 0;
+  reported_dropped = 0;
+  prefix_time = 0;
+  time_prefix[0] = '\0';
+  last_length = 0;
+  last_level = 0;
+  last_destinations = 0;
+  last_time = 0;
+  repeated = 0;
+}
+
+//-------------------------------------------------------------
+void Logger::write(uint8_t level, uint8_t destinations, const char* fmt, va_list vargs) {
+  if ((flags&LOGGER_FLAG_STDERR) == 0) destinations &= ~LOG_TO_STDERR;
+  if (logFile == NULL) destinations &= ~LOG_TO_FILE;
+  if (destinations == 0) return;
+
+  char buffer[BUFFER_SIZE];
+  if (writer_started.load(std::memory_order_acquire)) {
+    int length = fmt == NULL ? 0 : vsnprintf(buffer, BUFFER_SIZE, fmt, vargs);
+    if (length < 0) length = 0; else if (length >= BUFFER_SIZE) length = BUFFER_SIZE-1;
+    enqueue(level, destinations, buffer, length);
+    return;
+  }
+
+  format_message(buffer, level_prefixes[level], fmt, vargs);
+  if ((destinations&LOG_TO_STDERR) != 0) output(buffer, stderr);
+  if ((destinations&LOG_TO_FILE) != 0) {
+    output(buffer, logFile);
+    fflush(logFile);
+  }
+}
+
+// Called by any thread. A record occupies consecutive slots that are reserved at once. The writer frees slots
+// in order so if the last slot of the range is free then all others are free too.
+bool Logger::enqueue(uint8_t level, uint8_t destinations, const char* text, size_t length) {
+  uint32_t slots = length == 0 ? 1 : (length+LOGGER_SLOT_SIZE-1)/LOGGER_SLOT_SIZE;
+  if (slots > LOGGER_MAX_RECORD_SLOTS) {
+    slots = LOGGER_MAX_RECORD_SLOTS;
+    length = LOGGER_MAX_RECORD_SLOTS*LOGGER_SLOT_SIZE;
+  }
+
+  uint32_t position = write_position.load(std::memory_order_relaxed);
+  while (true) {
+    uint32_t last = position+slots-1;
+    uint32_t sequence = ring[last&(LOGGER_RING_SIZE-1)].sequence.load(std::memory_order_acquire);
+    int32_t diff = (int32_t)(sequence-last);
+    if (diff == 0) {
+      if (write_position.compare_exchange_weak(position, position+slots, std::memory_order_relaxed)) break;
+    } else if (diff < 0) { // the ring is full
+      __atomic_fetch_add(&stats.dropped, 1, __ATOMIC_RELAXED);
+      sem_post(&wakeup);
+      return false;
+    } else {
+      position = write_position.load(std::memory_order_relaxed);
+    }
+  }
+
+  time_t now = time(NULL);
+  for (uint32_t index = 0; index < slots; index++) {
+    LoggerSlot* slot = &ring[(position+index)&(LOGGER_RING_SIZE-1)];
+    size_t slot_length = length > LOGGER_SLOT_SIZE ? LOGGER_SLOT_SIZE : length;
+    memcpy(slot->text, text, slot_length);
+    slot->length = (uint16_t)slot_length;
+    slot->time = now;
+    slot->level = level;
+    slot->destinations = destinations;
+    slot->slots = index == 0 ? (uint8_t)slots : 0;
+    text += slot_length;
+    length -= slot_length;
+  }
+  // The first slot is published last so the writer sees the whole record.
+  for (uint32_t index = slots; index-- > 0; ) {
+    ring[(position+index)&(LOGGER_RING_SIZE-1)].sequence.store(position+index+1, std::memory_order_release);
+  }
+
+  if (level != LOG_LEVEL_INFO || position-__atomic_load_n(&read_position, __ATOMIC_RELAXED) >= LOGGER_RING_SIZE/2) sem_post(&wakeup);
+  return true;
+}
+
+//-------------------------------------------------------------
+bool Logger::startWriter() {
+  if (writer_started.load()) return true;
+  // The ring and the semaphore are kept after stopWriter() because other threads may still use them.
+  if (ring == NULL) {
+    ring = (LoggerSlot*)calloc(LOGGER_RING_SIZE, sizeof(LoggerSlot));
+    if (ring == NULL) {
+      error("Out of memory");
+      return false;
+    }
+    for (uint32_t index = 0; index < LOGGER_RING_SIZE; index++) ring[index].sequence.store(index, std::memory_order_relaxed);
+    sem_init(&wakeup, 0, 0);
+    if (this == defaultLogger) atexit(stopDefaultWriter);
+  }
+  stop_writer.store(false);
+
+  int rc = pthread_create(&writer_thread, NULL, writerThreadFunction, (void*)this);
+  if (rc != 0) {
+    error("Failed to start log writer thread: %s", strerror(rc));
+    return false;
+  }
+  writer_started.store(true, std::memory_order_release);
+  return true;
+}
+
+void Logger::stopWriter() {
+  if (!writer_started.load()) return;
+  stop_writer.store(true);
+  sem_post(&wakeup);
+  pthread_join(writer_thread, NULL);
+  writer_started.store(false, std::memory_order_release);
+  drain(); // messages that were queued while the thread was finishing
+}
+
+void Logger::stopDefaultWriter() {
+  if (defaultLogger != NULL) defaultLogger->stopWriter();
+}
+
+void* Logger::writerThreadFunction(void* context) {
+  sigset_t signals;
+  sigfillset(&signals);
+  pthread_sigmask(SIG_BLOCK, &signals, NULL);
+  ((Logger*)context)->writer();
+  return NULL;
+}
+
+void Logger::writer() {
+  while (true) {
+    bool stop = stop_writer.load();
+    drain();
+    if (stop) break;
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += (LOGGER_FLUSH_INTERVAL_MS%1000)*1000000L;
+    deadline.tv_sec += LOGGER_FLUSH_INTERVAL_MS/1000+deadline.tv_nsec/1000000000L;
+    deadline.tv_nsec %= 1000000000L;
+    while (sem_timedwait(&wakeup, &deadline) != 0 && errno == EINTR);
+  }
+}
+
+// Writes all published records and flushes the output.
+void Logger::drain() {
+  char record[LOGGER_MAX_RECORD_SLOTS*LOGGER_SLOT_SIZE];
+  bool written = false;
+  while (true) {
+    LoggerSlot* first = &ring[read_position&(LOGGER_RING_SIZE-1)];
+    if (first->sequence.load(std::memory_order_acquire) != read_position+1) break;
+    uint32_t slots = first->slots;
+    size_t length = 0;
+    for (uint32_t index = 0; index < slots; index++) {
+      LoggerSlot* slot = &ring[(read_position+index)&(LOGGER_RING_SIZE-1)];
+      memcpy(record+length, slot->text, slot->length);
+      length += slot->length;
+    }
+    writeRecord(first->level, first->destinations, first->time, record, length);
+    for (uint32_t index = 0; index < slots; index++) {
+      ring[(read_position+index)&(LOGGER_RING_SIZE-1)].sequence.store(read_position+index+LOGGER_RING_SIZE, std::memory_order_release);
+    }
+    __atomic_store_n(&read_position, read_position+slots, __ATOMIC_RELAXED);
+    written = true;
+  }
+
+  time_t now = time(NULL);
+  if (repeated != 0 && now-last_time >= LOGGER_REPEAT_WINDOW) {
+    writeRepeated();
+    written = true;
+  }
+
+  uint32_t dropped = __atomic_load_n(&stats.dropped, __ATOMIC_RELAXED);
+  if (dropped != reported_dropped) {
+    char text[64];
+    int length = snprintf(text, sizeof(text), "%u log messages were dropped because the queue was full.", dropped-reported_dropped);
+    reported_dropped = dropped;
+    writeLine(LOG_TO_STDERR|LOG_TO_FILE, now, level_prefixes[LOG_LEVEL_WARNING], text, length);
+    written = true;
+  }
+
+  if (written) {
+    if (logFile != NULL) fflush(logFile);
+    if ((flags&LOGGER_FLAG_STDERR) != 0) fflush(stderr);
+  }
+}
+
+void Logger::writeRecord(uint8_t level, uint8_t destinations, time_t time, const char* text, size_t length) {
+  if (length == last_length && level == last_level && destinations == last_destinations &&
+      time-last_time < LOGGER_REPEAT_WINDOW && memcmp(text, last_text, length) == 0) {
+    repeated++;
+    __atomic_fetch_add(&stats.suppressed, 1, __ATOMIC_RELAXED);
+    return;
+  }
+  if (repeated != 0) writeRepeated();
+  writeLine(destinations, time, level_prefixes[level], text, length);
+  __atomic_fetch_add(&stats.written, 1, __ATOMIC_RELAXED);
+
+  memcpy(last_text, text, length);
+  last_length = length;
+  last_level = level;
+  last_destinations = destinations;
+  last_time = time;
+}
+
+void Logger::writeRepeated() {
+  char text[64];
+  int length = snprintf(text, sizeof(text), "The last message was repeated %u times.", repeated);
+  repeated = 0;
+  writeLine(last_destinations, time(NULL), NULL, text, length);
+  last_length = 0;
+  last_time = 0;
+}
+
+void Logger::writeLine(uint8_t destinations, time_t time, const char* prefix, const char* text, size_t length) {
+  if ((flags&LOGGER_FLAG_TIME) != 0 && time != prefix_time) {
+    time_prefix[0] = '\0';
+    add_time(time_prefix, sizeof(time_prefix), time);
+    prefix_time = time;
+  }
+  bool new_line = length == 0 || text[length-1] != '\n';
+  for (int destination = LOG_TO_STDERR; destination <= LOG_TO_FILE; destination <<= 1) {
+    if ((destinations&destination) == 0) continue;
+    FILE* file;
+    if (destination == LOG_TO_STDERR) {
+      if ((flags&LOGGER_FLAG_STDERR) == 0) continue;
+      file = stderr;
+    } else {
+      file = logFile;
+      if (file == NULL) continue;
+    }
+    // Other writers of the log file (ReceivedMessage::print()) hold the lock of the stream for their lines.
+    flockfile(file);
+    if ((flags&LOGGER_FLAG_TIME) != 0) fputs(time_prefix, file);
+    if (prefix != NULL) fputs(prefix, file);
+    fwrite(text, 1, length, file);
+    if (new_line) fputc('\n', file);
+    funlockfile(file);
+  }
+}
@@ -9,9 +9,13 @@
 #define LOGGER_HPP_
 
 #include <stdio.h>
+#include <stdint.h>
 #include <stdarg.h>
 #include <string.h>
 #include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <atomic>
 
 #define BUFFER_SIZE 4096
 
@@ -71,22 +75,21 @@ public:
   }
 
 protected:
-  void add_time(char* buffer) {
-    time_t data_time = time(NULL);
+  void add_time(char* buffer, size_t size, time_t data_time) {
     struct tm tm;
     if ((flags&LOGGER_FLAG_TIME_UTC) != 0) { // UTC time zone
       struct tm* ptm = gmtime_r(&data_time, &tm);
-      if (ptm != NULL) strftime(buffer, BUFFER_SIZE, "%FT%TZ ", ptm); // ISO format
+      if (ptm != NULL) strftime(buffer, size, "%FT%TZ ", ptm); // ISO format
     } else { // local time zone
       struct tm* ptm = localtime_r(&data_time, &tm);
-      if (ptm != NULL) strftime(buffer, BUFFER_SIZE, "%Y-%m-%d %H:%M:%S%z ", ptm);
+      if (ptm != NULL) strftime(buffer, size, "%Y-%m-%d %H:%M:%S%z ", ptm);
     }
   }
 
   void format_message(char* buffer, const char* prefix, const char* fmt, va_list vargs) {
     buffer[0] = '\0';
     if (fmt != NULL) {
-      if ((flags&LOGGER_FLAG_TIME) != 0) add_time(buffer);
+      if ((flags&LOGGER_FLAG_TIME) != 0) add_time(buffer, BUFFER_SIZE, time(NULL));
 
       if (prefix != NULL) strcat(buffer, prefix);
       int len = strlen(buffer);
@@ -108,47 +111,126 @@ protected:
 };
 
 
+//-------------------------------------------------------------
+// Asynchronous writing of the log.
+//
+// After startWriter() messages are only formatted by the calling threads and put into a lock-free ring
+// (multiple producers, one consumer). The writer thread adds timestamps, writes batches of records and flushes
+// them every LOGGER_FLUSH_INTERVAL_MS or immediately after warnings and errors. Identical messages repeated
+// within LOGGER_REPEAT_WINDOW seconds are written once with the number of repetitions. If the ring is full
+// then the message is dropped and the number of dropped messages is written later.
+
+#define LOGGER_RING_SIZE         512  // number of slots, power of 2
+#define LOGGER_SLOT_SIZE         256  // a longer message occupies several consecutive slots
+#define LOGGER_MAX_RECORD_SLOTS  (BUFFER_SIZE/LOGGER_SLOT_SIZE)
+#define LOGGER_FLUSH_INTERVAL_MS 500
+#define LOGGER_REPEAT_WINDOW     10   // seconds
+
+#define LOG_LEVEL_INFO    0
+#define LOG_LEVEL_WARNING 1
+#define LOG_LEVEL_ERROR   2
+
+#define LOG_TO_STDERR 1
+#define LOG_TO_FILE   2
+
+typedef struct LoggerSlot {
+  std::atomic<uint32_t> sequence; // position+1 when the slot is filled, position+LOGGER_RING_SIZE when it is free
+  time_t time;
+  uint16_t length;                // length of the text in this slot
+  uint8_t level;
+  uint8_t destinations;
+  uint8_t slots;                  // number of slots of the record, it is set in the first slot only
+  char text[LOGGER_SLOT_SIZE];
+} LoggerSlot;
+
+typedef struct LoggerStatistics {
+  uint32_t written;    // records written by the writer thread
+  uint32_t dropped;    // records dropped because the ring was full
+  uint32_t suppressed; // repeated records that were not written
+} LoggerStatistics;
+
 class Logger : public ErrorLogger {
 private:
 
   FILE* logFile;
 
+  LoggerSlot* ring;
+  std::atomic<uint32_t> write_position;
+  std::atomic<bool> writer_started;
+  std::atomic<bool> stop_writer;
+  pthread_t writer_thread;
+  sem_t wakeup;
+  LoggerStatistics stats;
+
+  // used by the writer thread only
+  uint32_t read_position;
+  uint32_t reported_dropped;
+  time_t prefix_time;
+  char time_prefix[64];
+  char last_text[BUFFER_SIZE];
+  size_t last_length;
+  uint8_t last_level;
+  uint8_t last_destinations;
+  time_t last_time;
+  uint32_t repeated;
+
+  void write(uint8_t level, uint8_t destinations, const char* fmt, va_list vargs);
+  bool enqueue(uint8_t level, uint8_t destinations, const char* text, size_t length);
+  static void* writerThreadFunction(void* context);
+  static void stopDefaultWriter();
+  void writer();
+  void drain();
+  void writeRecord(uint8_t level, uint8_t destinations, time_t time, const char* text, size_t length);
+  void writeLine(uint8_t destinations, time_t time, const char* prefix, const char* text, size_t length);
+  void writeRepeated();
+
 public:
   static Logger* defaultLogger;
 
   Logger() : ErrorLogger(LOGGER_FLAG_STDERR | LOGGER_FLAG_TIME) {
-    logFile = NULL;
+    init(NULL);
   }
 
   Logger(FILE* logFile) : ErrorLogger(LOGGER_FLAG_TIME) {
     flags = LOGGER_FLAG_TIME;
-    this->logFile = logFile;
+    init(logFile);
   }
 
   virtual ~Logger() {
+    stopWriter();
     if (logFile != NULL) fclose(logFile);
     if ((flags&LOGGER_FLAG_STDERR) != 0) fflush(stderr);
   }
 
+  void init(FILE* logFile);
+
   void flush() {
+    if (writer_started.load(std::memory_order_acquire)) {
+      sem_post(&wakeup);
+      return;
+    }
     if (logFile != NULL) fflush(logFile);
     if ((flags&LOGGER_FLAG_STDERR) != 0) fflush(stderr);
   }
 
+  // The log file must not be changed while the writer thread is running.
   void setLogFile(FILE* logFile) {
     this->logFile = logFile;
   }
 
+  // Starts the writer thread. Messages are written synchronously until it is called and after stopWriter().
+  bool startWriter();
+  // Writes all queued messages and stops the writer thread. It must be called before the log file is closed.
+  void stopWriter();
+
+  void getStatistics(LoggerStatistics& result) {
+    result.written = __atomic_load_n(&stats.written, __ATOMIC_RELAXED);
+    result.dropped = __atomic_load_n(&stats.dropped, __ATOMIC_RELAXED);
+    result.suppressed = __atomic_load_n(&stats.suppressed, __ATOMIC_RELAXED);
+  }
+
   void info_vargs(const char* fmt, va_list vargs) {
-    if ((flags&LOGGER_FLAG_STDERR) != 0 || logFile != NULL) {
-      char buffer[BUFFER_SIZE];
-      format_message(buffer, NULL, fmt, vargs);
-      if ((flags&LOGGER_FLAG_STDERR) != 0) output(buffer, stderr);
-      if (logFile != NULL) {
-        output(buffer, logFile);
-        fflush(logFile);
-      }
-    }
+    write(LOG_LEVEL_INFO, LOG_TO_STDERR|LOG_TO_FILE, fmt, vargs);
   }
 
   void info(const char* fmt, ...) {
@@ -161,14 +243,7 @@ public:
   }
 
   void log_vargs(const char* fmt, va_list vargs) {
-    if (logFile != NULL) {
-      char buffer[BUFFER_SIZE];
-      format_message(buffer, NULL, fmt, vargs);
-      if (logFile != NULL) {
-        output(buffer, logFile);
-        fflush(logFile);
-      }
-    }
+    write(LOG_LEVEL_INFO, LOG_TO_FILE, fmt, vargs);
   }
 
   void log(const char* fmt, ...) {
@@ -181,15 +256,7 @@ public:
   }
 
   void warning_vargs(const char* fmt, va_list vargs) {
-    if ((flags&LOGGER_FLAG_STDERR) != 0 || logFile != NULL) {
-      char buffer[BUFFER_SIZE];
-      format_message(buffer, "WARNING: ", fmt, vargs);
-      if ((flags&LOGGER_FLAG_STDERR) != 0) output(buffer, stderr);
-      if (logFile != NULL) {
-        output(buffer, logFile);
-        fflush(logFile);
-      }
-    }
+    write(LOG_LEVEL_WARNING, LOG_TO_STDERR|LOG_TO_FILE, fmt, vargs);
   }
 
   void warning(const char* fmt, ...) {
@@ -202,15 +269,7 @@ public:
   }
 
   void error_vargs(const char* fmt, va_list vargs) {
-    if ((flags&LOGGER_FLAG_STDERR) != 0 || logFile != NULL) {
-      char buffer[BUFFER_SIZE];
-      format_message(buffer, "ERROR: ", fmt, vargs);
-      if ((flags&LOGGER_FLAG_STDERR) != 0) output(buffer, stderr);
-      if (logFile != NULL) {
-        output(buffer, logFile);
-        fflush(logFile);
-      }
-    }
+    write(LOG_LEVEL_ERROR, LOG_TO_STDERR|LOG_TO_FILE, fmt, vargs);
   }
 
   void error(const char* fmt, ...) {
@@ -33,6 +33,11 @@ void MqttRule::execute(const char* message, class Config& cfg) {
     if (debug) Log->info("%s \"%s\" => topic=\"%s\" message=\"%s\".", getTypeName(), id, mqttTopic, message);
     bool info = (cfg.options&VERBOSITY_INFO) != 0;
     if (info) Log->info("MQTT publishing: %s \"%s\"", mqttTopic, message);
-    publisher->publish_message(mqttTopic, message);
+    if (publisher->publish_message(mqttTopic, message))
+      statistics->mqtt_published++;
+    else
+      statistics->mqtt_errors++;
+  } else {
+    statistics->mqtt_errors++;
   }
 }
@@ -11,12 +11,22 @@
 #include <string.h>
 #include <mosquittopp.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include "Logger.hpp"
 #include "../common/Config.hpp"
 
 class Config;
 
+// Messages published with QoS 1 whose PUBACK is awaited for latency statistics, see on_publish().
+#define MQTT_TRACE_SLOTS 64 // power of 2
+
+typedef struct MqttTrace {
+  int mid;             // 0 if the slot is free
+  uint64_t origin;     // TRACE_SEQUENCE_CLOSED of the message, 0 if it is not known
+  uint64_t published;
+} MqttTrace;
+
 class MqttPublisher: public mosqpp::mosquittopp {
 
 private:
@@ -29,6 +39,10 @@ private:
   //PH added
   const char *username;
   const char *password;
+  // PUBACK is handled by the thread of mosquitto
+  pthread_mutex_t traces_lock;
+  MqttTrace traces[MQTT_TRACE_SLOTS];
+  uint64_t trace_origin = 0;
 
 public:
   MqttPublisher(const char* id, const char* host, int port, const char* username, const char* password, int options = 0, int keepalive = 60) : mosquittopp(id) {
@@ -45,12 +59,15 @@ public:
       this->username = username;
       this->password = password;
     }
+    pthread_mutex_init(&traces_lock, NULL);
+    memset(traces, 0, sizeof(traces));
     instance = this;
   }
 
   ~MqttPublisher() {
     if (connected) stop(true);
     mosqpp::lib_cleanup();   // Mosquitto library cleanup
+    pthread_mutex_destroy(&traces_lock);
   }
 
   static MqttPublisher* instance;
@@ -109,10 +126,17 @@ public:
     return connected;
   }
 
+  // Sets the origin of the trace of messages that are published next (TRACE_SEQUENCE_CLOSED of the received message).
+  void setTraceOrigin(uint64_t origin) {
+    trace_origin = origin;
+  }
+
   bool publish_message(const char* topic, const char* message) {
+    int mid = 0;
+    uint64_t published = metrics_clock();
     int error_code =
       publish(            // Publish the message.
-        NULL,             // (output) Message Id (int *) this allow to latter get status of each message
+        &mid,             // (output) Message Id (int *) this allow to latter get status of each message
         topic,            // topic of the message
         strlen(message),  // length of the payload (message)
         message,          // payload (the message)
@@ -131,7 +155,18 @@ public:
                           //   MOSQ_ERR_MALFORMED_UTF8 if the topic is not valid UTF-8
                           //   MOSQ_ERR_QOS_NOT_SUPPORTED  if the QoS is greater than that supported by the broker.
                           //   MOSQ_ERR_OVERSIZE_PACKET  if the resulting packet would be larger than supported by the broker.
-    if (error_code == MOSQ_ERR_SUCCESS) return true;
+    if (error_code == MOSQ_ERR_SUCCESS) {
+      // If PUBACK has been already handled then the slot is never matched and the latency is not counted.
+      if (mid != 0) {
+        pthread_mutex_lock(&traces_lock);
+        MqttTrace* trace = &traces[mid&(MQTT_TRACE_SLOTS-1)];
+        trace->mid = mid;
+        trace->origin = trace_origin;
+        trace->published = published;
+        pthread_mutex_unlock(&traces_lock);
+      }
+      return true;
+    }
     Log->error("ERROR %d on publishing MQTT message: %s", error_code, mosqpp::strerror(error_code));
     return false;
   }
@@ -156,8 +191,24 @@ private:
   }
 
   void on_publish(int mid) {
+    uint64_t acked = metrics_clock();
+    MqttTrace trace;
+    pthread_mutex_lock(&traces_lock);
+    MqttTrace* slot = &traces[mid&(MQTT_TRACE_SLOTS-1)];
+    trace = *slot;
+    if (slot->mid == mid) slot->mid = 0;
+    pthread_mutex_unlock(&traces_lock);
+
+    if (mid != 0 && trace.mid == mid) {
+      statistics->latency[LATENCY_MQTT_ACK].observeInterval(trace.published, acked);
+      if (trace.origin != 0) statistics->latency[LATENCY_MQTT_END_TO_END].observeInterval(trace.origin, acked);
+    }
     if ( (options&VERBOSITY_DEBUG)!=0 ) {
-      Log->error("Message has been sent to MQTT broker %s:%d.", host, port);
+      if (mid != 0 && trace.mid == mid)
+        Log->error("Message has been sent to MQTT broker %s:%d. Latency: mqtt_ack=%lluus mqtt_end_to_end=%lluus", host, port,
+            (unsigned long long)((acked-trace.published)/1000), trace.origin == 0 ? 0ULL : (unsigned long long)((acked-trace.origin)/1000));
+      else
+        Log->error("Message has been sent to MQTT broker %s:%d.", host, port);
     }
   }
 
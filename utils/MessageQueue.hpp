@@ -0,0 +1,120 @@
+/*
+ * MessageQueue.hpp
+ *
+ *  Created on: October 18, 2026
+ *      Author: Alex Konshin
+ */
+
+#ifndef UTILS_MESSAGEQUEUE_HPP_
+#define UTILS_MESSAGEQUEUE_HPP_
+
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+//-------------------------------------------------------------
+// Intrusive lock-free queue with many producers and one consumer (D. Vyukov's algorithm).
+//
+// Items are linked through their own field "next" so pushing does not allocate. A producer swaps the tail
+// and then links the previous tail to the new item, so push is wait-free and producers never block each other.
+// Between these two steps the consumer cannot see the new item and the following ones; it just waits for
+// the next notification that the producer sends after linking.
+//
+// The consumer parks on a futex. A producer makes the system call only if the consumer is actually waiting,
+// so a busy queue costs one atomic exchange and one atomic increment per push.
+// Protocol of waiting: prepareWait(), check the queue and other conditions, then wait() or cancelWait().
+
+template<typename T> class MessageQueue {
+private:
+  T* tail;                 // the last pushed item, changed by producers
+  T* head;                 // the next item to pop, used only by the consumer
+  T stub;                  // keeps the list not empty
+  uint32_t notifications;  // futex word, incremented after each push and on events
+  uint32_t waiting;        // 1 while the consumer is going to sleep
+
+  static long futex(uint32_t* address, int operation, uint32_t value) {
+    return syscall(SYS_futex, address, operation, value, NULL, NULL, 0);
+  }
+
+  void link(T* first, T* last) {
+    __atomic_store_n(&last->next, (T*)NULL, __ATOMIC_RELAXED);
+    T* previous = __atomic_exchange_n(&tail, last, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&previous->next, first, __ATOMIC_RELEASE);
+  }
+
+public:
+  MessageQueue() {
+    stub.next = NULL;
+    tail = &stub;
+    head = &stub;
+    notifications = 0;
+    waiting = 0;
+  }
+
+  // Called by producers. Items first..last must be already linked through field "next".
+  void push(T* first, T* last) {
+    link(first, last);
+    notify();
+  }
+  void push(T* item) {
+    push(item, item);
+  }
+
+  // Wakes up the consumer. Also called when some other condition the consumer waits for is changed.
+  void notify() {
+    __atomic_fetch_add(&notifications, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&waiting, __ATOMIC_SEQ_CST) != 0) futex(&notifications, FUTEX_WAKE_PRIVATE, 1);
+  }
+
+  // Called by the consumer. Returns NULL if the queue is empty or if the next item is not linked yet.
+  T* pop() {
+    T* item = head;
+    T* next = __atomic_load_n(&item->next, __ATOMIC_ACQUIRE);
+    if (item == &stub) {
+      if (next == NULL) return NULL;
+      head = next;
+      item = next;
+      next = __atomic_load_n(&item->next, __ATOMIC_ACQUIRE);
+    }
+    if (next != NULL) {
+      head = next;
+      item->next = NULL;
+      return item;
+    }
+    if (item != __atomic_load_n(&tail, __ATOMIC_ACQUIRE)) return NULL; // a producer has not linked it yet
+    // item is the last one; put the stub behind it so it can be taken
+    link(&stub, &stub);
+    next = __atomic_load_n(&item->next, __ATOMIC_ACQUIRE);
+    if (next == NULL) return NULL;
+    head = next;
+    item->next = NULL;
+    return item;
+  }
+
+  // Called by the consumer. Returns the value that must be passed to wait().
+  uint32_t prepareWait() {
+    __atomic_store_n(&waiting, 1, __ATOMIC_SEQ_CST);
+    return __atomic_load_n(&notifications, __ATOMIC_SEQ_CST);
+  }
+
+  // Sleeps until notify() is called after prepareWait() returned the value.
+  void wait(uint32_t value) {
+    while (__atomic_load_n(&notifications, __ATOMIC_SEQ_CST) == value) {
+      if (futex(&notifications, FUTEX_WAIT_PRIVATE, value) != 0 && errno != EINTR) break; // EAGAIN: already notified
+    }
+    __atomic_store_n(&waiting, 0, __ATOMIC_RELAXED);
+  }
+
+  void cancelWait() {
+    __atomic_store_n(&waiting, 0, __ATOMIC_RELAXED);
+  }
+
+  // Called by the consumer.
+  bool isEmpty() {
+    return head == &stub && __atomic_load_n(&stub.next, __ATOMIC_ACQUIRE) == NULL;
+  }
+};
+
+#endif /* UTILS_MESSAGEQUEUE_HPP_ */
@@ -0,0 +1,154 @@
+/*
+ * Metrics.cpp
+ *
+ *  Created on: October 18, 2026
+ *      Author: Alex Konshin
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "Utils.hpp"
+#include "Metrics.hpp"
+
+#define METRICS_PREFIX "f007th_"
+#define METRICS_BUFFER_INCREMENT 4096
+
+//-------------------------------------------------------------
+MetricsWriter::MetricsWriter() {
+  buffer = NULL;
+  buffer_size = 0;
+  size = 0;
+  out_of_memory = false;
+}
+
+MetricsWriter::~MetricsWriter() {
+  if (buffer != NULL) free(buffer);
+}
+
+void* MetricsWriter::detach() {
+  void* result = buffer;
+  buffer = NULL;
+  buffer_size = 0;
+  size = 0;
+  return result;
+}
+
+void MetricsWriter::append(const char* format, ...) {
+  if (out_of_memory) return;
+  va_list args;
+  while (true) {
+    size_t available = buffer_size-size;
+    if (available > 0) {
+      va_start(args, format);
+      int len = vsnprintf((char*)buffer+size, available, format, args);
+      va_end(args);
+      if (len < 0) return;
+      if ((size_t)len < available) {
+        size += len;
+        return;
+      }
+    }
+    if (resize_buffer(buffer_size+METRICS_BUFFER_INCREMENT, buffer, buffer_size) == NULL) {
+      out_of_memory = true;
+      return;
+    }
+  }
+}
+
+void MetricsWriter::write(const void* data, size_t len) {
+  if (out_of_memory || len == 0) return;
+  if (resize_buffer(size+len+1, buffer, buffer_size) == NULL) {
+    out_of_memory = true;
+    return;
+  }
+  memcpy((char*)buffer+size, data, len);
+  size += len;
+  ((char*)buffer)[size] = '\0';
+}
+
+//-------------------------------------------------------------
+void MetricsWriter::header(const char* name, const char* type, const char* help) {
+  append("# HELP " METRICS_PREFIX "%s %s\n# TYPE " METRICS_PREFIX "%s %s\n", name, help, name, type);
+}
+
+void MetricsWriter::value(const char* name, const char* labels, uint64_t value) {
+  if (labels == NULL)
+    append(METRICS_PREFIX "%s %llu\n", name, (unsigned long long)value);
+  else
+    append(METRICS_PREFIX "%s{%s} %llu\n", name, labels, (unsigned long long)value);
+}
+
+void MetricsWriter::value(const char* name, const char* labels, const char* value) {
+  if (labels == NULL)
+    append(METRICS_PREFIX "%s %s\n", name, value);
+  else
+    append(METRICS_PREFIX "%s{%s} %s\n", name, labels, value);
+}
+
+void MetricsWriter::gauge(const char* name, const char* help, int64_t value) {
+  header(name, "gauge", help);
+  append(METRICS_PREFIX "%s %lld\n", name, (long long)value);
+}
+
+// Writes buckets, sum and count of the histogram. The header must be written before.
+void MetricsWriter::histogram(const char* name, const char* labels, const MetricsHistogram& histogram) {
+  const char* separator = labels == NULL ? "" : ",";
+  if (labels == NULL) labels = "";
+  uint64_t count = 0;
+  for (int index = 0; index <= METRICS_HISTOGRAM_BUCKETS; index++) {
+    count += metrics_load(histogram.buckets[index]);
+    if (index < METRICS_HISTOGRAM_BUCKETS)
+      append(METRICS_PREFIX "%s_bucket{%s%sle=\"%g\"} %llu\n", name, labels, separator, metrics_histogram_bounds[index]/1e6, (unsigned long long)count);
+    else
+      append(METRICS_PREFIX "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name, labels, separator, (unsigned long long)count);
+  }
+  histogramTotals(name, labels, metrics_load(histogram.sum), count);
+}
+
+void MetricsWriter::histogram(const char* name, const char* labels, const MetricsLatencyHistogram& histogram) {
+  const char* separator = labels == NULL ? "" : ",";
+  if (labels == NULL) labels = "";
+  uint64_t count = 0;
+  for (int index = 0; index <= METRICS_LATENCY_BUCKETS; index++) {
+    count += metrics_load(histogram.buckets[index]);
+    if (index < METRICS_LATENCY_BUCKETS)
+      append(METRICS_PREFIX "%s_bucket{%s%sle=\"%g\"} %llu\n", name, labels, separator, metrics_latency_bound(index)/1e6, (unsigned long long)count);
+    else
+      append(METRICS_PREFIX "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name, labels, separator, (unsigned long long)count);
+  }
+  histogramTotals(name, labels, metrics_load(histogram.sum), count);
+}
+
+void MetricsWriter::histogramTotals(const char* name, const char* labels, uint64_t sum, uint64_t count) {
+  if (*labels == '\0') {
+    append(METRICS_PREFIX "%s_sum %.6f\n", name, sum/1e6);
+    append(METRICS_PREFIX "%s_count %llu\n", name, (unsigned long long)count);
+  } else {
+    append(METRICS_PREFIX "%s_sum{%s} %.6f\n", name, labels, sum/1e6);
+    append(METRICS_PREFIX "%s_count{%s} %llu\n", name, labels, (unsigned long long)count);
+  }
+}
+
+//-------------------------------------------------------------
+bool escape_label_value(const char* value, char* buffer, size_t size) {
+  size_t len = 0;
+  char ch;
+  while ((ch = *value++) != '\0') {
+    if (len+3 > size) return false;
+    if (ch == '\\' || ch == '"') {
+      buffer[len++] = '\\';
+      buffer[len++] = ch;
+    } else if (ch == '\n') {
+      buffer[len++] = '\\';
+      buffer[len++] = 'n';
+    } else {
+      buffer[len++] = ch;
+    }
+  }
+  if (len >= size) return false;
+  buffer[len] = '\0';
+  return true;
+}
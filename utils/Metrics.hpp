@@ -0,0 +1,164 @@
+/*
+ * Metrics.hpp
+ *
+ *  Created on: October 18, 2026
+ *      Author: Alex Konshin
+ */
+
+#ifndef UTILS_METRICS_HPP_
+#define UTILS_METRICS_HPP_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+//-------------------------------------------------------------
+// Internal counters in Prometheus text format (request /metrics).
+//
+// Counters are updated by the threads of the pipeline without locks and are read with relaxed atomic loads,
+// so generating the response never blocks the receiver, the decoder or the main loop.
+
+// Reads a counter that is updated by another thread.
+#define metrics_load(counter) __atomic_load_n(&(counter), __ATOMIC_RELAXED)
+
+//-------------------------------------------------------------
+// Histogram of durations with fixed buckets.
+// observe() can be called by several threads at the same time.
+
+#define METRICS_HISTOGRAM_BUCKETS 16
+
+// upper bounds of buckets in microseconds
+static const uint32_t metrics_histogram_bounds[METRICS_HISTOGRAM_BUCKETS] = {
+  100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000
+};
+
+typedef struct MetricsHistogram {
+  uint32_t buckets[METRICS_HISTOGRAM_BUCKETS+1]; // the last one is +Inf, counts are not cumulative
+  uint64_t sum;                                  // microseconds
+
+  void observe(uint32_t micros) {
+    int index = 0;
+    while (index < METRICS_HISTOGRAM_BUCKETS && micros > metrics_histogram_bounds[index]) index++;
+    __atomic_fetch_add(&buckets[index], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&sum, micros, __ATOMIC_RELAXED);
+  }
+
+  void observeSince(const struct timespec& started) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t micros = (int64_t)(now.tv_sec-started.tv_sec)*1000000+(now.tv_nsec-started.tv_nsec)/1000;
+    observe(micros < 0 ? 0 : micros > UINT32_MAX ? UINT32_MAX : (uint32_t)micros);
+  }
+} MetricsHistogram;
+
+//-------------------------------------------------------------
+// Log-linear histogram of latencies: each power of two of microseconds is split into
+// METRICS_LATENCY_SUB_BUCKETS equal buckets, so the relative error is the same from 1us to 16s
+// (upper bounds 1, 2, 3, 4, 6, 8, 12, 16, 24, 32, ... microseconds).
+// observe() can be called by several threads at the same time.
+
+#define METRICS_LATENCY_SUB_BITS 1
+#define METRICS_LATENCY_SUB_BUCKETS (1<<METRICS_LATENCY_SUB_BITS)
+#define METRICS_LATENCY_MAX_BITS 24   // the last finite bound is 2^24 microseconds
+#define METRICS_LATENCY_BUCKETS (METRICS_LATENCY_SUB_BUCKETS*(METRICS_LATENCY_MAX_BITS-METRICS_LATENCY_SUB_BITS+1))
+
+// Upper bound in microseconds of the bucket with the index.
+static inline uint32_t metrics_latency_bound(int index) {
+  if (index < METRICS_LATENCY_SUB_BUCKETS) return index+1;
+  int shift = (index-METRICS_LATENCY_SUB_BUCKETS)/METRICS_LATENCY_SUB_BUCKETS;
+  int sub_bucket = (index-METRICS_LATENCY_SUB_BUCKETS)%METRICS_LATENCY_SUB_BUCKETS;
+  return (uint32_t)(METRICS_LATENCY_SUB_BUCKETS+sub_bucket+1)<<shift;
+}
+
+typedef struct MetricsLatencyHistogram {
+  uint32_t buckets[METRICS_LATENCY_BUCKETS+1]; // the last one is +Inf, counts are not cumulative
+  uint64_t sum;                                // microseconds
+
+  // Bucket i holds values in (bound(i-1), bound(i)], 0 is counted as 1us.
+  static int bucketIndex(uint32_t micros) {
+    uint32_t value = micros <= 1 ? 0 : micros-1;
+    if (value < METRICS_LATENCY_SUB_BUCKETS) return value;
+    int shift = 31-__builtin_clz(value)-METRICS_LATENCY_SUB_BITS;
+    int index = METRICS_LATENCY_SUB_BUCKETS*(shift+1)+(int)(value>>shift)-METRICS_LATENCY_SUB_BUCKETS;
+    return index < METRICS_LATENCY_BUCKETS ? index : METRICS_LATENCY_BUCKETS;
+  }
+
+  void observe(uint32_t micros) {
+    __atomic_fetch_add(&buckets[bucketIndex(micros)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&sum, micros, __ATOMIC_RELAXED);
+  }
+
+  // Upper bound of the bucket of the quantile (0..1), UINT32_MAX if it is in +Inf or 0 if nothing was observed.
+  uint32_t quantile(double q) const {
+    uint64_t count = 0;
+    for (int index = 0; index <= METRICS_LATENCY_BUCKETS; index++) count += metrics_load(buckets[index]);
+    if (count == 0) return 0;
+    uint64_t rank = (uint64_t)(q*count+0.5);
+    if (rank < 1) rank = 1;
+    uint64_t seen = 0;
+    for (int index = 0; index < METRICS_LATENCY_BUCKETS; index++) {
+      seen += metrics_load(buckets[index]);
+      if (seen >= rank) return metrics_latency_bound(index);
+    }
+    return UINT32_MAX;
+  }
+
+  // Interval between two stamps of metrics_clock().
+  void observeInterval(uint64_t from, uint64_t to) {
+    uint64_t micros = to <= from ? 0 : (to-from)/1000;
+    observe(micros > UINT32_MAX ? UINT32_MAX : (uint32_t)micros);
+  }
+} MetricsLatencyHistogram;
+
+// CLOCK_MONOTONIC in nanoseconds, 0 is never returned so it can mean "not set".
+static inline uint64_t metrics_clock() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec*1000000000ULL+now.tv_nsec+1;
+}
+
+//-------------------------------------------------------------
+// Builder of the response. Names of metrics get prefix "f007th_".
+// Labels are passed already formatted (e.g. "gpio=\"27\"") or NULL.
+// If memory cannot be allocated then the rest of the output is ignored and failed() returns true.
+
+class MetricsWriter {
+private:
+  void* buffer;
+  size_t buffer_size;
+  size_t size;
+  bool out_of_memory;
+
+  void append(const char* format, ...) __attribute__ ((format (printf, 2, 3)));
+  void histogramTotals(const char* name, const char* labels, uint64_t sum, uint64_t count);
+
+public:
+  MetricsWriter();
+  ~MetricsWriter();
+
+  void header(const char* name, const char* type, const char* help);
+  void value(const char* name, const char* labels, uint64_t value);
+  void value(const char* name, const char* labels, const char* value); // formatted value, e.g. "-12.5"
+
+  void counter(const char* name, const char* help, uint64_t value) {
+    header(name, "counter", help);
+    this->value(name, NULL, value);
+  }
+  void gauge(const char* name, const char* help, int64_t value);
+  void histogram(const char* name, const char* labels, const MetricsHistogram& histogram);
+  void histogram(const char* name, const char* labels, const MetricsLatencyHistogram& histogram);
+  void write(const void* data, size_t len); // already formatted lines
+
+  bool failed() { return out_of_memory; }
+  size_t getSize() { return size; }
+  // The caller becomes the owner of the buffer.
+  void* detach();
+};
+
+// Copies the value of a label escaping '\\', '"' and new lines. Returns false if the buffer is too small.
+bool escape_label_value(const char* value, char* buffer, size_t size);
+
+// Called by HTTPD to add metrics of other components of the application.
+typedef void (*MetricsCollector)(void* context, MetricsWriter& writer);
+
+#endif /* UTILS_METRICS_HPP_ */
@@ -0,0 +1,72 @@
+/*
+ * Realtime.cpp
+ *
+ *  Created on: October 18, 2026
+ *      Author: Alex Konshin
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "Logger.hpp"
+#include "Realtime.hpp"
+
+//-------------------------------------------------------------
+bool set_thread_realtime(const char* thread_name, int priority, uint64_t cpus) {
+  bool ok = true;
+  if (cpus != 0) {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (int cpu = 0; cpu < REALTIME_MAX_CPUS; cpu++) {
+      if ((cpus&(1ULL<<cpu)) != 0) CPU_SET(cpu, &cpu_set);
+    }
+    int rc = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+    if (rc != 0) {
+      Log->error("Failed to bind %s thread to CPUs 0x%llx: %s", thread_name, (unsigned long long)cpus, strerror(rc));
+      ok = false;
+    }
+  }
+  if (priority != 0) {
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = priority;
+    int rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (rc != 0) {
+      Log->error("Failed to set real-time priority %d for %s thread: %s", priority, thread_name, strerror(rc));
+      ok = false;
+    }
+  }
+  if (ok) Log->info("%s thread: priority=%d CPUs=0x%llx", thread_name, priority, (unsigned long long)cpus);
+  return ok;
+}
+
+bool lock_process_memory() {
+  int rc = -1;
+#ifdef MCL_ONFAULT
+  rc = mlockall(MCL_CURRENT|MCL_FUTURE|MCL_ONFAULT);
+#endif
+  // Without MCL_ONFAULT all pages of stacks of new threads are locked at once (8MB per thread by default).
+  if (rc != 0) rc = mlockall(MCL_CURRENT);
+  if (rc != 0) {
+    Log->error("Failed to lock memory: %s", strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+void prefault_stack() {
+  volatile uint8_t buffer[REALTIME_PREFAULT_STACK_SIZE];
+  prefault(buffer, sizeof(buffer));
+}
+
+void prefault(volatile void* buffer, size_t size) {
+  long page_size = sysconf(_SC_PAGESIZE);
+  if (page_size <= 0) page_size = 4096;
+  volatile uint8_t* p = (volatile uint8_t*)buffer;
+  for (size_t offset = 0; offset < size; offset += page_size) p[offset] = p[offset];
+  if (size != 0) p[size-1] = p[size-1];
+}
@@ -0,0 +1,41 @@
+/*
+ * Realtime.hpp
+ *
+ *  Created on: October 18, 2026
+ *      Author: Alex Konshin
+ */
+
+#ifndef UTILS_REALTIME_HPP_
+#define UTILS_REALTIME_HPP_
+
+#include <stdint.h>
+#include <stddef.h>
+
+//-------------------------------------------------------------
+// Settings that reduce the latency of threads that capture and decode pulses.
+//
+// Under load (HTTP clients, curl, processes started by actions) these threads may be delayed long enough
+// to lose edges of a signal. Real-time priority makes the kernel run them before all normal threads,
+// pinning to cores that are isolated by the kernel (e.g. isolcpus=3) keeps other processes away from them,
+// and locking of memory prevents page faults in the middle of a sequence.
+// Each function returns false if the setting could not be applied (usually because of missing privileges),
+// the utility still works without it.
+
+#define REALTIME_MAX_CPUS 64
+#define REALTIME_PREFAULT_STACK_SIZE (128*1024)
+
+// Switches the calling thread to SCHED_FIFO with the priority (1..99) if it is not 0,
+// and binds it to the CPUs in the mask (bit N is CPU N) if the mask is not 0.
+bool set_thread_realtime(const char* thread_name, int priority, uint64_t cpus);
+
+// Locks pages of the process in memory. If the kernel supports MCL_ONFAULT then pages that are mapped later
+// (e.g. stacks of new threads) are locked only when they are touched, so they must be pre-faulted.
+bool lock_process_memory();
+
+// Touches the stack of the calling thread so page faults do not happen later.
+void prefault_stack();
+
+// Touches all pages of a buffer.
+void prefault(volatile void* buffer, size_t size);
+
+#endif /* UTILS_REALTIME_HPP_ */
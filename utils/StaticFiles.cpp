@@ -0,0 +1,453 @@
+/*
+ * StaticFiles.cpp
+ *
+ *  Created on: October 18, 2026
+ *      Author: Alex Konshin
+ */
+
+#include <microhttpd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <strings.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <poll.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#include "Logger.hpp"
+#include "StaticFiles.hpp"
+
+//-------------------------------------------------------------
+typedef struct FileExt2Mime {
+  const char* ext;
+  const char* mime;
+} FileExt2Mime;
+
+static struct FileExt2Mime ext2mime[] = {
+    { "html", "text/html" },
+    { "htm", "text/html" },
+    { "css", "text/css" },
+    { "xml", "application/xml" },
+    { "xhtml", "application/xhtml+xml" },
+    { "js", "text/javascript" },
+    { "json", "application/json" },
+    { "txt", "text/plain" },
+    { "png", "image/png" },
+    { "jpeg", "image/jpeg" },
+    { "jpg", "image/jpeg" },
+    { "gif", "image/gif" },
+    { "bmp", "image/bmp" },
+    { "svg", "image/svg+xml" },
+    { "ico", "image/x-icon" },
+    { "ttf", "font/ttf" },
+    { "woff", "font/woff" },
+    { "woff2", "font/woff2" },
+    { "mp3", "audio/mpeg" },
+    { "aac", "audio/aac" },
+    { "mid", "audio/midi" },
+    { "midi", "audio/midi" },
+    { "wav", "audio/wav" },
+    { "weba", "audio/webm" },
+    { "webm", "video/webm" },
+    { "webp", "image/webp" },
+    { "zip", "application/zip" },
+    { "gz", "application/gzip" },
+    { "7z", "application/x-7z-compressed" },
+    { NULL, NULL }
+};
+
+#define MAX_FILE_EXT 8
+
+static HashIndex<FileExt2Mime> mime_index;
+static pthread_once_t mime_index_once = PTHREAD_ONCE_INIT;
+
+static void init_mime_index() {
+  for (FileExt2Mime* record = ext2mime; record->ext != NULL; record++) {
+    mime_index.put(HashIndex<FileExt2Mime>::hash(record->ext, strlen(record->ext)), record);
+  }
+}
+
+const char* StaticFiles::getMimeType(const char* filepath) {
+  if (filepath == NULL) return NULL;
+  size_t pathlen = strlen(filepath);
+  if (pathlen == 0) return NULL;
+  size_t ext_len = 0;
+  const char* p = filepath+pathlen;
+  char ch;
+  while (--p != filepath && (ch=*p) != '.') {
+    if (ch == '/') return NULL; // no extension
+    if (++ext_len > MAX_FILE_EXT) return NULL;
+  }
+  if (*p != '.' || ext_len == 0) return NULL;
+
+  char ext[MAX_FILE_EXT+1];
+  for (size_t i = 0; i < ext_len; i++) {
+    ch = p[i+1];
+    ext[i] = (ch >= 'A' && ch <= 'Z') ? ch-'A'+'a' : ch;
+  }
+  ext[ext_len] = '\0';
+
+  pthread_once(&mime_index_once, init_mime_index);
+  FileExt2Mime* record = mime_index.find(HashIndex<FileExt2Mime>::hash(ext, ext_len));
+  if (record == NULL || strcmp(record->ext, ext) != 0) return NULL;
+  return record->mime;
+}
+
+//-------------------------------------------------------------
+// Returns bit mask of accepted encodings ACCEPT_ENCODING_*. Encodings with q=0 are not accepted.
+int StaticFiles::getAcceptedEncodings(const char* accept_encoding) {
+  if (accept_encoding == NULL) return 0;
+  int result = 0;
+  const char* p = accept_encoding;
+  while (*p != '\0') {
+    while (*p == ' ' || *p == ',') p++;
+    const char* token = p;
+    while (*p != '\0' && *p != ',' && *p != ';' && *p != ' ') p++;
+    size_t token_len = p-token;
+    bool accepted = true;
+    while (*p == ' ') p++;
+    if (*p == ';') {
+      const char* q = strstr(p, "q=");
+      const char* end = strchr(p, ',');
+      if (q != NULL && (end == NULL || q < end)) accepted = atof(q+2) > 0.0;
+    }
+    if (accepted) {
+      if (token_len == 4 && strncasecmp(token, "gzip", 4) == 0) result |= ACCEPT_ENCODING_GZIP;
+      else if (token_len == 2 && strncasecmp(token, "br", 2) == 0) result |= ACCEPT_ENCODING_BR;
+    }
+    while (*p != '\0' && *p != ',') p++;
+  }
+  return result;
+}
+
+void StaticFiles::makeETag(char* etag, off_t size, time_t mtime, ContentEncoding encoding) {
+  static const char* suffixes[NUMBER_OF_CONTENT_ENCODINGS] = { "", "-gz", "-br" };
+  snprintf(etag, STATIC_FILE_MAX_ETAG, "\"%llx-%llx%s\"", (unsigned long long)size, (unsigned long long)mtime, suffixes[(int)encoding]);
+}
+
+//-------------------------------------------------------------
+StaticFiles::StaticFiles(const char* www_root, unsigned max_age) {
+  this->www_root = www_root;
+  this->max_age = max_age;
+  pthread_rwlock_init(&lock, NULL);
+  table = NULL;
+  inotify_fd = -1;
+  watcher_started = false;
+  stop_watcher = false;
+}
+
+StaticFiles::~StaticFiles() {
+  stop();
+  destroyTable(table);
+  table = NULL;
+  pthread_rwlock_destroy(&lock);
+}
+
+void StaticFiles::destroyTable(StaticFilesTable* table) {
+  if (table == NULL) return;
+  StaticFile* file = table->files;
+  while (file != NULL) {
+    StaticFile* next = file->next;
+    for (int encoding = 0; encoding < NUMBER_OF_CONTENT_ENCODINGS; encoding++) {
+      // The buffer is freed by libmicrohttpd when the last connection that uses the response is done.
+      if (file->responses[encoding] != NULL) MHD_destroy_response(file->responses[encoding]);
+    }
+    free((void*)file->url);
+    free(file);
+    file = next;
+  }
+  delete table;
+}
+
+//-------------------------------------------------------------
+bool StaticFiles::load() {
+  if (www_root == NULL) return false;
+  char path[PATH_MAX];
+  size_t root_len = strlen(www_root);
+  if (root_len >= PATH_MAX) return false;
+  strcpy(path, www_root);
+  if (root_len > 1 && path[root_len-1] == '/') path[--root_len] = '\0';
+
+  StaticFilesTable* new_table = new StaticFilesTable();
+  new_table->files = NULL;
+  new_table->count = 0;
+  new_table->total_size = 0;
+  loadDirectory(new_table, path, root_len, root_len, 0);
+
+  pthread_rwlock_wrlock(&lock);
+  StaticFilesTable* old_table = table;
+  table = new_table;
+  pthread_rwlock_unlock(&lock);
+
+  destroyTable(old_table);
+  Log->log("Loaded %u file(s) from \"%s\" into cache (%lu bytes).", new_table->count, www_root, (unsigned long)new_table->total_size);
+  return true;
+}
+
+bool StaticFiles::loadDirectory(StaticFilesTable* new_table, char* path, size_t path_len, size_t root_len, int depth) {
+  DIR* dir = opendir(path);
+  if (dir == NULL) {
+    Log->error("Cannot open directory \"%s\".", path);
+    return false;
+  }
+  if (inotify_fd >= 0) {
+    inotify_add_watch(inotify_fd, path, IN_CLOSE_WRITE|IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO|IN_ATTRIB);
+  }
+
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != NULL) {
+    const char* name = entry->d_name;
+    if (name[0] == '.') continue; // hidden files, "." and ".."
+    size_t name_len = strlen(name);
+    if (path_len+1+name_len >= PATH_MAX) continue;
+    path[path_len] = '/';
+    strcpy(path+path_len+1, name);
+
+    struct stat file_stat;
+    if (lstat(path, &file_stat) == 0) {
+      if (S_ISDIR(file_stat.st_mode)) {
+        if (depth < STATIC_FILES_MAX_DEPTH) loadDirectory(new_table, path, path_len+1+name_len, root_len, depth+1);
+      } else {
+        loadFile(new_table, path, root_len);
+      }
+    }
+  }
+  path[path_len] = '\0';
+  closedir(dir);
+  return true;
+}
+
+bool StaticFiles::loadFile(StaticFilesTable* new_table, const char* path, size_t root_len) {
+  struct stat file_stat;
+  if (stat(path, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) return false;
+  if (file_stat.st_size > STATIC_FILES_MAX_FILE_SIZE || new_table->total_size+file_stat.st_size > STATIC_FILES_MAX_TOTAL_SIZE) return false;
+
+  const char* url = path+root_len;
+  uint64_t key = HashIndex<StaticFile>::hash(url, strlen(url));
+  if (new_table->index.find(key) != NULL) return false; // collision of hashes, the file will be served from disk
+
+  StaticFile* file = (StaticFile*)calloc(1, sizeof(StaticFile));
+  if (file == NULL) return false;
+  file->url = strdup(url);
+  if (file->url == NULL) {
+    free(file);
+    return false;
+  }
+
+  // Compressed variants are used only if they are not older than the file itself.
+  size_t path_len = strlen(path);
+  char variant_path[PATH_MAX];
+  bool variant_exists[NUMBER_OF_CONTENT_ENCODINGS] = { true, false, false };
+  struct stat variant_stats[NUMBER_OF_CONTENT_ENCODINGS];
+  variant_stats[0] = file_stat;
+  static const char* variant_extensions[NUMBER_OF_CONTENT_ENCODINGS] = { "", ".gz", ".br" };
+  bool has_variants = false;
+  if (path_len+3 < PATH_MAX) {
+    for (int encoding = 1; encoding < NUMBER_OF_CONTENT_ENCODINGS; encoding++) {
+      strcpy(variant_path, path);
+      strcpy(variant_path+path_len, variant_extensions[encoding]);
+      struct stat& variant_stat = variant_stats[encoding];
+      if (stat(variant_path, &variant_stat) == 0 && S_ISREG(variant_stat.st_mode) &&
+          variant_stat.st_mtime >= file_stat.st_mtime && variant_stat.st_size <= STATIC_FILES_MAX_FILE_SIZE) {
+        variant_exists[encoding] = true;
+        has_variants = true;
+      }
+    }
+  }
+
+  const char* mime = getMimeType(path);
+  char last_modified[64];
+  struct tm tm;
+  strftime(last_modified, sizeof(last_modified), "%a, %d %b %Y %H:%M:%S GMT", gmtime_r(&file_stat.st_mtime, &tm));
+
+  for (int encoding = 0; encoding < NUMBER_OF_CONTENT_ENCODINGS; encoding++) {
+    if (!variant_exists[encoding]) continue;
+    strcpy(variant_path, path);
+    strcpy(variant_path+path_len, variant_extensions[encoding]);
+    if (new_table->total_size+variant_stats[encoding].st_size > STATIC_FILES_MAX_TOTAL_SIZE) continue;
+    makeETag(file->etags[encoding], variant_stats[encoding].st_size, variant_stats[encoding].st_mtime, (ContentEncoding)encoding);
+    size_t size = 0;
+    file->responses[encoding] = createResponse(variant_path, mime, (ContentEncoding)encoding, file->etags[encoding], last_modified, has_variants, size);
+    new_table->total_size += size;
+  }
+  if (file->responses[(int)ContentEncoding::identity] == NULL) {
+    for (int encoding = 1; encoding < NUMBER_OF_CONTENT_ENCODINGS; encoding++) {
+      if (file->responses[encoding] != NULL) MHD_destroy_response(file->responses[encoding]);
+    }
+    free((void*)file->url);
+    free(file);
+    return false;
+  }
+
+  file->next = new_table->files;
+  new_table->files = file;
+  new_table->count++;
+  new_table->index.put(key, file);
+  return true;
+}
+
+struct MHD_Response* StaticFiles::createResponse(const char* path, const char* mime, ContentEncoding encoding, const char* etag,
+    const char* last_modified, bool has_variants, size_t& size) {
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) return NULL;
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0) {
+    close(fd);
+    return NULL;
+  }
+  size_t file_size = file_stat.st_size;
+  void* buffer = malloc(file_size == 0 ? 1 : file_size);
+  if (buffer == NULL) {
+    close(fd);
+    return NULL;
+  }
+  size_t loaded = 0;
+  while (loaded < file_size) {
+    ssize_t n = read(fd, (char*)buffer+loaded, file_size-loaded);
+    if (n <= 0) {
+      if (n < 0 && errno == EINTR) continue;
+      break;
+    }
+    loaded += n;
+  }
+  close(fd);
+  if (loaded != file_size) {
+    Log->error("Failed to read file \"%s\".", path);
+    free(buffer);
+    return NULL;
+  }
+
+  struct MHD_Response* response = MHD_create_response_from_buffer(file_size, buffer, MHD_RESPMEM_MUST_FREE);
+  if (response == NULL) {
+    free(buffer);
+    return NULL;
+  }
+  if (mime != NULL) MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, mime);
+  if (encoding == ContentEncoding::gzip) MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_ENCODING, "gzip");
+  else if (encoding == ContentEncoding::br) MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_ENCODING, "br");
+  if (has_variants) MHD_add_response_header(response, MHD_HTTP_HEADER_VARY, MHD_HTTP_HEADER_ACCEPT_ENCODING);
+  MHD_add_response_header(response, MHD_HTTP_HEADER_ETAG, etag);
+  MHD_add_response_header(response, MHD_HTTP_HEADER_LAST_MODIFIED, last_modified);
+  char cache_control[32];
+  if (max_age == 0)
+    strcpy(cache_control, "no-cache");
+  else
+    snprintf(cache_control, sizeof(cache_control), "max-age=%u", max_age);
+  MHD_add_response_header(response, MHD_HTTP_HEADER_CACHE_CONTROL, cache_control);
+
+  size = file_size;
+  return response;
+}
+
+//-------------------------------------------------------------
+/*
+ * Responds with the cached file or with status 304 if the client has the same version of the file.
+ * Returns -1 if the file is not cached.
+ */
+int StaticFiles::respond(struct MHD_Connection* connection, const char* url) {
+  int encoding = (int)ContentEncoding::identity;
+  int accepted = -1; // not parsed yet
+  int ret = -1;
+
+  pthread_rwlock_rdlock(&lock);
+  StaticFile* file = table == NULL ? NULL : table->index.find(HashIndex<StaticFile>::hash(url, strlen(url)));
+  if (file != NULL && strcmp(file->url, url) == 0) {
+    if (file->responses[(int)ContentEncoding::br] != NULL || file->responses[(int)ContentEncoding::gzip] != NULL) {
+      accepted = getAcceptedEncodings(MHD_lookup_connection_value(connection, MHD_HEADER_KIND, MHD_HTTP_HEADER_ACCEPT_ENCODING));
+      if ((accepted&ACCEPT_ENCODING_BR) != 0 && file->responses[(int)ContentEncoding::br] != NULL)
+        encoding = (int)ContentEncoding::br;
+      else if ((accepted&ACCEPT_ENCODING_GZIP) != 0 && file->responses[(int)ContentEncoding::gzip] != NULL)
+        encoding = (int)ContentEncoding::gzip;
+    }
+
+    const char* etag = file->etags[encoding];
+    const char* if_none_match = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, MHD_HTTP_HEADER_IF_NONE_MATCH);
+    if (if_none_match != NULL && strstr(if_none_match, etag) != NULL) {
+      struct MHD_Response* response = MHD_create_response_from_buffer(0, (void*)"", MHD_RESPMEM_PERSISTENT);
+      if (response == NULL) {
+        ret = MHD_NO;
+      } else {
+        MHD_add_response_header(response, MHD_HTTP_HEADER_ETAG, etag);
+        if (accepted != -1) MHD_add_response_header(response, MHD_HTTP_HEADER_VARY, MHD_HTTP_HEADER_ACCEPT_ENCODING);
+        ret = MHD_queue_response(connection, MHD_HTTP_NOT_MODIFIED, response);
+        MHD_destroy_response(response);
+      }
+    } else {
+      // The table holds a reference to the response so it cannot be destroyed while it is being queued.
+      ret = MHD_queue_response(connection, MHD_HTTP_OK, file->responses[encoding]);
+    }
+  }
+  pthread_rwlock_unlock(&lock);
+  return ret;
+}
+
+//-------------------------------------------------------------
+// Loads the files and starts the thread that reloads them on changes.
+bool StaticFiles::start() {
+  if (watcher_started || www_root == NULL) return watcher_started;
+  inotify_fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+  if (inotify_fd < 0) {
+    Log->error("Failed to initialize inotify. Changes in directory \"%s\" will not be detected.", www_root);
+    return load();
+  }
+  if (!load()) return false; // it also adds watches for all directories
+
+  stop_watcher = false;
+  watcher_started = true;
+  int rc = pthread_create(&watcher_thread, NULL, watcherThreadFunction, (void*)this);
+  if (rc != 0) {
+    Log->error("Error code %d from pthread_create()", rc);
+    watcher_started = false;
+    close(inotify_fd);
+    inotify_fd = -1;
+    return false;
+  }
+  return true;
+}
+
+void StaticFiles::stop() {
+  if (watcher_started) {
+    stop_watcher = true;
+    pthread_join(watcher_thread, NULL);
+    watcher_started = false;
+  }
+  if (inotify_fd >= 0) {
+    close(inotify_fd);
+    inotify_fd = -1;
+  }
+}
+
+void* StaticFiles::watcherThreadFunction(void* context) {
+  ((StaticFiles*)context)->watcher();
+  return NULL;
+}
+
+void StaticFiles::watcher() {
+  char events[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+  struct pollfd fds;
+  fds.fd = inotify_fd;
+  fds.events = POLLIN;
+
+  bool changed = false;
+  while (!stop_watcher) {
+    // Files are often written in several steps so the cache is reloaded when there are no changes during a short time.
+    int rc = poll(&fds, 1, changed ? STATIC_FILES_RELOAD_DELAY : 500);
+    if (rc < 0) {
+      if (errno == EINTR) continue;
+      Log->error("Failed to watch directory \"%s\" (errno=%d).", www_root, errno);
+      break;
+    }
+    if (rc == 0) {
+      if (changed) {
+        changed = false;
+        load();
+      }
+      continue;
+    }
+    while (read(inotify_fd, events, sizeof(events)) > 0) changed = true;
+  }
+}
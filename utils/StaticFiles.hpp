@@ -0,0 +1,87 @@
+/*
+ * StaticFiles.hpp
+ *
+ *  Created on: October 18, 2026
+ *      Author: Alex Konshin
+ */
+
+#ifndef UTILS_STATICFILES_HPP_
+#define UTILS_STATICFILES_HPP_
+
+#include <pthread.h>
+#include <time.h>
+
+#include "HashIndex.hpp"
+
+//-------------------------------------------------------------
+// Cache of files from directory www_root.
+//
+// All files are loaded into memory at start and reloaded when inotify reports a change in the directory tree.
+// Responses with all headers (Content-Type, ETag, Last-Modified, Cache-Control) are prepared at loading time.
+// If there is a file with extension ".gz" or ".br" next to the file then it is served instead of
+// the original file to the clients that accept this encoding.
+// Files that are too big to be cached are served from disk as before.
+
+#define STATIC_FILES_MAX_FILE_SIZE (1024*1024)
+#define STATIC_FILES_MAX_TOTAL_SIZE (16*1024*1024)
+#define STATIC_FILES_MAX_DEPTH 8
+#define STATIC_FILES_RELOAD_DELAY 200 // milliseconds without changes before reloading
+#define STATIC_FILE_MAX_ETAG 48
+
+enum class ContentEncoding : int { identity=0, gzip=1, br=2 };
+#define NUMBER_OF_CONTENT_ENCODINGS 3
+
+#define ACCEPT_ENCODING_GZIP (1<<(int)ContentEncoding::gzip)
+#define ACCEPT_ENCODING_BR   (1<<(int)ContentEncoding::br)
+
+typedef struct StaticFile {
+  StaticFile* next;
+  const char* url;  // path relative to www_root started with '/'
+  struct MHD_Response* responses[NUMBER_OF_CONTENT_ENCODINGS]; // NULL if there is no file with this encoding
+  char etags[NUMBER_OF_CONTENT_ENCODINGS][STATIC_FILE_MAX_ETAG];
+} StaticFile;
+
+typedef struct StaticFilesTable {
+  HashIndex<StaticFile> index;
+  StaticFile* files;
+  unsigned count;
+  size_t total_size;
+} StaticFilesTable;
+
+class StaticFiles {
+private:
+  const char* www_root;
+  unsigned max_age;
+  pthread_rwlock_t lock;
+  StaticFilesTable* table;
+
+  int inotify_fd;
+  pthread_t watcher_thread;
+  volatile bool watcher_started;
+  volatile bool stop_watcher;
+
+  bool loadDirectory(StaticFilesTable* new_table, char* path, size_t path_len, size_t root_len, int depth);
+  bool loadFile(StaticFilesTable* new_table, const char* path, size_t root_len);
+  struct MHD_Response* createResponse(const char* path, const char* mime, ContentEncoding encoding, const char* etag,
+      const char* last_modified, bool has_variants, size_t& size);
+  static void destroyTable(StaticFilesTable* table);
+
+  static void* watcherThreadFunction(void* context);
+  void watcher();
+
+public:
+  StaticFiles(const char* www_root, unsigned max_age);
+  ~StaticFiles();
+
+  bool start();
+  void stop();
+  bool load();
+
+  int respond(struct MHD_Connection* connection, const char* url);
+
+  static const char* getMimeType(const char* filepath);
+  static int getAcceptedEncodings(const char* accept_encoding);
+  static void makeETag(char* etag, off_t size, time_t mtime, ContentEncoding encoding);
+};
+
+#endif /* UTILS_STATICFILES_HPP_ */